@@ -14,6 +14,9 @@ pyplinkio_src_files = glob.glob(os.path.join(pyplinkio_src_dir, "*.c"))
 libraries = []
 if sys.platform == 'win32':
     libraries.append("Bcrypt")
+else:
+    libraries.append("pthread")
+    libraries.append("m")
 
 cplinkio = Extension(
     "plinkio.cplinkio",
@@ -0,0 +1,269 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "private/arena.h"
+
+/**
+ * Size of the first block of an arena. Each following block is
+ * twice as large, up to LIBPLINKIO_ARENA_MAX_BLOCK_SIZE_, so that
+ * small files do not pay for a large block.
+ */
+#define LIBPLINKIO_ARENA_MIN_BLOCK_SIZE_ 4096
+
+/**
+ * Largest size of a shared block. Longer strings get a block of
+ * their own.
+ */
+#define LIBPLINKIO_ARENA_MAX_BLOCK_SIZE_ ( 1 << 20 )
+
+/**
+ * Initial number of slots of the intern table, it is doubled
+ * whenever it becomes half full.
+ */
+#define LIBPLINKIO_ARENA_MIN_INTERN_CAPACITY_ 64
+
+/**
+ * Every single character string, character c is at index 2c.
+ */
+#define LIBPLINKIO_ARENA_CHAR_2_(c) (char)( c ), '\0'
+#define LIBPLINKIO_ARENA_CHAR_8_(c) LIBPLINKIO_ARENA_CHAR_2_( c ), LIBPLINKIO_ARENA_CHAR_2_( c + 1 ), \
+    LIBPLINKIO_ARENA_CHAR_2_( c + 2 ), LIBPLINKIO_ARENA_CHAR_2_( c + 3 ), LIBPLINKIO_ARENA_CHAR_2_( c + 4 ), \
+    LIBPLINKIO_ARENA_CHAR_2_( c + 5 ), LIBPLINKIO_ARENA_CHAR_2_( c + 6 ), LIBPLINKIO_ARENA_CHAR_2_( c + 7 )
+#define LIBPLINKIO_ARENA_CHAR_64_(c) LIBPLINKIO_ARENA_CHAR_8_( c ), LIBPLINKIO_ARENA_CHAR_8_( c + 8 ), \
+    LIBPLINKIO_ARENA_CHAR_8_( c + 16 ), LIBPLINKIO_ARENA_CHAR_8_( c + 24 ), LIBPLINKIO_ARENA_CHAR_8_( c + 32 ), \
+    LIBPLINKIO_ARENA_CHAR_8_( c + 40 ), LIBPLINKIO_ARENA_CHAR_8_( c + 48 ), LIBPLINKIO_ARENA_CHAR_8_( c + 56 )
+
+static const char g_single_chars[ 512 ] = {
+    LIBPLINKIO_ARENA_CHAR_64_( 0 ), LIBPLINKIO_ARENA_CHAR_64_( 64 ),
+    LIBPLINKIO_ARENA_CHAR_64_( 128 ), LIBPLINKIO_ARENA_CHAR_64_( 192 )
+};
+
+/**
+ * Header of a block, the storage follows it.
+ */
+struct libplinkio_arena_block_s {
+    struct libplinkio_arena_block_s *next;
+    size_t size;
+    size_t used;
+};
+
+struct libplinkio_arena_private_s {
+    /* The block that strings are added to, it links to the older ones. */
+    struct libplinkio_arena_block_s *head;
+    size_t next_block_size;
+
+    /* Open addressing set of the interned strings longer than one character. */
+    char **interned;
+    size_t intern_capacity;
+    size_t num_interned;
+};
+
+libplinkio_arena_private_t *
+libplinkio_arena_new_(void)
+{
+    libplinkio_arena_private_t *arena = (libplinkio_arena_private_t *) malloc( sizeof( libplinkio_arena_private_t ) );
+    if( arena == NULL )
+    {
+        return NULL;
+    }
+
+    arena->head = NULL;
+    arena->next_block_size = LIBPLINKIO_ARENA_MIN_BLOCK_SIZE_;
+    arena->interned = NULL;
+    arena->intern_capacity = 0;
+    arena->num_interned = 0;
+    return arena;
+}
+
+/**
+ * Returns size bytes of storage from the arena, adding a block if
+ * the current one is full.
+ */
+static char *
+arena_alloc(libplinkio_arena_private_t *arena, size_t size)
+{
+    struct libplinkio_arena_block_s *block = arena->head;
+    char *storage;
+
+    if( block == NULL || block->size - block->used < size )
+    {
+        size_t block_size = arena->next_block_size;
+        if( size > block_size )
+        {
+            block_size = size;
+        }
+        if( block_size > SIZE_MAX - sizeof( struct libplinkio_arena_block_s ) )
+        {
+            return NULL;
+        }
+
+        block = (struct libplinkio_arena_block_s *) malloc( sizeof( struct libplinkio_arena_block_s ) + block_size );
+        if( block == NULL )
+        {
+            return NULL;
+        }
+        block->size = block_size;
+        block->used = 0;
+
+        /* An oversized block is kept behind the current one, which may still have room. */
+        if( size > arena->next_block_size && arena->head != NULL )
+        {
+            block->next = arena->head->next;
+            arena->head->next = block;
+        }
+        else
+        {
+            block->next = arena->head;
+            arena->head = block;
+            if( arena->next_block_size < LIBPLINKIO_ARENA_MAX_BLOCK_SIZE_ )
+            {
+                arena->next_block_size *= 2;
+            }
+        }
+    }
+
+    storage = (char *)( block + 1 ) + block->used;
+    block->used += size;
+    return storage;
+}
+
+char *
+libplinkio_arena_strndup_(libplinkio_arena_private_t *arena, const char *str, size_t length)
+{
+    char *copy;
+    if( length == SIZE_MAX )
+    {
+        return NULL;
+    }
+
+    copy = arena_alloc( arena, length + 1 );
+    if( copy == NULL )
+    {
+        return NULL;
+    }
+
+    memcpy( copy, str, length );
+    copy[ length ] = '\0';
+    return copy;
+}
+
+char *
+libplinkio_arena_strdup_(libplinkio_arena_private_t *arena, const char *str)
+{
+    return libplinkio_arena_strndup_( arena, str, strlen( str ) );
+}
+
+/**
+ * FNV-1a hash of length characters.
+ */
+static uint64_t
+intern_hash(const char *str, size_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char) str[ i ];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Doubles the intern table and reinserts the strings.
+ *
+ * @return 0 on success, -1 if the table could not be allocated.
+ */
+static int
+intern_grow(libplinkio_arena_private_t *arena)
+{
+    size_t capacity = arena->intern_capacity == 0 ? LIBPLINKIO_ARENA_MIN_INTERN_CAPACITY_ : 2 * arena->intern_capacity;
+    char **interned = (char **) calloc( capacity, sizeof( char * ) );
+    if( interned == NULL )
+    {
+        return -1;
+    }
+
+    for(size_t i = 0; i < arena->intern_capacity; i++)
+    {
+        char *str = arena->interned[ i ];
+        size_t slot;
+        if( str == NULL )
+        {
+            continue;
+        }
+
+        slot = (size_t) intern_hash( str, strlen( str ) ) & ( capacity - 1 );
+        while( interned[ slot ] != NULL )
+        {
+            slot = ( slot + 1 ) & ( capacity - 1 );
+        }
+        interned[ slot ] = str;
+    }
+
+    if( arena->interned != NULL )
+    {
+        free( arena->interned );
+    }
+    arena->interned = interned;
+    arena->intern_capacity = capacity;
+    return 0;
+}
+
+char *
+libplinkio_arena_intern_(libplinkio_arena_private_t *arena, const char *str, size_t length)
+{
+    size_t slot;
+    if( length == 1 )
+    {
+        return (char *) &g_single_chars[ 2 * (unsigned char) str[ 0 ] ];
+    }
+
+    if( 2 * ( arena->num_interned + 1 ) > arena->intern_capacity && intern_grow( arena ) != 0 )
+    {
+        return NULL;
+    }
+
+    slot = (size_t) intern_hash( str, length ) & ( arena->intern_capacity - 1 );
+    while( arena->interned[ slot ] != NULL )
+    {
+        char *candidate = arena->interned[ slot ];
+        if( strncmp( candidate, str, length ) == 0 && candidate[ length ] == '\0' )
+        {
+            return candidate;
+        }
+        slot = ( slot + 1 ) & ( arena->intern_capacity - 1 );
+    }
+
+    arena->interned[ slot ] = libplinkio_arena_strndup_( arena, str, length );
+    if( arena->interned[ slot ] == NULL )
+    {
+        return NULL;
+    }
+    arena->num_interned++;
+    return arena->interned[ slot ];
+}
+
+void
+libplinkio_arena_free_(libplinkio_arena_private_t *arena)
+{
+    struct libplinkio_arena_block_s *block;
+    if( arena == NULL )
+    {
+        return;
+    }
+
+    block = arena->head;
+    while( block != NULL )
+    {
+        struct libplinkio_arena_block_s *next = block->next;
+        free( block );
+        block = next;
+    }
+    if( arena->interned != NULL )
+    {
+        free( arena->interned );
+    }
+    free( arena );
+}
@@ -0,0 +1,635 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <plinkio/bed.h>
+#include <plinkio/bed_header.h>
+#include <plinkio/status.h>
+
+#include "private/bed.h"
+#include "private/thread.h"
+#include "private/utility.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define LIBPLINKIO_HAVE_IO_URING_ 1
+#endif
+#endif
+#endif
+
+/**
+ * Number of threads of the pread engine, at most.
+ */
+#define LIBPLINKIO_ASYNC_MAX_THREADS_ 8
+
+typedef struct {
+    size_t row_index;
+    bed_async_callback_t callback;
+    void *user_data;
+} async_request;
+
+#ifdef LIBPLINKIO_HAVE_IO_URING_
+
+/**
+ * An io_uring instance set up with the raw system calls, so that
+ * liburing is not needed.
+ */
+typedef struct {
+    int fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* Entries that have been queued but not passed to the kernel. */
+    unsigned to_submit;
+
+    /* One iovec per slot, READV is supported by every io_uring kernel. */
+    struct iovec *iovecs;
+} async_uring;
+
+#endif
+
+/**
+ * A pool of threads that serve reads with pread.
+ */
+typedef struct {
+    libplinkio_thread_private_t threads[ LIBPLINKIO_ASYNC_MAX_THREADS_ ];
+    size_t num_threads;
+    libplinkio_mutex_private_t mutex;
+    libplinkio_cond_private_t work_cond;
+    libplinkio_cond_private_t done_cond;
+
+    /* Slots to read, and slots that have been read, as FIFOs of num_slots. */
+    size_t *work;
+    size_t work_head;
+    size_t work_count;
+    size_t *done;
+    int *done_result;
+    size_t done_head;
+    size_t done_count;
+    int stop;
+} async_pool;
+
+typedef struct {
+    struct pio_bed_file_t *bed_file;
+    int fd;
+    size_t row_size;
+    uint64_t data_offset;
+
+    /* Each slot holds one read in flight. */
+    size_t num_slots;
+    unsigned char *buffers;
+    async_request *slot_request;
+    size_t *slot_done;
+    size_t *free_slots;
+    size_t num_free;
+    size_t in_flight;
+
+    /* Requests waiting for a free slot. */
+    async_request *queue;
+    size_t queue_head;
+    size_t queue_count;
+    size_t queue_capacity;
+
+    snp_t *decoded_row;
+
+    /* Completions collected by engine_reap, up to num_slots. */
+    size_t *reaped_slots;
+    int *reaped_results;
+
+#ifdef LIBPLINKIO_HAVE_IO_URING_
+    async_uring *uring;
+#endif
+    async_pool *pool;
+} async_engine;
+
+#ifdef LIBPLINKIO_HAVE_IO_URING_
+
+static void
+uring_free(async_uring *uring)
+{
+    if (uring->sqes != NULL && uring->sqes != MAP_FAILED) munmap(uring->sqes, uring->sqes_size);
+    if (uring->cq_ring != NULL && uring->cq_ring != MAP_FAILED && uring->cq_ring != uring->sq_ring) munmap(uring->cq_ring, uring->cq_ring_size);
+    if (uring->sq_ring != NULL && uring->sq_ring != MAP_FAILED) munmap(uring->sq_ring, uring->sq_ring_size);
+    if (uring->fd != -1) close(uring->fd);
+    if (uring->iovecs != NULL) free(uring->iovecs);
+    free(uring);
+}
+
+static async_uring *
+uring_create(async_engine *engine)
+{
+    struct io_uring_params params;
+    async_uring *uring = (async_uring *)malloc(sizeof(async_uring));
+    unsigned char *sq;
+    unsigned char *cq;
+
+    if (uring == NULL) return NULL;
+    memset(uring, 0, sizeof(*uring));
+    memset(&params, 0, sizeof(params));
+    uring->fd = (int)syscall(__NR_io_uring_setup, (unsigned)engine->num_slots, &params);
+    if (uring->fd < 0) {
+        uring->fd = -1;
+        goto error;
+    }
+
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+        if (uring->cq_ring_size > uring->sq_ring_size) uring->sq_ring_size = uring->cq_ring_size;
+        uring->cq_ring_size = uring->sq_ring_size;
+    }
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ring == MAP_FAILED) goto error;
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+        uring->cq_ring = uring->sq_ring;
+    } else {
+        uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+        if (uring->cq_ring == MAP_FAILED) goto error;
+    }
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = (struct io_uring_sqe *)mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED) goto error;
+
+    sq = (unsigned char *)uring->sq_ring;
+    cq = (unsigned char *)uring->cq_ring;
+    uring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    uring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    uring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    uring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    uring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    uring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    uring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    uring->iovecs = (struct iovec *)malloc(engine->num_slots * sizeof(struct iovec));
+    if (uring->iovecs == NULL) goto error;
+
+    return uring;
+
+error:
+    uring_free(uring);
+    return NULL;
+}
+
+static void
+uring_queue(async_uring *uring, int fd, size_t slot, void *buffer, size_t length, uint64_t offset)
+{
+    unsigned tail = *uring->sq_tail;
+    unsigned index = tail & *uring->sq_mask;
+    struct io_uring_sqe *sqe = &uring->sqes[index];
+
+    uring->iovecs[slot].iov_base = buffer;
+    uring->iovecs[slot].iov_len = length;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = (uint64_t)(uintptr_t)&uring->iovecs[slot];
+    sqe->len = 1;
+    sqe->user_data = slot;
+    uring->sq_array[index] = index;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    uring->to_submit++;
+}
+
+/**
+ * Passes the queued entries to the kernel, and waits for
+ * min_complete completions.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+static int
+uring_enter(async_uring *uring, unsigned min_complete)
+{
+    if (uring->to_submit == 0 && min_complete == 0) return 0;
+    for (;;) {
+        unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        long submitted = syscall(__NR_io_uring_enter, uring->fd, uring->to_submit, min_complete, flags, NULL, 0);
+        if (submitted >= 0) {
+            uring->to_submit -= (unsigned)submitted;
+            if (uring->to_submit == 0 || min_complete > 0) return 0;
+            continue;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return -1;
+    }
+}
+
+static size_t
+uring_reap(async_uring *uring, size_t *slots, int *results, size_t max)
+{
+    unsigned head = *uring->cq_head;
+    unsigned tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+    size_t count = 0;
+
+    while (head != tail && count < max) {
+        struct io_uring_cqe *cqe = &uring->cqes[head & *uring->cq_mask];
+        slots[count] = (size_t)cqe->user_data;
+        results[count] = cqe->res;
+        count++;
+        head++;
+    }
+    __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+#endif
+
+static void
+pool_main(void *arg)
+{
+    async_engine *engine = (async_engine *)arg;
+    async_pool *pool = engine->pool;
+
+    for (;;) {
+        size_t slot;
+        size_t done;
+        int result;
+
+        libplinkio_mutex_lock_(&pool->mutex);
+        while (pool->work_count == 0 && !pool->stop) {
+            libplinkio_cond_wait_(&pool->work_cond, &pool->mutex);
+        }
+        if (pool->work_count == 0) {
+            libplinkio_mutex_unlock_(&pool->mutex);
+            break;
+        }
+        slot = pool->work[pool->work_head];
+        pool->work_head = (pool->work_head + 1) % engine->num_slots;
+        pool->work_count--;
+        done = engine->slot_done[slot];
+        libplinkio_mutex_unlock_(&pool->mutex);
+
+        result = libplinkio_pread_(
+            engine->fd,
+            engine->buffers + slot * engine->row_size + done,
+            engine->row_size - done,
+            engine->data_offset + (uint64_t)engine->slot_request[slot].row_index * engine->row_size + done
+        ) == 0 ? (int)(engine->row_size - done) : -1;
+
+        libplinkio_mutex_lock_(&pool->mutex);
+        pool->done[(pool->done_head + pool->done_count) % engine->num_slots] = slot;
+        pool->done_result[(pool->done_head + pool->done_count) % engine->num_slots] = result;
+        pool->done_count++;
+        libplinkio_cond_broadcast_(&pool->done_cond);
+        libplinkio_mutex_unlock_(&pool->mutex);
+    }
+}
+
+static void
+pool_free(async_engine *engine)
+{
+    async_pool *pool = engine->pool;
+    if (pool == NULL) return;
+
+    libplinkio_mutex_lock_(&pool->mutex);
+    pool->stop = 1;
+    libplinkio_cond_broadcast_(&pool->work_cond);
+    libplinkio_mutex_unlock_(&pool->mutex);
+    for (size_t i = 0; i < pool->num_threads; i++) {
+        libplinkio_thread_join_(&pool->threads[i]);
+    }
+
+    libplinkio_cond_destroy_(&pool->done_cond);
+    libplinkio_cond_destroy_(&pool->work_cond);
+    libplinkio_mutex_destroy_(&pool->mutex);
+    if (pool->work != NULL) free(pool->work);
+    if (pool->done != NULL) free(pool->done);
+    if (pool->done_result != NULL) free(pool->done_result);
+    free(pool);
+    engine->pool = NULL;
+}
+
+static int
+pool_create(async_engine *engine)
+{
+    async_pool *pool = (async_pool *)malloc(sizeof(async_pool));
+    size_t num_threads = engine->num_slots < LIBPLINKIO_ASYNC_MAX_THREADS_ ? engine->num_slots : LIBPLINKIO_ASYNC_MAX_THREADS_;
+
+    if (pool == NULL) return -1;
+    memset(pool, 0, sizeof(*pool));
+    pool->work = (size_t *)malloc(engine->num_slots * sizeof(size_t));
+    pool->done = (size_t *)malloc(engine->num_slots * sizeof(size_t));
+    pool->done_result = (int *)malloc(engine->num_slots * sizeof(int));
+    if (pool->work == NULL || pool->done == NULL || pool->done_result == NULL ||
+        libplinkio_mutex_init_(&pool->mutex) != 0) {
+        if (pool->work != NULL) free(pool->work);
+        if (pool->done != NULL) free(pool->done);
+        if (pool->done_result != NULL) free(pool->done_result);
+        free(pool);
+        return -1;
+    }
+    libplinkio_cond_init_(&pool->work_cond);
+    libplinkio_cond_init_(&pool->done_cond);
+    engine->pool = pool;
+
+    for (; pool->num_threads < num_threads; pool->num_threads++) {
+        if (libplinkio_thread_create_(&pool->threads[pool->num_threads], pool_main, engine) != 0) break;
+    }
+    if (pool->num_threads == 0) {
+        pool_free(engine);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Starts the read of the rest of the row in the given slot.
+ */
+static int
+engine_issue(async_engine *engine, size_t slot)
+{
+#ifdef LIBPLINKIO_HAVE_IO_URING_
+    if (engine->uring != NULL) {
+        size_t done = engine->slot_done[slot];
+        uring_queue(
+            engine->uring,
+            engine->fd,
+            slot,
+            engine->buffers + slot * engine->row_size + done,
+            engine->row_size - done,
+            engine->data_offset + (uint64_t)engine->slot_request[slot].row_index * engine->row_size + done
+        );
+        return 0;
+    }
+#endif
+    libplinkio_mutex_lock_(&engine->pool->mutex);
+    engine->pool->work[(engine->pool->work_head + engine->pool->work_count) % engine->num_slots] = slot;
+    engine->pool->work_count++;
+    libplinkio_cond_broadcast_(&engine->pool->work_cond);
+    libplinkio_mutex_unlock_(&engine->pool->mutex);
+    return 0;
+}
+
+/**
+ * Collects finished reads, waiting for at least one if wait is set.
+ *
+ * @return The number of reads, or 0 on error.
+ */
+static size_t
+engine_reap(async_engine *engine, int wait)
+{
+    size_t *slots = engine->reaped_slots;
+    int *results = engine->reaped_results;
+    size_t count = 0;
+#ifdef LIBPLINKIO_HAVE_IO_URING_
+    if (engine->uring != NULL) {
+        if (uring_enter(engine->uring, 0) != 0) return 0;
+        count = uring_reap(engine->uring, slots, results, engine->num_slots);
+        if (count == 0 && wait) {
+            if (uring_enter(engine->uring, 1) != 0) return 0;
+            count = uring_reap(engine->uring, slots, results, engine->num_slots);
+        }
+        return count;
+    }
+#endif
+    libplinkio_mutex_lock_(&engine->pool->mutex);
+    while (wait && engine->pool->done_count == 0) {
+        libplinkio_cond_wait_(&engine->pool->done_cond, &engine->pool->mutex);
+    }
+    for (; engine->pool->done_count > 0; count++) {
+        slots[count] = engine->pool->done[engine->pool->done_head];
+        results[count] = engine->pool->done_result[engine->pool->done_head];
+        engine->pool->done_head = (engine->pool->done_head + 1) % engine->num_slots;
+        engine->pool->done_count--;
+    }
+    libplinkio_mutex_unlock_(&engine->pool->mutex);
+    return count;
+}
+
+/**
+ * Moves queued requests into free slots and starts their reads.
+ */
+static void
+engine_start_queued(async_engine *engine)
+{
+    while (engine->num_free > 0 && engine->queue_count > 0) {
+        size_t slot = engine->free_slots[--engine->num_free];
+        engine->slot_request[slot] = engine->queue[engine->queue_head];
+        engine->slot_done[slot] = 0;
+        engine->queue_head = (engine->queue_head + 1) % engine->queue_capacity;
+        engine->queue_count--;
+        engine->in_flight++;
+        engine_issue(engine, slot);
+    }
+}
+
+static void
+engine_free(async_engine *engine)
+{
+    if (engine == NULL) return;
+    pool_free(engine);
+#ifdef LIBPLINKIO_HAVE_IO_URING_
+    if (engine->uring != NULL) uring_free(engine->uring);
+#endif
+    if (engine->buffers != NULL) free(engine->buffers);
+    if (engine->slot_request != NULL) free(engine->slot_request);
+    if (engine->slot_done != NULL) free(engine->slot_done);
+    if (engine->free_slots != NULL) free(engine->free_slots);
+    if (engine->queue != NULL) free(engine->queue);
+    if (engine->decoded_row != NULL) free(engine->decoded_row);
+    if (engine->reaped_slots != NULL) free(engine->reaped_slots);
+    if (engine->reaped_results != NULL) free(engine->reaped_results);
+    free(engine);
+}
+
+pio_status_t
+bed_async_init(struct bed_async_t *async, struct pio_bed_file_t *bed_file, size_t queue_depth)
+{
+    async_engine *engine = NULL;
+    const char *requested = getenv("LIBPLINKIO_ASYNC");
+
+    async->bed_file = bed_file;
+    async->engine = NULL;
+    if (bed_file->fp == NULL || bed_file->view != NULL) goto error;
+
+    engine = (async_engine *)malloc(sizeof(async_engine));
+    if (engine == NULL) goto error;
+    memset(engine, 0, sizeof(*engine));
+    engine->bed_file = bed_file;
+    engine->fd = fileno(bed_file->fp);
+    engine->row_size = bed_header_row_size(&bed_file->header);
+    engine->data_offset = bed_header_data_offset(&bed_file->header);
+    engine->num_slots = queue_depth != 0 ? queue_depth : BED_DEFAULT_QUEUE_DEPTH;
+    if (engine->fd == -1) goto error;
+
+    engine->buffers = (unsigned char *)malloc(engine->num_slots * engine->row_size + 1);
+    engine->slot_request = (async_request *)malloc(engine->num_slots * sizeof(async_request));
+    engine->slot_done = (size_t *)malloc(engine->num_slots * sizeof(size_t));
+    engine->free_slots = (size_t *)malloc(engine->num_slots * sizeof(size_t));
+    engine->decoded_row = (snp_t *)malloc(bed_header_num_cols(&bed_file->header) + 1);
+    engine->reaped_slots = (size_t *)malloc(engine->num_slots * sizeof(size_t));
+    engine->reaped_results = (int *)malloc(engine->num_slots * sizeof(int));
+    if (engine->buffers == NULL || engine->slot_request == NULL || engine->slot_done == NULL ||
+        engine->free_slots == NULL || engine->decoded_row == NULL ||
+        engine->reaped_slots == NULL || engine->reaped_results == NULL) goto error;
+    for (size_t i = 0; i < engine->num_slots; i++) {
+        engine->free_slots[i] = engine->num_slots - i - 1;
+    }
+    engine->num_free = engine->num_slots;
+
+#ifdef LIBPLINKIO_HAVE_IO_URING_
+    if (requested == NULL || strcmp(requested, "threads") != 0) {
+        engine->uring = uring_create(engine);
+    }
+    if (engine->uring == NULL && pool_create(engine) != 0) goto error;
+#else
+    UNUSED_PARAM(requested);
+    if (pool_create(engine) != 0) goto error;
+#endif
+
+    async->engine = engine;
+    return PIO_OK;
+
+error:
+    engine_free(engine);
+    return PIO_ERROR;
+}
+
+pio_status_t
+bed_async_submit(struct bed_async_t *async, const size_t *rows, size_t num_rows, bed_async_callback_t callback, void *user_data)
+{
+    async_engine *engine = (async_engine *)async->engine;
+    size_t num_file_rows = bed_header_num_rows(&engine->bed_file->header);
+
+    for (size_t i = 0; i < num_rows; i++) {
+        if (rows[i] >= num_file_rows) return PIO_ERROR;
+    }
+
+    if (engine->queue_count + num_rows > engine->queue_capacity) {
+        size_t capacity = engine->queue_capacity * 2 > engine->queue_count + num_rows ? engine->queue_capacity * 2 : engine->queue_count + num_rows;
+        async_request *queue = (async_request *)malloc(capacity * sizeof(async_request));
+        if (queue == NULL) return PIO_ERROR;
+        for (size_t i = 0; i < engine->queue_count; i++) {
+            queue[i] = engine->queue[(engine->queue_head + i) % engine->queue_capacity];
+        }
+        if (engine->queue != NULL) free(engine->queue);
+        engine->queue = queue;
+        engine->queue_head = 0;
+        engine->queue_capacity = capacity;
+    }
+
+    for (size_t i = 0; i < num_rows; i++) {
+        async_request *request = &engine->queue[(engine->queue_head + engine->queue_count) % engine->queue_capacity];
+        request->row_index = rows[i];
+        request->callback = callback;
+        request->user_data = user_data;
+        engine->queue_count++;
+    }
+    engine_start_queued(engine);
+
+    return PIO_OK;
+}
+
+size_t
+bed_async_poll(struct bed_async_t *async, size_t min_complete)
+{
+    async_engine *engine = (async_engine *)async->engine;
+    size_t num_completed = 0;
+
+    engine_start_queued(engine);
+    while (engine->in_flight > 0) {
+        int wait = num_completed < min_complete;
+        size_t num_reaped = engine_reap(engine, wait);
+
+        for (size_t i = 0; i < num_reaped; i++) {
+            size_t slot = engine->reaped_slots[i];
+            int result = engine->reaped_results[i];
+            async_request request = engine->slot_request[slot];
+
+            /* Short reads and interrupted reads continue where they stopped. */
+            if (result > 0 && engine->slot_done[slot] + (size_t)result < engine->row_size) {
+                engine->slot_done[slot] += (size_t)result;
+                engine_issue(engine, slot);
+                continue;
+            }
+#ifdef LIBPLINKIO_HAVE_IO_URING_
+            if (result == -EINTR || result == -EAGAIN) {
+                engine_issue(engine, slot);
+                continue;
+            }
+#endif
+
+            engine->in_flight--;
+            engine->free_slots[engine->num_free++] = slot;
+            num_completed++;
+            if (result < 0 || engine->slot_done[slot] + (size_t)result < engine->row_size) {
+                request.callback(request.user_data, request.row_index, PIO_ERROR, NULL);
+            } else {
+                libplinkio_bed_decode_row_(engine->bed_file, engine->buffers + slot * engine->row_size, engine->decoded_row);
+                request.callback(request.user_data, request.row_index, PIO_OK, engine->decoded_row);
+            }
+        }
+
+        engine_start_queued(engine);
+
+        /* Nothing was ready, or waiting failed. */
+        if (num_reaped == 0) break;
+    }
+
+    return num_completed;
+}
+
+void
+bed_async_wait(struct bed_async_t *async)
+{
+    while (bed_async_pending(async) > 0) {
+        if (bed_async_poll(async, 1) == 0) break;
+    }
+}
+
+size_t
+bed_async_pending(struct bed_async_t *async)
+{
+    async_engine *engine = (async_engine *)async->engine;
+    return engine->in_flight + engine->queue_count;
+}
+
+const char *
+bed_async_engine(struct bed_async_t *async)
+{
+#ifdef LIBPLINKIO_HAVE_IO_URING_
+    if (((async_engine *)async->engine)->uring != NULL) return "io_uring";
+#endif
+    UNUSED_PARAM(async);
+    return "threads";
+}
+
+void
+bed_async_close(struct bed_async_t *async)
+{
+    async_engine *engine = (async_engine *)async->engine;
+    if (engine == NULL) return;
+
+    /* The kernel or the threads may still write into the buffers. */
+    while (engine->in_flight > 0) {
+        size_t num_reaped = engine_reap(engine, 1);
+        if (num_reaped == 0) break;
+        engine->in_flight -= num_reaped;
+    }
+
+    engine_free(engine);
+    async->engine = NULL;
+}
@@ -6,10 +6,12 @@
  * for details.
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 
@@ -22,10 +24,11 @@
 #include <plinkio/bed.h>
 #include <plinkio/bed_header.h>
 #include <plinkio/status.h>
-#include <plinkio/snp_lookup.h>
 
 #include "private/utility.h"
 #include "private/bed.h"
+#include "private/snp_kernel.h"
+#include "private/thread.h"
 
 /**
  * Creates mock versions of IO functions to allow unit testing.
@@ -89,6 +92,9 @@ parse_header(struct pio_bed_file_t *bed_file)
  *   * 2 is homozygous minor
  *   * 3 is missing value
  *
+ * The work is done by the fastest kernel in snp_kernel.c that the
+ * CPU supports, see bed_unpack_kernel.
+ *
  * @param packed_snps The packed SNPs.
  * @param unpacked_snps The unpacked SNPs.
  * @param num_cols The number of SNPs. 
@@ -96,294 +102,2535 @@ parse_header(struct pio_bed_file_t *bed_file)
 void
 unpack_snps(const snp_t *packed_snps, uint8_t *unpacked_snps, size_t num_cols)
 {
-    size_t packed_length = num_cols / 4;
-    /* Unpack SNPs in pairs of 4. */
-    uint8_t* p = unpacked_snps;
-    if (((uintptr_t)unpacked_snps & 0b11) == 0) {
-        // 4 bytes aligned
-        for (size_t i = 0; i < packed_length; i++) {
-            *((uint32_t*)p) = *((uint32_t*)(snp_lookup[ packed_snps[ i ] ].snp_array));
-            p += 4;
-        }
-    } else if (((uintptr_t)unpacked_snps & 0b1) == 0) {
-        // 2 byte aligned
-        for (size_t i = 0; i < packed_length; i++) {
-            *((uint16_t*)p) = *((uint16_t*)(snp_lookup[ packed_snps[ i ] ].snp_array));
-            *((uint16_t*)(p + 2)) = *((uint16_t*)(snp_lookup[ packed_snps[ i ] ].snp_array + 2));
-            p += 4;
-        }
-    } else {
-        // Unaligned
-        for (size_t i = 0; i < packed_length; i++) {
-            *(p) = *(snp_lookup[ packed_snps[ i ] ].snp_array);
-            *(p + 1) = *(snp_lookup[ packed_snps[ i ] ].snp_array + 1);
-            *(p + 2) = *(snp_lookup[ packed_snps[ i ] ].snp_array + 2);
-            *(p + 3) = *(snp_lookup[ packed_snps[ i ] ].snp_array + 3);
-            p += 4;
-        }
-    }
-
-    /* Unpack the trailing SNPs */
-    size_t index = packed_length * 4;
-    size_t packed_left = num_cols % 4;
-    for(size_t i = 0; i < packed_left; i++) {
-        unpacked_snps[ index + i ] = snp_lookup[ packed_snps[ packed_length ] ].snp_array[ i ];
-    }
+    libplinkio_snp_kernel_( )->unpack( packed_snps, unpacked_snps, num_cols );
 }
 
 /**
  * Does the reverse of unpack_snps, and packs SNPs into bytes. See unpack_snps for
- * the detailed format.
+ * the detailed format. Like unpack_snps, the work is done by the
+ * fastest kernel that the CPU supports.
  *
  * @param unpack_snps The unpacked SNPs.
  * @param packed_snps The packed SNPs.
  * @param num_cols The number of columns.
+ *
+ * @return PIO_OK if all SNPs were between 0 and 3, PIO_ERROR otherwise.
  */
-void
+pio_status_t
 pack_snps(const snp_t *unpacked_snps, unsigned char *packed_snps, size_t num_cols)
 {
-    memset( packed_snps, 0, (num_cols + 3) / 4 );
+    if( libplinkio_snp_kernel_( )->pack( unpacked_snps, packed_snps, num_cols ) != 0 )
+    {
+        return PIO_ERROR;
+    }
+
+    return PIO_OK;
+}
+
+/**
+ * Values of unpack_snps for the packed genotypes 00, 01, 10 and 11.
+ */
+static const snp_t g_snp_codes[ 4 ] = { 0, 3, 1, 2 };
+
+/**
+ * Runs of selected columns that are shorter than this are gathered
+ * one genotype at a time instead of going through unpack_snps.
+ */
+#define BED_MIN_UNPACK_RUN 32
+
+/**
+ * Decodes num_cols consecutive genotypes starting at an arbitrary
+ * column of a packed row.
+ *
+ * @param packed_snps The packed row.
+ * @param first_col The first column to decode.
+ * @param unpacked_snps The decoded genotypes are stored here.
+ * @param num_cols The number of genotypes to decode.
+ */
+static void
+gather_snps(const unsigned char *packed_snps, size_t first_col, snp_t *unpacked_snps, size_t num_cols)
+{
     for(size_t i = 0; i < num_cols; i++)
     {
-        /* Genotypes are stored backwards. */
-        size_t packed_index = i / 4;
-        size_t position_in_byte = (i % 4) * 2;
-        packed_snps[ packed_index ] |= ( snp_to_bits[ unpacked_snps[ i ] ] << position_in_byte );
+        size_t col = first_col + i;
+        unpacked_snps[ i ] = g_snp_codes[ ( packed_snps[ col / 4 ] >> ( 2 * ( col % 4 ) ) ) & 3 ];
     }
 }
 
 /**
- * Transposes the given memory mapped file in place.
+ * Decodes a packed row, or only the selected columns of it if
+ * bed_set_col_subset has been called.
  *
- * @param rows Rows of the file.
- * @param num_rows The number of loci of the file to be transposed.
- * @param num_cols The number of samples of the file to be transposed.
+ * @param bed_file Bed file.
+ * @param packed_row The packed row.
+ * @param buffer The decoded row, see bed_row_size.
  */
+static void
+decode_row(struct pio_bed_file_t *bed_file, const unsigned char *packed_row, snp_t *buffer)
+{
+    const libplinkio_bed_col_subset_private_t *subset = (const libplinkio_bed_col_subset_private_t *) bed_file->col_subset;
+    if( subset == NULL )
+    {
+        unpack_snps( packed_row, buffer, bed_header_num_cols( &bed_file->header ) );
+        return;
+    }
+
+    for(size_t i = 0; i < subset->num_runs; i++)
+    {
+        size_t col = subset->runs[ i ].src;
+        size_t length = subset->runs[ i ].length;
+        snp_t *dst = buffer + subset->runs[ i ].dst;
+
+        if( length >= BED_MIN_UNPACK_RUN )
+        {
+            /* Gather up to the first whole byte and unpack whole bytes after it. */
+            size_t head = ( 4 - col % 4 ) % 4;
+            size_t body = ( length - head ) / 4 * 4;
+            gather_snps( packed_row, col, dst, head );
+            unpack_snps( packed_row + ( col + head ) / 4, dst + head, body );
+            col += head + body;
+            dst += head + body;
+            length -= head + body;
+        }
+        gather_snps( packed_row, col, dst, length );
+    }
+}
+
 void
-transpose_rows(const unsigned char *rows, size_t num_rows, size_t num_cols, FILE *output_file)
+libplinkio_bed_decode_row_(struct pio_bed_file_t *bed_file, const unsigned char *packed_row, snp_t *buffer)
 {
-    size_t num_bytes_per_row = ( num_cols + 3 ) / 4;
-    size_t num_bytes_per_col = ( num_rows + 3 ) / 4;
-    unsigned char *row_buffer = (unsigned char *) malloc( num_bytes_per_col );
-    for(size_t j = 0; j < num_cols; j++)
+    decode_row( bed_file, packed_row, buffer );
+}
+
+/**
+ * Frees the columns selected with bed_set_col_subset.
+ *
+ * @param bed_file Bed file.
+ */
+static void
+free_col_subset(struct pio_bed_file_t *bed_file)
+{
+    libplinkio_bed_col_subset_private_t *subset = (libplinkio_bed_col_subset_private_t *) bed_file->col_subset;
+    if( subset == NULL )
+    {
+        return;
+    }
+
+    if( subset->runs != NULL )
+    {
+        free( subset->runs );
+    }
+    if( subset->packed_buffer != NULL )
+    {
+        free( subset->packed_buffer );
+    }
+    free( subset );
+    bed_file->col_subset = NULL;
+}
+
+/**
+ * Reads a block of rows for the prefetch thread, and decodes them
+ * after the packed rows if requested.
+ *
+ * @param context The bed file.
+ * @param first_row The first row to read.
+ * @param num_rows The number of rows to read.
+ * @param block The block to fill.
+ *
+ * @return PIO_OK if the rows could be read, PIO_ERROR otherwise.
+ */
+static pio_status_t
+fill_prefetch_block(void *context, size_t first_row, size_t num_rows, unsigned char *block)
+{
+    struct pio_bed_file_t *bed_file = (struct pio_bed_file_t *) context;
+    const libplinkio_bed_prefetch_private_t *prefetch = (const libplinkio_bed_prefetch_private_t *) bed_file->prefetch;
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    uint64_t offset = bed_header_data_offset( &bed_file->header ) + (uint64_t) first_row * row_size_bytes;
+
+    if( bed_file->mapped_file != NULL )
+    {
+        memcpy( block, bed_file->mapped_file + offset, num_rows * row_size_bytes );
+    }
+    else if( libplinkio_pread_( fileno( bed_file->fp ), block, num_rows * row_size_bytes, offset ) != 0 )
+    {
+        return PIO_ERROR;
+    }
+
+    if( prefetch->decoded )
     {
-        memset( row_buffer, 0, num_bytes_per_col );
+        snp_t *decoded_rows = block + prefetch->rows_per_block * row_size_bytes;
         for(size_t i = 0; i < num_rows; i++)
         {
-            /* Index in the byte array */
-            size_t from_index = i * num_bytes_per_row + j / 4;
-            size_t to_index   =   i / 4;
+            decode_row( bed_file, block + i * row_size_bytes, decoded_rows + i * bed_row_size( bed_file ) );
+        }
+    }
+
+    return PIO_OK;
+}
+
+/**
+ * Stops the prefetch thread, if it is running, and drops the
+ * blocks it has read. The settings are kept. The thread reads
+ * with pread, so the file position is moved to the current row
+ * for the reads on the calling thread.
+ *
+ * @param bed_file Bed file.
+ *
+ * @return PIO_OK if the file position could be moved, PIO_ERROR
+ *         otherwise.
+ */
+static pio_status_t
+stop_prefetch(struct pio_bed_file_t *bed_file)
+{
+    libplinkio_bed_prefetch_private_t *prefetch = (libplinkio_bed_prefetch_private_t *) bed_file->prefetch;
+    uint64_t offset;
+    if( prefetch == NULL || prefetch->ring == NULL )
+    {
+        return PIO_OK;
+    }
+
+    libplinkio_prefetch_stop_( prefetch->ring );
+    prefetch->ring = NULL;
+    prefetch->block = NULL;
+
+    if( bed_file->fp == NULL || bed_file->mapped_file != NULL )
+    {
+        return PIO_OK;
+    }
+    offset = bed_header_data_offset( &bed_file->header ) + (uint64_t) bed_file->cur_row * bed_header_row_size( &bed_file->header );
+    return fseek( bed_file->fp, (long) offset, SEEK_SET ) == 0 ? PIO_OK : PIO_ERROR;
+}
 
-            /* Index in the byte */
-            size_t from_shift = ( j % 4 ) * 2;
-            size_t to_shift = ( i % 4 ) * 2;
+/**
+ * Starts the prefetch thread at the current row with the stored
+ * settings.
+ *
+ * @param bed_file Bed file.
+ *
+ * @return PIO_OK if the thread could be started, PIO_ERROR otherwise.
+ */
+static pio_status_t
+start_prefetch(struct pio_bed_file_t *bed_file)
+{
+    libplinkio_bed_prefetch_private_t *prefetch = (libplinkio_bed_prefetch_private_t *) bed_file->prefetch;
+    size_t row_bytes = bed_header_row_size( &bed_file->header ) + ( prefetch->decoded ? bed_row_size( bed_file ) : 0 );
+
+    prefetch->rows_per_block = row_bytes != 0 && prefetch->block_size / row_bytes > 0 ? prefetch->block_size / row_bytes : 1;
+    prefetch->block = NULL;
+    prefetch->ring = libplinkio_prefetch_start_( fill_prefetch_block,
+                                                 bed_file,
+                                                 bed_file->cur_row,
+                                                 bed_header_num_rows( &bed_file->header ),
+                                                 prefetch->rows_per_block,
+                                                 prefetch->rows_per_block * row_bytes,
+                                                 prefetch->depth );
+
+    return prefetch->ring != NULL ? PIO_OK : PIO_ERROR;
+}
+
+/**
+ * Stops the prefetch thread and frees its settings.
+ *
+ * @param bed_file Bed file.
+ *
+ * @return PIO_OK if the file position could be moved to the
+ *         current row, PIO_ERROR otherwise.
+ */
+static pio_status_t
+free_prefetch(struct pio_bed_file_t *bed_file)
+{
+    pio_status_t status;
+    if( bed_file->prefetch == NULL )
+    {
+        return PIO_OK;
+    }
+
+    status = stop_prefetch( bed_file );
+    free( bed_file->prefetch );
+    bed_file->prefetch = NULL;
+    return status;
+}
+
+/**
+ * Starts the prefetch thread again after stop_prefetch, if
+ * prefetching is enabled.
+ *
+ * @param bed_file Bed file.
+ *
+ * @return PIO_OK if prefetching is disabled or could be restarted,
+ *         PIO_ERROR otherwise, in which case it is disabled.
+ */
+static pio_status_t
+restart_prefetch(struct pio_bed_file_t *bed_file)
+{
+    if( bed_file->prefetch == NULL || start_prefetch( bed_file ) == PIO_OK )
+    {
+        return PIO_OK;
+    }
+
+    free_prefetch( bed_file );
+    return PIO_ERROR;
+}
 
-            /* Values to swap */
-            int from_value = ( rows[ from_index ] >> from_shift ) & 0x3;
-            
-            row_buffer[ to_index ] |= ( from_value << to_shift );
+/**
+ * Gives an advice for a range of the file to the kernel, through
+ * madvise if the file is mapped and posix_fadvise otherwise.
+ *
+ * @param bed_file Bed file.
+ * @param offset Offset of the range in bytes.
+ * @param length Length of the range in bytes, 0 means to the end of
+ *               the file.
+ * @param advice The advice.
+ *
+ * @return PIO_OK if the advice could be given, PIO_ERROR otherwise.
+ */
+static pio_status_t
+advise_range(struct pio_bed_file_t *bed_file, size_t offset, size_t length, libplinkio_advice_private_t advice)
+{
+    if( bed_file->mapped_file != NULL )
+    {
+        if( length == 0 )
+        {
+            length = bed_header_data_size( &bed_file->header ) - offset;
         }
+        if( libplinkio_madvise_( bed_file->mapped_file + offset, length, advice ) != 0 )
+        {
+            return PIO_ERROR;
+        }
+        /* Unmapping the pages leaves them in the page cache. */
+        if( advice != LIBPLINKIO_ADVICE_DONTNEED_ )
+        {
+            return PIO_OK;
+        }
+    }
 
-        fwrite( row_buffer, 1, num_bytes_per_col, output_file );
+    if( libplinkio_fadvise_( fileno( bed_file->fp ), offset, length, advice ) != 0 )
+    {
+        return PIO_ERROR;
     }
 
-    free( row_buffer );
+    return PIO_OK;
 }
 
 /**
- * Transposes the given memory mapped file.
+ * With BED_ACCESS_DONTNEED_CONSUMED, drops the pages before the row
+ * that was returned last once at least BED_DROP_CONSUMED_SIZE bytes
+ * have been consumed. The row that was returned last is kept, since
+ * bed_read_row_mapped hands out a pointer to it.
  *
- * @param mapped_file A memory mapped file.
- * @param num_loci The number of loci.
- * @param num_samples The number of samples.
- * @param output_path The transposed file will be stored here.
+ * @param bed_file Bed file whose current row has just moved forward.
+ */
+static void
+drop_consumed(struct pio_bed_file_t *bed_file)
+{
+    size_t consumed;
+
+    if( ( bed_file->access_pattern & BED_ACCESS_DONTNEED_CONSUMED ) == 0 || bed_file->cur_row == 0 )
+    {
+        return;
+    }
+
+    consumed = bed_header_data_offset( &bed_file->header ) +
+               ( bed_file->cur_row - 1 ) * bed_header_row_size( &bed_file->header );
+    consumed -= consumed % BED_DROP_CONSUMED_SIZE;
+    if( consumed > bed_file->dropped_offset )
+    {
+        /* Only a hint, a failure does not affect the rows. */
+        advise_range( bed_file, bed_file->dropped_offset, consumed - bed_file->dropped_offset, LIBPLINKIO_ADVICE_DONTNEED_ );
+        bed_file->dropped_offset = consumed;
+    }
+}
+
+/**
+ * Takes the current row from the prefetch ring and moves to the
+ * next row, waiting for the thread if the row is not read yet.
  *
- * @return Returns PIO_OK if the file could be transposed, PIO_ERROR otherwise.
+ * @param bed_file Bed file with a running prefetch thread.
+ * @param packed_row The address of the packed row is stored here.
+ * @param decoded_row The address of the decoded row is stored here
+ *                    if the thread decodes, NULL otherwise.
  *
- * @deprecated This function is left only for compatibility.
+ * @return PIO_OK if a row could be read,
+ *         PIO_END if there are no more rows,
+ *         PIO_ERROR otherwise.
  */
-pio_status_t
-transpose_file(const unsigned char *mapped_file, size_t num_loci, size_t num_samples, const char *output_path)
+static pio_status_t
+prefetch_advance(struct pio_bed_file_t *bed_file, const unsigned char **packed_row, const snp_t **decoded_row)
 {
-    struct bed_header_t header = bed_header_init2( num_loci, num_samples, mapped_file );
-    size_t original_num_rows = bed_header_num_rows( &header );
-    size_t original_num_cols = bed_header_num_cols( &header );
-    unsigned char byte_header[ BED_HEADER_MAX_SIZE ];
-    size_t byte_header_length = 0;
-   
-    int transposed_fd = -1;
-    FILE* output_file = fopen( output_path, "wb" );
-    if( output_file == NULL ) goto error;
+    libplinkio_bed_prefetch_private_t *prefetch = (libplinkio_bed_prefetch_private_t *) bed_file->prefetch;
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    size_t index;
 
-    transposed_fd = fileno(output_file);
-    if( transposed_fd < 0 ) goto error;
+    if( bed_file->cur_row >= bed_header_num_rows( &bed_file->header ) )
+    {
+        return PIO_END;
+    }
 
-    /* Clear size of file, otherwise we might have trailing bytes */
-    if(libplinkio_ftruncate_(transposed_fd, 0) == -1) goto error;
-    
-    /* Transpose and write header */
-    bed_header_transpose( &header );
-    bed_header_to_bytes( &header, byte_header, &byte_header_length );
-    
-    if(
-        fwrite(
-            byte_header, sizeof( unsigned char ), byte_header_length, output_file
-        ) != byte_header_length
-    ) goto error;
-    
-    /* Transpose data */
-    transpose_rows( mapped_file + bed_header_data_offset( &header ),
-                    original_num_rows,
-                    original_num_cols,
-                    output_file );
+    if( prefetch->block == NULL || bed_file->cur_row >= prefetch->block_first_row + prefetch->block_num_rows )
+    {
+        pio_status_t status;
+        if( prefetch->block != NULL )
+        {
+            libplinkio_prefetch_release_( prefetch->ring );
+            prefetch->block = NULL;
+        }
+
+        status = libplinkio_prefetch_next_( prefetch->ring, &prefetch->block, &prefetch->block_first_row, &prefetch->block_num_rows );
+        if( status != PIO_OK || prefetch->block_first_row != bed_file->cur_row )
+        {
+            prefetch->block = NULL;
+            return PIO_ERROR;
+        }
+    }
+
+    index = bed_file->cur_row - prefetch->block_first_row;
+    *packed_row = prefetch->block + index * row_size_bytes;
+    *decoded_row = NULL;
+    if( prefetch->decoded )
+    {
+        *decoded_row = prefetch->block + prefetch->rows_per_block * row_size_bytes + index * bed_row_size( bed_file );
+    }
+    bed_file->cur_row++;
+    drop_consumed( bed_file );
+
+    return PIO_OK;
+}
+
+/**
+ * Number of source rows of a tile of transpose_packed, a multiple
+ * of 4. Each tile fills this many genotypes of a destination row.
+ */
+#define BED_TRANSPOSE_TILE_ROWS 64
+
+/**
+ * Number of source bytes in each row of a tile of transpose_packed,
+ * i.e. a tile fills 4 times as many destination rows.
+ */
+#define BED_TRANSPOSE_TILE_BYTES 256
+
+/**
+ * Number of bytes of the transposed rows that transpose_rows
+ * writes at once.
+ */
+#define BED_TRANSPOSE_STRIPE_SIZE ( 16 << 20 )
+
+/**
+ * Transposes a matrix of packed genotypes, so that column j of the
+ * source becomes row j of the destination. Only the first
+ * ( num_rows + 3 ) / 4 bytes of each destination row are written,
+ * and the bits after the last genotype are cleared.
+ *
+ * The matrix is walked in tiles of BED_TRANSPOSE_TILE_ROWS by
+ * BED_TRANSPOSE_TILE_BYTES, which are transposed 4 rows at a time
+ * by the transpose4 kernel into a buffer that fits in the L1 cache,
+ * and then copied to the destination as contiguous runs.
+ *
+ * @param src The source rows.
+ * @param src_stride Number of bytes from one source row to the next.
+ * @param num_rows The number of source rows.
+ * @param num_cols The number of source columns.
+ * @param dst The destination rows.
+ * @param dst_stride Number of bytes from one destination row to the next.
+ */
+static void
+transpose_packed(const unsigned char *src, size_t src_stride, size_t num_rows, size_t num_cols, unsigned char *dst, size_t dst_stride)
+{
+    libplinkio_transpose4_kernel_private_t transpose4 = libplinkio_snp_kernel_( )->transpose4;
+    unsigned char tile[ 4 * BED_TRANSPOSE_TILE_BYTES ][ BED_TRANSPOSE_TILE_ROWS / 4 ];
+    unsigned char partial_rows[ 4 ][ BED_TRANSPOSE_TILE_BYTES ];
+    uint32_t words[ BED_TRANSPOSE_TILE_BYTES ];
+    size_t num_src_bytes = ( num_cols + 3 ) / 4;
+
+    for(size_t b0 = 0; b0 < num_src_bytes; b0 += BED_TRANSPOSE_TILE_BYTES)
+    {
+        size_t num_bytes = num_src_bytes - b0 < BED_TRANSPOSE_TILE_BYTES ? num_src_bytes - b0 : BED_TRANSPOSE_TILE_BYTES;
+        size_t first_col = 4 * b0;
+        size_t tile_cols = num_cols - first_col < 4 * num_bytes ? num_cols - first_col : 4 * num_bytes;
+
+        for(size_t i0 = 0; i0 < num_rows; i0 += BED_TRANSPOSE_TILE_ROWS)
+        {
+            size_t tile_rows = num_rows - i0 < BED_TRANSPOSE_TILE_ROWS ? num_rows - i0 : BED_TRANSPOSE_TILE_ROWS;
+            size_t num_quads = ( tile_rows + 3 ) / 4;
+
+            for(size_t q = 0; q < num_quads; q++)
+            {
+                const unsigned char *quad = src + ( i0 + 4 * q ) * src_stride + b0;
+                if( tile_rows - 4 * q >= 4 )
+                {
+                    transpose4( quad, src_stride, num_bytes, words );
+                }
+                else
+                {
+                    /* The rows after the last one read as homozygous major, i.e. cleared bits. */
+                    memset( partial_rows, 0, sizeof( partial_rows ) );
+                    for(size_t k = 0; k < tile_rows - 4 * q; k++)
+                    {
+                        memcpy( partial_rows[ k ], quad + k * src_stride, num_bytes );
+                    }
+                    transpose4( partial_rows[ 0 ], BED_TRANSPOSE_TILE_BYTES, num_bytes, words );
+                }
+
+                for(size_t j = 0; j < num_bytes; j++)
+                {
+                    tile[ 4 * j ][ q ] = (unsigned char) words[ j ];
+                    tile[ 4 * j + 1 ][ q ] = (unsigned char) ( words[ j ] >> 8 );
+                    tile[ 4 * j + 2 ][ q ] = (unsigned char) ( words[ j ] >> 16 );
+                    tile[ 4 * j + 3 ][ q ] = (unsigned char) ( words[ j ] >> 24 );
+                }
+            }
+
+            for(size_t c = 0; c < tile_cols; c++)
+            {
+                memcpy( dst + ( first_col + c ) * dst_stride + i0 / 4, tile[ c ], num_quads );
+            }
+        }
+    }
+}
+
+/**
+ * Number of bytes of the transposed rows that transpose_rows
+ * writes at once, the tests make it smaller than a row.
+ */
+static size_t g_transpose_stripe_size = BED_TRANSPOSE_STRIPE_SIZE;
+
+/**
+ * Stripes of the transposed rows shared by the threads of
+ * transpose_rows. Each thread takes the next stripe, transposes it
+ * into its own buffer and writes it at its offset of the output,
+ * so the stripes can be written in any order.
+ */
+struct transpose_job_t
+{
+    const unsigned char *rows;
+    size_t num_rows;
+    size_t num_cols;
+    size_t stripe_cols;
+    int fd;
+    uint64_t offset;
+
+    libplinkio_mutex_private_t mutex;
+    size_t next_col;
+    int failed;
+};
+
+/**
+ * Transposes and writes stripes of a transpose_job_t until there
+ * are none left or a thread has failed.
+ */
+static void
+transpose_stripes(void *arg)
+{
+    struct transpose_job_t *job = (struct transpose_job_t *) arg;
+    size_t num_bytes_per_row = ( job->num_cols + 3 ) / 4;
+    size_t num_bytes_per_col = ( job->num_rows + 3 ) / 4;
+    unsigned char *stripe = (unsigned char *) malloc( job->stripe_cols * num_bytes_per_col + 1 );
+    int failed = stripe == NULL;
+
+    while( !failed )
+    {
+        size_t j, cols;
+        libplinkio_mutex_lock_( &job->mutex );
+        j = job->next_col;
+        job->next_col += job->stripe_cols;
+        failed = job->failed;
+        libplinkio_mutex_unlock_( &job->mutex );
+        if( failed || j >= job->num_cols )
+        {
+            break;
+        }
+
+        cols = job->num_cols - j < job->stripe_cols ? job->num_cols - j : job->stripe_cols;
+        transpose_packed( job->rows + j / 4, num_bytes_per_row, job->num_rows, cols, stripe, num_bytes_per_col );
+        failed = libplinkio_pwrite_( job->fd, stripe, cols * num_bytes_per_col, job->offset + (uint64_t) j * num_bytes_per_col ) != 0;
+    }
+
+    if( failed )
+    {
+        libplinkio_mutex_lock_( &job->mutex );
+        job->failed = 1;
+        libplinkio_mutex_unlock_( &job->mutex );
+    }
+    if( stripe != NULL )
+    {
+        free( stripe );
+    }
+}
+
+/**
+ * Transposes the rows of a memory mapped file and writes the
+ * transposed rows to fd from offset on, in stripes of at most
+ * BED_TRANSPOSE_STRIPE_SIZE bytes. The file is first extended to
+ * hold all rows, the stripes are then spread over num_threads
+ * threads.
+ *
+ * @param rows Rows of the file.
+ * @param num_rows The number of loci of the file to be transposed.
+ * @param num_cols The number of samples of the file to be transposed.
+ * @param fd The transposed rows are written here.
+ * @param offset The offset of the first transposed row in fd.
+ * @param num_threads The number of threads, 0 for one per online
+ *                    processor.
+ *
+ * @return PIO_OK if the rows could be written, PIO_ERROR otherwise.
+ */
+pio_status_t
+transpose_rows(const unsigned char *rows, size_t num_rows, size_t num_cols, int fd, uint64_t offset, size_t num_threads)
+{
+    size_t num_bytes_per_col = ( num_rows + 3 ) / 4;
+    size_t num_started = 0;
+    libplinkio_thread_private_t *threads = NULL;
+    struct transpose_job_t job = { 0 };
+
+    if( num_threads == 0 )
+    {
+        num_threads = libplinkio_num_cpus_( );
+    }
+    if( libplinkio_fallocate_( fd, offset + (uint64_t) num_cols * num_bytes_per_col ) != 0 )
+    {
+        return PIO_ERROR;
+    }
+    if( num_cols == 0 || num_rows == 0 )
+    {
+        return PIO_OK;
+    }
+
+    /* Stripes start on a byte of the source rows, and there are
+     * enough of them for every thread. */
+    job.stripe_cols = g_transpose_stripe_size / num_bytes_per_col;
+    if( job.stripe_cols > ( num_cols + num_threads - 1 ) / num_threads )
+    {
+        job.stripe_cols = ( num_cols + num_threads - 1 ) / num_threads;
+    }
+    job.stripe_cols += 3;
+    job.stripe_cols -= job.stripe_cols % 4;
+    if( job.stripe_cols < 4 )
+    {
+        /* A single transposed row is larger than a stripe. */
+        job.stripe_cols = 4;
+    }
+    if( num_threads > ( num_cols + job.stripe_cols - 1 ) / job.stripe_cols )
+    {
+        num_threads = ( num_cols + job.stripe_cols - 1 ) / job.stripe_cols;
+    }
+
+    job.rows = rows;
+    job.num_rows = num_rows;
+    job.num_cols = num_cols;
+    job.fd = fd;
+    job.offset = offset;
+    if( libplinkio_mutex_init_( &job.mutex ) != 0 )
+    {
+        return PIO_ERROR;
+    }
+
+    /* The calling thread takes stripes as well. */
+    if( num_threads > 1 )
+    {
+        threads = (libplinkio_thread_private_t *) malloc( ( num_threads - 1 ) * sizeof( libplinkio_thread_private_t ) );
+    }
+    if( threads != NULL )
+    {
+        for(; num_started < num_threads - 1; num_started++)
+        {
+            if( libplinkio_thread_create_( &threads[ num_started ], transpose_stripes, &job ) != 0 )
+            {
+                break;
+            }
+        }
+    }
+    transpose_stripes( &job );
+    for(size_t i = 0; i < num_started; i++)
+    {
+        libplinkio_thread_join_( &threads[ i ] );
+    }
+
+    if( threads != NULL )
+    {
+        free( threads );
+    }
+    libplinkio_mutex_destroy_( &job.mutex );
+    return job.failed ? PIO_ERROR : PIO_OK;
+}
+
+/**
+ * Frees the window of a file read with bed_set_snp_order and
+ * restores the header of the file as it is stored.
+ *
+ * @param bed_file Bed file.
+ */
+static void
+free_view(struct pio_bed_file_t *bed_file)
+{
+    libplinkio_bed_view_private_t *view = (libplinkio_bed_view_private_t *) bed_file->view;
+    if( view == NULL )
+    {
+        return;
+    }
+
+    bed_file->header = view->file_header;
+    if( view->band != NULL )
+    {
+        free( view->band );
+    }
+    if( view->rows != NULL )
+    {
+        free( view->rows );
+    }
+    free( view );
+    bed_file->view = NULL;
+}
+
+/**
+ * Reads the window of the view that starts at first_row, i.e. the
+ * same bytes of every row of the file, and transposes it.
+ *
+ * @param bed_file Bed file read with bed_set_snp_order.
+ * @param first_row The first row of the window, a multiple of
+ *                  window_rows.
+ *
+ * @return PIO_OK if the window could be read, PIO_ERROR otherwise.
+ */
+static pio_status_t
+fill_view_window(struct pio_bed_file_t *bed_file, size_t first_row)
+{
+    libplinkio_bed_view_private_t *view = (libplinkio_bed_view_private_t *) bed_file->view;
+    size_t num_file_rows = bed_header_num_rows( &view->file_header );
+    size_t file_row_size = bed_header_row_size( &view->file_header );
+    uint64_t data_offset = bed_header_data_offset( &view->file_header );
+    size_t num_rows = bed_header_num_rows( &bed_file->header ) - first_row;
+    size_t band_bytes;
+    const unsigned char *src;
+    size_t src_stride;
+
+    if( num_rows > view->window_rows )
+    {
+        num_rows = view->window_rows;
+    }
+    band_bytes = ( num_rows + 3 ) / 4;
+    view->num_rows = 0;
+
+    if( bed_file->mapped_file != NULL )
+    {
+        src = bed_file->mapped_file + data_offset + first_row / 4;
+        src_stride = file_row_size;
+    }
+    else
+    {
+        int fd = fileno( bed_file->fp );
+        if( fd == -1 )
+        {
+            return PIO_ERROR;
+        }
+
+        /* A window of whole rows is one read, otherwise each row of
+         * the file contributes band_bytes. */
+        if( band_bytes == file_row_size )
+        {
+            if( libplinkio_pread_( fd, view->band, num_file_rows * file_row_size, data_offset ) != 0 )
+            {
+                return PIO_ERROR;
+            }
+        }
+        else
+        {
+            for(size_t i = 0; i < num_file_rows; i++)
+            {
+                if( libplinkio_pread_( fd, view->band + i * band_bytes, band_bytes, data_offset + (uint64_t) i * file_row_size + first_row / 4 ) != 0 )
+                {
+                    return PIO_ERROR;
+                }
+            }
+        }
+        src = view->band;
+        src_stride = band_bytes;
+    }
+
+    transpose_packed( src, src_stride, num_file_rows, num_rows, view->rows, bed_header_row_size( &bed_file->header ) );
+    view->first_row = first_row;
+    view->num_rows = num_rows;
+
+    return PIO_OK;
+}
+
+/**
+ * Returns the next row of a file read with bed_set_snp_order,
+ * reading the window that holds it if needed.
+ *
+ * @param bed_file Bed file.
+ * @param packed_row The address of the row in the window is stored here.
+ *
+ * @return PIO_OK if a row could be read,
+ *         PIO_END if there are no more rows,
+ *         PIO_ERROR otherwise.
+ */
+static pio_status_t
+view_advance(struct pio_bed_file_t *bed_file, const unsigned char **packed_row)
+{
+    libplinkio_bed_view_private_t *view = (libplinkio_bed_view_private_t *) bed_file->view;
+
+    if( bed_file->cur_row >= bed_header_num_rows( &bed_file->header ) )
+    {
+        return PIO_END;
+    }
+
+    if( bed_file->cur_row < view->first_row || bed_file->cur_row >= view->first_row + view->num_rows )
+    {
+        if( fill_view_window( bed_file, bed_file->cur_row - bed_file->cur_row % view->window_rows ) != PIO_OK )
+        {
+            return PIO_ERROR;
+        }
+    }
+
+    *packed_row = view->rows + ( bed_file->cur_row - view->first_row ) * bed_header_row_size( &bed_file->header );
+    bed_file->cur_row++;
+
+    return PIO_OK;
+}
+
+/**
+ * Reads one row of a file read with bed_set_snp_order without the
+ * window, by reading its byte from every row of the file, so that
+ * it can be called from many threads like bed_read_row_packed_at.
+ *
+ * @param bed_file Bed file.
+ * @param row_index Index of the row of the view.
+ * @param packed_row The packed row is stored here.
+ *
+ * @return PIO_OK if the row could be read, PIO_ERROR otherwise.
+ */
+static pio_status_t
+view_read_row_at(struct pio_bed_file_t *bed_file, size_t row_index, unsigned char *packed_row)
+{
+    libplinkio_bed_view_private_t *view = (libplinkio_bed_view_private_t *) bed_file->view;
+    size_t num_file_rows = bed_header_num_rows( &view->file_header );
+    size_t file_row_size = bed_header_row_size( &view->file_header );
+    uint64_t offset = bed_header_data_offset( &view->file_header ) + row_index / 4;
+    unsigned int shift = 2 * ( row_index % 4 );
+    int fd = bed_file->mapped_file == NULL ? fileno( bed_file->fp ) : -1;
+
+    memset( packed_row, 0, bed_header_row_size( &bed_file->header ) );
+    for(size_t i = 0; i < num_file_rows; i++)
+    {
+        unsigned char byte;
+        if( bed_file->mapped_file != NULL )
+        {
+            byte = bed_file->mapped_file[ offset + i * file_row_size ];
+        }
+        else if( fd == -1 || libplinkio_pread_( fd, &byte, 1, offset + (uint64_t) i * file_row_size ) != 0 )
+        {
+            return PIO_ERROR;
+        }
+
+        packed_row[ i / 4 ] |= (unsigned char) ( ( ( byte >> shift ) & 3 ) << ( 2 * ( i % 4 ) ) );
+    }
+
+    return PIO_OK;
+}
+
+pio_status_t
+bed_set_snp_order(struct pio_bed_file_t *bed_file, enum SnpOrder order, size_t window_size)
+{
+    libplinkio_bed_view_private_t *view;
+    size_t row_size_bytes, num_rows;
+    unsigned char *read_buffer;
+
+    if( bed_file->fp == NULL || bed_file->prefetch != NULL )
+    {
+        return PIO_ERROR;
+    }
+
+    /* Subsets refer to the columns of the old orientation. */
+    free_col_subset( bed_file );
+    free_view( bed_file );
+    if( fseek( bed_file->fp, (long)bed_header_data_offset( &bed_file->header ), SEEK_SET ) != 0 )
+    {
+        return PIO_ERROR;
+    }
+    bed_file->cur_row = 0;
+    bed_file->dropped_offset = 0;
+    if( bed_header_snp_order( &bed_file->header ) == order )
+    {
+        return PIO_OK;
+    }
+
+    view = (libplinkio_bed_view_private_t *) malloc( sizeof( libplinkio_bed_view_private_t ) );
+    if( view == NULL )
+    {
+        return PIO_ERROR;
+    }
+    memset( view, 0, sizeof( *view ) );
+    view->file_header = bed_file->header;
+    bed_header_transpose( &bed_file->header );
+
+    row_size_bytes = bed_header_row_size( &bed_file->header );
+    num_rows = bed_header_num_rows( &bed_file->header );
+    window_size = window_size != 0 ? window_size : BED_DEFAULT_WINDOW_SIZE;
+    view->window_rows = row_size_bytes != 0 ? window_size / row_size_bytes : num_rows;
+    if( view->window_rows > num_rows )
+    {
+        view->window_rows = num_rows + 3;
+    }
+    view->window_rows -= view->window_rows % 4;
+    if( view->window_rows < 4 )
+    {
+        view->window_rows = 4;
+    }
+
+    bed_file->view = view;
+    view->rows = (unsigned char *) malloc( view->window_rows * row_size_bytes + 1 );
+    if( bed_file->mapped_file == NULL )
+    {
+        view->band = (unsigned char *) malloc( view->window_rows / 4 * bed_header_num_rows( &view->file_header ) + 1 );
+    }
+
+    /* The typed reads unpack rows of the view in the read buffer. */
+    read_buffer = (unsigned char *) malloc( row_size_bytes > bed_header_row_size( &view->file_header ) ? row_size_bytes : bed_header_row_size( &view->file_header ) );
+    if( view->rows == NULL || ( bed_file->mapped_file == NULL && view->band == NULL ) || read_buffer == NULL )
+    {
+        if( read_buffer != NULL )
+        {
+            free( read_buffer );
+        }
+        free_view( bed_file );
+        return PIO_ERROR;
+    }
+    free( bed_file->read_buffer );
+    bed_file->read_buffer = read_buffer;
+
+    return PIO_OK;
+}
+
+/**
+ * Transposes the given memory mapped file.
+ *
+ * @param mapped_file A memory mapped file.
+ * @param num_loci The number of loci.
+ * @param num_samples The number of samples.
+ * @param output_path The transposed file will be stored here.
+ *
+ * @return Returns PIO_OK if the file could be transposed, PIO_ERROR otherwise.
+ *
+ * @deprecated This function is left only for compatibility.
+ */
+pio_status_t
+transpose_file(const unsigned char *mapped_file, size_t num_loci, size_t num_samples, const char *output_path)
+{
+    struct bed_header_t header = bed_header_init2( num_loci, num_samples, mapped_file );
+    size_t original_num_rows = bed_header_num_rows( &header );
+    size_t original_num_cols = bed_header_num_cols( &header );
+    unsigned char byte_header[ BED_HEADER_MAX_SIZE ];
+    size_t byte_header_length = 0;
+   
+    int transposed_fd = -1;
+    FILE* output_file = fopen( output_path, "wb" );
+    if( output_file == NULL ) goto error;
+
+    transposed_fd = fileno(output_file);
+    if( transposed_fd < 0 ) goto error;
+
+    /* Clear size of file, otherwise we might have trailing bytes */
+    if(libplinkio_ftruncate_(transposed_fd, 0) == -1) goto error;
+    
+    /* Transpose and write header */
+    bed_header_transpose( &header );
+    bed_header_to_bytes( &header, byte_header, &byte_header_length );
+    
+    if(
+        fwrite(
+            byte_header, sizeof( unsigned char ), byte_header_length, output_file
+        ) != byte_header_length
+    ) goto error;
+    if( fflush( output_file ) != 0 ) goto error;
+    
+    /* Transpose data */
+    if( transpose_rows( mapped_file + bed_header_data_offset( &header ),
+                        original_num_rows,
+                        original_num_cols,
+                        transposed_fd,
+                        byte_header_length,
+                        1 ) != PIO_OK ) goto error;
+
+    fclose( output_file );
+
+    return PIO_OK;
+
+error:
+    if (output_file != NULL) fclose(output_file);
+    return PIO_ERROR;
+}
+
+pio_status_t
+bed_open(struct pio_bed_file_t *bed_file, const char *path, size_t num_loci, size_t num_samples)
+{
+    size_t row_size_bytes;
+    FILE *bed_fp;
+   
+    memset( bed_file, 0, sizeof( *bed_file ) );
+    bed_fp = fopen( path, "rb" );
+    if( bed_fp == NULL )
+    {
+        return PIO_ERROR;
+    }
+
+    bed_file->fp = bed_fp;
+    bed_file->header = bed_header_init( num_loci, num_samples );
+    if( parse_header( bed_file ) != PIO_OK )
+    {
+        return PIO_ERROR;
+    }
+ 
+    row_size_bytes = bed_header_row_size( &bed_file->header ); 
+    bed_file->read_buffer = ( snp_t * ) malloc( row_size_bytes );
+    bed_file->cur_row = 0;
+
+    return PIO_OK;
+}
+
+pio_status_t
+bed_open_mapped(struct pio_bed_file_t *bed_file, const char *path, size_t num_loci, size_t num_samples)
+{
+    struct stat file_stats;
+    libplinkio_mmap_state_private_t *mmap_state = NULL;
+    void *mapped_file = NULL;
+    int fd = -1;
+
+    if( bed_open( bed_file, path, num_loci, num_samples ) != PIO_OK ) goto error;
+
+    /* Reading past the end of a mapping faults, so check the size up front. */
+    fd = fileno( bed_file->fp );
+    if( fd == -1 || fstat( fd, &file_stats ) == -1 ) goto error;
+    if( (size_t) file_stats.st_size < bed_header_data_size( &bed_file->header ) ) goto error;
+
+    mmap_state = (libplinkio_mmap_state_private_t *) malloc( sizeof( libplinkio_mmap_state_private_t ) );
+    if( mmap_state == NULL ) goto error;
+    mapped_file = libplinkio_mmap_( fd, LIBPLINKIO_MMAP_READONLY_, mmap_state );
+    if( mapped_file == NULL ) goto error;
+
+    bed_file->mapped_file = (const unsigned char *) mapped_file;
+    bed_file->mmap_state = mmap_state;
+
+    return PIO_OK;
+
+error:
+    if( mmap_state != NULL )
+    {
+        free( mmap_state );
+    }
+    bed_close( bed_file );
+    return PIO_ERROR;
+}
+
+pio_status_t
+bed_create(struct pio_bed_file_t *bed_file, const char *path, size_t num_samples)
+{
+    FILE *bed_fp;
+    unsigned char header_bytes[3];
+    size_t length;
+    size_t row_size_bytes;
+   
+    memset( bed_file, 0, sizeof( *bed_file ) );
+    bed_fp = fopen( path, "wb" );
+    if( bed_fp == NULL )
+    {
+        return PIO_ERROR;
+    }
+
+    bed_file->fp = bed_fp;
+    bed_file->header = bed_header_init( 0, num_samples );
+    bed_header_to_bytes( &bed_file->header, header_bytes, &length );
+    if( fwrite( header_bytes, sizeof( unsigned char ), length, bed_fp ) <= 0 )
+    {
+        fclose( bed_fp );
+        return PIO_ERROR;
+    }
+    
+    row_size_bytes = bed_header_row_size( &bed_file->header );
+    bed_file->read_buffer = ( snp_t * ) malloc( row_size_bytes );
+    bed_file->cur_row = 0;
+
+    return PIO_OK;
+}
+
+/**
+ * Clears the bits after the last genotype of a packed row, which
+ * the file may leave undefined.
+ *
+ * @param packed_row The packed row.
+ * @param num_cols The number of genotypes in the row.
+ */
+static void
+mask_trailing_bits(unsigned char *packed_row, size_t num_cols)
+{
+    if( num_cols % 4 != 0 )
+    {
+        packed_row[ num_cols / 4 ] &= (unsigned char) ( ( 1u << ( 2 * ( num_cols % 4 ) ) ) - 1 );
+    }
+}
+
+pio_status_t
+bed_create_sized(struct pio_bed_file_t *bed_file, const char *path, size_t num_loci, size_t num_samples)
+{
+    unsigned char header_bytes[3];
+    size_t length;
+    int fd;
+
+    memset( bed_file, 0, sizeof( *bed_file ) );
+    bed_file->fp = fopen( path, "wb" );
+    if( bed_file->fp == NULL )
+    {
+        return PIO_ERROR;
+    }
+
+    bed_file->header = bed_header_init( num_loci, num_samples );
+    bed_header_to_bytes( &bed_file->header, header_bytes, &length );
+    if( fwrite( header_bytes, sizeof( unsigned char ), length, bed_file->fp ) != length ||
+        fflush( bed_file->fp ) != 0 )
+    {
+        goto error;
+    }
+
+    /* The rows are written with pwrite from here on, which bypasses the stdio buffer. */
+    fd = fileno( bed_file->fp );
+    if( fd == -1 || libplinkio_fallocate_( fd, bed_header_data_size( &bed_file->header ) ) != 0 )
+    {
+        goto error;
+    }
+
+    bed_file->read_buffer = ( snp_t * ) malloc( bed_header_row_size( &bed_file->header ) );
+    bed_file->cur_row = 0;
+    bed_file->sized = 1;
+
+    return PIO_OK;
+
+error:
+    fclose( bed_file->fp );
+    bed_file->fp = NULL;
+    return PIO_ERROR;
+}
+
+/**
+ * Writes packed rows after the rows written so far. A file from
+ * bed_create appends them and counts them in the header, a file from
+ * bed_create_sized writes them at their offset.
+ *
+ * @param bed_file Bed file.
+ * @param packed_rows The packed rows, one after the other.
+ * @param num_rows The number of rows.
+ *
+ * @return PIO_OK if the rows could be written, PIO_ERROR otherwise.
+ */
+static pio_status_t
+write_packed_rows(struct pio_bed_file_t *bed_file, const unsigned char *packed_rows, size_t num_rows)
+{
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    size_t num_bytes = num_rows * row_size_bytes;
+
+    if( bed_file->sized )
+    {
+        uint64_t offset = bed_header_data_offset( &bed_file->header ) + (uint64_t) bed_file->cur_row * row_size_bytes;
+        int fd = fileno( bed_file->fp );
+        if( num_rows > bed_header_num_rows( &bed_file->header ) - bed_file->cur_row )
+        {
+            return PIO_ERROR;
+        }
+        if( fd == -1 || libplinkio_pwrite_( fd, packed_rows, num_bytes, offset ) != 0 )
+        {
+            return PIO_ERROR;
+        }
+    }
+    else
+    {
+        if( fwrite( packed_rows, sizeof( unsigned char ), num_bytes, bed_file->fp ) != num_bytes )
+        {
+            return PIO_ERROR;
+        }
+
+        if( bed_file->header.snp_order == BED_ONE_LOCUS_PER_ROW ) {
+            bed_file->header.num_loci += num_rows;
+        } else {
+            bed_file->header.num_samples += num_rows;
+        }
+    }
+
+    bed_file->cur_row += num_rows;
+    return PIO_OK;
+}
+
+pio_status_t
+bed_write_row(struct pio_bed_file_t *bed_file, const snp_t *buffer)
+{
+    if( pack_snps( buffer, bed_file->read_buffer, bed_header_num_cols( &bed_file->header ) ) != PIO_OK )
+    {
+        return PIO_ERROR;
+    }
+
+    return write_packed_rows( bed_file, bed_file->read_buffer, 1 );
+}
+
+pio_status_t
+bed_write_row_packed(struct pio_bed_file_t *bed_file, const unsigned char *packed_row)
+{
+    size_t num_cols = bed_header_num_cols( &bed_file->header );
+
+    if( num_cols % 4 == 0 )
+    {
+        return write_packed_rows( bed_file, packed_row, 1 );
+    }
+
+    /* The caller's row is const, so clear the padding in a copy. */
+    memcpy( bed_file->read_buffer, packed_row, bed_header_row_size( &bed_file->header ) );
+    mask_trailing_bits( bed_file->read_buffer, num_cols );
+
+    return write_packed_rows( bed_file, bed_file->read_buffer, 1 );
+}
+
+/**
+ * Returns the chunk buffer, grown to hold at least size bytes.
+ *
+ * @param bed_file Bed file.
+ * @param size The number of bytes needed.
+ *
+ * @return The chunk buffer, or NULL if it could not be allocated.
+ */
+static unsigned char *
+chunk_buffer(struct pio_bed_file_t *bed_file, size_t size)
+{
+    if( bed_file->chunk_buffer_size < size )
+    {
+        if( bed_file->chunk_buffer != NULL )
+        {
+            free( bed_file->chunk_buffer );
+        }
+        bed_file->chunk_buffer_size = size;
+        bed_file->chunk_buffer = (unsigned char *) malloc( size );
+        if( bed_file->chunk_buffer == NULL )
+        {
+            bed_file->chunk_buffer_size = 0;
+        }
+    }
+
+    return bed_file->chunk_buffer;
+}
+
+/**
+ * Checks that all genotypes are at most 3, without a branch per
+ * genotype so that the loop is vectorized.
+ *
+ * @param snps The genotypes.
+ * @param num_snps The number of genotypes.
+ *
+ * @return PIO_OK if all genotypes are valid, PIO_ERROR otherwise.
+ */
+static pio_status_t
+check_snps(const snp_t *snps, size_t num_snps)
+{
+    snp_t invalid = 0;
+    for(size_t i = 0; i < num_snps; i++)
+    {
+        invalid |= snps[ i ] & ~3;
+    }
+
+    return invalid == 0 ? PIO_OK : PIO_ERROR;
+}
+
+pio_status_t
+bed_write_rows(struct pio_bed_file_t *bed_file, const snp_t *rows, size_t num_rows)
+{
+    size_t num_cols = bed_header_num_cols( &bed_file->header );
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    size_t chunk_size = bed_file->chunk_size != 0 ? bed_file->chunk_size : BED_DEFAULT_CHUNK_SIZE;
+    size_t rows_per_chunk = row_size_bytes != 0 && chunk_size / row_size_bytes > 0 ? chunk_size / row_size_bytes : 1;
+    size_t rows_written = 0;
+    unsigned char *packed_rows;
+
+    if( num_rows == 0 )
+    {
+        return PIO_OK;
+    }
+
+    /* Nothing is written if a later chunk is invalid. */
+    if( check_snps( rows, num_rows * num_cols ) != PIO_OK )
+    {
+        return PIO_ERROR;
+    }
+
+    packed_rows = chunk_buffer( bed_file, ( num_rows < rows_per_chunk ? num_rows : rows_per_chunk ) * row_size_bytes );
+    if( packed_rows == NULL )
+    {
+        return PIO_ERROR;
+    }
+
+    while( rows_written < num_rows )
+    {
+        size_t chunk_rows = num_rows - rows_written < rows_per_chunk ? num_rows - rows_written : rows_per_chunk;
+        for(size_t i = 0; i < chunk_rows; i++)
+        {
+            if( pack_snps( rows + ( rows_written + i ) * num_cols, packed_rows + i * row_size_bytes, num_cols ) != PIO_OK )
+            {
+                return PIO_ERROR;
+            }
+        }
+
+        if( write_packed_rows( bed_file, packed_rows, chunk_rows ) != PIO_OK )
+        {
+            return PIO_ERROR;
+        }
+        rows_written += chunk_rows;
+    }
+
+    return PIO_OK;
+}
+
+pio_status_t
+bed_read_row_mapped(struct pio_bed_file_t *bed_file, const unsigned char **packed_row)
+{
+    if( bed_file->view != NULL )
+    {
+        return view_advance( bed_file, packed_row );
+    }
+    if( bed_file->mapped_file == NULL )
+    {
+        return PIO_ERROR;
+    }
+    if( bed_file->cur_row >= bed_header_num_rows( &bed_file->header ) )
+    {
+        return PIO_END;
+    }
+
+    *packed_row = bed_file->mapped_file +
+                  bed_header_data_offset( &bed_file->header ) +
+                  bed_file->cur_row * bed_header_row_size( &bed_file->header );
+    if( bed_file->prefetch != NULL )
+    {
+        /* Keep the ring in step, the pointer into the mapping is stable. */
+        const unsigned char *prefetched_row;
+        const snp_t *decoded_row;
+        return prefetch_advance( bed_file, &prefetched_row, &decoded_row );
+    }
+    bed_file->cur_row++;
+    drop_consumed( bed_file );
+
+    return PIO_OK;
+}
+
+pio_status_t
+bed_read_row_packed(struct pio_bed_file_t *bed_file, unsigned char *packed_row)
+{
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+
+    if( bed_file->view != NULL )
+    {
+        const unsigned char *view_row;
+        pio_status_t status = view_advance( bed_file, &view_row );
+        if( status == PIO_OK )
+        {
+            memcpy( packed_row, view_row, row_size_bytes );
+        }
+
+        return status;
+    }
+
+    if( bed_file->prefetch != NULL )
+    {
+        const unsigned char *prefetched_row;
+        const snp_t *decoded_row;
+        pio_status_t status = prefetch_advance( bed_file, &prefetched_row, &decoded_row );
+        if( status == PIO_OK )
+        {
+            memcpy( packed_row, prefetched_row, row_size_bytes );
+            mask_trailing_bits( packed_row, bed_header_num_cols( &bed_file->header ) );
+        }
+
+        return status;
+    }
+
+    if( bed_file->mapped_file != NULL )
+    {
+        const unsigned char *mapped_row;
+        pio_status_t status = bed_read_row_mapped( bed_file, &mapped_row );
+        if( status == PIO_OK )
+        {
+            memcpy( packed_row, mapped_row, row_size_bytes );
+            mask_trailing_bits( packed_row, bed_header_num_cols( &bed_file->header ) );
+        }
+
+        return status;
+    }
+
+    if( feof( bed_file->fp ) != 0 || bed_file->cur_row >= bed_header_num_rows( &bed_file->header ) )
+    {
+        return PIO_END;
+    }
+
+    if( fread( packed_row, 1, row_size_bytes, bed_file->fp ) != row_size_bytes )
+    {
+        return PIO_ERROR;
+    }
+
+    mask_trailing_bits( packed_row, bed_header_num_cols( &bed_file->header ) );
+    bed_file->cur_row++;
+    drop_consumed( bed_file );
+
+    return PIO_OK;
+}
+
+/**
+ * Packs the selected columns of a packed row together, so that the
+ * typed decoders can treat a subset like a whole row.
+ *
+ * @param bed_file Bed file.
+ * @param packed_row The packed row.
+ * @param num_cols The number of genotypes in the returned row is
+ *                 stored here.
+ *
+ * @return The packed row, or the selected columns of it packed into
+ *         the buffer of the subset.
+ */
+static const unsigned char *
+compact_row(struct pio_bed_file_t *bed_file, const unsigned char *packed_row, size_t *num_cols)
+{
+    const libplinkio_bed_col_subset_private_t *subset = (const libplinkio_bed_col_subset_private_t *) bed_file->col_subset;
+    if( subset == NULL )
+    {
+        *num_cols = bed_header_num_cols( &bed_file->header );
+        return packed_row;
+    }
+
+    *num_cols = subset->num_cols;
+    if( subset->num_cols == 0 )
+    {
+        return packed_row;
+    }
+
+    memset( subset->packed_buffer, 0, ( subset->num_cols + 3 ) / 4 );
+    for(size_t i = 0; i < subset->num_runs; i++)
+    {
+        for(size_t j = 0; j < subset->runs[ i ].length; j++)
+        {
+            size_t col = subset->runs[ i ].src + j;
+            size_t dst = subset->runs[ i ].dst + j;
+            unsigned int code = ( packed_row[ col / 4 ] >> ( 2 * ( col % 4 ) ) ) & 3;
+            subset->packed_buffer[ dst / 4 ] |= (unsigned char) ( code << ( 2 * ( dst % 4 ) ) );
+        }
+    }
+
+    return subset->packed_buffer;
+}
+
+/**
+ * Reads the next packed row for the typed decoders and computes the
+ * value of each packed code, see DosageScaling.
+ *
+ * @param bed_file Bed file.
+ * @param scaling How the genotypes are turned into dosages.
+ * @param missing_value The value of missing genotypes for BED_DOSAGE_RAW.
+ * @param packed_row The selected columns of the row are stored here.
+ * @param num_cols The number of genotypes in packed_row is stored here.
+ * @param table The value of each packed code is stored here.
+ *
+ * @return PIO_OK if the row could be read,
+ *         PIO_END if there are no more rows,
+ *         PIO_ERROR otherwise.
+ */
+static pio_status_t
+read_row_dosage_table(struct pio_bed_file_t *bed_file, enum DosageScaling scaling, double missing_value,
+                      const unsigned char **packed_row, size_t *num_cols, double table[4])
+{
+    size_t counts[ 4 ];
+    size_t num_observed;
+    double mean = 0.0;
+    double scale = 1.0;
+    pio_status_t status = bed_read_row_packed( bed_file, bed_file->read_buffer );
+    if( status != PIO_OK )
+    {
+        return status;
+    }
+
+    *packed_row = compact_row( bed_file, bed_file->read_buffer, num_cols );
+    table[ 0 ] = 0.0;
+    table[ 1 ] = missing_value;
+    table[ 2 ] = 1.0;
+    table[ 3 ] = 2.0;
+    if( scaling == BED_DOSAGE_RAW )
+    {
+        return PIO_OK;
+    }
+
+    libplinkio_count_snps_( *packed_row, *num_cols, counts );
+    num_observed = counts[ 0 ] + counts[ 2 ] + counts[ 3 ];
+    if( num_observed > 0 )
+    {
+        mean = ( counts[ 2 ] + 2.0 * counts[ 3 ] ) / num_observed;
+    }
+    table[ 1 ] = mean;
+    if( scaling == BED_DOSAGE_MEAN_IMPUTED )
+    {
+        return PIO_OK;
+    }
+
+    if( scaling == BED_DOSAGE_STANDARDIZED )
+    {
+        double variance = 0.0;
+        if( num_observed > 0 )
+        {
+            variance = ( counts[ 2 ] + 4.0 * counts[ 3 ] ) / num_observed - mean * mean;
+        }
+        scale = variance > 0.0 ? 1.0 / sqrt( variance ) : 0.0;
+    }
+    for(size_t i = 0; i < 4; i++)
+    {
+        table[ i ] = ( table[ i ] - mean ) * scale;
+    }
+
+    return PIO_OK;
+}
+
+pio_status_t
+bed_read_row_float(struct pio_bed_file_t *bed_file, float *buffer, enum DosageScaling scaling, double missing_value)
+{
+    const unsigned char *packed_row;
+    size_t num_cols;
+    double table[ 4 ];
+    float float_table[ 4 ];
+    pio_status_t status = read_row_dosage_table( bed_file, scaling, missing_value, &packed_row, &num_cols, table );
+    if( status != PIO_OK )
+    {
+        return status;
+    }
+
+    for(size_t i = 0; i < 4; i++)
+    {
+        float_table[ i ] = (float) table[ i ];
+    }
+    libplinkio_snp_kernel_( )->decode_f32( packed_row, buffer, num_cols, float_table );
+
+    return PIO_OK;
+}
+
+pio_status_t
+bed_read_row_double(struct pio_bed_file_t *bed_file, double *buffer, enum DosageScaling scaling, double missing_value)
+{
+    const unsigned char *packed_row;
+    size_t num_cols;
+    double table[ 4 ];
+    pio_status_t status = read_row_dosage_table( bed_file, scaling, missing_value, &packed_row, &num_cols, table );
+    if( status != PIO_OK )
+    {
+        return status;
+    }
+
+    libplinkio_snp_kernel_( )->decode_f64( packed_row, buffer, num_cols, table );
+
+    return PIO_OK;
+}
+
+pio_status_t
+bed_read_row_int8(struct pio_bed_file_t *bed_file, int8_t *buffer, int8_t missing_value)
+{
+    const int8_t table[ 4 ] = { 0, missing_value, 1, 2 };
+    const unsigned char *packed_row;
+    size_t num_cols;
+    pio_status_t status = bed_read_row_packed( bed_file, bed_file->read_buffer );
+    if( status != PIO_OK )
+    {
+        return status;
+    }
+
+    packed_row = compact_row( bed_file, bed_file->read_buffer, &num_cols );
+    libplinkio_snp_kernel_( )->decode_i8( packed_row, buffer, num_cols, table );
+
+    return PIO_OK;
+}
+
+pio_status_t
+bed_read_row(struct pio_bed_file_t *bed_file, snp_t *buffer)
+{
+    size_t row_size_bytes;
+    size_t bytes_read;
+
+    if( bed_file->view != NULL )
+    {
+        const unsigned char *packed_row;
+        pio_status_t status = view_advance( bed_file, &packed_row );
+        if( status == PIO_OK )
+        {
+            decode_row( bed_file, packed_row, buffer );
+        }
+
+        return status;
+    }
+
+    if( bed_file->prefetch != NULL )
+    {
+        const unsigned char *packed_row;
+        const snp_t *decoded_row;
+        pio_status_t status = prefetch_advance( bed_file, &packed_row, &decoded_row );
+        if( status == PIO_OK && decoded_row != NULL )
+        {
+            memcpy( buffer, decoded_row, bed_row_size( bed_file ) );
+        }
+        else if( status == PIO_OK )
+        {
+            decode_row( bed_file, packed_row, buffer );
+        }
+
+        return status;
+    }
+
+    if( bed_file->mapped_file != NULL )
+    {
+        const unsigned char *packed_row;
+        pio_status_t status = bed_read_row_mapped( bed_file, &packed_row );
+        if( status == PIO_OK )
+        {
+            decode_row( bed_file, packed_row, buffer );
+        }
+
+        return status;
+    }
+
+    if( feof( bed_file->fp ) != 0 || bed_file->cur_row >= bed_header_num_rows( &bed_file->header ) )
+    {
+        return PIO_END;
+    }
+
+    row_size_bytes = bed_header_row_size( &bed_file->header );
+    bytes_read = fread( bed_file->read_buffer, 
+                        1,
+                        row_size_bytes,
+                        bed_file->fp );
+    assert( bytes_read == row_size_bytes );
+
+    if( bytes_read != row_size_bytes )
+    {
+        return PIO_ERROR;
+    }
+
+    decode_row( bed_file, bed_file->read_buffer, buffer );
+    bed_file->cur_row++;
+    drop_consumed( bed_file );
+
+    return PIO_OK;
+}
+
+/**
+ * Reads consecutive rows into a matrix whose rows are stride bytes
+ * apart, and sets the bytes between the rows to missing.
+ *
+ * @param bed_file Bed file.
+ * @param max_rows The maximum number of rows to read.
+ * @param buffer The matrix to read into.
+ * @param stride The distance between rows, at least bed_row_size.
+ * @param rows_read The number of rows that were read is stored here.
+ *
+ * @return PIO_OK if at least one row could be read,
+ *         PIO_END if there are no more rows,
+ *         PIO_ERROR otherwise.
+ */
+static pio_status_t
+read_rows(struct pio_bed_file_t *bed_file, size_t max_rows, snp_t *buffer, size_t stride, size_t *rows_read)
+{
+    size_t decoded_row_size = bed_row_size( bed_file );
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    size_t chunk_size = bed_file->chunk_size != 0 ? bed_file->chunk_size : BED_DEFAULT_CHUNK_SIZE;
+    size_t rows_per_chunk = row_size_bytes != 0 && chunk_size / row_size_bytes > 0 ? chunk_size / row_size_bytes : 1;
+    size_t num_rows;
+
+    *rows_read = 0;
+    if( bed_file->cur_row >= bed_header_num_rows( &bed_file->header ) )
+    {
+        return PIO_END;
+    }
+
+    num_rows = bed_header_num_rows( &bed_file->header ) - bed_file->cur_row;
+    if( max_rows < num_rows )
+    {
+        num_rows = max_rows;
+    }
+
+    if( bed_file->prefetch != NULL || bed_file->view != NULL )
+    {
+        while( *rows_read < num_rows )
+        {
+            snp_t *row = buffer + *rows_read * stride;
+            if( bed_read_row( bed_file, row ) != PIO_OK )
+            {
+                return PIO_ERROR;
+            }
+            memset( row + decoded_row_size, 3, stride - decoded_row_size );
+            ( *rows_read )++;
+        }
+
+        return PIO_OK;
+    }
+
+    while( *rows_read < num_rows )
+    {
+        size_t chunk_rows = num_rows - *rows_read < rows_per_chunk ? num_rows - *rows_read : rows_per_chunk;
+        const unsigned char *packed_rows;
+
+        if( bed_file->mapped_file != NULL )
+        {
+            packed_rows = bed_file->mapped_file +
+                          bed_header_data_offset( &bed_file->header ) +
+                          bed_file->cur_row * row_size_bytes;
+        }
+        else
+        {
+            if( bed_file->chunk_buffer_size < chunk_rows * row_size_bytes &&
+                chunk_buffer( bed_file, rows_per_chunk * row_size_bytes ) == NULL )
+            {
+                return PIO_ERROR;
+            }
+
+            if( fread( bed_file->chunk_buffer, 1, chunk_rows * row_size_bytes, bed_file->fp ) != chunk_rows * row_size_bytes )
+            {
+                return PIO_ERROR;
+            }
+            packed_rows = bed_file->chunk_buffer;
+        }
+
+        for(size_t i = 0; i < chunk_rows; i++)
+        {
+            snp_t *row = buffer + ( *rows_read + i ) * stride;
+            decode_row( bed_file, packed_rows + i * row_size_bytes, row );
+            memset( row + decoded_row_size, 3, stride - decoded_row_size );
+        }
+
+        bed_file->cur_row += chunk_rows;
+        *rows_read += chunk_rows;
+        drop_consumed( bed_file );
+    }
+
+    return PIO_OK;
+}
+
+
+pio_status_t
+bed_read_rows(struct pio_bed_file_t *bed_file, size_t max_rows, snp_t *buffer, size_t *rows_read)
+{
+    return read_rows( bed_file, max_rows, buffer, bed_row_size( bed_file ), rows_read );
+}
+
+pio_status_t
+bed_read_rows_padded(struct pio_bed_file_t *bed_file, size_t max_rows, snp_t *buffer, size_t *rows_read)
+{
+    return read_rows( bed_file, max_rows, buffer, bed_row_stride( bed_file ), rows_read );
+}
+
+void
+bed_set_chunk_size(struct pio_bed_file_t *bed_file, size_t chunk_size)
+{
+    bed_file->chunk_size = chunk_size;
+}
+
+/**
+ * Rows of at most this many packed bytes are read by
+ * bed_read_row_at into a buffer on the stack, longer rows into a
+ * buffer allocated for the call, so that no shared buffer is
+ * needed. bed_write_row_at packs and writes rows in chunks of
+ * this size.
+ */
+#define BED_READ_AT_CHUNK_SIZE 4096
+
+pio_status_t
+bed_read_row_packed_at(struct pio_bed_file_t *bed_file, size_t row_index, unsigned char *packed_row)
+{
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    uint64_t offset;
+    int fd;
+
+    if( row_index >= bed_header_num_rows( &bed_file->header ) )
+    {
+        return PIO_END;
+    }
+
+    if( bed_file->view != NULL )
+    {
+        return view_read_row_at( bed_file, row_index, packed_row );
+    }
+
+    offset = bed_header_data_offset( &bed_file->header ) + (uint64_t) row_index * row_size_bytes;
+    if( bed_file->mapped_file != NULL )
+    {
+        memcpy( packed_row, bed_file->mapped_file + offset, row_size_bytes );
+        mask_trailing_bits( packed_row, bed_header_num_cols( &bed_file->header ) );
+        return PIO_OK;
+    }
+
+    fd = fileno( bed_file->fp );
+    if( fd == -1 || libplinkio_pread_( fd, packed_row, row_size_bytes, offset ) != 0 )
+    {
+        return PIO_ERROR;
+    }
+
+    mask_trailing_bits( packed_row, bed_header_num_cols( &bed_file->header ) );
+    return PIO_OK;
+}
+
+pio_status_t
+bed_read_row_at(struct pio_bed_file_t *bed_file, size_t row_index, snp_t *buffer)
+{
+    unsigned char chunk[ BED_READ_AT_CHUNK_SIZE ];
+    unsigned char *packed_row;
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    pio_status_t status = PIO_ERROR;
+    uint64_t offset;
+    int fd;
+
+    if( row_index >= bed_header_num_rows( &bed_file->header ) )
+    {
+        return PIO_END;
+    }
+
+    offset = bed_header_data_offset( &bed_file->header ) + (uint64_t) row_index * row_size_bytes;
+    if( bed_file->mapped_file != NULL && bed_file->view == NULL )
+    {
+        decode_row( bed_file, bed_file->mapped_file + offset, buffer );
+        return PIO_OK;
+    }
+
+    fd = fileno( bed_file->fp );
+    if( fd == -1 )
+    {
+        return PIO_ERROR;
+    }
+
+    /* The whole row is read at once, in a buffer of this call. */
+    packed_row = row_size_bytes <= BED_READ_AT_CHUNK_SIZE ? chunk : (unsigned char *) malloc( row_size_bytes );
+    if( packed_row == NULL )
+    {
+        return PIO_ERROR;
+    }
+    if( bed_file->view != NULL ? view_read_row_at( bed_file, row_index, packed_row ) == PIO_OK : libplinkio_pread_( fd, packed_row, row_size_bytes, offset ) == 0 )
+    {
+        decode_row( bed_file, packed_row, buffer );
+        status = PIO_OK;
+    }
+    if( packed_row != chunk )
+    {
+        free( packed_row );
+    }
+
+    return status;
+}
+
+pio_status_t
+bed_write_row_at(struct pio_bed_file_t *bed_file, size_t row_index, const snp_t *buffer)
+{
+    unsigned char chunk[ BED_READ_AT_CHUNK_SIZE ];
+    size_t num_cols = bed_header_num_cols( &bed_file->header );
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    uint64_t offset;
+    int fd;
+
+    if( !bed_file->sized || row_index >= bed_header_num_rows( &bed_file->header ) )
+    {
+        return PIO_ERROR;
+    }
+
+    /* The row is packed a chunk at a time, check it before the first write. */
+    if( check_snps( buffer, num_cols ) != PIO_OK )
+    {
+        return PIO_ERROR;
+    }
+
+    fd = fileno( bed_file->fp );
+    if( fd == -1 )
+    {
+        return PIO_ERROR;
+    }
+
+    offset = bed_header_data_offset( &bed_file->header ) + (uint64_t) row_index * row_size_bytes;
+    for(size_t done = 0; done < row_size_bytes; done += BED_READ_AT_CHUNK_SIZE)
+    {
+        size_t chunk_bytes = row_size_bytes - done < BED_READ_AT_CHUNK_SIZE ? row_size_bytes - done : BED_READ_AT_CHUNK_SIZE;
+        size_t first_col = done * 4;
+        size_t chunk_cols = num_cols - first_col < chunk_bytes * 4 ? num_cols - first_col : chunk_bytes * 4;
+
+        if( pack_snps( buffer + first_col, chunk, chunk_cols ) != PIO_OK ||
+            libplinkio_pwrite_( fd, chunk, chunk_bytes, offset + done ) != 0 )
+        {
+            return PIO_ERROR;
+        }
+    }
+
+    return PIO_OK;
+}
+
+/**
+ * Allocates the tile of bed_write_col.
+ *
+ * @param bed_file Bed file created with bed_create_sized.
+ *
+ * @return The column writer, or NULL if it could not be allocated.
+ */
+static libplinkio_bed_col_writer_private_t *
+create_col_writer(struct pio_bed_file_t *bed_file)
+{
+    size_t num_rows = bed_header_num_rows( &bed_file->header );
+    size_t num_cols = bed_header_num_cols( &bed_file->header );
+    size_t col_size_bytes = ( num_rows + 3 ) / 4;
+    size_t tile_size = bed_file->tile_size != 0 ? bed_file->tile_size : BED_DEFAULT_TILE_SIZE;
+    libplinkio_bed_col_writer_private_t *writer;
+
+    writer = (libplinkio_bed_col_writer_private_t *) malloc( sizeof( libplinkio_bed_col_writer_private_t ) );
+    if( writer == NULL )
+    {
+        return NULL;
+    }
+
+    /* A tile covers whole bytes of each row, and at most all of them. */
+    writer->tile_cols = col_size_bytes != 0 ? tile_size / col_size_bytes : 0;
+    writer->tile_cols -= writer->tile_cols % 4;
+    if( writer->tile_cols < 4 )
+    {
+        writer->tile_cols = 4;
+    }
+    if( writer->tile_cols > ( num_cols + 3 ) / 4 * 4 )
+    {
+        writer->tile_cols = ( num_cols + 3 ) / 4 * 4;
+    }
+    writer->next_col = 0;
+    writer->num_cols = 0;
+    writer->cols = (unsigned char *) malloc( writer->tile_cols * col_size_bytes + 1 );
+    writer->rows = (unsigned char *) malloc( num_rows * ( writer->tile_cols / 4 ) + 1 );
+    if( writer->cols == NULL || writer->rows == NULL )
+    {
+        free( writer->cols );
+        free( writer->rows );
+        free( writer );
+        return NULL;
+    }
+
+    return writer;
+}
+
+/**
+ * Frees the tile of bed_write_col, without writing it.
+ *
+ * @param bed_file Bed file.
+ */
+static void
+free_col_writer(struct pio_bed_file_t *bed_file)
+{
+    libplinkio_bed_col_writer_private_t *writer = (libplinkio_bed_col_writer_private_t *) bed_file->col_writer;
+    if( writer == NULL )
+    {
+        return;
+    }
+
+    free( writer->cols );
+    free( writer->rows );
+    free( writer );
+    bed_file->col_writer = NULL;
+}
+
+/**
+ * Writes the columns that bed_write_col has buffered. Columns share
+ * the bytes of the rows 4 at a time, so unless final is set, the
+ * columns after the last multiple of 4 are kept for the next flush.
+ *
+ * @param bed_file Bed file.
+ * @param final Non-zero if no more columns will be written, in
+ *              which case the last byte of each row is written
+ *              partially filled.
+ *
+ * @return PIO_OK if the columns could be written, PIO_ERROR otherwise.
+ */
+static pio_status_t
+flush_cols(struct pio_bed_file_t *bed_file, int final)
+{
+    libplinkio_bed_col_writer_private_t *writer = (libplinkio_bed_col_writer_private_t *) bed_file->col_writer;
+    size_t num_rows = bed_header_num_rows( &bed_file->header );
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    size_t col_size_bytes = ( num_rows + 3 ) / 4;
+    size_t num_flushed;
+    size_t tile_row_bytes;
+    size_t first_col;
+    uint64_t offset;
+    int fd;
+
+    if( writer == NULL )
+    {
+        return PIO_OK;
+    }
+    num_flushed = final ? writer->num_cols : writer->num_cols - writer->num_cols % 4;
+    if( num_flushed == 0 )
+    {
+        return PIO_OK;
+    }
+
+    fd = fileno( bed_file->fp );
+    if( fd == -1 )
+    {
+        return PIO_ERROR;
+    }
+
+    first_col = writer->next_col - writer->num_cols;
+    tile_row_bytes = ( num_flushed + 3 ) / 4;
+    transpose_packed( writer->cols, col_size_bytes, num_flushed, num_rows, writer->rows, writer->tile_cols / 4 );
+
+    offset = bed_header_data_offset( &bed_file->header ) + first_col / 4;
+    if( tile_row_bytes == row_size_bytes && writer->tile_cols / 4 == row_size_bytes )
+    {
+        /* The tile holds whole rows, which are contiguous in the file. */
+        if( libplinkio_pwrite_( fd, writer->rows, num_rows * row_size_bytes, offset ) != 0 )
+        {
+            return PIO_ERROR;
+        }
+    }
+    else
+    {
+        for(size_t i = 0; i < num_rows; i++)
+        {
+            if( libplinkio_pwrite_( fd, writer->rows + i * ( writer->tile_cols / 4 ), tile_row_bytes, offset + (uint64_t) i * row_size_bytes ) != 0 )
+            {
+                return PIO_ERROR;
+            }
+        }
+    }
+
+    /* The kept columns start the next tile, on a byte of the rows. */
+    memmove( writer->cols, writer->cols + num_flushed * col_size_bytes, ( writer->num_cols - num_flushed ) * col_size_bytes );
+    writer->num_cols -= num_flushed;
+    return PIO_OK;
+}
+
+pio_status_t
+bed_flush_cols(struct pio_bed_file_t *bed_file)
+{
+    libplinkio_bed_col_writer_private_t *writer = (libplinkio_bed_col_writer_private_t *) bed_file->col_writer;
+    return flush_cols( bed_file, writer != NULL && writer->next_col == bed_header_num_cols( &bed_file->header ) );
+}
+
+pio_status_t
+bed_write_col(struct pio_bed_file_t *bed_file, const snp_t *buffer)
+{
+    libplinkio_bed_col_writer_private_t *writer = (libplinkio_bed_col_writer_private_t *) bed_file->col_writer;
+    size_t num_rows = bed_header_num_rows( &bed_file->header );
+
+    if( !bed_file->sized )
+    {
+        return PIO_ERROR;
+    }
+    if( writer == NULL )
+    {
+        writer = create_col_writer( bed_file );
+        if( writer == NULL )
+        {
+            return PIO_ERROR;
+        }
+        bed_file->col_writer = writer;
+    }
+    if( writer->next_col >= bed_header_num_cols( &bed_file->header ) )
+    {
+        return PIO_ERROR;
+    }
+
+    if( pack_snps( buffer, writer->cols + writer->num_cols * ( ( num_rows + 3 ) / 4 ), num_rows ) != PIO_OK )
+    {
+        return PIO_ERROR;
+    }
+    writer->num_cols++;
+    writer->next_col++;
+
+    if( writer->num_cols == writer->tile_cols || writer->next_col == bed_header_num_cols( &bed_file->header ) )
+    {
+        return bed_flush_cols( bed_file );
+    }
+
+    return PIO_OK;
+}
+
+void
+bed_set_col_tile_size(struct pio_bed_file_t *bed_file, size_t tile_size)
+{
+    bed_file->tile_size = tile_size;
+}
+
+/**
+ * Orders size_t values, or pairs of size_t by their first element,
+ * for qsort.
+ */
+static int
+compare_rows(const void *a, const void *b)
+{
+    size_t row_a = *(const size_t *) a;
+    size_t row_b = *(const size_t *) b;
+
+    return ( row_a > row_b ) - ( row_a < row_b );
+}
+
+pio_status_t
+bed_row_subset_init(struct bed_row_subset_t *subset, struct pio_bed_file_t *bed_file, const size_t *rows, size_t num_rows, enum RowOrder order)
+{
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    size_t chunk_size = bed_file->chunk_size != 0 ? bed_file->chunk_size : BED_DEFAULT_CHUNK_SIZE;
+
+    memset( subset, 0, sizeof( *subset ) );
+    if( bed_file->view != NULL )
+    {
+        return PIO_ERROR;
+    }
+    for(size_t i = 0; i < num_rows; i++)
+    {
+        if( rows[ i ] >= bed_header_num_rows( &bed_file->header ) )
+        {
+            return PIO_ERROR;
+        }
+    }
+
+    subset->bed_file = bed_file;
+    subset->num_rows = num_rows;
+    subset->file_order = order == BED_FILE_ORDER;
+    subset->window_capacity = row_size_bytes != 0 && chunk_size / row_size_bytes > 0 ? chunk_size / row_size_bytes : 1;
+    if( subset->window_capacity > num_rows && num_rows > 0 )
+    {
+        subset->window_capacity = num_rows;
+    }
+
+    subset->rows = (size_t *) malloc( sizeof( size_t ) * ( num_rows > 0 ? num_rows : 1 ) );
+    subset->sorted = (size_t *) malloc( 2 * sizeof( size_t ) * subset->window_capacity );
+    subset->window = (unsigned char *) malloc( subset->window_capacity * row_size_bytes + 1 );
+    subset->span_buffer = (unsigned char *) malloc( subset->window_capacity * row_size_bytes + 1 );
+    if( subset->rows == NULL || subset->sorted == NULL || subset->window == NULL || subset->span_buffer == NULL )
+    {
+        bed_row_subset_close( subset );
+        return PIO_ERROR;
+    }
+
+    memcpy( subset->rows, rows, sizeof( size_t ) * num_rows );
+    if( subset->file_order )
+    {
+        qsort( subset->rows, num_rows, sizeof( size_t ), compare_rows );
+    }
+
+    return PIO_OK;
+}
+
+/**
+ * Reads the packed rows of the next window of the subset. The rows
+ * of the window are sorted, and rows that are close enough are read
+ * with one pread together with the rows between them.
+ *
+ * @param subset The iterator.
+ *
+ * @return PIO_OK if the rows could be read, PIO_ERROR otherwise.
+ */
+static pio_status_t
+fill_window(struct bed_row_subset_t *subset)
+{
+    struct pio_bed_file_t *bed_file = subset->bed_file;
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    uint64_t data_offset = bed_header_data_offset( &bed_file->header );
+    size_t *sorted = subset->sorted;
+    size_t num_window_rows;
+    int fd;
+
+    subset->window_start = subset->next;
+    subset->window_end = subset->num_rows - subset->next < subset->window_capacity ? subset->num_rows : subset->next + subset->window_capacity;
+    num_window_rows = subset->window_end - subset->window_start;
+
+    for(size_t i = 0; i < num_window_rows; i++)
+    {
+        sorted[ 2 * i ] = subset->rows[ subset->window_start + i ];
+        sorted[ 2 * i + 1 ] = i;
+    }
+    if( !subset->file_order )
+    {
+        qsort( sorted, num_window_rows, 2 * sizeof( size_t ), compare_rows );
+    }
+
+    if( bed_file->mapped_file != NULL )
+    {
+        for(size_t i = 0; i < num_window_rows; i++)
+        {
+            memcpy( subset->window + sorted[ 2 * i + 1 ] * row_size_bytes,
+                    bed_file->mapped_file + data_offset + sorted[ 2 * i ] * row_size_bytes,
+                    row_size_bytes );
+        }
+
+        return PIO_OK;
+    }
+
+    fd = fileno( bed_file->fp );
+    if( fd == -1 )
+    {
+        return PIO_ERROR;
+    }
+
+    for(size_t first = 0, last = 0; first < num_window_rows; first = last + 1)
+    {
+        size_t first_row = sorted[ 2 * first ];
+        size_t num_span_rows;
+
+        /* Extend the read while the span fits and the gaps are small. */
+        for(last = first; last + 1 < num_window_rows; last++)
+        {
+            size_t prev_row = sorted[ 2 * last ];
+            size_t next_row = sorted[ 2 * ( last + 1 ) ];
+            if( next_row - first_row + 1 > subset->window_capacity )
+            {
+                break;
+            }
+            if( next_row > prev_row + 1 && ( next_row - prev_row - 1 ) * row_size_bytes > BED_MAX_GAP_SIZE )
+            {
+                break;
+            }
+        }
+
+        num_span_rows = sorted[ 2 * last ] - first_row + 1;
+        if( libplinkio_pread_( fd, subset->span_buffer, num_span_rows * row_size_bytes, data_offset + (uint64_t) first_row * row_size_bytes ) != 0 )
+        {
+            return PIO_ERROR;
+        }
+
+        for(size_t k = first; k <= last; k++)
+        {
+            memcpy( subset->window + sorted[ 2 * k + 1 ] * row_size_bytes,
+                    subset->span_buffer + ( sorted[ 2 * k ] - first_row ) * row_size_bytes,
+                    row_size_bytes );
+        }
+    }
+
+    return PIO_OK;
+}
+
+/**
+ * Returns the packed data of the next row of the subset, reading
+ * the next window if needed.
+ *
+ * @param subset The iterator.
+ * @param packed_row The address of the row is stored here.
+ * @param row_index The index of the row is stored here, unless NULL.
+ *
+ * @return PIO_OK, PIO_END or PIO_ERROR.
+ */
+static pio_status_t
+row_subset_advance(struct bed_row_subset_t *subset, const unsigned char **packed_row, size_t *row_index)
+{
+    if( subset->next >= subset->num_rows )
+    {
+        return PIO_END;
+    }
+    if( subset->next >= subset->window_end && fill_window( subset ) != PIO_OK )
+    {
+        return PIO_ERROR;
+    }
+
+    *packed_row = subset->window + ( subset->next - subset->window_start ) * bed_header_row_size( &subset->bed_file->header );
+    if( row_index != NULL )
+    {
+        *row_index = subset->rows[ subset->next ];
+    }
+    subset->next++;
+
+    return PIO_OK;
+}
+
+pio_status_t
+bed_row_subset_next(struct bed_row_subset_t *subset, snp_t *buffer, size_t *row_index)
+{
+    const unsigned char *packed_row;
+    pio_status_t status = row_subset_advance( subset, &packed_row, row_index );
+    if( status == PIO_OK )
+    {
+        decode_row( subset->bed_file, packed_row, buffer );
+    }
 
-    fclose( output_file );
+    return status;
+}
 
-    return PIO_OK;
+pio_status_t
+bed_row_subset_next_packed(struct bed_row_subset_t *subset, unsigned char *packed_row, size_t *row_index)
+{
+    const unsigned char *window_row;
+    pio_status_t status = row_subset_advance( subset, &window_row, row_index );
+    if( status == PIO_OK )
+    {
+        memcpy( packed_row, window_row, bed_header_row_size( &subset->bed_file->header ) );
+        mask_trailing_bits( packed_row, bed_header_num_cols( &subset->bed_file->header ) );
+    }
 
-error:
-    if (output_file != NULL) fclose(output_file);
-    return PIO_ERROR;
+    return status;
+}
+
+void
+bed_row_subset_close(struct bed_row_subset_t *subset)
+{
+    if( subset->rows != NULL )
+    {
+        free( subset->rows );
+    }
+    if( subset->sorted != NULL )
+    {
+        free( subset->sorted );
+    }
+    if( subset->window != NULL )
+    {
+        free( subset->window );
+    }
+    if( subset->span_buffer != NULL )
+    {
+        free( subset->span_buffer );
+    }
+    memset( subset, 0, sizeof( *subset ) );
 }
 
 pio_status_t
-bed_open(struct pio_bed_file_t *bed_file, const char *path, size_t num_loci, size_t num_samples)
+bed_skip_row(struct pio_bed_file_t *bed_file)
 {
     size_t row_size_bytes;
-    FILE *bed_fp;
-   
-    memset( bed_file, 0, sizeof( *bed_file ) );
-    bed_fp = fopen( path, "rb" );
-    if( bed_fp == NULL )
+
+    if( feof( bed_file->fp ) != 0 || bed_file->cur_row >= bed_header_num_rows( &bed_file->header ) )
     {
-        return PIO_ERROR;
+        return PIO_END;
     }
 
-    bed_file->fp = bed_fp;
-    bed_file->header = bed_header_init( num_loci, num_samples );
-    if( parse_header( bed_file ) != PIO_OK )
+    if( bed_file->prefetch != NULL )
+    {
+        const unsigned char *packed_row;
+        const snp_t *decoded_row;
+        return prefetch_advance( bed_file, &packed_row, &decoded_row );
+    }
+
+    /* The window is read when a row of it is. */
+    if( bed_file->view != NULL )
     {
+        bed_file->cur_row++;
+        return PIO_OK;
+    }
+
+    row_size_bytes = bed_header_row_size( &bed_file->header );
+    if( bed_file->mapped_file == NULL && fseek( bed_file->fp, (long)row_size_bytes, SEEK_CUR ) ) {
         return PIO_ERROR;
     }
- 
-    row_size_bytes = bed_header_row_size( &bed_file->header ); 
-    bed_file->read_buffer = ( snp_t * ) malloc( row_size_bytes );
-    bed_file->cur_row = 0;
+
+    bed_file->cur_row++;
+    drop_consumed( bed_file );
 
     return PIO_OK;
 }
 
 pio_status_t
-bed_create(struct pio_bed_file_t *bed_file, const char *path, size_t num_samples)
+bed_set_prefetch(struct pio_bed_file_t *bed_file, size_t depth, size_t block_size, int decoded)
 {
-    FILE *bed_fp;
-    unsigned char header_bytes[3];
-    size_t length;
-    size_t row_size_bytes;
-   
-    memset( bed_file, 0, sizeof( *bed_file ) );
-    bed_fp = fopen( path, "wb" );
-    if( bed_fp == NULL )
+    libplinkio_bed_prefetch_private_t *prefetch;
+
+    if( free_prefetch( bed_file ) != PIO_OK )
+    {
+        return PIO_ERROR;
+    }
+    if( depth == 0 )
+    {
+        return PIO_OK;
+    }
+    if( bed_file->view != NULL )
     {
         return PIO_ERROR;
     }
 
-    bed_file->fp = bed_fp;
-    bed_file->header = bed_header_init( 0, num_samples );
-    bed_header_to_bytes( &bed_file->header, header_bytes, &length );
-    if( fwrite( header_bytes, sizeof( unsigned char ), length, bed_fp ) <= 0 )
+    prefetch = (libplinkio_bed_prefetch_private_t *) malloc( sizeof( libplinkio_bed_prefetch_private_t ) );
+    if( prefetch == NULL )
     {
-        fclose( bed_fp );
         return PIO_ERROR;
     }
-    
-    row_size_bytes = bed_header_row_size( &bed_file->header );
-    bed_file->read_buffer = ( snp_t * ) malloc( row_size_bytes );
-    bed_file->cur_row = 0;
+    memset( prefetch, 0, sizeof( *prefetch ) );
+    prefetch->depth = depth;
+    prefetch->block_size = block_size != 0 ? block_size : BED_DEFAULT_CHUNK_SIZE;
+    prefetch->decoded = decoded != 0;
+    bed_file->prefetch = prefetch;
 
-    return PIO_OK;
+    return restart_prefetch( bed_file );
 }
 
 pio_status_t
-bed_write_row(struct pio_bed_file_t *bed_file, const snp_t *buffer)
+bed_set_access_pattern(struct pio_bed_file_t *bed_file, int pattern)
 {
-    pack_snps( buffer, bed_file->read_buffer, bed_header_num_cols( &bed_file->header ) );
-    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    int known = BED_ACCESS_SEQUENTIAL | BED_ACCESS_RANDOM | BED_ACCESS_DONTNEED_CONSUMED;
+    libplinkio_advice_private_t advice = LIBPLINKIO_ADVICE_NORMAL_;
 
-    size_t bytes_written = fwrite( bed_file->read_buffer, sizeof( unsigned char ), row_size_bytes, bed_file->fp );
-
-    if( bytes_written > 0 )
+    if( ( pattern & ~known ) != 0 || ( ( pattern & BED_ACCESS_SEQUENTIAL ) != 0 && ( pattern & BED_ACCESS_RANDOM ) != 0 ) )
     {
-        if( bed_file->header.snp_order == BED_ONE_LOCUS_PER_ROW ) {
-            bed_file->header.num_loci += 1;
-        } else {
-            bed_file->header.num_samples += 1;
-        }
-        bed_file->cur_row += 1;
+        return PIO_ERROR;
+    }
 
-        return PIO_OK;
+    if( ( pattern & BED_ACCESS_SEQUENTIAL ) != 0 )
+    {
+        advice = LIBPLINKIO_ADVICE_SEQUENTIAL_;
     }
-    else
+    else if( ( pattern & BED_ACCESS_RANDOM ) != 0 )
     {
-        return PIO_ERROR;
+        advice = LIBPLINKIO_ADVICE_RANDOM_;
     }
+
+    bed_file->access_pattern = pattern;
+    bed_file->dropped_offset = 0;
+
+    /* Only a hint, the rows are read the same way if it is refused. */
+    advise_range( bed_file, 0, 0, advice );
+
+    return PIO_OK;
 }
 
 pio_status_t
-bed_read_row(struct pio_bed_file_t *bed_file, snp_t *buffer)
+bed_will_need_rows(struct pio_bed_file_t *bed_file, size_t first_row, size_t num_rows)
 {
-    size_t row_size_bytes;
-    size_t bytes_read;
+    size_t row_size_bytes = bed_header_row_size( &bed_file->header );
+    size_t total_rows = bed_header_num_rows( &bed_file->header );
 
-    if( feof( bed_file->fp ) != 0 || bed_file->cur_row >= bed_header_num_rows( &bed_file->header ) )
+    if( first_row > total_rows || num_rows > total_rows - first_row )
     {
-        return PIO_END;
+        return PIO_ERROR;
     }
 
-    row_size_bytes = bed_header_row_size( &bed_file->header );
-    bytes_read = fread( bed_file->read_buffer, 
-                        1,
-                        row_size_bytes,
-                        bed_file->fp );
-    assert( bytes_read == row_size_bytes );
-
-    if( bytes_read != row_size_bytes )
+    /* The rows of a transposed file are spread over all of it. */
+    if( num_rows == 0 || bed_file->view != NULL )
     {
-        return PIO_ERROR;
+        return PIO_OK;
     }
 
-    unpack_snps( bed_file->read_buffer, buffer, bed_header_num_cols( &bed_file->header ) );
-    bed_file->cur_row++;
+    advise_range( bed_file,
+                  bed_header_data_offset( &bed_file->header ) + first_row * row_size_bytes,
+                  num_rows * row_size_bytes,
+                  LIBPLINKIO_ADVICE_WILLNEED_ );
 
     return PIO_OK;
 }
 
 pio_status_t
-bed_skip_row(struct pio_bed_file_t *bed_file)
+bed_set_col_subset(struct pio_bed_file_t *bed_file, const size_t *cols, size_t num_cols)
 {
-    size_t row_size_bytes;
+    size_t total_cols = bed_header_num_cols( &bed_file->header );
+    libplinkio_bed_col_subset_private_t *subset = NULL;
+    size_t num_runs = 0;
 
-    if( feof( bed_file->fp ) != 0 || bed_file->cur_row >= bed_header_num_rows( &bed_file->header ) )
+    if( cols == NULL )
     {
-        return PIO_END;
+        stop_prefetch( bed_file );
+        free_col_subset( bed_file );
+        return restart_prefetch( bed_file );
     }
 
-    row_size_bytes = bed_header_row_size( &bed_file->header );
-    if( fseek( bed_file->fp, (long)row_size_bytes, SEEK_CUR ) ) {
+    for(size_t i = 0; i < num_cols; i++)
+    {
+        if( cols[ i ] >= total_cols )
+        {
+            return PIO_ERROR;
+        }
+        if( i == 0 || cols[ i ] != cols[ i - 1 ] + 1 )
+        {
+            num_runs++;
+        }
+    }
+
+    subset = (libplinkio_bed_col_subset_private_t *) malloc( sizeof( libplinkio_bed_col_subset_private_t ) );
+    if( subset == NULL )
+    {
         return PIO_ERROR;
     }
+    subset->num_cols = num_cols;
+    subset->num_runs = 0;
+    subset->runs = NULL;
+    subset->packed_buffer = NULL;
+    if( num_runs > 0 )
+    {
+        subset->runs = (libplinkio_bed_col_run_private_t *) malloc( sizeof( libplinkio_bed_col_run_private_t ) * num_runs );
+        subset->packed_buffer = (unsigned char *) malloc( ( num_cols + 3 ) / 4 );
+        if( subset->runs == NULL || subset->packed_buffer == NULL )
+        {
+            if( subset->runs != NULL )
+            {
+                free( subset->runs );
+            }
+            if( subset->packed_buffer != NULL )
+            {
+                free( subset->packed_buffer );
+            }
+            free( subset );
+            return PIO_ERROR;
+        }
+    }
 
-    bed_file->cur_row++;
+    for(size_t i = 0; i < num_cols; i++)
+    {
+        if( i > 0 && cols[ i ] == cols[ i - 1 ] + 1 )
+        {
+            subset->runs[ subset->num_runs - 1 ].length++;
+            continue;
+        }
+        subset->runs[ subset->num_runs ].src = cols[ i ];
+        subset->runs[ subset->num_runs ].dst = i;
+        subset->runs[ subset->num_runs ].length = 1;
+        subset->num_runs++;
+    }
 
-    return PIO_OK;
+    /* Decoded rows in the ring have the old columns. */
+    stop_prefetch( bed_file );
+    free_col_subset( bed_file );
+    bed_file->col_subset = subset;
+
+    return restart_prefetch( bed_file );
 }
 
 size_t
 bed_row_size(struct pio_bed_file_t *bed_file)
 {
+    if( bed_file->col_subset != NULL )
+    {
+        return sizeof( snp_t ) * ( (libplinkio_bed_col_subset_private_t *) bed_file->col_subset )->num_cols;
+    }
+
     return sizeof( snp_t ) * bed_header_num_cols( &bed_file->header );
 }
 
+size_t
+bed_row_stride(struct pio_bed_file_t *bed_file)
+{
+    size_t row_size = bed_row_size( bed_file );
+    return ( row_size + BED_ROW_ALIGNMENT - 1 ) / BED_ROW_ALIGNMENT * BED_ROW_ALIGNMENT;
+}
+
+snp_t *
+bed_row_alloc(struct pio_bed_file_t *bed_file)
+{
+    return bed_matrix_alloc( bed_file, 1 );
+}
+
+snp_t *
+bed_matrix_alloc(struct pio_bed_file_t *bed_file, size_t num_rows)
+{
+    size_t stride = bed_row_stride( bed_file );
+    size_t size;
+    snp_t *buffer;
+
+    if( stride != 0 && num_rows > SIZE_MAX / stride )
+    {
+        return NULL;
+    }
+    size = num_rows * stride;
+    buffer = (snp_t *) libplinkio_aligned_alloc_( size, BED_ROW_ALIGNMENT );
+    if( buffer != NULL )
+    {
+        memset( buffer, 3, size );
+    }
+
+    return buffer;
+}
+
+void
+bed_buffer_free(snp_t *buffer)
+{
+    libplinkio_aligned_free_( buffer );
+}
+
+const char *
+bed_unpack_kernel(void)
+{
+    return libplinkio_snp_kernel_( )->name;
+}
+
 size_t
 bed_num_snps_per_row(struct pio_bed_file_t *bed_file)
 {
@@ -401,20 +2648,50 @@ bed_reset_row(struct pio_bed_file_t *bed_file)
 {
     fseek( bed_file->fp, (long)bed_header_data_offset( &bed_file->header ), SEEK_SET );
     bed_file->cur_row = 0;
+    bed_file->dropped_offset = 0;
+
+    stop_prefetch( bed_file );
+    restart_prefetch( bed_file );
 }
 
-void
+pio_status_t
 bed_close(struct pio_bed_file_t *bed_file)
 {
+    pio_status_t status;
+
+    /* The prefetch thread may still be reading from the mapping. */
+    free_prefetch( bed_file );
+    status = flush_cols( bed_file, 1 );
+    free_col_writer( bed_file );
+    if( bed_file->mapped_file != NULL )
+    {
+        libplinkio_munmap_( (void *) bed_file->mapped_file, (libplinkio_mmap_state_private_t *) bed_file->mmap_state );
+        free( bed_file->mmap_state );
+        bed_file->mapped_file = NULL;
+        bed_file->mmap_state = NULL;
+    }
+    free_col_subset( bed_file );
+    free_view( bed_file );
     if( bed_file->fp == NULL )
     {
-        return;
+        return status;
     }
 
-    fclose( bed_file->fp );
+    if( fclose( bed_file->fp ) != 0 )
+    {
+        status = PIO_ERROR;
+    }
     free( bed_file->read_buffer );
+    if( bed_file->chunk_buffer != NULL )
+    {
+        free( bed_file->chunk_buffer );
+    }
     bed_file->fp = NULL;
     bed_file->read_buffer = NULL;
+    bed_file->chunk_buffer = NULL;
+    bed_file->chunk_buffer_size = 0;
+
+    return status;
 }
 
 /**
@@ -424,15 +2701,14 @@ bed_close(struct pio_bed_file_t *bed_file)
  * @param transposed_fd Output file descriptor.
  * @param num_loci The number of loci.
  * @param num_samples The number of samples.
+ * @param num_threads The number of threads, see transpose_rows.
  *
  * @return Returns PIO_OK if the file could be transposed, PIO_ERROR otherwise.
  */
 pio_status_t
-libplinkio_bed_transpose_fd_(const int original_fd, const int transposed_fd, size_t num_loci, size_t num_samples)
+libplinkio_bed_transpose_fd_(const int original_fd, const int transposed_fd, size_t num_loci, size_t num_samples, size_t num_threads)
 {
     unsigned char* mapped_file = NULL;
-    int dup_fd = -1;
-    FILE* output_file = NULL;
     libplinkio_mmap_state_private_t mmap_stats = { 0 };
 
     if(original_fd < 0) goto error;
@@ -443,13 +2719,6 @@ libplinkio_bed_transpose_fd_(const int original_fd, const int transposed_fd, siz
     /* Clear size of file, otherwise we might have trailing bytes */
     if(libplinkio_ftruncate_(transposed_fd, 0) == -1) goto error;
 
-    // Open stream
-    dup_fd = dup(transposed_fd);
-    if (dup_fd == -1) goto error;
-    output_file = fdopen(dup_fd, "wb");
-    if (output_file == NULL) goto error;
-    dup_fd = -1;
-
     struct bed_header_t header = bed_header_init2( num_loci, num_samples, mapped_file );
     size_t original_num_rows = bed_header_num_rows( &header );
     size_t original_num_cols = bed_header_num_cols( &header );
@@ -460,34 +2729,39 @@ libplinkio_bed_transpose_fd_(const int original_fd, const int transposed_fd, siz
     bed_header_transpose( &header );
     bed_header_to_bytes( &header, byte_header, &byte_header_length );
     
-    if( fwrite( byte_header, sizeof( unsigned char ), byte_header_length, output_file ) != byte_header_length ) goto error;
+    if( libplinkio_pwrite_( transposed_fd, byte_header, byte_header_length, 0 ) != 0 ) goto error;
     
-    /* Transpose data */
-    transpose_rows(
+    /* Transpose data, the stripes are written at their offsets */
+    if (transpose_rows(
         mapped_file + byte_header_length,
         original_num_rows,
         original_num_cols,
-        output_file
-    );
+        transposed_fd,
+        byte_header_length,
+        num_threads
+    ) != PIO_OK) goto error;
 
     /* Release alloacted resources */
     if (libplinkio_munmap_(mapped_file, &mmap_stats) != 0) {
         mapped_file = NULL;
         goto error;
     }
-    fclose(output_file);
 
     return PIO_OK;
 
 error:
-    if (dup_fd != -1) close(dup_fd);
-    if (output_file != NULL) fclose(output_file);
     if (mapped_file != NULL) libplinkio_munmap_(mapped_file, &mmap_stats);
     return PIO_ERROR;
 }
 
 pio_status_t
 bed_transpose(const char *original_path, const char *transposed_path, size_t num_loci, size_t num_samples)
+{
+    return bed_transpose_threads( original_path, transposed_path, num_loci, num_samples, 1 );
+}
+
+pio_status_t
+bed_transpose_threads(const char *original_path, const char *transposed_path, size_t num_loci, size_t num_samples, size_t num_threads)
 {
     int original_fd = -1;
     int transposed_fd = -1;
@@ -507,7 +2781,7 @@ bed_transpose(const char *original_path, const char *transposed_path, size_t num
     if( transposed_fd == -1 ) goto error;
 
     /* Transpose */
-    if (libplinkio_bed_transpose_fd_(original_fd, transposed_fd, num_loci, num_samples) != PIO_OK) goto error;
+    if (libplinkio_bed_transpose_fd_(original_fd, transposed_fd, num_loci, num_samples, num_threads) != PIO_OK) goto error;
 
     close(transposed_fd);
     close(original_fd);
@@ -519,6 +2793,181 @@ error:
     return PIO_ERROR;
 }
 
+/**
+ * Reads the stripes of rows of original_fd, transposes each into a
+ * run of num_cols columns of at most band_rows / 4 bytes and writes
+ * the runs one after another to run_fd from run_offset on.
+ *
+ * @return PIO_OK if all runs could be written, PIO_ERROR otherwise.
+ */
+static pio_status_t
+write_transposed_runs(int original_fd, uint64_t data_offset, size_t num_rows, size_t num_cols, size_t band_rows, int run_fd, uint64_t run_offset, uint64_t *bytes_done, uint64_t bytes_total, bed_transpose_progress_t progress, void *user_data)
+{
+    size_t num_bytes_per_row = ( num_cols + 3 ) / 4;
+    unsigned char *band = (unsigned char *) malloc( band_rows * num_bytes_per_row + 1 );
+    unsigned char *run = (unsigned char *) malloc( num_cols * ( band_rows / 4 ) + 1 );
+    if( band == NULL || run == NULL ) goto error;
+
+    for(size_t i = 0; i < num_rows; i += band_rows)
+    {
+        size_t rows = num_rows - i < band_rows ? num_rows - i : band_rows;
+        size_t run_size = num_cols * ( ( rows + 3 ) / 4 );
+        if( libplinkio_pread_( original_fd, band, rows * num_bytes_per_row, data_offset + (uint64_t) i * num_bytes_per_row ) != 0 ) goto error;
+
+        transpose_packed( band, num_bytes_per_row, rows, num_cols, run, ( rows + 3 ) / 4 );
+        if( libplinkio_pwrite_( run_fd, run, run_size, run_offset + (uint64_t) num_cols * ( i / 4 ) ) != 0 ) goto error;
+
+        *bytes_done += run_size;
+        if( progress != NULL )
+        {
+            progress( user_data, *bytes_done, bytes_total );
+        }
+    }
+
+    free( band );
+    free( run );
+    return PIO_OK;
+
+error:
+    free( band );
+    free( run );
+    return PIO_ERROR;
+}
+
+/**
+ * Reads the same columns from each run written by
+ * write_transposed_runs and writes them as whole rows of
+ * transposed_fd, group_cols rows at a time.
+ *
+ * @return PIO_OK if all rows could be written, PIO_ERROR otherwise.
+ */
+static pio_status_t
+merge_transposed_runs(int run_fd, size_t num_rows, size_t num_cols, size_t band_rows, size_t group_cols, int transposed_fd, uint64_t data_offset, uint64_t *bytes_done, uint64_t bytes_total, bed_transpose_progress_t progress, void *user_data)
+{
+    size_t num_bytes_per_col = ( num_rows + 3 ) / 4;
+    size_t band_bytes = band_rows / 4;
+    unsigned char *chunk = (unsigned char *) malloc( group_cols * band_bytes + 1 );
+    unsigned char *rows = (unsigned char *) malloc( group_cols * num_bytes_per_col + 1 );
+    if( chunk == NULL || rows == NULL ) goto error;
+
+    for(size_t j = 0; j < num_cols; j += group_cols)
+    {
+        size_t cols = num_cols - j < group_cols ? num_cols - j : group_cols;
+        for(size_t i = 0; i < num_rows; i += band_rows)
+        {
+            size_t run_bytes = ( ( num_rows - i < band_rows ? num_rows - i : band_rows ) + 3 ) / 4;
+            uint64_t offset = (uint64_t) num_cols * ( i / 4 ) + (uint64_t) j * run_bytes;
+            if( libplinkio_pread_( run_fd, chunk, cols * run_bytes, offset ) != 0 ) goto error;
+
+            for(size_t c = 0; c < cols; c++)
+            {
+                memcpy( rows + c * num_bytes_per_col + i / 4, chunk + c * run_bytes, run_bytes );
+            }
+        }
+
+        if( libplinkio_pwrite_( transposed_fd, rows, cols * num_bytes_per_col, data_offset + (uint64_t) j * num_bytes_per_col ) != 0 ) goto error;
+
+        *bytes_done += cols * num_bytes_per_col;
+        if( progress != NULL )
+        {
+            progress( user_data, *bytes_done, bytes_total );
+        }
+    }
+
+    free( chunk );
+    free( rows );
+    return PIO_OK;
+
+error:
+    free( chunk );
+    free( rows );
+    return PIO_ERROR;
+}
+
+pio_status_t
+bed_transpose_budget(const char *original_path, const char *transposed_path, size_t num_loci, size_t num_samples, size_t memory_budget, bed_transpose_progress_t progress, void *user_data)
+{
+    int original_fd = -1;
+    int transposed_fd = -1;
+    int run_fd = -1;
+    struct stat file_stats;
+    unsigned char byte_header[ BED_HEADER_MAX_SIZE ] = { 0 };
+    size_t byte_header_length = 0;
+    struct bed_header_t header;
+    size_t num_rows, num_cols, num_bytes_per_row, num_bytes_per_col;
+    size_t band_bytes, group_cols;
+    uint64_t data_offset, bytes_done = 0, bytes_total;
+
+#ifdef _WIN32
+    original_fd = open( original_path, O_RDONLY | O_BINARY );
+#else
+    original_fd = open( original_path, O_RDONLY );
+#endif
+    if( original_fd == -1 ) goto error;
+    if( fstat( original_fd, &file_stats ) == -1 ) goto error;
+
+    /* A v0.99 header is a single byte, read only what is there. */
+    if( libplinkio_pread_( original_fd, byte_header, (size_t) file_stats.st_size < BED_HEADER_MAX_SIZE ? (size_t) file_stats.st_size : BED_HEADER_MAX_SIZE, 0 ) != 0 ) goto error;
+    header = bed_header_init2( num_loci, num_samples, byte_header );
+    num_rows = bed_header_num_rows( &header );
+    num_cols = bed_header_num_cols( &header );
+    num_bytes_per_row = ( num_cols + 3 ) / 4;
+    num_bytes_per_col = ( num_rows + 3 ) / 4;
+    data_offset = bed_header_data_offset( &header );
+    if( (uint64_t) file_stats.st_size < data_offset + (uint64_t) num_rows * num_bytes_per_row ) goto error;
+    libplinkio_fadvise_( original_fd, 0, 0, LIBPLINKIO_ADVICE_SEQUENTIAL_ );
+
+#ifdef _WIN32
+    transposed_fd = open( transposed_path, O_CREAT | O_TRUNC | O_WRONLY | O_BINARY, S_IREAD | S_IWRITE );
+#else
+    transposed_fd = open( transposed_path, O_CREAT | O_TRUNC | O_WRONLY, S_IREAD | S_IWRITE );
+#endif
+    if( transposed_fd == -1 ) goto error;
+
+    bed_header_transpose( &header );
+    bed_header_to_bytes( &header, byte_header, &byte_header_length );
+    if( libplinkio_pwrite_( transposed_fd, byte_header, byte_header_length, 0 ) != 0 ) goto error;
+    if( num_rows == 0 || num_cols == 0 ) goto done;
+
+    /* A band of 4 * band_bytes rows and its run must fit the budget,
+     * and so must the chunk read from each run and the rows built
+     * from them in the merge. At least 4 rows and 1 column are
+     * always used. */
+    band_bytes = memory_budget / ( 4 * num_bytes_per_row + num_cols );
+    if( band_bytes < 1 ) band_bytes = 1;
+    if( band_bytes > num_bytes_per_col ) band_bytes = num_bytes_per_col;
+    group_cols = memory_budget / ( band_bytes + num_bytes_per_col );
+    if( group_cols < 1 ) group_cols = 1;
+    if( group_cols > num_cols ) group_cols = num_cols;
+
+    /* All rows fit in one band, so its run is the transposed data. */
+    if( band_bytes == num_bytes_per_col )
+    {
+        bytes_total = (uint64_t) num_cols * num_bytes_per_col;
+        if( write_transposed_runs( original_fd, data_offset, num_rows, num_cols, 4 * band_bytes, transposed_fd, byte_header_length, &bytes_done, bytes_total, progress, user_data ) != PIO_OK ) goto error;
+        goto done;
+    }
+
+    run_fd = libplinkio_tmp_open_( transposed_path, strlen( transposed_path ) );
+    if( run_fd == -1 ) goto error;
+
+    bytes_total = 2 * (uint64_t) num_cols * num_bytes_per_col;
+    if( write_transposed_runs( original_fd, data_offset, num_rows, num_cols, 4 * band_bytes, run_fd, 0, &bytes_done, bytes_total, progress, user_data ) != PIO_OK ) goto error;
+    if( merge_transposed_runs( run_fd, num_rows, num_cols, 4 * band_bytes, group_cols, transposed_fd, byte_header_length, &bytes_done, bytes_total, progress, user_data ) != PIO_OK ) goto error;
+
+done:
+    if( run_fd != -1 ) close( run_fd );
+    close( original_fd );
+    if( close( transposed_fd ) != 0 ) return PIO_ERROR;
+    return PIO_OK;
+
+error:
+    if( run_fd != -1 ) close( run_fd );
+    if( transposed_fd != -1 ) close( transposed_fd );
+    if( original_fd != -1 ) close( original_fd );
+    return PIO_ERROR;
+}
+
 pio_status_t
 libplinkio_bed_transpose_pio_bed_file_(struct pio_bed_file_t *bed_file, const char *transposed_path, size_t num_loci, size_t num_samples, _Bool is_tmp)
 {
@@ -528,6 +2977,7 @@ libplinkio_bed_transpose_pio_bed_file_(struct pio_bed_file_t *bed_file, const ch
     size_t row_size_bytes = 0;
 
     if( bed_file->fp == NULL ) goto error;
+    free_prefetch(bed_file);
     rewind(bed_file->fp);
     fflush(bed_file->fp);
     original_fd = fileno(bed_file->fp);
@@ -545,12 +2995,15 @@ libplinkio_bed_transpose_pio_bed_file_(struct pio_bed_file_t *bed_file, const ch
     if( transposed_fd == -1 ) goto error;
 
     /* Transpose */
-    if (libplinkio_bed_transpose_fd_(original_fd, transposed_fd, num_loci, num_samples) != PIO_OK) goto error;
+    if (libplinkio_bed_transpose_fd_(original_fd, transposed_fd, num_loci, num_samples, 1) != PIO_OK) goto error;
     if (lseek(transposed_fd, 0, SEEK_SET) == -1) goto error; 
 
     bed_file->header = bed_header_init( num_loci, num_samples );
     row_size_bytes = bed_header_row_size(&bed_file->header);
 
+    /* The columns of the transposed file are different. */
+    free_col_subset(bed_file);
+
     // Write new bed_file
     free(bed_file->read_buffer);
     bed_file->read_buffer = (unsigned char*)malloc(row_size_bytes);
@@ -569,6 +3022,8 @@ libplinkio_bed_transpose_pio_bed_file_(struct pio_bed_file_t *bed_file, const ch
 
 error:
     if (bed_file->read_buffer != NULL) free(bed_file->read_buffer);
+    if (bed_file->chunk_buffer != NULL) free(bed_file->chunk_buffer);
+    free_col_subset(bed_file);
     *bed_file = (struct pio_bed_file_t){0};
     if (transposed_fp != NULL) fclose(transposed_fp);
     if (transposed_fd != -1) close(transposed_fd);
@@ -7,12 +7,15 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <plinkio/utarray.h>
 #include <plinkio/bim.h>
 #include <plinkio/bim_parse.h>
 #include <plinkio/status.h>
 
+#include "private/arena.h"
 #include "private/bim.h"
 #include "private/locus.h"
 
@@ -40,8 +43,15 @@ bim_open(struct pio_bim_file_t *bim_file, const char *path)
     }
 
     bim_file->fp = bim_fp;
+    bim_file->strings = libplinkio_arena_new_( );
+    if( bim_file->strings == NULL )
+    {
+        fclose( bim_fp );
+        bim_file->fp = NULL;
+        return PIO_ERROR;
+    }
     utarray_new( bim_file->locus, &LIBPLINKIO_LOCUS_ICD_ );
-    status = parse_loci( bim_file->fp, bim_file->locus );
+    status = libplinkio_bim_parse_loci_( bim_file->fp, bim_file->locus, (libplinkio_arena_private_t *) bim_file->strings );
 
     fclose( bim_fp );
     bim_file->fp = NULL;
@@ -61,32 +71,152 @@ bim_create(struct pio_bim_file_t *bim_file, const char *path)
     }
 
     bim_file->fp = bim_fp;
+    bim_file->strings = libplinkio_arena_new_( );
+    if( bim_file->strings == NULL )
+    {
+        fclose( bim_fp );
+        bim_file->fp = NULL;
+        return PIO_ERROR;
+    }
     utarray_new( bim_file->locus, &LIBPLINKIO_LOCUS_ICD_ );
 
     return PIO_OK;
 }
 
+/**
+ * Copies an allele into the arena of the bim file, alleles are
+ * interned so that equal alleles share their string.
+ *
+ * @return The copy, or NULL if it could not be allocated.
+ */
+static char *
+copy_allele(libplinkio_arena_private_t *strings, const char *allele)
+{
+    size_t length = strlen( allele );
+    if( length == 0 )
+    {
+        return libplinkio_arena_strndup_( strings, allele, length );
+    }
+
+    return libplinkio_arena_intern_( strings, allele, length );
+}
+
+/**
+ * Adds a copy of a written locus to the locus list, or only counts
+ * it if the loci are discarded.
+ *
+ * @param bim_file Bim file.
+ * @param locus The written locus.
+ *
+ * @return PIO_OK if the locus could be copied, PIO_ERROR otherwise.
+ */
+static pio_status_t
+add_written_locus(struct pio_bim_file_t *bim_file, struct pio_locus_t *locus)
+{
+    libplinkio_arena_private_t *strings = (libplinkio_arena_private_t *) bim_file->strings;
+    struct pio_locus_t locus_copy;
+    if( bim_file->discard_loci )
+    {
+        bim_file->num_discarded_loci++;
+        return PIO_OK;
+    }
+
+    locus_copy.pio_id = bim_num_loci( bim_file );
+    locus_copy.chromosome = locus->chromosome;
+    locus_copy.name = libplinkio_arena_strdup_( strings, locus->name );
+    locus_copy.position = locus->position;
+    locus_copy.bp_position = locus->bp_position;
+    locus_copy.allele1 = copy_allele( strings, locus->allele1 );
+    locus_copy.allele2 = copy_allele( strings, locus->allele2 );
+    if( locus_copy.name == NULL || locus_copy.allele1 == NULL || locus_copy.allele2 == NULL )
+    {
+        return PIO_ERROR;
+    }
+
+    utarray_push_back( bim_file->locus, &locus_copy );
+    return PIO_OK;
+}
+
 pio_status_t
 bim_write(struct pio_bim_file_t *bim_file, struct pio_locus_t *locus)
 {
-    struct pio_locus_t locus_copy;
     if( write_locus( bim_file->fp, locus ) == PIO_OK )
     {
-        locus_copy.pio_id = bim_num_loci( bim_file );
-        locus_copy.chromosome = locus->chromosome;
-        locus_copy.name = strdup( locus->name );
-        locus_copy.position = locus->position;
-        locus_copy.bp_position = locus->bp_position;
-        locus_copy.allele1 = strdup( locus->allele1 );
-        locus_copy.allele2 = strdup( locus->allele2 );
+        return add_written_locus( bim_file, locus );
+    }
+    else
+    {
+        return PIO_ERROR;
+    }
+}
 
-        utarray_push_back( bim_file->locus, &locus_copy );
+pio_status_t
+bim_write_loci(struct pio_bim_file_t *bim_file, struct pio_locus_t *loci, size_t num_loci)
+{
+    char *buffer = NULL;
+    size_t length = 0;
+
+    if( num_loci == 0 )
+    {
         return PIO_OK;
     }
-    else
+
+    buffer = (char *) malloc( BIM_WRITE_BUFFER_SIZE );
+    if( buffer == NULL )
     {
         return PIO_ERROR;
     }
+
+    for(size_t i = 0; i < num_loci; i++)
+    {
+        size_t line_size = locus_line_size( &loci[ i ] );
+        if( line_size > BIM_WRITE_BUFFER_SIZE - length )
+        {
+            if( length > 0 && fwrite( buffer, 1, length, bim_file->fp ) != length )
+            {
+                goto error;
+            }
+            length = 0;
+        }
+
+        if( line_size > BIM_WRITE_BUFFER_SIZE )
+        {
+            /* Longer than the whole buffer, only with absurdly long names. */
+            if( write_locus( bim_file->fp, &loci[ i ] ) != PIO_OK )
+            {
+                goto error;
+            }
+            continue;
+        }
+
+        length += format_locus( buffer + length, &loci[ i ] );
+    }
+
+    if( length > 0 && fwrite( buffer, 1, length, bim_file->fp ) != length )
+    {
+        goto error;
+    }
+    free( buffer );
+
+    for(size_t i = 0; i < num_loci; i++)
+    {
+        if( add_written_locus( bim_file, &loci[ i ] ) != PIO_OK )
+        {
+            return PIO_ERROR;
+        }
+    }
+
+    return PIO_OK;
+
+error:
+    free( buffer );
+    return PIO_ERROR;
+}
+
+void
+bim_set_keep_loci(struct pio_bim_file_t *bim_file, int keep)
+{
+    bim_file->discard_loci = !keep;
 }
 
 struct pio_locus_t *
@@ -98,7 +228,7 @@ bim_get_locus(struct pio_bim_file_t *bim_file, size_t pio_id)
 size_t
 bim_num_loci(struct pio_bim_file_t *bim_file)
 {
-    return utarray_len( bim_file->locus );
+    return utarray_len( bim_file->locus ) + bim_file->num_discarded_loci;
 }
 
 void
@@ -114,7 +244,9 @@ bim_close(struct pio_bim_file_t *bim_file)
     }
 
     utarray_free( bim_file->locus );
+    libplinkio_arena_free_( (libplinkio_arena_private_t *) bim_file->strings );
     bim_file->locus = NULL;
+    bim_file->strings = NULL;
     bim_file->fp = NULL;
 }
 
@@ -133,6 +265,7 @@ pio_status_t libplinkio_bim_link_loci_to_file_(libplinkio_loci_private_t loci, s
     }
 
     bim_file->locus = loci.ptr;
+    bim_file->strings = loci.strings;
     bim_file->fp = bim_fp;
     return PIO_OK;
 
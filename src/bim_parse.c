@@ -8,8 +8,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
 
 #include "private/utility.h"
+#include "private/bim.h"
 #include "private/plink_txt_parse.h"
 
 #include <plinkio/utarray.h>
@@ -28,9 +32,24 @@
 #endif
 
 /**
- * Buffer size for reading CSV file.
+ * Upper bound on the length of the numeric fields and separators of
+ * a .bim line: a chromosome of 3 digits, a genetic position of at
+ * most 47 characters as printed by "%f", a base pair position of
+ * 20 characters and 6 separators.
  */
-#define LIBPLINKIO_BIM_PARSE_BUFFER_SIZE_ 4096
+#define LIBPLINKIO_BIM_NUMBERS_LENGTH_ 80
+
+/**
+ * Positions below this magnitude are formatted directly, since
+ * their value times 10^6 is exact as a double. Larger ones and
+ * non-finite ones go through snprintf.
+ */
+#define LIBPLINKIO_BIM_MAX_DIRECT_POSITION_ 1e9
+
+/**
+ * Size of the line buffer of write_locus on the stack.
+ */
+#define LIBPLINKIO_BIM_LINE_SIZE_ 256
 
 struct bim_state_t
 {
@@ -55,6 +74,11 @@ struct bim_state_t
      * List of loci parsed so far.
      */
     UT_array *locus;
+
+    /**
+     * Arena for the strings of the loci, or NULL to use malloc.
+     */
+    libplinkio_arena_private_t *strings;
 };
 
 /**
@@ -73,6 +97,7 @@ bim_new_field(char *field, size_t field_length, size_t field_num, void *data)
     UNUSED_PARAM(field_num);
     struct bim_state_t *state = (struct bim_state_t *) data;
     pio_status_t status;
+    char number[ LIBPLINKIO_FIELD_BUFFER_SIZE_ ];
     char *buffer;
 
     if( state->field == -1 )
@@ -81,9 +106,13 @@ bim_new_field(char *field, size_t field_length, size_t field_num, void *data)
     }
 
     /* Null terminated field. */
-    buffer = (char * ) malloc( sizeof( char ) * ( field_length + 1 ) );
-    strncpy( buffer, field, field_length );
-    buffer[ field_length ] = '\0';
+    buffer = libplinkio_terminate_field_( field, field_length, number, sizeof( number ) );
+    if( buffer == NULL )
+    {
+        state->any_error = 1;
+        state->field = -1;
+        return;
+    }
 
     switch( state->field )
     {
@@ -91,7 +120,7 @@ bim_new_field(char *field, size_t field_length, size_t field_num, void *data)
             state->cur_locus.chromosome = libplinkio_parse_chr_( buffer, field_length, &status );
             break;
         case 1:
-            state->cur_locus.name = libplinkio_parse_str_( buffer, field_length, &status );
+            state->cur_locus.name = libplinkio_parse_arena_str_( state->strings, buffer, field_length, &status );
             break;
         case 2:
             state->cur_locus.position = libplinkio_parse_genetic_position_( buffer, field_length, &status );
@@ -100,17 +129,20 @@ bim_new_field(char *field, size_t field_length, size_t field_num, void *data)
             state->cur_locus.bp_position = libplinkio_parse_bp_position_( buffer, field_length, &status );
             break;
         case 4:
-            state->cur_locus.allele1 = libplinkio_parse_str_( buffer, field_length, &status );
+            state->cur_locus.allele1 = libplinkio_parse_arena_allele_( state->strings, buffer, field_length, &status );
             break;
         case 5:
-            state->cur_locus.allele2 = libplinkio_parse_str_( buffer, field_length, &status );
+            state->cur_locus.allele2 = libplinkio_parse_arena_allele_( state->strings, buffer, field_length, &status );
             break;
         default:
             status = PIO_ERROR;
             break;
     }
-    
-    free( buffer );
+
+    if( buffer != number )
+    {
+        free( buffer );
+    }
 
     if( status == PIO_OK )
     {
@@ -147,22 +179,18 @@ bim_new_row(size_t number, void *data)
 pio_status_t
 parse_loci(FILE *bim_fp, UT_array *locus)
 {
-    char read_buffer[ LIBPLINKIO_BIM_PARSE_BUFFER_SIZE_ ];
+    return libplinkio_bim_parse_loci_( bim_fp, locus, NULL );
+}
+
+pio_status_t
+libplinkio_bim_parse_loci_(FILE *bim_fp, UT_array *locus, libplinkio_arena_private_t *strings)
+{
     struct bim_state_t state = { 0 };
-    libplinkio_txt_parser_private_t parser = { 0 };
 
     state.locus = locus;
+    state.strings = strings;
 
-    libplinkio_txt_parser_init_( &parser );
-    do {
-        size_t bytes_read = fread( read_buffer, sizeof( char ), LIBPLINKIO_BIM_PARSE_BUFFER_SIZE_ - 1, bim_fp );
-        if (ferror(bim_fp)) goto error;
-        read_buffer[bytes_read] = '\0';
-        libplinkio_txt_parse_( &parser, read_buffer, bytes_read, &bim_new_field, &bim_new_row, (void *) &state );
-    } while( !feof( bim_fp ) );
-
-    libplinkio_txt_parse_fini_( &parser, &bim_new_field, &bim_new_row, (void *) &state );
-    libplinkio_txt_parser_free_( &parser );
+    if( libplinkio_txt_parse_file_( bim_fp, &bim_new_field, &bim_new_row, (void *) &state ) != PIO_OK ) goto error;
     
     if ( state.any_error != 0 ) goto error;
     return PIO_OK;
@@ -171,20 +199,156 @@ error:
     return PIO_ERROR;
 }
 
+/**
+ * Writes the decimal digits of value.
+ *
+ * @param buffer The digits are written here.
+ * @param value The value.
+ * @param min_digits The number of digits to pad to with zeros.
+ *
+ * @return The number of digits.
+ */
+static size_t
+format_digits(char *buffer, uint64_t value, size_t min_digits)
+{
+    char digits[ 20 ];
+    size_t length = 0;
+    do
+    {
+        digits[ length++ ] = (char) ( '0' + value % 10 );
+        value /= 10;
+    } while( value != 0 );
+    while( length < min_digits )
+    {
+        digits[ length++ ] = '0';
+    }
+
+    for(size_t i = 0; i < length; i++)
+    {
+        buffer[ i ] = digits[ length - 1 - i ];
+    }
+
+    return length;
+}
+
+/**
+ * Writes value like "%lld".
+ *
+ * @return The number of characters written.
+ */
+static size_t
+format_integer(char *buffer, long long value)
+{
+    if( value < 0 )
+    {
+        buffer[ 0 ] = '-';
+        return 1 + format_digits( buffer + 1, (uint64_t) 0 - (uint64_t) value, 1 );
+    }
+
+    return format_digits( buffer, (uint64_t) value, 1 );
+}
+
+/**
+ * Writes position like "%f", i.e. with 6 decimals rounded half to
+ * even.
+ *
+ * @return The number of characters written.
+ */
+static size_t
+format_position(char *buffer, float position)
+{
+    double magnitude = position < 0 ? -(double) position : (double) position;
+    double scaled;
+    uint64_t micros;
+    double fraction;
+    size_t length = 0;
+
+    if( !( magnitude < LIBPLINKIO_BIM_MAX_DIRECT_POSITION_ ) )
+    {
+        return (size_t) snprintf( buffer, LIBPLINKIO_BIM_NUMBERS_LENGTH_, "%f", position );
+    }
+
+    /* A float has 24 significant bits and 10^6 < 2^20, so the product is exact. */
+    scaled = magnitude * 1e6;
+    micros = (uint64_t) scaled;
+    fraction = scaled - (double) micros;
+    if( fraction > 0.5 || ( fraction == 0.5 && micros % 2 == 1 ) )
+    {
+        micros++;
+    }
+
+    if( signbit( position ) )
+    {
+        buffer[ length++ ] = '-';
+    }
+    length += format_digits( buffer + length, micros / 1000000, 1 );
+    buffer[ length++ ] = '.';
+    length += format_digits( buffer + length, micros % 1000000, 6 );
+
+    return length;
+}
+
+/**
+ * Copies a string and returns its length.
+ */
+static size_t
+format_string(char *buffer, const char *string)
+{
+    size_t length = strlen( string );
+    memcpy( buffer, string, length );
+    return length;
+}
+
+size_t
+locus_line_size(struct pio_locus_t *locus)
+{
+    return strlen( locus->name ) + strlen( locus->allele1 ) + strlen( locus->allele2 ) + LIBPLINKIO_BIM_NUMBERS_LENGTH_;
+}
+
+size_t
+format_locus(char *buffer, struct pio_locus_t *locus)
+{
+    size_t length = format_integer( buffer, locus->chromosome );
+    buffer[ length++ ] = '\t';
+    length += format_string( buffer + length, locus->name );
+    buffer[ length++ ] = '\t';
+    length += format_position( buffer + length, locus->position );
+    buffer[ length++ ] = '\t';
+    length += format_integer( buffer + length, locus->bp_position );
+    buffer[ length++ ] = '\t';
+    length += format_string( buffer + length, locus->allele1 );
+    buffer[ length++ ] = '\t';
+    length += format_string( buffer + length, locus->allele2 );
+    buffer[ length++ ] = '\n';
+
+    return length;
+}
+
 pio_status_t
 write_locus(FILE *bim_fp, struct pio_locus_t *locus)
 {
-    int bytes_written = fprintf( bim_fp,
-                    "%d\t%s\t%f\t%lld\t%s\t%s\n",
-                    locus->chromosome,
-                    locus->name,
-                    locus->position,
-                    locus->bp_position,
-                    locus->allele1,
-                    locus->allele2
-                    );
-
-    if( bytes_written > 0 )
+    char line[ LIBPLINKIO_BIM_LINE_SIZE_ ];
+    char *buffer = line;
+    size_t length;
+    size_t bytes_written;
+
+    if( locus_line_size( locus ) > sizeof( line ) )
+    {
+        buffer = (char *) malloc( locus_line_size( locus ) );
+        if( buffer == NULL )
+        {
+            return PIO_ERROR;
+        }
+    }
+
+    length = format_locus( buffer, locus );
+    bytes_written = fwrite( buffer, 1, length, bim_fp );
+    if( buffer != line )
+    {
+        free( buffer );
+    }
+
+    if( bytes_written == length )
     {
         return PIO_OK;
     }
@@ -0,0 +1,127 @@
+#include "private/cpu.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LIBPLINKIO_X86_
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef LIBPLINKIO_X86_
+
+/* CPUID.1:EDX */
+#define LIBPLINKIO_CPUID_SSE2_ (1u << 26)
+/* CPUID.1:ECX */
+#define LIBPLINKIO_CPUID_SSSE3_ (1u << 9)
+#define LIBPLINKIO_CPUID_OSXSAVE_ (1u << 27)
+#define LIBPLINKIO_CPUID_AVX_ (1u << 28)
+/* CPUID.(7,0):EBX */
+#define LIBPLINKIO_CPUID_AVX2_ (1u << 5)
+#define LIBPLINKIO_CPUID_AVX512F_ (1u << 16)
+#define LIBPLINKIO_CPUID_AVX512BW_ (1u << 30)
+/* XCR0, XMM and YMM state, then opmask, ZMM_Hi256 and Hi16_ZMM state. */
+#define LIBPLINKIO_XCR0_AVX_ 0x06u
+#define LIBPLINKIO_XCR0_AVX512_ 0xe6u
+
+static void
+cpu_cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; i++) regs[i] = (unsigned int)info[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned int
+cpu_max_leaf(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    return (unsigned int)info[0];
+#else
+    return __get_cpuid_max(0, NULL);
+#endif
+}
+
+static uint64_t
+cpu_xgetbv0(void)
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static unsigned int
+cpu_detect_features(void)
+{
+    unsigned int regs[4] = { 0 };
+    unsigned int features = 0;
+    unsigned int leaves = cpu_max_leaf();
+    uint64_t xcr0 = 0;
+
+    if (leaves < 1) return 0;
+    cpu_cpuid(1, 0, regs);
+    if ((regs[3] & LIBPLINKIO_CPUID_SSE2_) != 0) features |= LIBPLINKIO_CPU_SSE2_;
+    if ((regs[2] & LIBPLINKIO_CPUID_SSSE3_) != 0) features |= LIBPLINKIO_CPU_SSSE3_;
+
+    /* Wide registers are only usable if the OS saves them on context switches. */
+    if ((regs[2] & LIBPLINKIO_CPUID_OSXSAVE_) == 0 || (regs[2] & LIBPLINKIO_CPUID_AVX_) == 0) return features;
+    xcr0 = cpu_xgetbv0();
+    if ((xcr0 & LIBPLINKIO_XCR0_AVX_) != LIBPLINKIO_XCR0_AVX_ || leaves < 7) return features;
+
+    cpu_cpuid(7, 0, regs);
+    if ((regs[1] & LIBPLINKIO_CPUID_AVX2_) != 0) features |= LIBPLINKIO_CPU_AVX2_;
+    if (
+        (regs[1] & LIBPLINKIO_CPUID_AVX512F_) != 0
+        && (regs[1] & LIBPLINKIO_CPUID_AVX512BW_) != 0
+        && (xcr0 & LIBPLINKIO_XCR0_AVX512_) == LIBPLINKIO_XCR0_AVX512_
+    ) features |= LIBPLINKIO_CPU_AVX512BW_;
+
+    return features;
+}
+
+#else
+
+static unsigned int
+cpu_detect_features(void)
+{
+    return 0;
+}
+
+#endif
+
+/**
+ * Returns the mask of all features up to and including the
+ * level named in LIBPLINKIO_SIMD, or all features if it is unset.
+ */
+static unsigned int
+cpu_requested_features(void)
+{
+    const char *level = getenv("LIBPLINKIO_SIMD");
+    if (level == NULL || *level == '\0') return ~0u;
+
+    if (strcmp(level, "scalar") == 0) return 0;
+    if (strcmp(level, "sse2") == 0) return LIBPLINKIO_CPU_SSE2_;
+    if (strcmp(level, "ssse3") == 0) return LIBPLINKIO_CPU_SSE2_ | LIBPLINKIO_CPU_SSSE3_;
+    if (strcmp(level, "avx2") == 0) return LIBPLINKIO_CPU_SSE2_ | LIBPLINKIO_CPU_SSSE3_ | LIBPLINKIO_CPU_AVX2_;
+    return ~0u;
+}
+
+unsigned int
+libplinkio_cpu_features_(void)
+{
+    return cpu_detect_features() & cpu_requested_features();
+}
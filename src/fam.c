@@ -13,6 +13,7 @@
 #include <plinkio/fam_parse.h>
 #include <plinkio/status.h>
 
+#include "private/arena.h"
 #include "private/fam.h"
 #include "private/sample.h"
 
@@ -41,8 +42,15 @@ fam_open(struct pio_fam_file_t *fam_file, const char *path)
     }
 
     fam_file->fp = fam_fp;
+    fam_file->strings = libplinkio_arena_new_( );
+    if( fam_file->strings == NULL )
+    {
+        fclose( fam_fp );
+        fam_file->fp = NULL;
+        return PIO_ERROR;
+    }
     utarray_new( fam_file->sample, &LIBPLINKIO_SAMPLE_ICD_ );
-    status = parse_samples( fam_file->fp, fam_file->sample );
+    status = libplinkio_fam_parse_samples_( fam_file->fp, fam_file->sample, (libplinkio_arena_private_t *) fam_file->strings );
     
     fclose( fam_fp );
     fam_file->fp = NULL;
@@ -56,6 +64,7 @@ fam_create(struct pio_fam_file_t *fam_file, const char *path, struct pio_sample_
     size_t i;
     FILE *fam_fp;
     struct pio_sample_t sample_copy;
+    libplinkio_arena_private_t *strings;
 
     memset( fam_file, 0, sizeof( *fam_file ) );
     fam_fp = fopen( path, "w" );
@@ -66,6 +75,12 @@ fam_create(struct pio_fam_file_t *fam_file, const char *path, struct pio_sample_
 
     fam_file->fp = fam_fp;
 
+    strings = libplinkio_arena_new_( );
+    if( strings == NULL )
+    {
+        return PIO_ERROR;
+    }
+    fam_file->strings = strings;
     utarray_new( fam_file->sample, &LIBPLINKIO_SAMPLE_ICD_ );
     for(i = 0; i < num_samples; i++)
     {
@@ -75,10 +90,14 @@ fam_create(struct pio_fam_file_t *fam_file, const char *path, struct pio_sample_
         }
 
         sample_copy.pio_id = i;
-        sample_copy.fid = strdup( samples[ i ].fid );
-        sample_copy.iid = strdup( samples[ i ].iid );
-        sample_copy.mother_iid = strdup( samples[ i ].mother_iid );
-        sample_copy.father_iid = strdup( samples[ i ].father_iid );
+        sample_copy.fid = libplinkio_arena_strdup_( strings, samples[ i ].fid );
+        sample_copy.iid = libplinkio_arena_strdup_( strings, samples[ i ].iid );
+        sample_copy.mother_iid = libplinkio_arena_strdup_( strings, samples[ i ].mother_iid );
+        sample_copy.father_iid = libplinkio_arena_strdup_( strings, samples[ i ].father_iid );
+        if( sample_copy.fid == NULL || sample_copy.iid == NULL || sample_copy.mother_iid == NULL || sample_copy.father_iid == NULL )
+        {
+            return PIO_ERROR;
+        }
         sample_copy.sex = samples[ i ].sex;
         sample_copy.affection = samples[ i ].affection;
         sample_copy.phenotype = samples[ i ].phenotype;
@@ -114,8 +133,10 @@ fam_close(struct pio_fam_file_t *fam_file)
     }
 
     utarray_free( fam_file->sample );
+    libplinkio_arena_free_( (libplinkio_arena_private_t *) fam_file->strings );
 
     fam_file->sample = NULL;
+    fam_file->strings = NULL;
     fam_file->fp = NULL;
 }
 
@@ -134,6 +155,7 @@ pio_status_t libplinkio_fam_link_samples_to_file_(libplinkio_samples_private_t s
     }
 
     fam_file->sample = samples.ptr;
+    fam_file->strings = samples.strings;
     fam_file->fp = fam_fp;
     return PIO_OK;
 
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 
 #include "private/utility.h"
+#include "private/fam.h"
 #include "private/plink_txt_parse.h"
 
 #include <plinkio/utarray.h>
@@ -26,11 +27,6 @@
     #define feof mock_feof
 #endif
 
-/**
- * Buffer size for reading CSV file.
- */
-#define LIBPLINKIO_FAM_PARSE_BUFFER_SIZE_ 4096
-
 struct fam_state_t
 {
     /**
@@ -54,6 +50,11 @@ struct fam_state_t
      * List of samples parsed so far.
      */
     UT_array *samples;
+
+    /**
+     * Arena for the strings of the samples, or NULL to use malloc.
+     */
+    libplinkio_arena_private_t *strings;
 };
 
 /**
@@ -72,6 +73,7 @@ fam_new_field(char *field, size_t field_length, size_t field_num, void *data)
     UNUSED_PARAM(field_num);
     struct fam_state_t *state = (struct fam_state_t *) data;
     pio_status_t status;
+    char number[ LIBPLINKIO_FIELD_BUFFER_SIZE_ ];
     char *buffer;
 
     if( state->field == -1 )
@@ -80,23 +82,27 @@ fam_new_field(char *field, size_t field_length, size_t field_num, void *data)
     }
 
     /* Null terminated field. */
-    buffer = (char * ) malloc( sizeof( char ) * ( field_length + 1 ) );
-    strncpy( buffer, field, field_length );
-    buffer[ field_length ] = '\0';
+    buffer = libplinkio_terminate_field_( field, field_length, number, sizeof( number ) );
+    if( buffer == NULL )
+    {
+        state->any_error = 1;
+        state->field = -1;
+        return;
+    }
 
     switch( state->field )
     {
         case 0:
-            state->cur_sample.fid = libplinkio_parse_str_( buffer, field_length, &status );
+            state->cur_sample.fid = libplinkio_parse_arena_str_( state->strings, buffer, field_length, &status );
             break;
         case 1:
-            state->cur_sample.iid = libplinkio_parse_str_( buffer, field_length, &status );
+            state->cur_sample.iid = libplinkio_parse_arena_str_( state->strings, buffer, field_length, &status );
             break;
         case 2:
-            state->cur_sample.father_iid = libplinkio_parse_str_( buffer, field_length, &status );
+            state->cur_sample.father_iid = libplinkio_parse_arena_str_( state->strings, buffer, field_length, &status );
             break;
         case 3:
-            state->cur_sample.mother_iid = libplinkio_parse_str_( buffer, field_length, &status );
+            state->cur_sample.mother_iid = libplinkio_parse_arena_str_( state->strings, buffer, field_length, &status );
             break;
         case 4:
             state->cur_sample.sex = libplinkio_parse_sex_( buffer, field_length, &status );
@@ -109,7 +115,10 @@ fam_new_field(char *field, size_t field_length, size_t field_num, void *data)
             break;
     }
 
-    free( buffer );
+    if( buffer != number )
+    {
+        free( buffer );
+    }
 
     if( status == PIO_OK )
     {
@@ -146,22 +155,18 @@ fam_new_row(size_t number, void *data)
 pio_status_t
 parse_samples(FILE *fam_fp, UT_array *sample)
 {
-    char read_buffer[ LIBPLINKIO_FAM_PARSE_BUFFER_SIZE_ ];
+    return libplinkio_fam_parse_samples_( fam_fp, sample, NULL );
+}
+
+pio_status_t
+libplinkio_fam_parse_samples_(FILE *fam_fp, UT_array *sample, libplinkio_arena_private_t *strings)
+{
     struct fam_state_t state = { 0 };
-    libplinkio_txt_parser_private_t parser = { 0 };
 
     state.samples = sample;
+    state.strings = strings;
 
-    libplinkio_txt_parser_init_( &parser );
-    do {
-        size_t bytes_read = fread( read_buffer, sizeof( char ), LIBPLINKIO_FAM_PARSE_BUFFER_SIZE_ - 1, fam_fp );
-        if (ferror(fam_fp)) goto error;
-        read_buffer[bytes_read] = '\0';
-        libplinkio_txt_parse_( &parser, read_buffer, bytes_read, &fam_new_field, &fam_new_row, (void *) &state );
-    } while( !feof( fam_fp ) );
-
-    libplinkio_txt_parse_fini_( &parser, &fam_new_field, &fam_new_row, (void *) &state );
-    libplinkio_txt_parser_free_( &parser );
+    if( libplinkio_txt_parse_file_( fam_fp, &fam_new_field, &fam_new_row, (void *) &state ) != PIO_OK ) goto error;
     
     if ( state.any_error != 0 ) goto error;
     return PIO_OK;
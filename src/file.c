@@ -9,52 +9,227 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#if defined(__has_include)
+#if __has_include(<linux/fs.h>)
+#include <linux/fs.h>
+#endif
+#endif
+#endif
 
 #include <plinkio/file.h>
 
+#include "private/utility.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 /**
- * Total size for a buffer containing the copy command
- * that will be issued to the shell.
+ * Number of bytes that are read and written at a time when the
+ * file cannot be copied by the kernel.
  */
-#define FILE_COPY_BUFFER_SIZE 4096
+#define FILE_COPY_BUFFER_SIZE ( 1 << 20 )
 
-file_status_t
-file_copy(const char *from_path, const char *to_path)
+#ifdef __linux__
+/**
+ * Copies size bytes from in_fd to out_fd without moving them
+ * through user space. The copy shares the extents of the file where
+ * the file system supports reflinks, and is otherwise done with
+ * copy_file_range, or sendfile where that cannot copy between the
+ * two files.
+ *
+ * @return 0 if the file was copied, 1 if the kernel cannot copy
+ *         between these files and nothing was written, -1 otherwise.
+ */
+static int
+copy_in_kernel(int in_fd, int out_fd, uint64_t size)
 {
-    char *copy_command = malloc( sizeof( char ) * ( strlen( from_path ) + strlen( to_path ) + 5 ) );
-    int status = 0;
+    uint64_t done = 0;
 
-    sprintf( copy_command, "cp %s %s", from_path, to_path );
-    status = system( copy_command );
-    free( copy_command );
+#ifdef FICLONE
+    if( ioctl( out_fd, FICLONE, in_fd ) == 0 )
+    {
+        return 0;
+    }
+#endif
 
-    if( status != -1 )
+#ifdef __NR_copy_file_range
+    while( done < size )
     {
-        return FILE_OK;
+        long copied = syscall( __NR_copy_file_range, in_fd, NULL, out_fd, NULL, (size_t) ( size - done ), 0u );
+        if( copied > 0 )
+        {
+            done += (uint64_t) copied;
+            continue;
+        }
+        if( copied == -1 && errno == EINTR )
+        {
+            continue;
+        }
+        if( copied == 0 || done > 0 )
+        {
+            return -1;
+        }
+        if( errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP && errno != EPERM )
+        {
+            return -1;
+        }
+        break;
     }
-    else
+#endif
+
+    while( done < size )
     {
-        return FILE_ERROR;
+        ssize_t copied = sendfile( out_fd, in_fd, NULL, (size_t) ( size - done ) );
+        if( copied > 0 )
+        {
+            done += (uint64_t) copied;
+            continue;
+        }
+        if( copied == -1 && errno == EINTR )
+        {
+            continue;
+        }
+        return copied == -1 && done == 0 && ( errno == EINVAL || errno == ENOSYS ) ? 1 : -1;
     }
 
+    return 0;
+}
+#endif
+
+/**
+ * Copies the rest of in_fd to out_fd through a buffer.
+ *
+ * @return 0 if the file was copied, -1 otherwise.
+ */
+static int
+copy_buffered(int in_fd, int out_fd)
+{
+    char *buffer = (char *) malloc( FILE_COPY_BUFFER_SIZE );
+    int status = -1;
+    if( buffer == NULL )
+    {
+        return -1;
+    }
+
+    for(;;)
+    {
+        long num_read = (long) read( in_fd, buffer, FILE_COPY_BUFFER_SIZE );
+        long num_written = 0;
+        if( num_read == 0 )
+        {
+            status = 0;
+            break;
+        }
+        if( num_read < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+            break;
+        }
+
+        while( num_written < num_read )
+        {
+            long written = (long) write( out_fd, buffer + num_written, (unsigned int) ( num_read - num_written ) );
+            if( written < 0 && errno == EINTR )
+            {
+                continue;
+            }
+            if( written <= 0 )
+            {
+                break;
+            }
+            num_written += written;
+        }
+        if( num_written < num_read )
+        {
+            break;
+        }
+    }
+
+    free( buffer );
+    return status;
 }
 
 file_status_t
-file_remove(const char *path)
+file_copy(const char *from_path, const char *to_path)
 {
-    char *rm_command = malloc( sizeof( char ) * ( strlen( path ) + 4 ) );
-    int status = 0;
-    
-    sprintf( rm_command, "rm %s", path );
-    status = system( rm_command );
-    free( rm_command );
-
-    if( status != -1 )
+    struct stat file_stats;
+    char *tmp_path = NULL;
+    int in_fd = -1;
+    int out_fd = -1;
+    int status;
+
+    in_fd = open( from_path, O_RDONLY | O_BINARY );
+    if( in_fd == -1 || fstat( in_fd, &file_stats ) == -1 ) goto error;
+
+    /* The copy is renamed into place once it is complete, so to_path
+     * never holds a partial file. */
+    out_fd = libplinkio_tmp_create_( to_path, &tmp_path );
+    if( out_fd == -1 ) goto error;
+
+#ifdef __linux__
+    status = copy_in_kernel( in_fd, out_fd, (uint64_t) file_stats.st_size );
+    if( status == 1 )
     {
-        return FILE_OK;
+        status = copy_buffered( in_fd, out_fd );
     }
-    else
+#else
+    status = copy_buffered( in_fd, out_fd );
+#endif
+    if( status != 0 ) goto error;
+
+    status = close( out_fd );
+    out_fd = -1;
+    if( status != 0 ) goto error;
+    close( in_fd );
+    in_fd = -1;
+
+    if( file_rename( tmp_path, to_path ) != FILE_OK ) goto error;
+    free( tmp_path );
+
+    return FILE_OK;
+
+error:
+    if( out_fd != -1 ) close( out_fd );
+    if( in_fd != -1 ) close( in_fd );
+    if( tmp_path != NULL )
     {
-        return FILE_ERROR;
+        remove( tmp_path );
+        free( tmp_path );
     }
+    return FILE_ERROR;
+}
+
+file_status_t
+file_rename(const char *from_path, const char *to_path)
+{
+#ifdef _WIN32
+    return MoveFileExA( from_path, to_path, MOVEFILE_REPLACE_EXISTING ) ? FILE_OK : FILE_ERROR;
+#else
+    return rename( from_path, to_path ) == 0 ? FILE_OK : FILE_ERROR;
+#endif
+}
+
+file_status_t
+file_remove(const char *path)
+{
+    return remove( path ) == 0 ? FILE_OK : FILE_ERROR;
 }
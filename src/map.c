@@ -33,6 +33,7 @@ libplinkio_map_open_(libplinkio_loci_private_t *loci, const char *path)
     if( map_fp == NULL ) goto error;
 
     *loci = libplinkio_new_loci_();
+    if (loci->strings == NULL) goto error;
     if (libplinkio_map_parse_loci_( map_fp, *loci ) != PIO_OK) goto error;
 
     fclose( map_fp );
@@ -26,11 +26,6 @@
     #define feof mock_feof
 #endif
 
-/**
- * Buffer size for reading CSV file.
- */
-#define LIBPLINKIO_MAP_PARSE_BUFFER_SIZE_ 4096
-
 struct map_state_t
 {
     /**
@@ -78,15 +73,14 @@ map_new_field(char *field, size_t field_length, size_t field_num, void *data)
     UNUSED_PARAM(field_num);
     struct map_state_t *state = (struct map_state_t *) data;
     pio_status_t status = PIO_OK;
+    char number[ LIBPLINKIO_FIELD_BUFFER_SIZE_ ];
     char *buffer = NULL;
 
     if( state->field == -1 ) goto error;
 
     /* Null terminated field. */
-    buffer = (char*)calloc((field_length + 1), sizeof(char));
+    buffer = libplinkio_terminate_field_( field, field_length, number, sizeof( number ) );
     if (buffer == NULL) goto error;
-    strncpy( buffer, field, field_length );
-    buffer[ field_length ] = '\0';
 
     switch( state->field )
     {
@@ -94,15 +88,13 @@ map_new_field(char *field, size_t field_length, size_t field_num, void *data)
             state->cur_locus.chromosome = libplinkio_parse_chr_( buffer, field_length, &status );
             break;
         case 1:
-            state->cur_locus.name = libplinkio_parse_str_( buffer, field_length, &status );
+            state->cur_locus.name = libplinkio_parse_arena_str_( state->loci.strings, buffer, field_length, &status );
             break;
         case 2:
             // This "if" is a workaroud for false positives of test_free in cmockery.
             if (state->tmp_buffer != NULL) free(state->tmp_buffer);
-            state->tmp_buffer = buffer;
+            state->tmp_buffer = libplinkio_parse_str_( buffer, field_length, &status );
             state->tmp_buffer_length = field_length;
-            buffer = NULL;
-            status = PIO_OK;
             break;
         case 3:
             state->cur_locus.bp_position = libplinkio_parse_bp_position_( buffer, field_length, &status );
@@ -111,8 +103,7 @@ map_new_field(char *field, size_t field_length, size_t field_num, void *data)
             status = PIO_ERROR;
             break;
     }
-    // This "if" is a workaroud for false positives of test_free in cmockery.
-    if (buffer != NULL) free( buffer );
+    if (buffer != number) free( buffer );
     buffer = NULL;
 
     if( status == PIO_OK )
@@ -126,7 +117,8 @@ map_new_field(char *field, size_t field_length, size_t field_num, void *data)
     return;
 
 error:
-    free(buffer);
+    // This "if" is a workaroud for false positives of test_free in cmockery.
+    if (buffer != NULL && buffer != number) free(buffer);
     state->any_error = 1;
     state->field = -1;
     return;
@@ -182,22 +174,11 @@ error:
 pio_status_t
 libplinkio_map_parse_loci_(FILE *map_fp, libplinkio_loci_private_t loci)
 {
-    char read_buffer[ LIBPLINKIO_MAP_PARSE_BUFFER_SIZE_ ];
     struct map_state_t state = { 0 };
-    libplinkio_txt_parser_private_t parser = { 0 };
 
     state.loci = loci;
 
-    libplinkio_txt_parser_init_( &parser );
-    do {
-        size_t bytes_read = fread( read_buffer, sizeof( char ), LIBPLINKIO_MAP_PARSE_BUFFER_SIZE_ - 1, map_fp );
-        if (ferror(map_fp)) goto error;
-        read_buffer[bytes_read] = '\0';
-        libplinkio_txt_parse_( &parser, read_buffer, bytes_read, &map_new_field, &map_new_row, (void *) &state );
-    } while( !feof( map_fp ) );
-
-    libplinkio_txt_parse_fini_( &parser, &map_new_field, &map_new_row, (void *) &state );
-    libplinkio_txt_parser_free_( &parser );
+    if( libplinkio_txt_parse_file_( map_fp, &map_new_field, &map_new_row, (void *) &state ) != PIO_OK ) goto error;
     
     if ( state.any_error != 0 ) goto error;
     return PIO_OK;
@@ -17,6 +17,7 @@ libplinkio_ped_open_(libplinkio_samples_private_t *samples, libplinkio_loci_priv
     if( ped_fp == NULL ) goto error;
 
     *samples = libplinkio_new_samples_();
+    if (samples->strings == NULL) goto error;
 
     if (libplinkio_ped_parse_samples_(ped_fp, *samples, *loci, bed_file) != PIO_OK) goto error;
 
@@ -29,11 +29,6 @@
     #define feof mock_feof
 #endif
 
-/**
- * Buffer size for reading CSV file.
- */
-#define LIBPLINKIO_PED_PARSE_BUFFER_SIZE_ 4096
-
 struct ped_state_t
 {
     /**
@@ -100,7 +95,8 @@ ped_new_field(char *field, size_t field_length, size_t field_num, void *data)
     UNUSED_PARAM(field_num);
     struct ped_state_t *state = (struct ped_state_t *) data;
     pio_status_t status = PIO_OK;
-    char *buffer;
+    char number[ LIBPLINKIO_FIELD_BUFFER_SIZE_ ];
+    char *buffer = NULL;
 
     size_t locus_length = 0;
     size_t idx = 0;
@@ -112,24 +108,26 @@ ped_new_field(char *field, size_t field_length, size_t field_num, void *data)
         return;
     }
 
-    /* Null terminated field. */
-    buffer = (char * ) malloc( sizeof( char ) * ( field_length + 1 ) );
-    strncpy( buffer, field, field_length );
-    buffer[ field_length ] = '\0';
+    /* Null terminated field, the alleles are parsed in place. */
+    if( state->field < 6 )
+    {
+        buffer = libplinkio_terminate_field_( field, field_length, number, sizeof( number ) );
+        if( buffer == NULL ) goto error;
+    }
 
     switch( state->field )
     {
         case 0:
-            state->cur_sample.fid = libplinkio_parse_str_( buffer, field_length, &status );
+            state->cur_sample.fid = libplinkio_parse_arena_str_( state->samples.strings, buffer, field_length, &status );
             break;
         case 1:
-            state->cur_sample.iid = libplinkio_parse_str_( buffer, field_length, &status );
+            state->cur_sample.iid = libplinkio_parse_arena_str_( state->samples.strings, buffer, field_length, &status );
             break;
         case 2:
-            state->cur_sample.father_iid = libplinkio_parse_str_( buffer, field_length, &status );
+            state->cur_sample.father_iid = libplinkio_parse_arena_str_( state->samples.strings, buffer, field_length, &status );
             break;
         case 3:
-            state->cur_sample.mother_iid = libplinkio_parse_str_( buffer, field_length, &status );
+            state->cur_sample.mother_iid = libplinkio_parse_arena_str_( state->samples.strings, buffer, field_length, &status );
             break;
         case 4:
             state->cur_sample.sex = libplinkio_parse_sex_( buffer, field_length, &status );
@@ -153,7 +151,7 @@ ped_new_field(char *field, size_t field_length, size_t field_num, void *data)
                     locus_idx = idx >> 1;
                     allele_idx = idx & 1;
                     libplinkio_parse_allele_(
-                        buffer,
+                        field,
                         field_length,
                         locus_idx,
                         allele_idx,
@@ -170,7 +168,7 @@ ped_new_field(char *field, size_t field_length, size_t field_num, void *data)
                         break;
                     }
                     libplinkio_parse_allele_(
-                        buffer,
+                        field,
                         1,
                         idx,
                         0,
@@ -180,7 +178,7 @@ ped_new_field(char *field, size_t field_length, size_t field_num, void *data)
                         &status
                     );
                     libplinkio_parse_allele_(
-                        buffer + 1,
+                        field + 1,
                         1,
                         idx,
                         1,
@@ -194,13 +192,16 @@ ped_new_field(char *field, size_t field_length, size_t field_num, void *data)
             break;
     }
 
-    free( buffer );
+    // This "if" is a workaroud for false positives of test_free in cmockery.
+    if( buffer != NULL && buffer != number ) free( buffer );
+    buffer = NULL;
 
     if( status != PIO_OK ) goto error;
     state->field++;
     return;
 
 error:
+    if( buffer != NULL && buffer != number ) free( buffer );
     state->any_error = 1;
     state->field = -1;
     return;
@@ -242,9 +243,7 @@ ped_new_row(size_t number, void *data)
 pio_status_t
 libplinkio_ped_parse_samples_(FILE* ped_fp, libplinkio_samples_private_t samples, libplinkio_loci_private_t loci, struct pio_bed_file_t* bed_file)
 {
-    char read_buffer[ LIBPLINKIO_PED_PARSE_BUFFER_SIZE_ ];
     struct ped_state_t state = { 0 };
-    libplinkio_txt_parser_private_t parser = { 0 };
 
     int ped_num_cols = libplinkio_count_txt_column_(ped_fp);
     if ( (ped_num_cols < 0) ) goto error;
@@ -266,16 +265,7 @@ libplinkio_ped_parse_samples_(FILE* ped_fp, libplinkio_samples_private_t samples
     state.snps = (snp_t*)calloc(locus_length, sizeof(snp_t));
     if (state.snps == NULL) goto error;
 
-    libplinkio_txt_parser_init_( &parser );
-    do {
-        size_t bytes_read = fread( read_buffer, sizeof( char ), LIBPLINKIO_PED_PARSE_BUFFER_SIZE_ - 1, ped_fp );
-        if (ferror( ped_fp )) goto error;
-        read_buffer[bytes_read] = '\0';
-        libplinkio_txt_parse_( &parser, read_buffer, bytes_read, &ped_new_field, &ped_new_row, (void *) &state );
-    } while( !feof( ped_fp ) );
-
-    libplinkio_txt_parse_fini_( &parser, &ped_new_field, &ped_new_row, (void *) &state );
-    libplinkio_txt_parser_free_( &parser );
+    if( libplinkio_txt_parse_file_( ped_fp, &ped_new_field, &ped_new_row, (void *) &state ) != PIO_OK ) goto error;
 
     free(state.snps);
     state.snps = NULL;
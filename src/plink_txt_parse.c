@@ -1,12 +1,31 @@
 #include "private/utility.h"
+#include "private/cpu.h"
 #include "private/plink_txt_parse.h"
+#include "private/thread.h"
 #include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef LIBPLINKIO_X86_
+#include <immintrin.h>
+#endif
 
 /**
  * Buffer size for reading CSV file.
  */
 #define LIBPLINKIO_COLUMN_COUNT_BUFFER_SIZE_ 4096
 
+/**
+ * Size of the blocks that are read when a file cannot be mapped.
+ */
+#define LIBPLINKIO_TXT_PARSE_BLOCK_SIZE_ ( 1 << 20 )
+
+/**
+ * Number of characters that are classified at a time, one per bit
+ * of the masks.
+ */
+#define LIBPLINKIO_TXT_CLASSIFY_SIZE_ 64
+
 /**
  * Parses an string from a csv field.
  *
@@ -37,6 +56,90 @@ libplinkio_parse_str_(const char *field, size_t length, pio_status_t *status)
     }
 }
 
+/**
+ * Parses a string from a csv field into an arena.
+ *
+ * @param arena The string is allocated from this arena, or
+ *              with malloc like libplinkio_parse_str_ if it
+ *              is NULL.
+ * @param field Csv field.
+ * @param length Length of the field.
+ * @param status Status of the conversion.
+ *
+ * @return The parsed csv field, or NULL if it could
+ *         not be parsed.
+ */
+char*
+libplinkio_parse_arena_str_(libplinkio_arena_private_t *arena, const char *field, size_t length, pio_status_t *status)
+{
+    char *str;
+    if( arena == NULL )
+    {
+        return libplinkio_parse_str_( field, length, status );
+    }
+
+    str = length > 0 ? libplinkio_arena_strndup_( arena, field, length ) : NULL;
+    *status = str != NULL ? PIO_OK : PIO_ERROR;
+    return str;
+}
+
+/**
+ * Parses an allele from a csv field, alleles are interned in the
+ * arena so that equal alleles share their string.
+ *
+ * @param arena The allele is interned in this arena, or allocated
+ *              with malloc like libplinkio_parse_str_ if it is NULL.
+ * @param field Csv field.
+ * @param length Length of the field.
+ * @param status Status of the conversion.
+ *
+ * @return The parsed csv field, or NULL if it could
+ *         not be parsed.
+ */
+char*
+libplinkio_parse_arena_allele_(libplinkio_arena_private_t *arena, const char *field, size_t length, pio_status_t *status)
+{
+    char *allele;
+    if( arena == NULL )
+    {
+        return libplinkio_parse_str_( field, length, status );
+    }
+
+    allele = length > 0 ? libplinkio_arena_intern_( arena, field, length ) : NULL;
+    *status = allele != NULL ? PIO_OK : PIO_ERROR;
+    return allele;
+}
+
+/**
+ * Returns a null terminated copy of a field, in buffer if it
+ * fits and on the heap otherwise.
+ *
+ * @param field Csv field.
+ * @param length Length of the field.
+ * @param buffer Buffer for short fields.
+ * @param buffer_size Size of the buffer.
+ *
+ * @return The copy, or NULL if it could not be allocated. The
+ *         caller frees it if it is not buffer.
+ */
+char*
+libplinkio_terminate_field_(const char *field, size_t length, char *buffer, size_t buffer_size)
+{
+    char *copy = buffer;
+    if( length >= buffer_size )
+    {
+        copy = (char *) malloc( sizeof( char ) * ( length + 1 ) );
+        if( copy == NULL )
+        {
+            return NULL;
+        }
+    }
+
+    memcpy( copy, field, length );
+    copy[ length ] = '\0';
+    return copy;
+}
+
 /**
  * Parses a chromosome number and returns it.
  *
@@ -219,7 +322,7 @@ libplinkio_parse_phenotype_(const char *field, size_t length, struct pio_sample_
  * @param field Csv field.
  * @param length Length of the field.
  * @param idx Index of the locus field.
- * @param loci Loci.
+ * @param loci Loci, the alleles are interned in their arena.
  * @param prev_call Previous call type of the allele.
  * @param status Status of the conversion.
  */
@@ -229,30 +332,29 @@ libplinkio_parse_allele_(const char *field, size_t length, size_t locus_idx, siz
     libplinkio_allele_call_private_t call = LIBPLINKIO_ALLELE_CALL_NO_;
 
     struct pio_locus_t* locus = libplinkio_get_locus_(loci, locus_idx);
-    char* allele = (char*)calloc(length + 1, sizeof(char));
-    if (allele == NULL) goto error;
-    strncpy( allele, field, length );
-    allele[length] = '\0';
+    char* allele = NULL;
 
-    if (strcmp(allele, "0") == 0) {
-        free(allele);
+    if (length == 1 && field[0] == '0') {
         call = LIBPLINKIO_ALLELE_CALL_NO_;
-    } else if (locus->allele1 == NULL) {
-        locus->allele1 = allele;
-        call = LIBPLINKIO_ALLELE_CALL_1_;
-    } else if (strcmp(allele, locus->allele1) == 0) {
-        free(allele);
-        call = LIBPLINKIO_ALLELE_CALL_1_;
-    } else if (locus->allele2 == NULL) {
-        locus->allele2 = allele;
-        call = LIBPLINKIO_ALLELE_CALL_2_;
-    } else if (strcmp(allele, locus->allele2) == 0) {
-        free(allele);
-        call = LIBPLINKIO_ALLELE_CALL_2_;
     } else {
-        goto error;
+        /* Interned alleles are equal exactly if their pointers are. */
+        allele = libplinkio_arena_intern_(loci.strings, field, length);
+        if (allele == NULL) goto error;
+
+        if (locus->allele1 == NULL) {
+            locus->allele1 = allele;
+            call = LIBPLINKIO_ALLELE_CALL_1_;
+        } else if (allele == locus->allele1) {
+            call = LIBPLINKIO_ALLELE_CALL_1_;
+        } else if (locus->allele2 == NULL) {
+            locus->allele2 = allele;
+            call = LIBPLINKIO_ALLELE_CALL_2_;
+        } else if (allele == locus->allele2) {
+            call = LIBPLINKIO_ALLELE_CALL_2_;
+        } else {
+            goto error;
+        }
     }
-    allele = NULL;
 
     if (allele_idx == 0) {
         // first call
@@ -281,12 +383,168 @@ libplinkio_parse_allele_(const char *field, size_t length, size_t locus_idx, siz
     *status = PIO_OK;
     return;
 error:
-    free(allele);
     *prev_call = LIBPLINKIO_ALLELE_CALL_ERROR_;
     *status = PIO_ERROR;
     return;
 }
 
+/**
+ * Classifies LIBPLINKIO_TXT_CLASSIFY_SIZE_ characters: bit i of
+ * delims is set if text[ i ] is a space, a tab or a newline, and
+ * bit i of newlines if it is a newline.
+ */
+typedef void (*txt_classify_kernel_t)(const char *text, uint64_t *delims, uint64_t *newlines);
+
+/**
+ * Classifies the first length characters of text, the bits after
+ * them are cleared.
+ */
+static void
+classify_tail(const char *text, size_t length, uint64_t *delims, uint64_t *newlines)
+{
+    uint64_t d = 0;
+    uint64_t n = 0;
+    for(size_t i = 0; i < length; i++)
+    {
+        char c = text[ i ];
+        d |= (uint64_t) ( c == ' ' || c == '\t' || c == '\n' ) << i;
+        n |= (uint64_t) ( c == '\n' ) << i;
+    }
+
+    *delims = d;
+    *newlines = n;
+}
+
+static void
+classify_scalar(const char *text, uint64_t *delims, uint64_t *newlines)
+{
+    classify_tail( text, LIBPLINKIO_TXT_CLASSIFY_SIZE_, delims, newlines );
+}
+
+#ifdef LIBPLINKIO_X86_
+
+LIBPLINKIO_TARGET_("sse2")
+static void
+classify_sse2(const char *text, uint64_t *delims, uint64_t *newlines)
+{
+    const __m128i space = _mm_set1_epi8( ' ' );
+    const __m128i tab = _mm_set1_epi8( '\t' );
+    const __m128i newline = _mm_set1_epi8( '\n' );
+    uint64_t d = 0;
+    uint64_t n = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        __m128i x = _mm_loadu_si128( (const __m128i *)( text + 16 * i ) );
+        __m128i is_newline = _mm_cmpeq_epi8( x, newline );
+        __m128i is_delim = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( x, space ), _mm_cmpeq_epi8( x, tab ) ), is_newline );
+        d |= (uint64_t) (uint32_t) _mm_movemask_epi8( is_delim ) << ( 16 * i );
+        n |= (uint64_t) (uint32_t) _mm_movemask_epi8( is_newline ) << ( 16 * i );
+    }
+
+    *delims = d;
+    *newlines = n;
+}
+
+LIBPLINKIO_TARGET_("avx2")
+static void
+classify_avx2(const char *text, uint64_t *delims, uint64_t *newlines)
+{
+    const __m256i space = _mm256_set1_epi8( ' ' );
+    const __m256i tab = _mm256_set1_epi8( '\t' );
+    const __m256i newline = _mm256_set1_epi8( '\n' );
+    __m256i lo = _mm256_loadu_si256( (const __m256i *) text );
+    __m256i hi = _mm256_loadu_si256( (const __m256i *)( text + 32 ) );
+    __m256i lo_newline = _mm256_cmpeq_epi8( lo, newline );
+    __m256i hi_newline = _mm256_cmpeq_epi8( hi, newline );
+    __m256i lo_delim = _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( lo, space ), _mm256_cmpeq_epi8( lo, tab ) ), lo_newline );
+    __m256i hi_delim = _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( hi, space ), _mm256_cmpeq_epi8( hi, tab ) ), hi_newline );
+
+    *delims = (uint64_t) (uint32_t) _mm256_movemask_epi8( lo_delim ) | (uint64_t) (uint32_t) _mm256_movemask_epi8( hi_delim ) << 32;
+    *newlines = (uint64_t) (uint32_t) _mm256_movemask_epi8( lo_newline ) | (uint64_t) (uint32_t) _mm256_movemask_epi8( hi_newline ) << 32;
+}
+
+LIBPLINKIO_TARGET_("avx512f,avx512bw")
+static void
+classify_avx512(const char *text, uint64_t *delims, uint64_t *newlines)
+{
+    __m512i x = _mm512_loadu_si512( (const void *) text );
+    uint64_t n = _mm512_cmpeq_epi8_mask( x, _mm512_set1_epi8( '\n' ) );
+
+    *delims = n | _mm512_cmpeq_epi8_mask( x, _mm512_set1_epi8( ' ' ) ) | _mm512_cmpeq_epi8_mask( x, _mm512_set1_epi8( '\t' ) );
+    *newlines = n;
+}
+
+#endif /* LIBPLINKIO_X86_ */
+
+/**
+ * All compiled classifiers, slowest first, together with the
+ * CPU features they require.
+ */
+static const struct {
+    unsigned int features;
+    const char *name;
+    txt_classify_kernel_t classify;
+} g_txt_kernels[] = {
+    { 0, "scalar", classify_scalar },
+#ifdef LIBPLINKIO_X86_
+    { LIBPLINKIO_CPU_SSE2_, "sse2", classify_sse2 },
+    { LIBPLINKIO_CPU_SSE2_ | LIBPLINKIO_CPU_SSSE3_ | LIBPLINKIO_CPU_AVX2_, "avx2", classify_avx2 },
+    { LIBPLINKIO_CPU_SSE2_ | LIBPLINKIO_CPU_SSSE3_ | LIBPLINKIO_CPU_AVX2_ | LIBPLINKIO_CPU_AVX512BW_, "avx512", classify_avx512 },
+#endif
+};
+
+#define LIBPLINKIO_NUM_TXT_KERNELS_ ( sizeof( g_txt_kernels ) / sizeof( g_txt_kernels[ 0 ] ) )
+
+/**
+ * One plus the index of the selected classifier in g_txt_kernels,
+ * or 0 until it is resolved on first use, accessed atomically like
+ * the index of libplinkio_snp_kernel_.
+ */
+static volatile size_t g_txt_classify_index = 0;
+
+static txt_classify_kernel_t
+txt_classify_kernel(void)
+{
+    size_t index = libplinkio_atomic_load_( &g_txt_classify_index );
+    if( index == 0 )
+    {
+        unsigned int features = libplinkio_cpu_features_( );
+        for(size_t i = 0; i < LIBPLINKIO_NUM_TXT_KERNELS_; i++)
+        {
+            if( ( g_txt_kernels[ i ].features & features ) == g_txt_kernels[ i ].features )
+            {
+                index = i + 1;
+            }
+        }
+        libplinkio_atomic_store_( &g_txt_classify_index, index );
+    }
+
+    return g_txt_kernels[ index - 1 ].classify;
+}
+
+/**
+ * Appends a piece of a field that continues into the next buffer
+ * to the field buffer of the parser, keeping it null terminated.
+ */
+static pio_status_t
+txt_append_field(libplinkio_txt_parser_private_t* parser, const char* text, size_t length)
+{
+    size_t least_required_size = parser->field_length + length + 1;
+    if (least_required_size > parser->field_buffer_size) {
+        size_t new_buffer_size = libplinkio_bits_msb_size_(least_required_size);
+        if (SIZE_MAX >> 2 < new_buffer_size) return PIO_ERROR;
+        new_buffer_size <<= 2;
+        char* tmp = (char*)realloc((void*)parser->field_buffer, sizeof(char)*new_buffer_size);
+        if (tmp == NULL) return PIO_ERROR;
+        parser->field_buffer = tmp;
+        parser->field_buffer_size = new_buffer_size;
+    }
+    memcpy(parser->field_buffer + parser->field_length, text, length);
+    parser->field_length += length;
+    parser->field_buffer[parser->field_length] = '\0';
+    return PIO_OK;
+}
+
 pio_status_t
 libplinkio_txt_parser_init_(
     libplinkio_txt_parser_private_t* parser
@@ -298,7 +556,6 @@ libplinkio_txt_parser_init_(
     if (parser->field_buffer == NULL) {
         return PIO_ERROR;
     }
-    memset((void*)parser->field_buffer, '\0', sizeof(char)*parser->field_buffer_size);
     parser->field_length = 0;
     parser->field_num = 0;
     parser->row_num = 0;
@@ -315,7 +572,12 @@ libplinkio_txt_parse_(
     void* data
 )
 {
-    libplinkio_txt_parser_state_private_t state = LIBPLINKIO_CHAR_SET_INIT_;
+    txt_classify_kernel_t classify = txt_classify_kernel();
+    const char* nul;
+    size_t field_start = SIZE_MAX;
+    uint64_t prev_delim;
+    char last;
+
     if (
         parser == NULL
         || parser->field_buffer == NULL
@@ -325,55 +587,71 @@ libplinkio_txt_parse_(
         return PIO_ERROR;
     }
 
-    for (size_t i = 0; i < length; i++)
+    /* The text ends at the first null character. */
+    nul = (const char*)memchr(buffer, '\0', length);
+    if (nul != NULL) length = (size_t)(nul - buffer);
+    if (length == 0) return PIO_OK;
+
+    /* A field start is a non-delimiter that follows a delimiter, and
+       a field end a delimiter that follows a non-delimiter. The field
+       that is open when the buffer starts, if any, has field_start
+       SIZE_MAX and its beginning is in the field buffer. */
+    prev_delim = parser->prev_state == LIBPLINKIO_CHAR_SET_GRAPH_ ? 0 : 1;
+    for (size_t block = 0; block < length; block += LIBPLINKIO_TXT_CLASSIFY_SIZE_)
     {
-        switch (buffer[i]) {
-          case ' ':
-          case '\t':
-              state = LIBPLINKIO_CHAR_SET_DELIM_;
-              break;
-          case '\n':
-              state = LIBPLINKIO_CHAR_SET_EOL_;
-              break;
-          case '\0':
-              return PIO_OK;
-              break;
-          default:
-              state = LIBPLINKIO_CHAR_SET_GRAPH_;
-              break;
+        size_t block_length = length - block;
+        uint64_t delims, newlines, follows_delim, starts, ends, events;
+        if (block_length >= LIBPLINKIO_TXT_CLASSIFY_SIZE_) {
+            block_length = LIBPLINKIO_TXT_CLASSIFY_SIZE_;
+            classify(buffer + block, &delims, &newlines);
+        } else {
+            classify_tail(buffer + block, block_length, &delims, &newlines);
         }
 
-        if (state == LIBPLINKIO_CHAR_SET_GRAPH_) {
-            size_t least_required_size = parser->field_length + 2;
-            if (least_required_size > parser->field_buffer_size) {
-                size_t new_buffer_size = libplinkio_bits_msb_size_(least_required_size);
-                if (SIZE_MAX >> 2 < new_buffer_size) return PIO_ERROR;
-                new_buffer_size <<= 2;
-                char* tmp = (char*)realloc((void*)parser->field_buffer, sizeof(char)*new_buffer_size);
-                if (tmp != NULL) {
-                    memset((void*)(tmp + parser->field_buffer_size), '\0', sizeof(char)*(new_buffer_size - parser->field_buffer_size));
-                    parser->field_buffer = tmp;
-                    parser->field_buffer_size = new_buffer_size;
+        follows_delim = delims << 1 | prev_delim;
+        starts = ~delims & follows_delim;
+        if (block_length < LIBPLINKIO_TXT_CLASSIFY_SIZE_) starts &= ((uint64_t)1 << block_length) - 1;
+        ends = delims & ~follows_delim;
+        prev_delim = delims >> (LIBPLINKIO_TXT_CLASSIFY_SIZE_ - 1);
+
+        events = starts | ends | newlines;
+        while (events != 0)
+        {
+            uint64_t event = events & (0 - events);
+            size_t pos = block + libplinkio_ctz64_(events);
+            events ^= event;
+
+            if ((starts & event) != 0) {
+                field_start = pos;
+            } else if ((ends & event) != 0) {
+                if (field_start == SIZE_MAX) {
+                    if (txt_append_field(parser, buffer, pos) != PIO_OK) return PIO_ERROR;
+                    new_field(parser->field_buffer, parser->field_length, parser->field_num, data);
+                    parser->field_length = 0;
                 } else {
-                    return PIO_ERROR;
+                    new_field(buffer + field_start, pos - field_start, parser->field_num, data);
                 }
+                parser->field_num++;
             }
-            (parser->field_length)++;
-            parser->field_buffer[parser->field_length - 1] = buffer[i];
-        } else if (parser->prev_state == LIBPLINKIO_CHAR_SET_GRAPH_) {
-            new_field(parser->field_buffer, parser->field_length, parser->field_num, data);
-            memset((void*)(parser->field_buffer), '\0', sizeof(char)*(parser->field_length));
-            parser->field_length = 0;
-            parser->field_num++;
-        }
 
-        if (state == LIBPLINKIO_CHAR_SET_EOL_) {
-            new_row(parser->row_num, data);
-            parser->row_num++;
-            parser->field_num = 0;
+            if ((newlines & event) != 0) {
+                new_row(parser->row_num, data);
+                parser->row_num++;
+                parser->field_num = 0;
+            }
         }
+    }
 
-        parser->prev_state = state;
+    last = buffer[length - 1];
+    if (last == '\n') {
+        parser->prev_state = LIBPLINKIO_CHAR_SET_EOL_;
+    } else if (last == ' ' || last == '\t') {
+        parser->prev_state = LIBPLINKIO_CHAR_SET_DELIM_;
+    } else {
+        /* The last field continues in the next buffer. */
+        size_t start = field_start == SIZE_MAX ? 0 : field_start;
+        if (txt_append_field(parser, buffer + start, length - start) != PIO_OK) return PIO_ERROR;
+        parser->prev_state = LIBPLINKIO_CHAR_SET_GRAPH_;
     }
     return PIO_OK;
 }
@@ -397,7 +675,6 @@ libplinkio_txt_parse_fini_(
     if (parser->prev_state != LIBPLINKIO_CHAR_SET_EOL_) {
         new_row(parser->row_num, data);
     }
-    memset((void*)(parser->field_buffer), '\0', sizeof(char)*(parser->field_length));
     parser->field_length = 0;
     parser->field_num = 0;
     parser->row_num = 0;
@@ -415,6 +692,91 @@ libplinkio_txt_parser_free_(
     parser->field_buffer = NULL;
 }
 
+#ifndef UNIT_TESTING
+/**
+ * Maps the rest of a regular file into memory.
+ *
+ * @param fp The file.
+ * @param text The text from the current position of fp.
+ * @param length The length of the text.
+ * @param mapped_file The mapping, to be passed to libplinkio_munmap_.
+ * @param mmap_state The state of the mapping.
+ *
+ * @return 0 if the file was mapped, -1 otherwise.
+ */
+static int
+txt_map_file(FILE* fp, char** text, size_t* length, void** mapped_file, libplinkio_mmap_state_private_t* mmap_state)
+{
+    struct stat file_stats;
+    long offset;
+    int fd = fileno(fp);
+
+    if (fd == -1 || fstat(fd, &file_stats) == -1) return -1;
+    if ((file_stats.st_mode & S_IFMT) != S_IFREG || file_stats.st_size <= 0) return -1;
+    if ((uint64_t)file_stats.st_size > SIZE_MAX) return -1;
+    offset = ftell(fp);
+    if (offset < 0 || offset >= file_stats.st_size) return -1;
+
+    *mapped_file = libplinkio_mmap_(fd, LIBPLINKIO_MMAP_READONLY_, mmap_state);
+    if (*mapped_file == NULL) return -1;
+    libplinkio_madvise_(*mapped_file, (size_t)file_stats.st_size, LIBPLINKIO_ADVICE_SEQUENTIAL_);
+
+    *text = (char*)*mapped_file + offset;
+    *length = (size_t)file_stats.st_size - (size_t)offset;
+    return 0;
+}
+#endif
+
+pio_status_t
+libplinkio_txt_parse_file_(
+    FILE* fp,
+    void (*new_field)(char*, size_t, size_t, void*),
+    void (*new_row)(size_t, void*),
+    void* data
+)
+{
+    libplinkio_txt_parser_private_t parser = { 0 };
+    char* block = NULL;
+    pio_status_t status = PIO_ERROR;
+#ifndef UNIT_TESTING
+    libplinkio_mmap_state_private_t mmap_state;
+    void* mapped_file = NULL;
+    char* text = NULL;
+    size_t length = 0;
+#endif
+
+    if (libplinkio_txt_parser_init_(&parser) != PIO_OK) goto error;
+
+#ifndef UNIT_TESTING
+    if (txt_map_file(fp, &text, &length, &mapped_file, &mmap_state) == 0) {
+        pio_status_t parse_status = libplinkio_txt_parse_(&parser, text, length, new_field, new_row, data);
+        libplinkio_munmap_(mapped_file, &mmap_state);
+        if (parse_status != PIO_OK || fseek(fp, 0, SEEK_END) != 0) goto error;
+        goto done;
+    }
+#endif
+
+    block = (char*)malloc(LIBPLINKIO_TXT_PARSE_BLOCK_SIZE_);
+    if (block == NULL) goto error;
+    do {
+        size_t bytes_read = fread(block, sizeof(char), LIBPLINKIO_TXT_PARSE_BLOCK_SIZE_, fp);
+        if (ferror(fp)) goto error;
+        if (libplinkio_txt_parse_(&parser, block, bytes_read, new_field, new_row, data) != PIO_OK) goto error;
+    } while (!feof(fp));
+
+#ifndef UNIT_TESTING
+done:
+#endif
+    if (libplinkio_txt_parse_fini_(&parser, new_field, new_row, data) != PIO_OK) goto error;
+    status = PIO_OK;
+
+error:
+    // This "if" is a workaroud for false positives of test_free in cmockery.
+    if (block != NULL) free(block);
+    if (parser.field_buffer != NULL) libplinkio_txt_parser_free_(&parser);
+    return status;
+}
+
 int libplinkio_count_txt_column_(FILE* fp) {
     char read_buffer[ LIBPLINKIO_COLUMN_COUNT_BUFFER_SIZE_ ];
     libplinkio_txt_parser_state_private_t prev_state = LIBPLINKIO_CHAR_SET_INIT_;
@@ -11,6 +11,12 @@
 #include <string.h>
 #include <fcntl.h>
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 #include <plinkio/plinkio.h>
 #include <plinkio/file.h>
 
@@ -46,24 +52,20 @@ concatenate(const char *a, const char *b)
     return buffer;
 }
 
-pio_status_t
-pio_open(struct pio_file_t *plink_file, const char *plink_file_prefix)
-{
-    char *fam_path = concatenate( plink_file_prefix, ".fam" );
-    char *bim_path = concatenate( plink_file_prefix, ".bim" );
-    char *bed_path = concatenate( plink_file_prefix, ".bed" );
-
-    pio_status_t status = pio_open_ex( plink_file, fam_path, bim_path, bed_path );
-
-    free( fam_path );
-    free( bim_path );
-    free( bed_path );
-
-    return status;
-}
-
-
-pio_status_t pio_open_ex(struct pio_file_t *plink_file, const char *fam_path, const char *bim_path, const char *bed_path)
+/**
+ * Opens the .fam, .bim and .bed files of a plink file.
+ *
+ * @param plink_file Plink file.
+ * @param fam_path Path to the .fam file.
+ * @param bim_path Path to the .bim file.
+ * @param bed_path Path to the .bed file.
+ * @param mapped Whether the .bed file should be memory mapped.
+ *
+ * @return PIO_OK, if all files existed and could be read, otherwise
+ *         the error of the last file that failed.
+ */
+static pio_status_t
+open_files(struct pio_file_t *plink_file, const char *fam_path, const char *bim_path, const char *bed_path, _Bool mapped)
 {
     int error = 0;
     size_t num_samples = 0;
@@ -87,7 +89,14 @@ pio_status_t pio_open_ex(struct pio_file_t *plink_file, const char *fam_path, co
         error = P_BIM_IO_ERROR;
     }
 
-    if( bed_open( &plink_file->bed_file, bed_path, num_loci, num_samples ) != PIO_OK )
+    if( mapped )
+    {
+        if( bed_open_mapped( &plink_file->bed_file, bed_path, num_loci, num_samples ) != PIO_OK )
+        {
+            error = P_BED_IO_ERROR;
+        }
+    }
+    else if( bed_open( &plink_file->bed_file, bed_path, num_loci, num_samples ) != PIO_OK )
     {
         error = P_BED_IO_ERROR;
     }
@@ -106,6 +115,73 @@ pio_status_t pio_open_ex(struct pio_file_t *plink_file, const char *fam_path, co
     }
 }
 
+/**
+ * Opens the plink file with the given prefix.
+ *
+ * @param plink_file Plink file.
+ * @param plink_file_prefix Path to the plink files, without the extension.
+ * @param mapped Whether the .bed file should be memory mapped.
+ *
+ * @return See open_files.
+ */
+static pio_status_t
+open_prefix(struct pio_file_t *plink_file, const char *plink_file_prefix, _Bool mapped)
+{
+    char *fam_path = concatenate( plink_file_prefix, ".fam" );
+    char *bim_path = concatenate( plink_file_prefix, ".bim" );
+    char *bed_path = concatenate( plink_file_prefix, ".bed" );
+
+    pio_status_t status = open_files( plink_file, fam_path, bim_path, bed_path, mapped );
+
+    free( fam_path );
+    free( bim_path );
+    free( bed_path );
+
+    return status;
+}
+
+pio_status_t
+pio_open(struct pio_file_t *plink_file, const char *plink_file_prefix)
+{
+    return open_prefix( plink_file, plink_file_prefix, false );
+}
+
+pio_status_t
+pio_open_mapped(struct pio_file_t *plink_file, const char *plink_file_prefix)
+{
+    return open_prefix( plink_file, plink_file_prefix, true );
+}
+
+pio_status_t
+pio_open_order(struct pio_file_t *plink_file, const char *plink_file_prefix, enum SnpOrder order)
+{
+    pio_status_t status = open_prefix( plink_file, plink_file_prefix, false );
+    if( status != PIO_OK )
+    {
+        return status;
+    }
+
+    if( bed_set_snp_order( &plink_file->bed_file, order, 0 ) != PIO_OK )
+    {
+        pio_close( plink_file );
+        return P_BED_IO_ERROR;
+    }
+
+    return PIO_OK;
+}
+
+pio_status_t
+pio_set_snp_order(struct pio_file_t *plink_file, enum SnpOrder order, size_t window_size)
+{
+    return bed_set_snp_order( &plink_file->bed_file, order, window_size );
+}
+
+pio_status_t
+pio_open_ex(struct pio_file_t *plink_file, const char *fam_path, const char *bim_path, const char *bed_path)
+{
+    return open_files( plink_file, fam_path, bim_path, bed_path, false );
+}
+
 pio_status_t
 libplinkio_open_txt_(struct pio_file_t *plink_file, const char *plink_file_prefix)
 {
@@ -218,6 +294,74 @@ pio_create(struct pio_file_t *plink_file, const char *plink_file_prefix, struct
     return PIO_OK;
 }
 
+pio_status_t
+pio_create_sized(struct pio_file_t *plink_file, const char *plink_file_prefix, struct pio_sample_t *samples, size_t num_samples, struct pio_locus_t *loci, size_t num_loci)
+{
+    char *fam_path = concatenate( plink_file_prefix, ".fam" );
+    char *bim_path = concatenate( plink_file_prefix, ".bim" );
+    char *bed_path = concatenate( plink_file_prefix, ".bed" );
+    pio_status_t status = PIO_OK;
+
+    if( fam_create( &plink_file->fam_file, fam_path, samples, num_samples ) != PIO_OK )
+    {
+        status = P_FAM_IO_ERROR;
+    }
+    else if( bim_create( &plink_file->bim_file, bim_path ) != PIO_OK ||
+             bim_write_loci( &plink_file->bim_file, loci, num_loci ) != PIO_OK )
+    {
+        status = P_BIM_IO_ERROR;
+    }
+    else if( bed_create_sized( &plink_file->bed_file, bed_path, num_loci, num_samples ) != PIO_OK )
+    {
+        status = P_BED_IO_ERROR;
+    }
+
+    free( fam_path );
+    free( bim_path );
+    free( bed_path );
+
+    return status;
+}
+
+pio_status_t
+pio_write_row_at(struct pio_file_t *plink_file, size_t row, const snp_t *buffer)
+{
+    if( bed_write_row_at( &plink_file->bed_file, row, buffer ) != PIO_OK )
+    {
+        return P_BED_IO_ERROR;
+    }
+
+    return PIO_OK;
+}
+
+pio_status_t
+pio_write_sample(struct pio_file_t *plink_file, const snp_t *buffer)
+{
+    if( bed_write_col( &plink_file->bed_file, buffer ) != PIO_OK )
+    {
+        return P_BED_IO_ERROR;
+    }
+
+    return PIO_OK;
+}
+
+pio_status_t
+pio_flush_samples(struct pio_file_t *plink_file)
+{
+    if( bed_flush_cols( &plink_file->bed_file ) != PIO_OK )
+    {
+        return P_BED_IO_ERROR;
+    }
+
+    return PIO_OK;
+}
+
+void
+pio_set_sample_tile_size(struct pio_file_t *plink_file, size_t tile_size)
+{
+    bed_set_col_tile_size( &plink_file->bed_file, tile_size );
+}
+
 pio_status_t
 pio_write_row(struct pio_file_t *plink_file, struct pio_locus_t *locus, snp_t *buffer)
 {
@@ -238,6 +382,42 @@ pio_write_row(struct pio_file_t *plink_file, struct pio_locus_t *locus, snp_t *b
     }
 }
 
+pio_status_t
+pio_write_row_packed(struct pio_file_t *plink_file, struct pio_locus_t *locus, const unsigned char *packed_row)
+{
+    if( bed_write_row_packed( &plink_file->bed_file, packed_row ) != PIO_OK )
+    {
+        return P_BED_IO_ERROR;
+    }
+    if( bim_write( &plink_file->bim_file, locus ) != PIO_OK )
+    {
+        return P_BIM_IO_ERROR;
+    }
+
+    return PIO_OK;
+}
+
+pio_status_t
+pio_write_rows(struct pio_file_t *plink_file, struct pio_locus_t *loci, const snp_t *matrix, size_t num_rows)
+{
+    if( bed_write_rows( &plink_file->bed_file, matrix, num_rows ) != PIO_OK )
+    {
+        return P_BED_IO_ERROR;
+    }
+    if( bim_write_loci( &plink_file->bim_file, loci, num_rows ) != PIO_OK )
+    {
+        return P_BIM_IO_ERROR;
+    }
+
+    return PIO_OK;
+}
+
+void
+pio_set_keep_loci(struct pio_file_t *plink_file, int keep)
+{
+    bim_set_keep_loci( &plink_file->bim_file, keep );
+}
+
 struct pio_sample_t *
 pio_get_sample(struct pio_file_t *plink_file, size_t pio_id)
 {
@@ -268,6 +448,144 @@ pio_next_row(struct pio_file_t *plink_file, snp_t *buffer)
     return bed_read_row( &plink_file->bed_file, buffer ); 
 }
 
+pio_status_t
+pio_next_row_packed(struct pio_file_t *plink_file, unsigned char *packed_row)
+{
+    return bed_read_row_packed( &plink_file->bed_file, packed_row );
+}
+
+pio_status_t
+pio_set_prefetch(struct pio_file_t *plink_file, size_t depth, size_t block_size, int decoded)
+{
+    return bed_set_prefetch( &plink_file->bed_file, depth, block_size, decoded );
+}
+
+pio_status_t
+pio_set_access_pattern(struct pio_file_t *plink_file, int pattern)
+{
+    return bed_set_access_pattern( &plink_file->bed_file, pattern );
+}
+
+pio_status_t
+pio_will_need_rows(struct pio_file_t *plink_file, size_t first_row, size_t num_rows)
+{
+    return bed_will_need_rows( &plink_file->bed_file, first_row, num_rows );
+}
+
+pio_status_t
+pio_next_row_float(struct pio_file_t *plink_file, float *buffer, enum DosageScaling scaling, double missing_value)
+{
+    return bed_read_row_float( &plink_file->bed_file, buffer, scaling, missing_value );
+}
+
+pio_status_t
+pio_next_row_double(struct pio_file_t *plink_file, double *buffer, enum DosageScaling scaling, double missing_value)
+{
+    return bed_read_row_double( &plink_file->bed_file, buffer, scaling, missing_value );
+}
+
+pio_status_t
+pio_next_row_int8(struct pio_file_t *plink_file, int8_t *buffer, int8_t missing_value)
+{
+    return bed_read_row_int8( &plink_file->bed_file, buffer, missing_value );
+}
+
+pio_status_t
+pio_next_row_mapped(struct pio_file_t *plink_file, const unsigned char **packed_row)
+{
+    return bed_read_row_mapped( &plink_file->bed_file, packed_row );
+}
+
+pio_status_t
+pio_next_rows(struct pio_file_t *plink_file, size_t max_rows, snp_t *buffer, size_t *rows_read)
+{
+    return bed_read_rows( &plink_file->bed_file, max_rows, buffer, rows_read );
+}
+
+pio_status_t
+pio_next_rows_padded(struct pio_file_t *plink_file, size_t max_rows, snp_t *buffer, size_t *rows_read)
+{
+    return bed_read_rows_padded( &plink_file->bed_file, max_rows, buffer, rows_read );
+}
+
+void
+pio_set_chunk_size(struct pio_file_t *plink_file, size_t chunk_size)
+{
+    bed_set_chunk_size( &plink_file->bed_file, chunk_size );
+}
+
+pio_status_t
+pio_row_subset_init(struct bed_row_subset_t *subset, struct pio_file_t *plink_file, const size_t *rows, size_t num_rows, enum RowOrder order)
+{
+    return bed_row_subset_init( subset, &plink_file->bed_file, rows, num_rows, order );
+}
+
+pio_status_t
+pio_row_subset_next(struct bed_row_subset_t *subset, snp_t *buffer, size_t *row_index)
+{
+    return bed_row_subset_next( subset, buffer, row_index );
+}
+
+pio_status_t
+pio_row_subset_next_packed(struct bed_row_subset_t *subset, unsigned char *packed_row, size_t *row_index)
+{
+    return bed_row_subset_next_packed( subset, packed_row, row_index );
+}
+
+void
+pio_row_subset_close(struct bed_row_subset_t *subset)
+{
+    bed_row_subset_close( subset );
+}
+
+pio_status_t
+pio_async_init(struct bed_async_t *async, struct pio_file_t *plink_file, size_t queue_depth)
+{
+    return bed_async_init( async, &plink_file->bed_file, queue_depth );
+}
+
+pio_status_t
+pio_async_submit(struct bed_async_t *async, const size_t *rows, size_t num_rows, bed_async_callback_t callback, void *user_data)
+{
+    return bed_async_submit( async, rows, num_rows, callback, user_data );
+}
+
+size_t
+pio_async_poll(struct bed_async_t *async, size_t min_complete)
+{
+    return bed_async_poll( async, min_complete );
+}
+
+void
+pio_async_wait(struct bed_async_t *async)
+{
+    bed_async_wait( async );
+}
+
+const char *
+pio_async_engine(struct bed_async_t *async)
+{
+    return bed_async_engine( async );
+}
+
+void
+pio_async_close(struct bed_async_t *async)
+{
+    bed_async_close( async );
+}
+
+pio_status_t
+pio_read_row_at(struct pio_file_t *plink_file, size_t row_index, snp_t *buffer)
+{
+    return bed_read_row_at( &plink_file->bed_file, row_index, buffer );
+}
+
+pio_status_t
+pio_read_row_packed_at(struct pio_file_t *plink_file, size_t row_index, unsigned char *packed_row)
+{
+    return bed_read_row_packed_at( &plink_file->bed_file, row_index, packed_row );
+}
+
 pio_status_t
 pio_skip_row(struct pio_file_t *plink_file)
 {
@@ -286,27 +604,124 @@ pio_row_size(struct pio_file_t *plink_file)
     return bed_row_size( &plink_file->bed_file );
 }
 
+size_t
+pio_row_stride(struct pio_file_t *plink_file)
+{
+    return bed_row_stride( &plink_file->bed_file );
+}
+
+snp_t *
+pio_row_alloc(struct pio_file_t *plink_file)
+{
+    return bed_row_alloc( &plink_file->bed_file );
+}
+
+snp_t *
+pio_matrix_alloc(struct pio_file_t *plink_file, size_t num_rows)
+{
+    return bed_matrix_alloc( &plink_file->bed_file, num_rows );
+}
+
+void
+pio_buffer_free(snp_t *buffer)
+{
+    bed_buffer_free( buffer );
+}
+
+size_t
+pio_packed_row_size(struct pio_file_t *plink_file)
+{
+    return bed_header_row_size( &plink_file->bed_file.header );
+}
+
+pio_status_t
+pio_set_sample_subset(struct pio_file_t *plink_file, const size_t *samples, size_t num_samples)
+{
+    if( samples != NULL && !pio_one_locus_per_row( plink_file ) )
+    {
+        return PIO_ERROR;
+    }
+
+    return bed_set_col_subset( &plink_file->bed_file, samples, num_samples );
+}
+
+pio_status_t
+pio_set_sample_mask(struct pio_file_t *plink_file, const unsigned char *mask)
+{
+    size_t num_samples = pio_num_samples( plink_file );
+    size_t num_selected = 0;
+    size_t *samples = NULL;
+    pio_status_t status;
+
+    if( mask == NULL )
+    {
+        return pio_set_sample_subset( plink_file, NULL, 0 );
+    }
+
+    for(size_t i = 0; i < num_samples; i++)
+    {
+        num_selected += ( mask[ i / 8 ] >> ( i % 8 ) ) & 1;
+    }
+
+    samples = (size_t *) malloc( sizeof( size_t ) * ( num_selected > 0 ? num_selected : 1 ) );
+    if( samples == NULL )
+    {
+        return PIO_ERROR;
+    }
+
+    num_selected = 0;
+    for(size_t i = 0; i < num_samples; i++)
+    {
+        if( ( ( mask[ i / 8 ] >> ( i % 8 ) ) & 1 ) != 0 )
+        {
+            samples[ num_selected++ ] = i;
+        }
+    }
+
+    status = pio_set_sample_subset( plink_file, samples, num_selected );
+    free( samples );
+
+    return status;
+}
+
+const char *
+pio_unpack_kernel(void)
+{
+    return bed_unpack_kernel( );
+}
+
 int
 pio_one_locus_per_row(struct pio_file_t *plink_file)
 {
     return bed_snp_order( &plink_file->bed_file) == BED_ONE_LOCUS_PER_ROW;
 }
 
-void
+pio_status_t
 pio_close(struct pio_file_t *plink_file)
 {
-    bed_close( &plink_file->bed_file );
+    pio_status_t status = bed_close( &plink_file->bed_file );
     bim_close( &plink_file->bim_file );
     fam_close( &plink_file->fam_file );
+
+    return status == PIO_OK ? PIO_OK : P_BED_IO_ERROR;
 }
 
-pio_status_t
-pio_transpose(const char *plink_file_prefix, const char *transposed_file_prefix)
+/**
+ * Transposes the .bed file with bed_transpose_threads, or with
+ * bed_transpose_budget if memory_budget is non-zero, and copies
+ * the .bim and .fam files. The .bed file is written under a
+ * temporary name and renamed after the copies, so the transposed
+ * .bed file only appears once the whole fileset is complete.
+ */
+static pio_status_t
+transpose_fileset(const char *plink_file_prefix, const char *transposed_file_prefix, size_t num_threads, size_t memory_budget, bed_transpose_progress_t progress, void *user_data)
 {
     struct pio_file_t plink_file;
     char *bed_path;
     char *transposed_bed_path;
-    pio_status_t status;
+    char *tmp_bed_path = NULL;
+    pio_status_t status = PIO_ERROR;
+    int tmp_fd;
     if( pio_open( &plink_file, plink_file_prefix ) != PIO_OK )
     {
         return PIO_ERROR;
@@ -315,28 +730,80 @@ pio_transpose(const char *plink_file_prefix, const char *transposed_file_prefix)
     bed_path = concatenate( plink_file_prefix, ".bed" );
     transposed_bed_path = concatenate( transposed_file_prefix, ".bed" );
 
-    status = bed_transpose( bed_path, transposed_bed_path, pio_num_loci( &plink_file ), pio_num_samples( &plink_file ) );
+    tmp_fd = libplinkio_tmp_create_( transposed_bed_path, &tmp_bed_path );
+    if( tmp_fd != -1 )
+    {
+        close( tmp_fd );
+        if( memory_budget != 0 )
+        {
+            status = bed_transpose_budget( bed_path, tmp_bed_path, pio_num_loci( &plink_file ), pio_num_samples( &plink_file ), memory_budget, progress, user_data );
+        }
+        else
+        {
+            status = bed_transpose_threads( bed_path, tmp_bed_path, pio_num_loci( &plink_file ), pio_num_samples( &plink_file ), num_threads );
+        }
+    }
     if( status == PIO_OK )
     {
         char *bim_path;
         char *transposed_bim_path;
         char *fam_path = concatenate( plink_file_prefix, ".fam" );
         char *transposed_fam_path = concatenate( transposed_file_prefix, ".fam" );
-        file_copy( fam_path, transposed_fam_path );
+        if( file_copy( fam_path, transposed_fam_path ) != FILE_OK )
+        {
+            status = PIO_ERROR;
+        }
         free( fam_path );
         free( transposed_fam_path );
         
         bim_path = concatenate( plink_file_prefix, ".bim" );
         transposed_bim_path = concatenate( transposed_file_prefix, ".bim" );
-        file_copy( bim_path, transposed_bim_path );
+        if( status == PIO_OK && file_copy( bim_path, transposed_bim_path ) != FILE_OK )
+        {
+            status = PIO_ERROR;
+        }
         free( bim_path );
         free( transposed_bim_path );
     }
+    if( status == PIO_OK && file_rename( tmp_bed_path, transposed_bed_path ) != FILE_OK )
+    {
+        status = PIO_ERROR;
+    }
 
     pio_close( &plink_file );
 
+    if( tmp_bed_path != NULL )
+    {
+        if( status != PIO_OK )
+        {
+            file_remove( tmp_bed_path );
+        }
+        free( tmp_bed_path );
+    }
     free( bed_path );
     free( transposed_bed_path );
 
     return status;
 }
+
+pio_status_t
+pio_transpose(const char *plink_file_prefix, const char *transposed_file_prefix)
+{
+    return transpose_fileset( plink_file_prefix, transposed_file_prefix, 1, 0, NULL, NULL );
+}
+
+pio_status_t
+pio_transpose_threads(const char *plink_file_prefix, const char *transposed_file_prefix, size_t num_threads)
+{
+    return transpose_fileset( plink_file_prefix, transposed_file_prefix, num_threads, 0, NULL, NULL );
+}
+
+pio_status_t
+pio_transpose_budget(const char *plink_file_prefix, const char *transposed_file_prefix, size_t memory_budget, bed_transpose_progress_t progress, void *user_data)
+{
+    if( memory_budget == 0 )
+    {
+        memory_budget = 1;
+    }
+    return transpose_fileset( plink_file_prefix, transposed_file_prefix, 1, memory_budget, progress, user_data );
+}
@@ -14,6 +14,7 @@ extern "C" {
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
 
 #include <plinkio/status.h>
 #include <plinkio/bed_header.h>
@@ -48,6 +49,293 @@ struct pio_bed_file_t
      * Index of the current row.
      */
     size_t cur_row;
+
+    /**
+     * The whole file when opened with bed_open_mapped, or NULL
+     * if rows are read through fp.
+     */
+    const unsigned char *mapped_file;
+
+    /**
+     * Platform specific state of the mapping.
+     */
+    void *mmap_state;
+
+    /**
+     * Buffer for the packed rows of bed_read_rows, allocated on
+     * first use.
+     */
+    unsigned char *chunk_buffer;
+
+    /**
+     * Size of chunk_buffer in bytes.
+     */
+    size_t chunk_buffer_size;
+
+    /**
+     * Number of bytes that bed_read_rows reads at once, or 0 for
+     * BED_DEFAULT_CHUNK_SIZE.
+     */
+    size_t chunk_size;
+
+    /**
+     * The columns that the read functions decode, see
+     * bed_set_col_subset, or NULL if all columns are decoded.
+     */
+    void *col_subset;
+
+    /**
+     * State of the background reader, see bed_set_prefetch, or
+     * NULL if rows are read on the calling thread.
+     */
+    void *prefetch;
+
+    /**
+     * The AccessPattern flags given to bed_set_access_pattern.
+     */
+    int access_pattern;
+
+    /**
+     * With BED_ACCESS_DONTNEED_CONSUMED, the offset up to which
+     * the pages of the file have been dropped.
+     */
+    size_t dropped_offset;
+
+    /**
+     * Non-zero if the file was created with bed_create_sized, in
+     * which case the number of rows is fixed and rows are written
+     * at their offset.
+     */
+    int sized;
+
+    /**
+     * The columns buffered by bed_write_col, or NULL if none have
+     * been written.
+     */
+    void *col_writer;
+
+    /**
+     * Number of packed bytes of a tile of bed_write_col, or 0 for
+     * BED_DEFAULT_TILE_SIZE.
+     */
+    size_t tile_size;
+
+    /**
+     * The window of a file read in the other orientation, see
+     * bed_set_snp_order, or NULL if rows are read as stored.
+     */
+    void *view;
+};
+
+/**
+ * Number of bytes that bed_read_rows reads at once by default.
+ */
+#define BED_DEFAULT_CHUNK_SIZE ( 1 << 20 )
+
+/**
+ * Number of packed bytes of the columns that bed_write_col buffers
+ * by default before it writes them to the file.
+ */
+#define BED_DEFAULT_TILE_SIZE ( 16 << 20 )
+
+/**
+ * Number of bytes of transposed rows that a file read with
+ * bed_set_snp_order holds in memory by default.
+ */
+#define BED_DEFAULT_WINDOW_SIZE ( 16 << 20 )
+
+/**
+ * Alignment in bytes of the buffers from bed_row_alloc and
+ * bed_matrix_alloc, and the multiple that their rows are padded to.
+ * It is the width of the widest vector registers.
+ */
+#define BED_ROW_ALIGNMENT 64
+
+/**
+ * Rows of a bed_row_subset_t that are closer than this many bytes
+ * are read together, since reading the gap is cheaper than a seek.
+ */
+#define BED_MAX_GAP_SIZE ( 1 << 16 )
+
+/**
+ * Number of reads that a bed_async_t keeps in flight by default.
+ */
+#define BED_DEFAULT_QUEUE_DEPTH 64
+
+/**
+ * Number of consumed bytes after which BED_ACCESS_DONTNEED_CONSUMED
+ * drops the pages behind the current row, a multiple of the page size.
+ */
+#define BED_DROP_CONSUMED_SIZE ( 8 << 20 )
+
+/**
+ * Hints about how a bed file will be read, given to the kernel as
+ * posix_fadvise for files read through fp and as madvise for mapped
+ * files. The hints only affect caching, never the rows that are read.
+ */
+enum AccessPattern
+{
+    /**
+     * No particular pattern, the default read ahead of the kernel.
+     */
+    BED_ACCESS_NORMAL = 0,
+
+    /**
+     * The rows are read in order, so the kernel can read further ahead.
+     */
+    BED_ACCESS_SEQUENTIAL = 1,
+
+    /**
+     * The rows are read in random order, so read ahead is wasted.
+     */
+    BED_ACCESS_RANDOM = 2,
+
+    /**
+     * The pages of rows that the sequential read functions have
+     * moved past are dropped from the page cache, which keeps a scan
+     * over a file larger than memory from evicting everything else.
+     * Can be combined with the other patterns.
+     */
+    BED_ACCESS_DONTNEED_CONSUMED = 4
+};
+
+/**
+ * How bed_read_row_float and bed_read_row_double turn genotypes
+ * into dosages. The mean and standard deviation are taken over the
+ * non-missing genotypes of each row.
+ */
+enum DosageScaling
+{
+    /**
+     * The genotypes 0, 1 and 2, missing genotypes are set to a
+     * given value.
+     */
+    BED_DOSAGE_RAW,
+
+    /**
+     * The genotypes 0, 1 and 2, missing genotypes are set to the
+     * mean of the row.
+     */
+    BED_DOSAGE_MEAN_IMPUTED,
+
+    /**
+     * The genotypes minus the mean of the row, missing genotypes
+     * are set to 0.
+     */
+    BED_DOSAGE_CENTERED,
+
+    /**
+     * The genotypes minus the mean of the row divided by the
+     * standard deviation of the row, missing genotypes are set to 0.
+     * Rows without variation are all 0.
+     */
+    BED_DOSAGE_STANDARDIZED
+};
+
+/**
+ * The order in which a bed_row_subset_t returns its rows.
+ */
+enum RowOrder
+{
+    /**
+     * The rows are returned in the order they were given.
+     */
+    BED_REQUESTED_ORDER,
+
+    /**
+     * The rows are returned in the order they are stored in the file.
+     */
+    BED_FILE_ORDER
+};
+
+/**
+ * Iterates over a subset of the rows of a bed file. The rows are
+ * read in windows of about the chunk size of the file, where the
+ * rows of each window are sorted and neighbouring rows are merged
+ * into a single positional read. Gaps are skipped without reading
+ * row by row, and the current row of the bed file is not used.
+ */
+struct bed_row_subset_t
+{
+    /**
+     * The bed file that the rows are read from.
+     */
+    struct pio_bed_file_t *bed_file;
+
+    /**
+     * The rows in the order they are returned.
+     */
+    size_t *rows;
+
+    /**
+     * The number of rows.
+     */
+    size_t num_rows;
+
+    /**
+     * Index in rows of the next row to return.
+     */
+    size_t next;
+
+    /**
+     * The rows from window_start to window_end are stored packed
+     * in window, in the order of rows.
+     */
+    size_t window_start;
+    size_t window_end;
+    unsigned char *window;
+
+    /**
+     * The maximum number of rows in a window.
+     */
+    size_t window_capacity;
+
+    /**
+     * The rows of the current window sorted by their position in
+     * the file, as pairs of row and index in the window.
+     */
+    size_t *sorted;
+
+    /**
+     * Buffer for merged reads of rows that are not adjacent.
+     */
+    unsigned char *span_buffer;
+
+    /**
+     * Whether the rows are sorted, i.e. BED_FILE_ORDER.
+     */
+    int file_order;
+};
+
+/**
+ * Called for each row read by a bed_async_t, on the thread that
+ * calls bed_async_poll.
+ *
+ * @param user_data The pointer given to bed_async_submit.
+ * @param row_index The index of the row.
+ * @param status PIO_OK if the row could be read, PIO_ERROR otherwise.
+ * @param row The decoded row, see bed_read_row, or NULL on error.
+ *            It is only valid during the call.
+ */
+typedef void (*bed_async_callback_t)(void *user_data, size_t row_index, pio_status_t status, const snp_t *row);
+
+/**
+ * Reads many independent rows of a bed file concurrently. On Linux
+ * the reads are queued with io_uring when the kernel supports it,
+ * otherwise a small pool of threads issues positional reads. The
+ * current row of the bed file is not used.
+ */
+struct bed_async_t
+{
+    /**
+     * The bed file that the rows are read from.
+     */
+    struct pio_bed_file_t *bed_file;
+
+    /**
+     * State of the read engine.
+     */
+    void *engine;
 };
 
 /**
@@ -63,6 +351,46 @@ struct pio_bed_file_t
  */
 pio_status_t bed_open(struct pio_bed_file_t *bed_file, const char *path, size_t num_loci, size_t num_samples);
 
+/**
+ * Opens the bed file like bed_open, and maps the whole file into
+ * memory. Rows are then decoded straight from the mapping, without
+ * the copy through stdio, and bed_read_row_mapped can hand out
+ * pointers into it.
+ *
+ * @param bed_file Bed file.
+ * @param path Path to the bed file.
+ * @param num_loci The number loci.
+ * @param num_samples The number of samples.
+ *
+ * @return PIO_OK if the file could be opened and mapped, PIO_ERROR
+ *         otherwise, e.g. if the file is shorter than the header says.
+ */
+pio_status_t bed_open_mapped(struct pio_bed_file_t *bed_file, const char *path, size_t num_loci, size_t num_samples);
+
+/**
+ * Reads the rows of an opened bed file in the given orientation.
+ * If the file is stored in the other one, the header of bed_file is
+ * transposed, and the rows are served from a window of at most
+ * window_size bytes that is refilled by reading the same bytes from
+ * every row of the file and transposing them in memory. The file
+ * itself is not changed and no other file is written.
+ *
+ * The sequential, typed and bed_read_row_at functions work as
+ * usual, the latter read one byte from every row of the file.
+ * Prefetching, row subsets and asynchronous reads are not
+ * supported on a transposed file. Call it before the first read.
+ *
+ * @param bed_file Bed file opened with bed_open or bed_open_mapped.
+ * @param order The orientation of the rows that are read.
+ * @param window_size The size in bytes, or 0 for
+ *                    BED_DEFAULT_WINDOW_SIZE. At least 4 rows are
+ *                    always held.
+ *
+ * @return PIO_OK if the rows can be read in the given order,
+ *         PIO_ERROR otherwise.
+ */
+pio_status_t bed_set_snp_order(struct pio_bed_file_t *bed_file, enum SnpOrder order, size_t window_size);
+
 /**
  * Creates a bed file.
  *
@@ -74,15 +402,121 @@ pio_status_t bed_open(struct pio_bed_file_t *bed_file, const char *path, size_t
  */
 pio_status_t bed_create(struct pio_bed_file_t *bed_file, const char *path, size_t num_samples);
 
+/**
+ * Creates a locus major bed file with a known number of loci. The
+ * file is allocated to its full size up front, so that its rows can
+ * be written in any order with bed_write_row_at. Rows that are never
+ * written hold the homozygous major genotype. bed_write_row and
+ * bed_write_rows can still be used, they write the rows in order
+ * from the first one.
+ *
+ * @param bed_file Bed file.
+ * @param path Path to the bed file.
+ * @param num_loci The number of loci that the .bed file will include.
+ * @param num_samples The number of samples that the .bed file will include.
+ *
+ * @return PIO_OK if the file could be created, PIO_ERROR otherwise.
+ */
+pio_status_t bed_create_sized(struct pio_bed_file_t *bed_file, const char *path, size_t num_loci, size_t num_samples);
+
 /**
  * Writes a single row of samples to the bed file, assuming that the size of
  * the buffer is at least as big as specified when created.
  *
  * @param bed_file Bed file.
  * @param buffer List of SNPs to write to file.
+ *
+ * @return PIO_OK if the row could be written, PIO_ERROR if a SNP is
+ *         larger than 3 or the write failed.
  */
 pio_status_t bed_write_row(struct pio_bed_file_t *bed_file, const snp_t *buffer);
 
+/**
+ * Writes num_rows consecutive rows of a row-major matrix. The rows
+ * are packed into the chunk buffer, see bed_set_chunk_size, and
+ * each full chunk is written at once. All rows are checked before
+ * any of them is written.
+ *
+ * @param bed_file Bed file.
+ * @param rows The rows, num_rows times bed_num_snps_per_row SNPs.
+ * @param num_rows The number of rows.
+ *
+ * @return PIO_OK if the rows could be written, PIO_ERROR if a SNP is
+ *         larger than 3 or the write failed.
+ */
+pio_status_t bed_write_rows(struct pio_bed_file_t *bed_file, const snp_t *rows, size_t num_rows);
+
+/**
+ * Writes a row that is already in the packed format of the file,
+ * e.g. one from bed_read_row_packed, without decoding and encoding
+ * it. Every 2-bit code is a valid genotype, so only the bits after
+ * the last genotype are cleared before the row is written.
+ *
+ * @param bed_file Bed file.
+ * @param packed_row The packed row of bed_header_row_size bytes.
+ *
+ * @return PIO_OK if the row could be written, PIO_ERROR otherwise.
+ */
+pio_status_t bed_write_row_packed(struct pio_bed_file_t *bed_file, const unsigned char *packed_row);
+
+/**
+ * Writes a row of a file created with bed_create_sized at its
+ * offset. It does not use the file position or any buffer of
+ * bed_file, so many threads may write different rows at once.
+ *
+ * @param bed_file Bed file created with bed_create_sized.
+ * @param row_index Index of the row, starting from 0.
+ * @param buffer The genotypes of the row.
+ *
+ * @return PIO_OK if the row could be written, PIO_ERROR if the file
+ *         was not created with bed_create_sized, row_index is past
+ *         the last row, a SNP is larger than 3 or the write failed.
+ *         Nothing is written if a SNP is larger than 3.
+ */
+pio_status_t bed_write_row_at(struct pio_bed_file_t *bed_file, size_t row_index, const snp_t *buffer);
+
+/**
+ * Writes the next column of a file created with bed_create_sized,
+ * i.e. the genotypes of one sample for all loci. The columns are
+ * packed into tiles of several samples, and each full tile is
+ * transposed in memory and written into the rows of the file, so
+ * that data produced one sample at a time never has to go through
+ * a sample major file and bed_transpose. Do not mix with the row
+ * writes on the same file.
+ *
+ * @param bed_file Bed file created with bed_create_sized.
+ * @param buffer The genotypes of the column, one for each row.
+ *
+ * @return PIO_OK if the column could be buffered or written,
+ *         PIO_ERROR if the file was not created with
+ *         bed_create_sized, all columns have been written, a SNP is
+ *         larger than 3 or the write failed.
+ */
+pio_status_t bed_write_col(struct pio_bed_file_t *bed_file, const snp_t *buffer);
+
+/**
+ * Writes the columns that bed_write_col has buffered. This is done
+ * by bed_close as well. Columns share the bytes of a row 4 at a
+ * time, so until the last column has been written, the last
+ * columns_written % 4 columns stay buffered.
+ *
+ * @param bed_file Bed file.
+ *
+ * @return PIO_OK if the columns could be written, PIO_ERROR otherwise.
+ */
+pio_status_t bed_flush_cols(struct pio_bed_file_t *bed_file);
+
+/**
+ * Sets the number of packed bytes that bed_write_col buffers
+ * before it writes them. Larger tiles mean fewer and longer writes
+ * into each row, and take twice their size in memory. Takes effect
+ * before the first column is written.
+ *
+ * @param bed_file Bed file.
+ * @param tile_size The size in bytes, or 0 for BED_DEFAULT_TILE_SIZE.
+ */
+void bed_set_col_tile_size(struct pio_bed_file_t *bed_file, size_t tile_size);
+
 /**
  * Reads a single row from the given bed_file. Each element in the buffer
  * will contain a SNP. The SNP will be encoded as follows:
@@ -103,6 +537,294 @@ pio_status_t bed_write_row(struct pio_bed_file_t *bed_file, const snp_t *buffer)
  */
 pio_status_t bed_read_row(struct pio_bed_file_t *bed_file, snp_t *buffer);
 
+/**
+ * Copies the next row from the given bed_file without decoding it.
+ * The row is stored in the 2-bit format of the .bed file:
+ * - Each byte holds 4 SNPs, the first SNP in the two lowest bits,
+ *   i.e. SNP j is ( packed_row[ j / 4 ] >> ( 2 * ( j % 4 ) ) ) & 3.
+ * - The SNPs are encoded as follows:
+ *   * 00 - Homozygous major
+ *   * 01 - Missing value
+ *   * 10 - Hetrozygous
+ *   * 11 - Homozygous minor
+ * - The row takes bed_header_row_size bytes, i.e.
+ *   ( bed_num_snps_per_row + 3 ) / 4, and the bits after the last
+ *   SNP in the last byte are always cleared to 00, so whole bytes
+ *   or words can be processed without masking.
+ *
+ * @param bed_file Bed file.
+ * @param packed_row The buffer to read into, must be able to hold
+ *                   bed_header_row_size bytes.
+ *
+ * @return PIO_OK if a row could be read,
+ *         PIO_END if there are no more rows,
+ *         PIO_ERROR otherwise.
+ */
+pio_status_t bed_read_row_packed(struct pio_bed_file_t *bed_file, unsigned char *packed_row);
+
+/**
+ * Reads the next row like bed_read_row, but decodes it straight to
+ * float dosages with the given scaling, see DosageScaling. The row
+ * statistics are computed from the packed row, so the decoded row
+ * is only written once.
+ *
+ * @param bed_file Bed file.
+ * @param buffer The dosages are stored here, bed_row_size floats.
+ * @param scaling How the genotypes are turned into dosages.
+ * @param missing_value The value of missing genotypes for
+ *                      BED_DOSAGE_RAW, ignored otherwise.
+ *
+ * @return PIO_OK if the row could be read,
+ *         PIO_END if there are no more rows,
+ *         PIO_ERROR otherwise.
+ */
+pio_status_t bed_read_row_float(struct pio_bed_file_t *bed_file, float *buffer, enum DosageScaling scaling, double missing_value);
+
+/**
+ * Same as bed_read_row_float but for doubles.
+ */
+pio_status_t bed_read_row_double(struct pio_bed_file_t *bed_file, double *buffer, enum DosageScaling scaling, double missing_value);
+
+/**
+ * Reads the next row like bed_read_row, but stores the genotypes as
+ * 0, 1 and 2 with missing genotypes set to missing_value, e.g. -1.
+ *
+ * @param bed_file Bed file.
+ * @param buffer The genotypes are stored here, bed_row_size values.
+ * @param missing_value The value of missing genotypes.
+ *
+ * @return PIO_OK if the row could be read,
+ *         PIO_END if there are no more rows,
+ *         PIO_ERROR otherwise.
+ */
+pio_status_t bed_read_row_int8(struct pio_bed_file_t *bed_file, int8_t *buffer, int8_t missing_value);
+
+/**
+ * Reads up to max_rows consecutive rows from the given bed_file
+ * into a row-major matrix, where row i starts at
+ * buffer + i * bed_row_size( bed_file ). Many rows are read with a
+ * single call to fread, see bed_set_chunk_size, and decoded in one
+ * pass, which saves the per row overhead of bed_read_row.
+ *
+ * @param bed_file Bed file.
+ * @param max_rows The maximum number of rows to read.
+ * @param buffer The matrix to read into, must be able to hold
+ *               max_rows * bed_row_size bytes.
+ * @param rows_read The number of rows that were read is stored here.
+ *
+ * @return PIO_OK if at least one row could be read,
+ *         PIO_END if there are no more rows,
+ *         PIO_ERROR otherwise.
+ */
+pio_status_t bed_read_rows(struct pio_bed_file_t *bed_file, size_t max_rows, snp_t *buffer, size_t *rows_read);
+
+/**
+ * Sets the number of bytes that bed_read_rows reads at once.
+ * At least one row is always read, regardless of the size.
+ *
+ * @param bed_file Bed file.
+ * @param chunk_size The size in bytes, or 0 for BED_DEFAULT_CHUNK_SIZE.
+ */
+void bed_set_chunk_size(struct pio_bed_file_t *bed_file, size_t chunk_size);
+
+/**
+ * Same as bed_read_rows, but row i starts at
+ * buffer + i * bed_row_stride( bed_file ), e.g. in a matrix from
+ * bed_matrix_alloc. The padding after each row is set to 3
+ * (missing), so vectorized code can process whole rows without
+ * handling the last few genotypes separately.
+ *
+ * @param bed_file Bed file.
+ * @param max_rows The maximum number of rows to read.
+ * @param buffer The matrix to read into, must be able to hold
+ *               max_rows * bed_row_stride bytes.
+ * @param rows_read The number of rows that were read is stored here.
+ *
+ * @return PIO_OK if at least one row could be read,
+ *         PIO_END if there are no more rows,
+ *         PIO_ERROR otherwise.
+ */
+pio_status_t bed_read_rows_padded(struct pio_bed_file_t *bed_file, size_t max_rows, snp_t *buffer, size_t *rows_read);
+
+/**
+ * Returns a pointer to the next row of a file opened with
+ * bed_open_mapped, without decoding or copying it. The row is
+ * bed_header_row_size bytes in the packed format described at
+ * bed_read_row_packed, except that the bits after the last SNP are
+ * left as they are in the file. The pointer is valid until bed_close.
+ * For a file read in the other orientation, see bed_set_snp_order,
+ * the pointer is into the window and valid until the next read.
+ *
+ * @param bed_file Bed file opened with bed_open_mapped, or
+ *                 transposed with bed_set_snp_order.
+ * @param packed_row The address of the row will be stored here.
+ *
+ * @return PIO_OK if a row could be read,
+ *         PIO_END if there are no more rows,
+ *         PIO_ERROR if the file is not mapped.
+ */
+pio_status_t bed_read_row_mapped(struct pio_bed_file_t *bed_file, const unsigned char **packed_row);
+
+/**
+ * Reads the row with the given index, without using or moving
+ * the current row of bed_file. The offset is computed from the
+ * header and the row is read with a single positional read into a
+ * buffer of the call, on the stack for rows of up to 4096 packed
+ * bytes and allocated otherwise. So the call is O(1) and may be
+ * made from many threads at once on the same bed_file, as long as
+ * none of them uses the sequential functions at the same time.
+ *
+ * @param bed_file Bed file.
+ * @param row_index Index of the row, starting from 0.
+ * @param buffer The buffer to read into, see bed_read_row.
+ *
+ * @return PIO_OK if the row could be read,
+ *         PIO_END if row_index is past the last row,
+ *         PIO_ERROR otherwise.
+ */
+pio_status_t bed_read_row_at(struct pio_bed_file_t *bed_file, size_t row_index, snp_t *buffer);
+
+/**
+ * Like bed_read_row_at, but copies the row in the packed format
+ * described at bed_read_row_packed instead of decoding it.
+ *
+ * @param bed_file Bed file.
+ * @param row_index Index of the row, starting from 0.
+ * @param packed_row The buffer to read into, must be able to hold
+ *                   bed_header_row_size bytes.
+ *
+ * @return PIO_OK if the row could be read,
+ *         PIO_END if row_index is past the last row,
+ *         PIO_ERROR otherwise.
+ */
+pio_status_t bed_read_row_packed_at(struct pio_bed_file_t *bed_file, size_t row_index, unsigned char *packed_row);
+
+/**
+ * Starts iterating over the given rows of a bed file.
+ *
+ * @param subset The iterator.
+ * @param bed_file Bed file, must stay open while subset is used.
+ * @param rows Indices of the rows, in any order and possibly with
+ *             repeats. The list is copied.
+ * @param num_rows The number of indices in rows.
+ * @param order Whether the rows are returned as given or sorted.
+ *
+ * @return PIO_OK if the iterator could be created, PIO_ERROR if an
+ *         index is out of range or memory could not be allocated.
+ */
+pio_status_t bed_row_subset_init(struct bed_row_subset_t *subset, struct pio_bed_file_t *bed_file, const size_t *rows, size_t num_rows, enum RowOrder order);
+
+/**
+ * Decodes the next row of the subset, see bed_read_row.
+ *
+ * @param subset The iterator.
+ * @param buffer The buffer to read into, must be able to hold
+ *               bed_row_size bytes.
+ * @param row_index The index of the row in the file is stored here,
+ *                  unless it is NULL.
+ *
+ * @return PIO_OK if a row could be read,
+ *         PIO_END if there are no more rows,
+ *         PIO_ERROR otherwise.
+ */
+pio_status_t bed_row_subset_next(struct bed_row_subset_t *subset, snp_t *buffer, size_t *row_index);
+
+/**
+ * Copies the next row of the subset in the packed format described
+ * at bed_read_row_packed.
+ *
+ * @param subset The iterator.
+ * @param packed_row The buffer to read into, must be able to hold
+ *                   bed_header_row_size bytes.
+ * @param row_index The index of the row in the file is stored here,
+ *                  unless it is NULL.
+ *
+ * @return PIO_OK if a row could be read,
+ *         PIO_END if there are no more rows,
+ *         PIO_ERROR otherwise.
+ */
+pio_status_t bed_row_subset_next_packed(struct bed_row_subset_t *subset, unsigned char *packed_row, size_t *row_index);
+
+/**
+ * Frees the memory of the iterator.
+ *
+ * @param subset The iterator.
+ */
+void bed_row_subset_close(struct bed_row_subset_t *subset);
+
+/**
+ * Creates an asynchronous reader for the given bed file. The
+ * environment variable LIBPLINKIO_ASYNC can be set to "threads" to
+ * disable io_uring.
+ *
+ * @param async The reader.
+ * @param bed_file Bed file, must stay open while async is used.
+ * @param queue_depth The maximum number of reads in flight, or 0
+ *                    for BED_DEFAULT_QUEUE_DEPTH.
+ *
+ * @return PIO_OK if the reader could be created, PIO_ERROR otherwise.
+ */
+pio_status_t bed_async_init(struct bed_async_t *async, struct pio_bed_file_t *bed_file, size_t queue_depth);
+
+/**
+ * Queues reads of the given rows. Up to queue_depth of them are
+ * started right away, the rest as earlier reads complete. The
+ * callback is called once per row from bed_async_poll or
+ * bed_async_wait, in the order the reads complete.
+ *
+ * @param async The reader.
+ * @param rows Indices of the rows, the list is copied.
+ * @param num_rows The number of indices in rows.
+ * @param callback Called for each completed row.
+ * @param user_data Passed to callback.
+ *
+ * @return PIO_OK if the rows could be queued, PIO_ERROR if an index
+ *         is out of range, in which case nothing is queued.
+ */
+pio_status_t bed_async_submit(struct bed_async_t *async, const size_t *rows, size_t num_rows, bed_async_callback_t callback, void *user_data);
+
+/**
+ * Runs the callbacks of completed reads and starts queued ones.
+ *
+ * @param async The reader.
+ * @param min_complete Waits until at least this many reads have
+ *                     completed, or none are left. 0 never waits.
+ *
+ * @return The number of callbacks that were run.
+ */
+size_t bed_async_poll(struct bed_async_t *async, size_t min_complete);
+
+/**
+ * Waits until all submitted rows have been read and their
+ * callbacks run.
+ *
+ * @param async The reader.
+ */
+void bed_async_wait(struct bed_async_t *async);
+
+/**
+ * Returns the number of submitted rows whose callbacks have not
+ * been run yet.
+ *
+ * @param async The reader.
+ */
+size_t bed_async_pending(struct bed_async_t *async);
+
+/**
+ * Returns the name of the read engine, "io_uring" or "threads".
+ *
+ * @param async The reader.
+ */
+const char *bed_async_engine(struct bed_async_t *async);
+
+/**
+ * Waits for the reads in flight, without running their callbacks,
+ * and frees the reader.
+ *
+ * @param async The reader.
+ */
+void bed_async_close(struct bed_async_t *async);
+
 /**
  * Skips a single row from the given bed_file.
  *
@@ -115,8 +837,80 @@ pio_status_t bed_read_row(struct pio_bed_file_t *bed_file, snp_t *buffer);
 pio_status_t bed_skip_row(struct pio_bed_file_t *bed_file);
 
 /**
- * Returns the number of bytes required to store a row from
- * the given bed file.
+ * Starts a background thread that reads the rows after the current
+ * one ahead of the caller, so that disk and network latency is
+ * hidden behind the work done on each row. The thread fills a ring
+ * of depth blocks of block_size bytes each, and the sequential read
+ * functions take their rows from the ring with unchanged semantics.
+ * bed_reset_row restarts the thread at the first row.
+ *
+ * @param bed_file Bed file opened for reading.
+ * @param depth The number of blocks that are read ahead, or 0 to
+ *              stop prefetching.
+ * @param block_size The size in bytes of a block, or 0 for
+ *                   BED_DEFAULT_CHUNK_SIZE. At least one row is
+ *                   always read per block.
+ * @param decoded Non-zero if the thread should decode the rows too,
+ *                which moves the decoding off the calling thread.
+ *
+ * @return PIO_OK if the thread could be started, PIO_ERROR otherwise.
+ */
+pio_status_t bed_set_prefetch(struct pio_bed_file_t *bed_file, size_t depth, size_t block_size, int decoded);
+
+/**
+ * Tells the kernel how the rows of the file will be read, see
+ * AccessPattern. The hint applies to the whole file, and
+ * bed_reset_row starts dropping consumed pages from the beginning
+ * again.
+ *
+ * @param bed_file Bed file opened for reading.
+ * @param pattern A combination of AccessPattern flags, where
+ *                BED_ACCESS_SEQUENTIAL and BED_ACCESS_RANDOM
+ *                exclude each other.
+ *
+ * @return PIO_OK if the pattern is valid, PIO_ERROR otherwise.
+ *         Platforms without the advice calls accept any
+ *         valid pattern and ignore it.
+ */
+pio_status_t bed_set_access_pattern(struct pio_bed_file_t *bed_file, int pattern);
+
+/**
+ * Asks the kernel to start reading a range of rows into the page
+ * cache, so that later reads of these rows do not wait for the
+ * disk. Useful ahead of bed_read_row_at or a row subset.
+ *
+ * @param bed_file Bed file opened for reading.
+ * @param first_row The first row of the range.
+ * @param num_rows The number of rows in the range.
+ *
+ * @return PIO_OK if the range is within the file, PIO_ERROR otherwise.
+ */
+pio_status_t bed_will_need_rows(struct pio_bed_file_t *bed_file, size_t first_row, size_t num_rows);
+
+/**
+ * Selects the columns that bed_read_row, bed_read_rows and
+ * bed_read_row_at decode, e.g. a subset of the samples of a
+ * file with one locus per row. The decoded rows then only contain
+ * the selected columns, in the given order, and bed_row_size
+ * shrinks accordingly. Runs of consecutive columns are decoded
+ * with the SIMD kernels, other columns are gathered straight from
+ * the packed bytes. The packed read functions are not affected.
+ *
+ * @param bed_file Bed file.
+ * @param cols Indices of the selected columns, may contain repeats,
+ *             or NULL to decode all columns again.
+ * @param num_cols Number of indices in cols.
+ *
+ * @return PIO_OK if the subset could be set, PIO_ERROR if an index
+ *         is out of range or memory could not be allocated, in which
+ *         case the previous selection is kept.
+ */
+pio_status_t bed_set_col_subset(struct pio_bed_file_t *bed_file, const size_t *cols, size_t num_cols);
+
+/**
+ * Returns the number of bytes required to store a decoded row from
+ * the given bed file, which only counts the selected columns if
+ * bed_set_col_subset has been called.
  *
  * @param bed_file Bed file.
  *
@@ -125,6 +919,62 @@ pio_status_t bed_skip_row(struct pio_bed_file_t *bed_file);
  */
 size_t bed_row_size(struct pio_bed_file_t *bed_file);
 
+/**
+ * Returns bed_row_size rounded up to a multiple of
+ * BED_ROW_ALIGNMENT, i.e. the distance between the rows of a
+ * matrix from bed_matrix_alloc. It changes with the column subset.
+ *
+ * @param bed_file Bed file.
+ *
+ * @return The padded size of a row in bytes.
+ */
+size_t bed_row_stride(struct pio_bed_file_t *bed_file);
+
+/**
+ * Allocates a row of bed_row_stride bytes, aligned to
+ * BED_ROW_ALIGNMENT, with every genotype set to 3 (missing). The
+ * read functions only write the first bed_row_size bytes, so the
+ * padding stays missing.
+ *
+ * @param bed_file Bed file.
+ *
+ * @return The row, or NULL if it could not be allocated. Must be
+ *         freed with bed_buffer_free.
+ */
+snp_t *bed_row_alloc(struct pio_bed_file_t *bed_file);
+
+/**
+ * Allocates a matrix of num_rows rows of bed_row_stride bytes,
+ * aligned to BED_ROW_ALIGNMENT, with every genotype set to 3
+ * (missing). See bed_read_rows_padded.
+ *
+ * @param bed_file Bed file.
+ * @param num_rows The number of rows.
+ *
+ * @return The matrix, or NULL if it could not be allocated or its
+ *         size does not fit in a size_t. Must be freed with
+ *         bed_buffer_free.
+ */
+snp_t *bed_matrix_alloc(struct pio_bed_file_t *bed_file, size_t num_rows);
+
+/**
+ * Frees a buffer from bed_row_alloc or bed_matrix_alloc.
+ *
+ * @param buffer The buffer, or NULL.
+ */
+void bed_buffer_free(snp_t *buffer);
+
+/**
+ * Returns the name of the decoder that is used for unpacking
+ * rows on this machine. The fastest instruction set supported by
+ * the CPU is picked on first use, one of "scalar", "sse2", "ssse3",
+ * "avx2" or "avx512". Setting the environment variable
+ * LIBPLINKIO_SIMD to one of these names caps the choice.
+ *
+ * @return the name of the active decoder.
+ */
+const char *bed_unpack_kernel(void);
+
 /**
  * Returns the number of snps stored in a row for the
  * given bed file.
@@ -152,11 +1002,16 @@ enum SnpOrder bed_snp_order(struct pio_bed_file_t *bed_file);
 void bed_reset_row(struct pio_bed_file_t *bed_file);
 
 /**
- * Closes the bed file.
+ * Closes the bed file, after writing the columns that
+ * bed_write_col has buffered.
  *
  * @param bed_file Bed file.
+ *
+ * @return PIO_OK if the buffered columns could be written and the
+ *         file closed, PIO_ERROR otherwise. The file is closed in
+ *         either case.
  */
-void bed_close(struct pio_bed_file_t *bed_file);
+pio_status_t bed_close(struct pio_bed_file_t *bed_file);
 
 /**
  * Transposes the given file to the given output file.
@@ -170,6 +1025,59 @@ void bed_close(struct pio_bed_file_t *bed_file);
  */
 pio_status_t bed_transpose(const char *original_path, const char *transposed_path, size_t num_loci, size_t num_samples);
 
+/**
+ * Transposes the given file like bed_transpose, with the given
+ * number of threads. The transposed rows are split into stripes
+ * that each thread writes at their offsets of the output.
+ *
+ * @param original_path The file to transpose.
+ * @param transposed_path The file where the transposed data
+ *        will be stored.
+ * @param num_loci The number of loci.
+ * @param num_samples The number of samples.
+ * @param num_threads The number of threads, 0 for one per online
+ *                    processor.
+ *
+ * @return PIO_OK if the file could be transposed, PIO_ERROR otherwise.
+ */
+pio_status_t bed_transpose_threads(const char *original_path, const char *transposed_path, size_t num_loci, size_t num_samples, size_t num_threads);
+
+/**
+ * Called by bed_transpose_budget after each stripe it writes.
+ *
+ * @param user_data The pointer given to bed_transpose_budget.
+ * @param bytes_done The number of bytes written so far.
+ * @param bytes_total The number of bytes that will be written in
+ *                    all passes.
+ */
+typedef void (*bed_transpose_progress_t)(void *user_data, uint64_t bytes_done, uint64_t bytes_total);
+
+/**
+ * Transposes the given file to the given output file without
+ * holding more than about memory_budget bytes of it in memory.
+ *
+ * The first pass reads bands of rows in order, transposes each in
+ * memory and appends it as a run to a temporary file next to the
+ * output. The second pass reads the same columns from every run
+ * and writes them as whole rows of the output, in order. When all
+ * rows fit in one band the runs are skipped and the data is read
+ * and written once. Larger budgets give fewer, longer reads in the
+ * second pass.
+ *
+ * @param original_path The file to transpose.
+ * @param transposed_path The file where the transposed data
+ *        will be stored, it is created or truncated.
+ * @param num_loci The number of loci.
+ * @param num_samples The number of samples.
+ * @param memory_budget The number of bytes to use for buffers. At
+ *        least 4 rows and 1 transposed row are always buffered.
+ * @param progress Called after each stripe, may be NULL.
+ * @param user_data Passed to progress.
+ *
+ * @return PIO_OK if the file could be transposed, PIO_ERROR otherwise.
+ */
+pio_status_t bed_transpose_budget(const char *original_path, const char *transposed_path, size_t num_loci, size_t num_samples, size_t memory_budget, bed_transpose_progress_t progress, void *user_data);
+
 #ifdef __cplusplus
 }
 #endif
@@ -73,8 +73,31 @@ struct pio_bim_file_t
      * List of all locus in the file.
      */
     UT_array *locus;
+
+    /**
+     * Non-zero if written loci are not copied into the locus list,
+     * see bim_set_keep_loci.
+     */
+    int discard_loci;
+
+    /**
+     * Number of written loci that were not copied.
+     */
+    size_t num_discarded_loci;
+
+    /**
+     * Arena that owns the strings of the loci, they are freed
+     * together by bim_close.
+     */
+    void *strings;
 };
 
+/**
+ * Size of the buffer that bim_write_loci formats lines into before
+ * writing them.
+ */
+#define BIM_WRITE_BUFFER_SIZE ( 1 << 20 )
+
 /**
  * Opens the bim file at the given path and reads all loci
  * into memory, and closes the file.
@@ -106,13 +129,40 @@ pio_status_t bim_create(struct pio_bim_file_t *bim_file, const char *path);
  */
 pio_status_t bim_write(struct pio_bim_file_t *bim_file, struct pio_locus_t *locus);
 
+/**
+ * Writes the given loci to the bim file. The lines are formatted
+ * into a buffer of BIM_WRITE_BUFFER_SIZE bytes, which is written
+ * whenever it is full, so there is one write per many loci.
+ *
+ * @param bim_file Bim file.
+ * @param loci The loci to write.
+ * @param num_loci The number of loci.
+ *
+ * @return PIO_OK if the loci could be written, PIO_ERROR otherwise.
+ */
+pio_status_t bim_write_loci(struct pio_bim_file_t *bim_file, struct pio_locus_t *loci, size_t num_loci);
+
+/**
+ * Sets whether bim_write and bim_write_loci keep a copy of each
+ * locus in memory, which is the default. Writers that never look
+ * the loci up again can turn it off to save an allocation per
+ * string. Loci that are not kept are still counted by
+ * bim_num_loci, but bim_get_locus returns NULL for them. Call it
+ * before the first locus is written.
+ *
+ * @param bim_file Bim file.
+ * @param keep Non-zero to keep copies of the written loci.
+ */
+void bim_set_keep_loci(struct pio_bim_file_t *bim_file, int keep);
+
 /**
  * Returns the locus with the given pio_id.
  *
  * @param bim_file The bim file to get the locus from.
  * @param pio_id The pio id of the locus.
  *
- * @return the locus with the given pio_id.
+ * @return the locus with the given pio_id, or NULL if it is not
+ *         in memory.
  */
 struct pio_locus_t * bim_get_locus(struct pio_bim_file_t *bim_file, size_t pio_id);
 
@@ -38,6 +38,29 @@ pio_status_t parse_loci(FILE *bim_fp, UT_array *locus);
  */
 pio_status_t write_locus(FILE *bim_fp, struct pio_locus_t *locus);
 
+/**
+ * Returns an upper bound on the length of the .bim line of the
+ * given locus, see format_locus.
+ *
+ * @param locus The locus.
+ *
+ * @return The maximum number of bytes that format_locus writes.
+ */
+size_t locus_line_size(struct pio_locus_t *locus);
+
+/**
+ * Formats a locus as a line of the .bim file, the same way as
+ * fprintf with "%d\t%s\t%f\t%lld\t%s\t%s\n" but without going
+ * through the format string parser. No terminating null is written.
+ *
+ * @param buffer The line is written here, must be able to hold
+ *               locus_line_size bytes.
+ * @param locus The locus to format.
+ *
+ * @return The length of the line.
+ */
+size_t format_locus(char *buffer, struct pio_locus_t *locus);
+
 #ifdef __cplusplus
 }
 #endif
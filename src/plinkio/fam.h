@@ -102,6 +102,12 @@ struct pio_fam_file_t
      * List of additional information for each sample.
      */
     UT_array *sample;
+
+    /**
+     * Arena that owns the strings of the samples, they are freed
+     * together by fam_close.
+     */
+    void *strings;
 };
 
 /**
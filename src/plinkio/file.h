@@ -31,7 +31,10 @@ enum file_status {
 typedef enum file_status file_status_t;
 
 /**
- * Copies a file to another.
+ * Copies a file to another. The copy is made in the kernel where
+ * possible, sharing the data with the original on file systems
+ * that support it, and written to a temporary file next to to_path
+ * that replaces it only once it is complete.
  *
  * @param from_path The path to copy from.
  * @param to_path   The destination path.
@@ -40,6 +43,17 @@ typedef enum file_status file_status_t;
  */
 file_status_t file_copy(const char *from_path, const char *to_path);
 
+/**
+ * Renames a file, replacing to_path if it exists. Other processes
+ * see either the old or the new file at to_path.
+ *
+ * @param from_path The path of the file.
+ * @param to_path   The new path of the file.
+ *
+ * @return FILE_OK if the file was renamed, FILE_ERROR otherwise.
+ */
+file_status_t file_rename(const char *from_path, const char *to_path);
+
 /**
  * Removes the file of the given path
  *
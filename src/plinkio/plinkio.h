@@ -57,6 +57,50 @@ struct pio_file_t
  */
 pio_status_t pio_open(struct pio_file_t *plink_file, const char *plink_file_prefix);
 
+/**
+ * Opens the given plink file like pio_open, but memory maps the whole
+ * .bed file instead of reading it through stdio. This avoids a copy
+ * per row, and allows pio_next_row_mapped to return rows without
+ * copying them at all.
+ *
+ * @param plink_file Plink file.
+ * @param plink_file_prefix Path to the plink files, without the extension.
+ *
+ * @return PIO_OK, if all files existed and could be read. PIO_ERROR otherwise.
+ */
+pio_status_t pio_open_mapped(struct pio_file_t *plink_file, const char *plink_file_prefix);
+
+/**
+ * Opens the given plink file like pio_open, and reads the rows of
+ * the .bed file in the given orientation. A file stored in the
+ * other one is transposed in memory a window at a time while it is
+ * read, see pio_set_snp_order, so pio_transpose is not needed.
+ *
+ * @param plink_file Plink file.
+ * @param plink_file_prefix Path to the plink files, without the extension.
+ * @param order BED_ONE_LOCUS_PER_ROW to read a locus per row,
+ *              BED_ONE_SAMPLE_PER_ROW to read a sample per row.
+ *
+ * @return PIO_OK, if all files existed and could be read. PIO_ERROR otherwise.
+ */
+pio_status_t pio_open_order(struct pio_file_t *plink_file, const char *plink_file_prefix, enum SnpOrder order);
+
+/**
+ * Reads the rows of an opened plink file in the given orientation,
+ * see bed_set_snp_order. Files opened with pio_open_mapped read the
+ * windows of a transposed file from the mapping, without a read per
+ * row of the file.
+ *
+ * @param plink_file Plink file.
+ * @param order The orientation of the rows that are read.
+ * @param window_size Number of bytes of transposed rows held in
+ *                    memory, or 0 for BED_DEFAULT_WINDOW_SIZE.
+ *
+ * @return PIO_OK if the rows can be read in the given order,
+ *         PIO_ERROR otherwise.
+ */
+pio_status_t pio_set_snp_order(struct pio_file_t *plink_file, enum SnpOrder order, size_t window_size);
+
 #ifdef LIBPLINKIO_EXPERIMENTAL
 /**
  * Opens the given plink text file. Parses the fam and bim files.
@@ -87,6 +131,72 @@ libplinkio_open_txt(
  */
 pio_status_t pio_create(struct pio_file_t *plink_file, const char *plink_file_prefix, struct pio_sample_t *samples, size_t num_samples);
 
+/**
+ * Creates a plink file whose loci are all known up front. The .fam
+ * and .bim files are written here, and the .bed file is allocated to
+ * its full size, so that its rows can then be written in any order
+ * and from many threads at once with pio_write_row_at.
+ *
+ * @param plink_file Plink file.
+ * @param plink_file_prefix Path to the plink files, without the extension.
+ * @param samples Complete list of samples to be in the .fam file.
+ * @param num_samples The number of samples in the samples array.
+ * @param loci Complete list of loci to be in the .bim file.
+ * @param num_loci The number of loci in the loci array.
+ *
+ * @return PIO_OK if all files could be created, P_FAM_IO_ERROR,
+ *         P_BIM_IO_ERROR or P_BED_IO_ERROR otherwise.
+ */
+pio_status_t pio_create_sized(struct pio_file_t *plink_file, const char *plink_file_prefix, struct pio_sample_t *samples, size_t num_samples, struct pio_locus_t *loci, size_t num_loci);
+
+/**
+ * Writes the genotypes of the given SNP of a plink file created with
+ * pio_create_sized. Each row may be written at any time and from any
+ * thread, as long as no two threads write the same row at once.
+ *
+ * @param plink_file Plink file created with pio_create_sized.
+ * @param row The index of the SNP, starting from 0.
+ * @param buffer The genotypes for all individuals.
+ *
+ * @return PIO_OK if the row could be written, P_BED_IO_ERROR otherwise.
+ */
+pio_status_t pio_write_row_at(struct pio_file_t *plink_file, size_t row, const snp_t *buffer);
+
+/**
+ * Writes the genotypes of the next sample, in the order of the
+ * .fam file, of a plink file created with pio_create_sized. The
+ * .bed file stays locus major: the samples are buffered in tiles
+ * that are transposed in memory and written into the rows of the
+ * file, see bed_write_col. Do not mix with pio_write_row_at.
+ *
+ * @param plink_file Plink file created with pio_create_sized.
+ * @param buffer The genotypes of the sample for all loci.
+ *
+ * @return PIO_OK if the sample could be written, P_BED_IO_ERROR otherwise.
+ */
+pio_status_t pio_write_sample(struct pio_file_t *plink_file, const snp_t *buffer);
+
+/**
+ * Writes the samples that pio_write_sample has buffered, which
+ * pio_close does as well. Samples share the bytes of a row 4 at a
+ * time, so until the last sample has been written, the last
+ * samples_written % 4 samples stay buffered.
+ *
+ * @param plink_file Plink file created with pio_create_sized.
+ *
+ * @return PIO_OK if the samples could be written, P_BED_IO_ERROR otherwise.
+ */
+pio_status_t pio_flush_samples(struct pio_file_t *plink_file);
+
+/**
+ * Sets the number of packed bytes that pio_write_sample buffers,
+ * see bed_set_col_tile_size.
+ *
+ * @param plink_file Plink file created with pio_create_sized.
+ * @param tile_size The size in bytes, or 0 for BED_DEFAULT_TILE_SIZE.
+ */
+void pio_set_sample_tile_size(struct pio_file_t *plink_file, size_t tile_size);
+
 /**
  * Writes the genotypes for a single SNP for all individuals to the .bed file,
  * and adds the corresponding entry to the .bim file.
@@ -99,6 +209,50 @@ pio_status_t pio_create(struct pio_file_t *plink_file, const char *plink_file_pr
  */
 pio_status_t pio_write_row(struct pio_file_t *plink_file, struct pio_locus_t *locus, snp_t *buffer);
 
+/**
+ * Like pio_write_row, but takes the genotypes in the packed format
+ * of the .bed file, e.g. from pio_next_row_packed, so that rows can
+ * be copied between files without decoding them.
+ *
+ * @param plink_file Plink file created with pio_create.
+ * @param locus The locus to write genotypes for.
+ * @param packed_row The packed genotypes for all individuals, see
+ *                   pio_packed_row_size.
+ *
+ * @return PIO_OK if the files could be written, P_BIM_IO_ERROR or
+ *         P_BED_IO_ERROR otherwise.
+ */
+pio_status_t pio_write_row_packed(struct pio_file_t *plink_file, struct pio_locus_t *locus, const unsigned char *packed_row);
+
+/**
+ * Writes the genotypes for num_rows SNPs at once, and adds the
+ * corresponding entries to the .bim file. The rows are packed and
+ * written in large blocks and the .bim lines are formatted into a
+ * large buffer, which is much faster than calling pio_write_row
+ * for each SNP.
+ *
+ * @param plink_file Plink file created with pio_create.
+ * @param loci The num_rows loci to write genotypes for.
+ * @param matrix The genotypes, one row of pio_num_samples genotypes
+ *               after the other.
+ * @param num_rows The number of SNPs.
+ *
+ * @return PIO_OK if the files could be written. P_BED_IO_ERROR or
+ *         P_BIM_IO_ERROR otherwise.
+ */
+pio_status_t pio_write_rows(struct pio_file_t *plink_file, struct pio_locus_t *loci, const snp_t *matrix, size_t num_rows);
+
+/**
+ * Sets whether the loci written with pio_write_row and
+ * pio_write_rows are kept in memory. They are kept by default, when
+ * they are not pio_get_locus returns NULL for them, which saves
+ * memory when writing many SNPs. Call it before the first write.
+ *
+ * @param plink_file Plink file created with pio_create.
+ * @param keep Non-zero to keep the loci, 0 otherwise.
+ */
+void pio_set_keep_loci(struct pio_file_t *plink_file, int keep);
+
 /**
  * Opens the given plink file, which is specificed by separate paths
  * to the .bim, .bed and .fam files.
@@ -174,6 +328,329 @@ size_t pio_num_loci(struct pio_file_t *plink_file);
  */
 pio_status_t pio_next_row(struct pio_file_t *plink_file, snp_t *buffer);
 
+/**
+ * Reads the next row without decoding it, in the 2-bit format of
+ * the .bed file. This is a quarter of the size of the row from
+ * pio_next_row, and can be used directly by kernels that work on
+ * the packed encoding:
+ * - Each byte holds 4 SNPs, the first SNP in the two lowest bits,
+ *   i.e. SNP j is ( packed_row[ j / 4 ] >> ( 2 * ( j % 4 ) ) ) & 3.
+ * - The SNPs are encoded as follows:
+ *   * 00 - Homozygous major
+ *   * 01 - Missing value
+ *   * 10 - Hetrozygous
+ *   * 11 - Homozygous minor
+ * - The row takes pio_packed_row_size bytes, and the bits after
+ *   the last SNP in the last byte are always cleared to 00.
+ *
+ * @param plink_file Plink file.
+ * @param packed_row The row will be stored here. Must be able to
+ *                   hold pio_packed_row_size bytes.
+ *
+ * @return PIO_OK if the row could be read, PIO_END if we are at the
+ *         end of file, PIO_ERROR otherwise.
+ */
+pio_status_t pio_next_row_packed(struct pio_file_t *plink_file, unsigned char *packed_row);
+
+/**
+ * Reads the next row straight into float dosages, e.g. for a BLAS
+ * routine, instead of decoding with pio_next_row and converting in
+ * a second pass. Missing genotypes are set to missing_value, the
+ * row mean, or 0 after centering, see DosageScaling.
+ *
+ * @param plink_file Plink file.
+ * @param buffer The row will be stored here. Must be able to hold
+ *               pio_row_size floats.
+ * @param scaling How the genotypes are turned into dosages.
+ * @param missing_value The value of missing genotypes for
+ *                      BED_DOSAGE_RAW.
+ *
+ * @return PIO_OK if the row could be read, PIO_END if we are at the
+ *         end of file, PIO_ERROR otherwise.
+ */
+pio_status_t pio_next_row_float(struct pio_file_t *plink_file, float *buffer, enum DosageScaling scaling, double missing_value);
+
+/**
+ * Same as pio_next_row_float but for doubles.
+ */
+pio_status_t pio_next_row_double(struct pio_file_t *plink_file, double *buffer, enum DosageScaling scaling, double missing_value);
+
+/**
+ * Reads the next row as signed genotypes 0, 1 and 2, with missing
+ * genotypes set to missing_value.
+ *
+ * @param plink_file Plink file.
+ * @param buffer The row will be stored here. Must be able to hold
+ *               pio_row_size values.
+ * @param missing_value The value of missing genotypes, e.g. -1.
+ *
+ * @return PIO_OK if the row could be read, PIO_END if we are at the
+ *         end of file, PIO_ERROR otherwise.
+ */
+pio_status_t pio_next_row_int8(struct pio_file_t *plink_file, int8_t *buffer, int8_t missing_value);
+
+/**
+ * Reads up to max_rows consecutive rows into a row-major matrix,
+ * where row i starts at buffer + i * pio_row_size( plink_file ).
+ * The rows are read with a few large reads, see pio_set_chunk_size,
+ * and decoded in one pass, which is much cheaper than calling
+ * pio_next_row for each row when the rows are short.
+ *
+ * @param plink_file Plink file.
+ * @param max_rows The maximum number of rows to read.
+ * @param buffer The rows will be stored here. Must be able to hold at
+ *               least max_rows * pio_row_size bytes.
+ * @param rows_read The number of rows that were read is stored here,
+ *                  it is less than max_rows at the end of the file.
+ *
+ * @return PIO_OK if at least one row could be read, PIO_END if we
+ *         are at the end of file, PIO_ERROR otherwise.
+ */
+pio_status_t pio_next_rows(struct pio_file_t *plink_file, size_t max_rows, snp_t *buffer, size_t *rows_read);
+
+/**
+ * Same as pio_next_rows, but row i starts at
+ * buffer + i * pio_row_stride( plink_file ) and the padding after
+ * each row is set to missing, see pio_matrix_alloc.
+ *
+ * @param plink_file Plink file.
+ * @param max_rows The maximum number of rows to read.
+ * @param buffer The rows will be stored here. Must be able to hold at
+ *               least max_rows * pio_row_stride bytes.
+ * @param rows_read The number of rows that were read is stored here.
+ *
+ * @return PIO_OK if at least one row could be read, PIO_END if we
+ *         are at the end of file, PIO_ERROR otherwise.
+ */
+pio_status_t pio_next_rows_padded(struct pio_file_t *plink_file, size_t max_rows, snp_t *buffer, size_t *rows_read);
+
+/**
+ * Sets the number of bytes that pio_next_rows reads from the .bed
+ * file at once. At least one row is always read.
+ *
+ * @param plink_file Plink file.
+ * @param chunk_size The size in bytes, or 0 to restore the default
+ *                   of BED_DEFAULT_CHUNK_SIZE.
+ */
+void pio_set_chunk_size(struct pio_file_t *plink_file, size_t chunk_size);
+
+/**
+ * Starts reading rows on a background thread, ahead of the calls to
+ * pio_next_row, so that the time spent waiting on the disk or a
+ * network file system overlaps with the work done on each row. The
+ * thread keeps up to depth blocks of block_size bytes ready, and
+ * pio_next_row, pio_next_rows, pio_next_row_packed and pio_skip_row
+ * take their rows from these blocks without changing behaviour.
+ *
+ * @param plink_file Plink file.
+ * @param depth The number of blocks to read ahead, or 0 to read on
+ *              the calling thread again.
+ * @param block_size The size in bytes of a block, or 0 for
+ *                   BED_DEFAULT_CHUNK_SIZE.
+ * @param decoded Non-zero if the thread should also decode the rows,
+ *                which takes the decoding off the calling thread.
+ *
+ * @return PIO_OK if prefetching could be started, PIO_ERROR otherwise.
+ */
+pio_status_t pio_set_prefetch(struct pio_file_t *plink_file, size_t depth, size_t block_size, int decoded);
+
+/**
+ * Tells the operating system how the rows will be read, so that it
+ * can adapt its read ahead and caching. The pattern is a combination
+ * of BED_ACCESS_SEQUENTIAL or BED_ACCESS_RANDOM with
+ * BED_ACCESS_DONTNEED_CONSUMED, which drops the pages of rows that
+ * pio_next_row and friends have moved past, so that a single scan
+ * over a large file does not fill the page cache. See AccessPattern.
+ *
+ * @param plink_file Plink file.
+ * @param pattern Combination of AccessPattern flags.
+ *
+ * @return PIO_OK if the pattern is valid, PIO_ERROR otherwise.
+ */
+pio_status_t pio_set_access_pattern(struct pio_file_t *plink_file, int pattern);
+
+/**
+ * Asks the operating system to read the given rows into memory in
+ * the background, e.g. before reading them with pio_read_row_at.
+ *
+ * @param plink_file Plink file.
+ * @param first_row The first row to read.
+ * @param num_rows The number of rows to read.
+ *
+ * @return PIO_OK if the rows are within the file, PIO_ERROR otherwise.
+ */
+pio_status_t pio_will_need_rows(struct pio_file_t *plink_file, size_t first_row, size_t num_rows);
+
+/**
+ * Returns a pointer to the next row of a file opened with
+ * pio_open_mapped, in the packed format described at
+ * pio_next_row_packed. Nothing is copied or decoded, so the bits
+ * after the last SNP are left as they are in the file. The pointer
+ * stays valid until pio_close. For a file read in the other
+ * orientation, see pio_set_snp_order, the pointer is into the
+ * window and only valid until the next read.
+ *
+ * @param plink_file Plink file opened with pio_open_mapped, or
+ *                   read in the other orientation.
+ * @param packed_row The address of the row will be stored here.
+ *
+ * @return PIO_OK if the row could be read, PIO_END if we are at the
+ *         end of file, PIO_ERROR if the file is not mapped.
+ */
+pio_status_t pio_next_row_mapped(struct pio_file_t *plink_file, const unsigned char **packed_row);
+
+/**
+ * Starts iterating over the given rows, e.g. the loci that are
+ * needed from a large file. The rows are sorted internally and
+ * neighbouring rows are merged into large positional reads, so
+ * gaps are skipped without a seek per row. The position used by
+ * pio_next_row is not affected.
+ *
+ * @param subset The iterator, free it with pio_row_subset_close.
+ * @param plink_file Plink file, must stay open while subset is used.
+ * @param rows Indices of the rows, in any order and possibly with
+ *             repeats. The list is copied.
+ * @param num_rows The number of indices in rows.
+ * @param order BED_REQUESTED_ORDER to return the rows as given, or
+ *              BED_FILE_ORDER to return them sorted, which allows
+ *              larger merged reads.
+ *
+ * @return PIO_OK if the iterator could be created, PIO_ERROR if an
+ *         index is out of range.
+ */
+pio_status_t pio_row_subset_init(struct bed_row_subset_t *subset, struct pio_file_t *plink_file, const size_t *rows, size_t num_rows, enum RowOrder order);
+
+/**
+ * Reads the next row of the subset, see pio_next_row.
+ *
+ * @param subset The iterator.
+ * @param buffer The row will be stored here. Must be able to hold at
+ *               least pio_row_size bytes.
+ * @param row_index The index of the row is stored here, unless NULL.
+ *
+ * @return PIO_OK if the row could be read, PIO_END if there are no
+ *         more rows, PIO_ERROR otherwise.
+ */
+pio_status_t pio_row_subset_next(struct bed_row_subset_t *subset, snp_t *buffer, size_t *row_index);
+
+/**
+ * Reads the next row of the subset in the packed format described
+ * at pio_next_row_packed.
+ *
+ * @param subset The iterator.
+ * @param packed_row The row will be stored here. Must be able to
+ *                   hold pio_packed_row_size bytes.
+ * @param row_index The index of the row is stored here, unless NULL.
+ *
+ * @return PIO_OK if the row could be read, PIO_END if there are no
+ *         more rows, PIO_ERROR otherwise.
+ */
+pio_status_t pio_row_subset_next_packed(struct bed_row_subset_t *subset, unsigned char *packed_row, size_t *row_index);
+
+/**
+ * Frees the memory of the iterator.
+ *
+ * @param subset The iterator.
+ */
+void pio_row_subset_close(struct bed_row_subset_t *subset);
+
+/**
+ * Creates a reader that reads many independent rows concurrently,
+ * for workloads with many small lookups. On Linux the reads are
+ * queued with io_uring when the kernel allows it, otherwise a pool
+ * of threads issues positional reads. Set the environment variable
+ * LIBPLINKIO_ASYNC to "threads" to always use the thread pool.
+ *
+ * @param async The reader, free it with pio_async_close.
+ * @param plink_file Plink file, must stay open while async is used.
+ * @param queue_depth The maximum number of reads in flight, or 0
+ *                    for BED_DEFAULT_QUEUE_DEPTH.
+ *
+ * @return PIO_OK if the reader could be created, PIO_ERROR otherwise.
+ */
+pio_status_t pio_async_init(struct bed_async_t *async, struct pio_file_t *plink_file, size_t queue_depth);
+
+/**
+ * Queues reads of the given rows. The callback is called with each
+ * decoded row from pio_async_poll or pio_async_wait, in the order
+ * the reads complete.
+ *
+ * @param async The reader.
+ * @param rows Indices of the rows, the list is copied.
+ * @param num_rows The number of indices in rows.
+ * @param callback Called once for each row.
+ * @param user_data Passed to callback.
+ *
+ * @return PIO_OK if the rows could be queued, PIO_ERROR if an index
+ *         is out of range.
+ */
+pio_status_t pio_async_submit(struct bed_async_t *async, const size_t *rows, size_t num_rows, bed_async_callback_t callback, void *user_data);
+
+/**
+ * Runs the callbacks of the reads that have completed.
+ *
+ * @param async The reader.
+ * @param min_complete Waits until at least this many callbacks have
+ *                     been run, or no reads are left. 0 never waits.
+ *
+ * @return The number of callbacks that were run.
+ */
+size_t pio_async_poll(struct bed_async_t *async, size_t min_complete);
+
+/**
+ * Waits until the callbacks of all submitted rows have been run.
+ *
+ * @param async The reader.
+ */
+void pio_async_wait(struct bed_async_t *async);
+
+/**
+ * Returns the name of the engine that serves the reads, "io_uring"
+ * or "threads".
+ *
+ * @param async The reader.
+ */
+const char *pio_async_engine(struct bed_async_t *async);
+
+/**
+ * Frees the reader. Reads in flight are waited for, but their
+ * callbacks are not run.
+ *
+ * @param async The reader.
+ */
+void pio_async_close(struct bed_async_t *async);
+
+/**
+ * Reads the row with the given index, without moving the position
+ * used by pio_next_row. The row is read with a single positional
+ * read, so any row can be reached in constant time and several
+ * threads may read rows from the same plink_file at once, as long
+ * as none of them uses pio_next_row or pio_skip_row meanwhile.
+ *
+ * @param plink_file Plink file.
+ * @param row_index Index of the row, starting from 0.
+ * @param buffer The row will be stored here. Must be able to hold at
+ *               least pio_row_size bytes.
+ *
+ * @return PIO_OK if the row could be read, PIO_END if row_index is
+ *         past the last row, PIO_ERROR otherwise.
+ */
+pio_status_t pio_read_row_at(struct pio_file_t *plink_file, size_t row_index, snp_t *buffer);
+
+/**
+ * Like pio_read_row_at, but copies the row in the packed format
+ * described at pio_next_row_packed instead of decoding it.
+ *
+ * @param plink_file Plink file.
+ * @param row_index Index of the row, starting from 0.
+ * @param packed_row The row will be stored here. Must be able to
+ *                   hold pio_packed_row_size bytes.
+ *
+ * @return PIO_OK if the row could be read, PIO_END if row_index is
+ *         past the last row, PIO_ERROR otherwise.
+ */
+pio_status_t pio_read_row_packed_at(struct pio_file_t *plink_file, size_t row_index, unsigned char *packed_row);
+
 /**
  * Skips the next row from the bed file.
  *
@@ -193,7 +670,8 @@ pio_status_t pio_skip_row(struct pio_file_t *plink_file);
 void pio_reset_row(struct pio_file_t *plink_file);
 
 /**
- * Returns the size of a row in bytes.
+ * Returns the size of a row in bytes. If a sample subset has been
+ * set, only the selected samples are counted.
  *
  * @param plink_file Plink file.
  *
@@ -201,6 +679,101 @@ void pio_reset_row(struct pio_file_t *plink_file);
  */
 size_t pio_row_size(struct pio_file_t *plink_file);
 
+/**
+ * Returns pio_row_size rounded up to a multiple of
+ * BED_ROW_ALIGNMENT, the distance between the rows of a matrix
+ * from pio_matrix_alloc.
+ *
+ * @param plink_file Plink file.
+ *
+ * @return the padded size of a row in bytes.
+ */
+size_t pio_row_stride(struct pio_file_t *plink_file);
+
+/**
+ * Allocates a row buffer for vectorized code. It is aligned to
+ * BED_ROW_ALIGNMENT and pio_row_stride bytes long, and every byte
+ * is 3 (missing). Since pio_next_row only writes pio_row_size
+ * bytes, the padding stays missing and loops can run over whole
+ * vectors. Allocate after pio_set_sample_subset, the size depends
+ * on it.
+ *
+ * @param plink_file Plink file.
+ *
+ * @return The row, or NULL on failure. Free it with pio_buffer_free.
+ */
+snp_t *pio_row_alloc(struct pio_file_t *plink_file);
+
+/**
+ * Allocates a matrix of num_rows rows of pio_row_stride bytes for
+ * pio_next_rows_padded, aligned and filled like pio_row_alloc.
+ *
+ * @param plink_file Plink file.
+ * @param num_rows The number of rows.
+ *
+ * @return The matrix, or NULL on failure. Free it with
+ *         pio_buffer_free.
+ */
+snp_t *pio_matrix_alloc(struct pio_file_t *plink_file, size_t num_rows);
+
+/**
+ * Frees a buffer from pio_row_alloc or pio_matrix_alloc.
+ *
+ * @param buffer The buffer, or NULL.
+ */
+void pio_buffer_free(snp_t *buffer);
+
+/**
+ * Returns the size in bytes of a row in the packed format of the
+ * .bed file, as returned by pio_next_row_packed. This does not
+ * depend on the sample subset.
+ *
+ * @param plink_file Plink file.
+ *
+ * @return the size of a packed row in bytes.
+ */
+size_t pio_packed_row_size(struct pio_file_t *plink_file);
+
+/**
+ * Selects the samples that pio_next_row, pio_next_rows and
+ * pio_read_row_at return, so that analyses of a part of a large
+ * cohort do not need to decode the whole row. The rows then contain
+ * the selected samples in the given order, and pio_row_size is the
+ * number of selected samples. The selected genotypes are decoded
+ * straight from the packed data. The packed row functions still
+ * return all samples.
+ *
+ * @param plink_file Plink file with one locus per row.
+ * @param samples Pio ids of the selected samples, or NULL to return
+ *                all samples again.
+ * @param num_samples The number of ids in samples.
+ *
+ * @return PIO_OK if the subset could be set, PIO_ERROR if an id is
+ *         out of range or the file has one sample per row.
+ */
+pio_status_t pio_set_sample_subset(struct pio_file_t *plink_file, const size_t *samples, size_t num_samples);
+
+/**
+ * Like pio_set_sample_subset, but selects the samples with a
+ * bitmask, keeping them in the order of the file. Sample i is
+ * selected if bit i % 8 of mask[ i / 8 ] is set.
+ *
+ * @param plink_file Plink file with one locus per row.
+ * @param mask The bitmask, must hold ( pio_num_samples + 7 ) / 8
+ *             bytes, or NULL to return all samples again.
+ *
+ * @return PIO_OK if the subset could be set, PIO_ERROR otherwise.
+ */
+pio_status_t pio_set_sample_mask(struct pio_file_t *plink_file, const unsigned char *mask);
+
+/**
+ * Returns the name of the SIMD decoder used by pio_next_row,
+ * see bed_unpack_kernel.
+ *
+ * @return the name of the active decoder, e.g. "avx2".
+ */
+const char *pio_unpack_kernel(void);
+
 /**
  * Determines whether a row represents one loci for
  * all individuals, or all loci for one individual.
@@ -224,11 +797,46 @@ int pio_one_locus_per_row(struct pio_file_t *plink_file);
 pio_status_t pio_transpose(const char *plink_file_prefix, const char *transposed_file_prefix);
 
 /**
- * Closes all opened plink files. No changes are made.
+ * Transposes the given file like pio_transpose, with the given
+ * number of threads, see bed_transpose_threads.
+ *
+ * @param plink_file_prefix Path to the plink files, without the extension.
+ * @param transposed_file_prefix The transposed plink files will be stored at this path.
+ *                               The .bim and .fam files will be copied.
+ * @param num_threads The number of threads, 0 for one per online
+ *                    processor.
+ *
+ * @return PIO_OK if the file could be transposed, PIO_ERROR otherwise.
+ */
+pio_status_t pio_transpose_threads(const char *plink_file_prefix, const char *transposed_file_prefix, size_t num_threads);
+
+/**
+ * Transposes the given file like pio_transpose, but reads and
+ * writes it in sequential stripes that fit in memory_budget bytes,
+ * see bed_transpose_budget.
+ *
+ * @param plink_file_prefix Path to the plink files, without the extension.
+ * @param transposed_file_prefix The transposed plink files will be stored at this path.
+ *                               The .bim and .fam files will be copied.
+ * @param memory_budget The number of bytes to use for buffers.
+ * @param progress Called after each stripe of the .bed file, may be NULL.
+ * @param user_data Passed to progress.
+ *
+ * @return PIO_OK if the file could be transposed, PIO_ERROR otherwise.
+ */
+pio_status_t pio_transpose_budget(const char *plink_file_prefix, const char *transposed_file_prefix, size_t memory_budget, bed_transpose_progress_t progress, void *user_data);
+
+/**
+ * Closes all opened plink files. Samples that pio_write_sample
+ * has buffered are written first, no other changes are made.
  *
  * @param plink_file The file to close.
+ *
+ * @return PIO_OK if the files could be closed, P_BED_IO_ERROR if
+ *         the buffered samples could not be written. The files are
+ *         closed in either case.
  */
-void pio_close(struct pio_file_t *plink_file);
+pio_status_t pio_close(struct pio_file_t *plink_file);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "private/prefetch.h"
+#include "private/thread.h"
+
+struct libplinkio_prefetch_private_s {
+    libplinkio_prefetch_fill_private_t fill;
+    void *context;
+
+    /* Only used by the producer. */
+    size_t next_row;
+    size_t end_row;
+    size_t rows_per_block;
+
+    size_t block_size;
+    size_t depth;
+    unsigned char *blocks;
+    size_t *block_first_row;
+    size_t *block_num_rows;
+    pio_status_t *block_status;
+
+    /* The number of blocks that have been filled, written by the producer. */
+    volatile size_t head;
+    /* The number of blocks that have been released, written by the consumer. */
+    volatile size_t tail;
+    volatile size_t stop;
+
+    libplinkio_mutex_private_t mutex;
+    libplinkio_cond_private_t cond;
+    libplinkio_thread_private_t thread;
+};
+
+/**
+ * Wakes up the other side after an index has been published.
+ * Waiters check the indices under the mutex, so a wake up cannot
+ * be missed.
+ */
+static void
+prefetch_notify(libplinkio_prefetch_private_t *prefetch)
+{
+    libplinkio_mutex_lock_(&prefetch->mutex);
+    libplinkio_cond_broadcast_(&prefetch->cond);
+    libplinkio_mutex_unlock_(&prefetch->mutex);
+}
+
+static void
+prefetch_main(void *arg)
+{
+    libplinkio_prefetch_private_t *prefetch = (libplinkio_prefetch_private_t *)arg;
+    size_t head = 0;
+
+    for (;;) {
+        size_t slot = head % prefetch->depth;
+        size_t num_rows = 0;
+        pio_status_t status = PIO_END;
+
+        if (head - libplinkio_atomic_load_(&prefetch->tail) == prefetch->depth) {
+            libplinkio_mutex_lock_(&prefetch->mutex);
+            while (head - libplinkio_atomic_load_(&prefetch->tail) == prefetch->depth && !libplinkio_atomic_load_(&prefetch->stop)) {
+                libplinkio_cond_wait_(&prefetch->cond, &prefetch->mutex);
+            }
+            libplinkio_mutex_unlock_(&prefetch->mutex);
+        }
+        if (libplinkio_atomic_load_(&prefetch->stop)) break;
+
+        if (prefetch->next_row < prefetch->end_row) {
+            num_rows = prefetch->end_row - prefetch->next_row;
+            if (num_rows > prefetch->rows_per_block) num_rows = prefetch->rows_per_block;
+            status = prefetch->fill(prefetch->context, prefetch->next_row, num_rows, prefetch->blocks + slot * prefetch->block_size);
+        }
+
+        prefetch->block_first_row[slot] = prefetch->next_row;
+        prefetch->block_num_rows[slot] = num_rows;
+        prefetch->block_status[slot] = status;
+        prefetch->next_row += num_rows;
+
+        head++;
+        libplinkio_atomic_store_(&prefetch->head, head);
+        prefetch_notify(prefetch);
+
+        /* The end and errors are final, the consumer never releases them. */
+        if (status != PIO_OK) break;
+    }
+}
+
+libplinkio_prefetch_private_t *
+libplinkio_prefetch_start_(libplinkio_prefetch_fill_private_t fill, void *context, size_t first_row, size_t end_row, size_t rows_per_block, size_t block_size, size_t depth)
+{
+    libplinkio_prefetch_private_t *prefetch = NULL;
+    int has_mutex = 0;
+    int has_cond = 0;
+
+    if (depth == 0 || rows_per_block == 0) return NULL;
+    prefetch = (libplinkio_prefetch_private_t *)malloc(sizeof(libplinkio_prefetch_private_t));
+    if (prefetch == NULL) goto error;
+    memset(prefetch, 0, sizeof(*prefetch));
+
+    prefetch->fill = fill;
+    prefetch->context = context;
+    prefetch->next_row = first_row;
+    prefetch->end_row = end_row;
+    prefetch->rows_per_block = rows_per_block;
+    prefetch->block_size = block_size;
+    prefetch->depth = depth;
+
+    prefetch->blocks = (unsigned char *)malloc(depth * block_size + 1);
+    prefetch->block_first_row = (size_t *)malloc(depth * sizeof(size_t));
+    prefetch->block_num_rows = (size_t *)malloc(depth * sizeof(size_t));
+    prefetch->block_status = (pio_status_t *)malloc(depth * sizeof(pio_status_t));
+    if (prefetch->blocks == NULL || prefetch->block_first_row == NULL || prefetch->block_num_rows == NULL || prefetch->block_status == NULL) goto error;
+
+    if (libplinkio_mutex_init_(&prefetch->mutex) != 0) goto error;
+    has_mutex = 1;
+    if (libplinkio_cond_init_(&prefetch->cond) != 0) goto error;
+    has_cond = 1;
+    if (libplinkio_thread_create_(&prefetch->thread, prefetch_main, prefetch) != 0) goto error;
+
+    return prefetch;
+
+error:
+    if (prefetch == NULL) return NULL;
+    if (has_cond) libplinkio_cond_destroy_(&prefetch->cond);
+    if (has_mutex) libplinkio_mutex_destroy_(&prefetch->mutex);
+    if (prefetch->blocks != NULL) free(prefetch->blocks);
+    if (prefetch->block_first_row != NULL) free(prefetch->block_first_row);
+    if (prefetch->block_num_rows != NULL) free(prefetch->block_num_rows);
+    if (prefetch->block_status != NULL) free(prefetch->block_status);
+    free(prefetch);
+    return NULL;
+}
+
+pio_status_t
+libplinkio_prefetch_next_(libplinkio_prefetch_private_t *prefetch, const unsigned char **block, size_t *first_row, size_t *num_rows)
+{
+    size_t tail = prefetch->tail;
+    size_t slot = tail % prefetch->depth;
+
+    if (libplinkio_atomic_load_(&prefetch->head) == tail) {
+        libplinkio_mutex_lock_(&prefetch->mutex);
+        while (libplinkio_atomic_load_(&prefetch->head) == tail) {
+            libplinkio_cond_wait_(&prefetch->cond, &prefetch->mutex);
+        }
+        libplinkio_mutex_unlock_(&prefetch->mutex);
+    }
+
+    *block = prefetch->blocks + slot * prefetch->block_size;
+    *first_row = prefetch->block_first_row[slot];
+    *num_rows = prefetch->block_num_rows[slot];
+    return prefetch->block_status[slot];
+}
+
+void
+libplinkio_prefetch_release_(libplinkio_prefetch_private_t *prefetch)
+{
+    libplinkio_atomic_store_(&prefetch->tail, prefetch->tail + 1);
+    prefetch_notify(prefetch);
+}
+
+void
+libplinkio_prefetch_stop_(libplinkio_prefetch_private_t *prefetch)
+{
+    if (prefetch == NULL) return;
+
+    libplinkio_atomic_store_(&prefetch->stop, 1);
+    prefetch_notify(prefetch);
+    libplinkio_thread_join_(&prefetch->thread);
+
+    libplinkio_cond_destroy_(&prefetch->cond);
+    libplinkio_mutex_destroy_(&prefetch->mutex);
+    free(prefetch->blocks);
+    free(prefetch->block_first_row);
+    free(prefetch->block_num_rows);
+    free(prefetch->block_status);
+    free(prefetch);
+}
@@ -0,0 +1,72 @@
+#ifndef INCLUDED_PLINKIO_PRIVATE_ARENA_H_
+#define INCLUDED_PLINKIO_PRIVATE_ARENA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/**
+ * A bump allocator for strings that live as long as the file they
+ * were read from. Strings are carved out of large blocks and are
+ * never freed on their own, the whole arena is freed at once.
+ */
+typedef struct libplinkio_arena_private_s libplinkio_arena_private_t;
+
+/**
+ * Creates an empty arena. No block is allocated until the first
+ * string is added.
+ *
+ * @return The arena, or NULL if it could not be allocated.
+ */
+libplinkio_arena_private_t *libplinkio_arena_new_(void);
+
+/**
+ * Copies length characters of str into the arena and null
+ * terminates the copy. str does not need to be null terminated.
+ *
+ * @param arena The arena.
+ * @param str The characters to copy.
+ * @param length The number of characters.
+ *
+ * @return The copy, or NULL if it could not be allocated.
+ */
+char *libplinkio_arena_strndup_(libplinkio_arena_private_t *arena, const char *str, size_t length);
+
+/**
+ * Copies a null terminated string into the arena.
+ *
+ * @return The copy, or NULL if it could not be allocated.
+ */
+char *libplinkio_arena_strdup_(libplinkio_arena_private_t *arena, const char *str);
+
+/**
+ * Returns a string equal to the first length characters of str
+ * that is shared by all calls on the arena with equal strings, so
+ * that interned strings are equal exactly if their pointers are.
+ * Strings of one character are static, longer ones are hashed and
+ * copied into the arena the first time they are seen. The result
+ * must not be modified.
+ *
+ * @param arena The arena.
+ * @param str The characters to intern.
+ * @param length The number of characters, at least 1.
+ *
+ * @return The interned string, or NULL if it could not be allocated.
+ */
+char *libplinkio_arena_intern_(libplinkio_arena_private_t *arena, const char *str, size_t length);
+
+/**
+ * Frees all strings of the arena and the arena itself. Does
+ * nothing if arena is NULL.
+ *
+ * @param arena The arena.
+ */
+void libplinkio_arena_free_(libplinkio_arena_private_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* End of INCLUDED_PLINKIO_PRIVATE_ARENA_H_ */
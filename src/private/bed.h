@@ -5,11 +5,167 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 #include <plinkio/bed.h>
 #include <plinkio/status.h>
 
+#include "private/prefetch.h"
+
+/**
+ * A run of consecutive columns of the file that are decoded to
+ * consecutive positions of the output row.
+ */
+typedef struct {
+    /**
+     * First column of the run in the file.
+     */
+    size_t src;
+
+    /**
+     * Position of the first column in the decoded row.
+     */
+    size_t dst;
+
+    /**
+     * Number of columns in the run.
+     */
+    size_t length;
+} libplinkio_bed_col_run_private_t;
+
+/**
+ * The columns selected with bed_set_col_subset, compiled into runs
+ * so that long runs can be decoded with the SIMD kernels and short
+ * ones gathered genotype by genotype.
+ */
+typedef struct {
+    /**
+     * Number of selected columns, i.e. the length of a decoded row.
+     */
+    size_t num_cols;
+
+    /**
+     * Number of runs.
+     */
+    size_t num_runs;
+
+    /**
+     * The runs in the order of the decoded row.
+     */
+    libplinkio_bed_col_run_private_t *runs;
+
+    /**
+     * Holds the selected columns of a row packed together, for the
+     * typed decoders.
+     */
+    unsigned char *packed_buffer;
+} libplinkio_bed_col_subset_private_t;
+
+/**
+ * The prefetch settings of a bed file, see bed_set_prefetch.
+ */
+typedef struct {
+    /**
+     * The running prefetcher, or NULL if it is stopped.
+     */
+    libplinkio_prefetch_private_t *ring;
+
+    /**
+     * The block that the current row is read from, or NULL.
+     */
+    const unsigned char *block;
+    size_t block_first_row;
+    size_t block_num_rows;
+
+    /**
+     * The number of rows in a full block. A block holds the packed
+     * rows, followed by the decoded rows if decoded is set.
+     */
+    size_t rows_per_block;
+
+    size_t depth;
+    size_t block_size;
+    int decoded;
+} libplinkio_bed_prefetch_private_t;
+
+/**
+ * The columns buffered by bed_write_col, see bed_set_col_tile_size.
+ */
+typedef struct {
+    /**
+     * Number of columns in a full tile, a multiple of 4.
+     */
+    size_t tile_cols;
+
+    /**
+     * Index of the next column that bed_write_col writes.
+     */
+    size_t next_col;
+
+    /**
+     * Number of columns in the current tile, which starts at
+     * column next_col - num_cols.
+     */
+    size_t num_cols;
+
+    /**
+     * The columns of the tile packed one after the other, each
+     * with the genotypes of all rows.
+     */
+    unsigned char *cols;
+
+    /**
+     * The tile transposed into the layout of the file, tile_cols / 4
+     * bytes for each row.
+     */
+    unsigned char *rows;
+} libplinkio_bed_col_writer_private_t;
+
+/**
+ * A file read in the other orientation than it is stored, see
+ * bed_set_snp_order. The rows of the view are the columns of the
+ * file, and a window of them is transposed into memory at a time.
+ */
+typedef struct {
+    /**
+     * The header of the file as it is stored.
+     */
+    struct bed_header_t file_header;
+
+    /**
+     * Number of rows of the view in a full window, a multiple of 4
+     * so that a window starts on a byte of the rows of the file.
+     */
+    size_t window_rows;
+
+    /**
+     * The first row of the view in the window, and the number of
+     * rows in it, 0 if no window has been read.
+     */
+    size_t first_row;
+    size_t num_rows;
+
+    /**
+     * The bytes of the columns of the window in each row of the
+     * file, when they are read with pread.
+     */
+    unsigned char *band;
+
+    /**
+     * The rows of the window, bed_header_row_size of the view
+     * bytes apart.
+     */
+    unsigned char *rows;
+} libplinkio_bed_view_private_t;
+
+/**
+ * Decodes a packed row like the read functions of bed_file do,
+ * i.e. only the selected columns if a subset is set.
+ */
+void libplinkio_bed_decode_row_(struct pio_bed_file_t *bed_file, const unsigned char *packed_row, snp_t *buffer);
+
 pio_status_t
-libplinkio_bed_transpose_fd_(const int original_fd, const int transposed_fd, size_t num_loci, size_t num_samples);
+libplinkio_bed_transpose_fd_(const int original_fd, const int transposed_fd, size_t num_loci, size_t num_samples, size_t num_threads);
 
 pio_status_t
 libplinkio_bed_transpose_pio_bed_file_(struct pio_bed_file_t *bed_file, const char *transposed_path, size_t num_loci, size_t num_samples, _Bool is_tmp);
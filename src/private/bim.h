@@ -20,6 +20,18 @@ extern "C" {
  */
 pio_status_t libplinkio_bim_link_loci_to_file_(libplinkio_loci_private_t loci, struct pio_bim_file_t* bim_file, const char* bim_path, _Bool is_tmp);
 
+/**
+ * Parses the loci of a bim file like parse_loci.
+ *
+ * @param bim_fp The bim file.
+ * @param locus The loci are appended here.
+ * @param strings The names and alleles are allocated from this
+ *                arena, or with malloc if it is NULL.
+ *
+ * @return PIO_OK if the file could be parsed, PIO_ERROR otherwise.
+ */
+pio_status_t libplinkio_bim_parse_loci_(FILE *bim_fp, UT_array *locus, libplinkio_arena_private_t *strings);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,47 @@
+#ifndef INCLUDED_PLINKIO_PRIVATE_CPU_H_
+#define INCLUDED_PLINKIO_PRIVATE_CPU_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LIBPLINKIO_X86_ 1
+#endif
+
+/**
+ * Enables an instruction set for a single function, so that
+ * kernels can be compiled without changing the global flags.
+ * MSVC allows intrinsics everywhere and needs no annotation.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define LIBPLINKIO_TARGET_(isa) __attribute__((target(isa)))
+#else
+#define LIBPLINKIO_TARGET_(isa)
+#endif
+
+/**
+ * Instruction set extensions that the SIMD kernels can use.
+ */
+typedef enum {
+    LIBPLINKIO_CPU_SSE2_ = 1 << 0,
+    LIBPLINKIO_CPU_SSSE3_ = 1 << 1,
+    LIBPLINKIO_CPU_AVX2_ = 1 << 2,
+    LIBPLINKIO_CPU_AVX512BW_ = 1 << 3
+} libplinkio_cpu_feature_private_t;
+
+/**
+ * Returns the instruction set extensions supported by both the
+ * processor and the operating system, as a mask of
+ * libplinkio_cpu_feature_private_t.
+ *
+ * The environment variable LIBPLINKIO_SIMD can be set to one of
+ * scalar, sse2, ssse3, avx2 or avx512 to cap the detected level.
+ */
+unsigned int libplinkio_cpu_features_(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* End of INCLUDED_PLINKIO_PRIVATE_CPU_H_ */
@@ -20,6 +20,17 @@ extern "C" {
  */
 pio_status_t libplinkio_fam_link_samples_to_file_(libplinkio_samples_private_t samples, struct pio_fam_file_t* fam_file, const char* fam_path, _Bool is_tmp);
 
+/**
+ * Parses the samples of a fam file like parse_samples.
+ *
+ * @param fam_fp The fam file.
+ * @param sample The samples are appended here.
+ * @param strings The identifiers are allocated from this arena,
+ *                or with malloc if it is NULL.
+ *
+ * @return PIO_OK if the file could be parsed, PIO_ERROR otherwise.
+ */
+pio_status_t libplinkio_fam_parse_samples_(FILE *fam_fp, UT_array *sample, libplinkio_arena_private_t *strings);
 
 #ifdef __cplusplus
 }
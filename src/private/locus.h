@@ -9,40 +9,22 @@ extern "C" {
 #include <plinkio/bim.h>
 
 #include "private/utility.h"
+#include "private/arena.h"
 
 typedef struct {
     UT_array* ptr;
-} libplinkio_loci_private_t;
 
-/**
- * Locus destructor. Ensures that the allocated
- * strings are freed properly.
- *
- * @param element Pointer to a locus.
- */
-static void
-libplinkio_utarray_locus_dtor_(void *element)
-{
-    struct pio_locus_t *locus = (struct pio_locus_t *) element;
-
-    if( locus->name != NULL )
-    {
-        free( locus->name );
-    }
-    if( locus->allele1 != NULL )
-    {
-        free( locus->allele1 );
-    }
-    if( locus->allele2 != NULL )
-    {
-        free( locus->allele2 );
-    }
-}
+    /**
+     * Owns the strings of the loci in ptr.
+     */
+    libplinkio_arena_private_t* strings;
+} libplinkio_loci_private_t;
 
 /**
- * Properties of the locus array for dtarray.
+ * Properties of the locus array for dtarray. The strings of the
+ * loci are owned by an arena, so there is no destructor.
  */
-static UT_icd LIBPLINKIO_LOCUS_ICD_ = { sizeof( struct pio_locus_t ), NULL, NULL, libplinkio_utarray_locus_dtor_ };
+static UT_icd LIBPLINKIO_LOCUS_ICD_ = { sizeof( struct pio_locus_t ), NULL, NULL, NULL };
 
 static FORCE_INLINE libplinkio_loci_private_t libplinkio_init_loci_(void) {
     libplinkio_loci_private_t loci = {0};
@@ -51,6 +33,8 @@ static FORCE_INLINE libplinkio_loci_private_t libplinkio_init_loci_(void) {
 
 static FORCE_INLINE libplinkio_loci_private_t libplinkio_new_loci_(void) {
     libplinkio_loci_private_t loci = libplinkio_init_loci_();
+    loci.strings = libplinkio_arena_new_();
+    if (loci.strings == NULL) return loci;
     utarray_new( loci.ptr, &LIBPLINKIO_LOCUS_ICD_ );
     return loci;
 }
@@ -83,6 +67,7 @@ static FORCE_INLINE void libplinkio_add_locus_(libplinkio_loci_private_t loci, s
 
 static FORCE_INLINE void libplinkio_free_loci_(libplinkio_loci_private_t loci) {
     if (loci.ptr != NULL) utarray_free(loci.ptr);
+    libplinkio_arena_free_(loci.strings);
 }
 
 #ifdef __cplusplus
@@ -10,8 +10,15 @@ extern "C" {
 #include <plinkio/plinkio.h>
 #include <plinkio/status.h>
 
+#include "private/arena.h"
 #include "private/locus.h"
 
+/**
+ * Size of the buffer on the stack that the parsers null terminate
+ * fields in, longer fields are copied to the heap.
+ */
+#define LIBPLINKIO_FIELD_BUFFER_SIZE_ 64
+
 typedef enum {
     LIBPLINKIO_CHAR_SET_INIT_,
     LIBPLINKIO_CHAR_SET_GRAPH_,
@@ -39,6 +46,15 @@ typedef enum {
 char*
 libplinkio_parse_str_(const char *field, size_t length, pio_status_t *status);
 
+char*
+libplinkio_parse_arena_str_(libplinkio_arena_private_t *arena, const char *field, size_t length, pio_status_t *status);
+
+char*
+libplinkio_parse_arena_allele_(libplinkio_arena_private_t *arena, const char *field, size_t length, pio_status_t *status);
+
+char*
+libplinkio_terminate_field_(const char *field, size_t length, char *buffer, size_t buffer_size);
+
 unsigned char
 libplinkio_parse_chr_(const char *field, size_t length, pio_status_t *status);
 
@@ -62,6 +78,13 @@ libplinkio_txt_parser_init_(
     libplinkio_txt_parser_private_t* parser
 );
 
+/**
+ * Splits buffer into fields separated by spaces and tabs, and rows
+ * separated by newlines, and calls new_field and new_row for each
+ * of them in order. The text ends at the first null character. A
+ * field is passed as a slice of buffer that is not null terminated,
+ * unless it began in an earlier buffer, in which case it is copied.
+ */
 pio_status_t
 libplinkio_txt_parse_(
     libplinkio_txt_parser_private_t* parser,
@@ -85,6 +108,26 @@ libplinkio_txt_parser_free_(
     libplinkio_txt_parser_private_t* parser
 );
 
+/**
+ * Parses the rest of fp like libplinkio_txt_parse_ followed by
+ * libplinkio_txt_parse_fini_. Regular files are memory mapped and
+ * parsed in place, other streams are read in large blocks.
+ *
+ * @param fp The file.
+ * @param new_field Called for each field.
+ * @param new_row Called at the end of each row.
+ * @param data Passed to the callbacks.
+ *
+ * @return PIO_OK if the file could be read, PIO_ERROR otherwise.
+ */
+pio_status_t
+libplinkio_txt_parse_file_(
+    FILE* fp,
+    void (*new_field)(char*, size_t, size_t, void*),
+    void (*new_row)(size_t, void*),
+    void* data
+);
+
 int libplinkio_count_txt_column_(FILE* fp);
 
 #ifdef __cplusplus
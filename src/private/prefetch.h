@@ -0,0 +1,73 @@
+#ifndef INCLUDED_PLINKIO_PRIVATE_PREFETCH_H_
+#define INCLUDED_PLINKIO_PRIVATE_PREFETCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include <plinkio/status.h>
+
+/**
+ * Fills a block with num_rows rows starting at first_row. Called
+ * on the prefetch thread.
+ *
+ * @return PIO_OK if the rows could be read, PIO_ERROR otherwise.
+ */
+typedef pio_status_t (*libplinkio_prefetch_fill_private_t)(void *context, size_t first_row, size_t num_rows, unsigned char *block);
+
+/**
+ * A background thread that fills a bounded ring of row blocks
+ * ahead of a single consumer. The ring indices are only ever
+ * written by one side each, so the consumer takes ready blocks
+ * without locking, and only sleeps on a condition variable when the
+ * ring is empty, as does the producer when it is full.
+ */
+typedef struct libplinkio_prefetch_private_s libplinkio_prefetch_private_t;
+
+/**
+ * Starts prefetching the rows from first_row to end_row.
+ *
+ * @param fill Reads a block of rows.
+ * @param context Passed to fill.
+ * @param first_row The first row to read.
+ * @param end_row One past the last row to read.
+ * @param rows_per_block The number of rows in a full block.
+ * @param block_size The size of a block in bytes.
+ * @param depth The number of blocks in the ring.
+ *
+ * @return The prefetcher, or NULL if it could not be started.
+ */
+libplinkio_prefetch_private_t *libplinkio_prefetch_start_(libplinkio_prefetch_fill_private_t fill, void *context, size_t first_row, size_t end_row, size_t rows_per_block, size_t block_size, size_t depth);
+
+/**
+ * Waits for the next block. The block stays valid until
+ * libplinkio_prefetch_release_ is called.
+ *
+ * @param prefetch The prefetcher.
+ * @param block The address of the block is stored here.
+ * @param first_row The first row of the block is stored here.
+ * @param num_rows The number of rows in the block is stored here.
+ *
+ * @return PIO_OK if a block was read, PIO_END after the last block,
+ *         PIO_ERROR if the block could not be read.
+ */
+pio_status_t libplinkio_prefetch_next_(libplinkio_prefetch_private_t *prefetch, const unsigned char **block, size_t *first_row, size_t *num_rows);
+
+/**
+ * Hands the block from the last call to libplinkio_prefetch_next_
+ * back to the producer.
+ */
+void libplinkio_prefetch_release_(libplinkio_prefetch_private_t *prefetch);
+
+/**
+ * Stops the thread and frees the prefetcher.
+ */
+void libplinkio_prefetch_stop_(libplinkio_prefetch_private_t *prefetch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* End of INCLUDED_PLINKIO_PRIVATE_PREFETCH_H_ */
@@ -9,48 +9,26 @@ extern "C" {
 #include <plinkio/fam.h>
 
 #include "private/utility.h"
+#include "private/arena.h"
 
 typedef struct {
     UT_array* ptr;
-} libplinkio_samples_private_t;
 
-/**
- * Sample destructor. Ensures that the allocated
- * strings are freed properly.
- *
- * @param element Pointer to a sample.
- */
-static void
-libplinkio_utarray_sample_dtor_(void *element)
-{
-    struct pio_sample_t *sample = (struct pio_sample_t *) element;
-
-    if( sample->fid != NULL )
-    {
-        free( sample->fid );
-    }
-    if( sample->iid != NULL )
-    {
-        free( sample->iid );
-    }
-    if( sample->father_iid != NULL )
-    {
-        free( sample->father_iid );
-    }
-    if( sample->mother_iid != NULL )
-    {
-        free( sample->mother_iid );
-    }
-}
+    /**
+     * Owns the strings of the samples in ptr.
+     */
+    libplinkio_arena_private_t* strings;
+} libplinkio_samples_private_t;
 
 /**
- * Properties of the sample array for dtarray.
+ * Properties of the sample array for dtarray. The strings of the
+ * samples are owned by an arena, so there is no destructor.
  */
 static UT_icd LIBPLINKIO_SAMPLE_ICD_ = {
     sizeof( struct pio_sample_t ),
     NULL,
     NULL,
-    libplinkio_utarray_sample_dtor_
+    NULL
 };
 
 static FORCE_INLINE libplinkio_samples_private_t libplinkio_init_samples_(void) {
@@ -60,6 +38,8 @@ static FORCE_INLINE libplinkio_samples_private_t libplinkio_init_samples_(void)
 
 static FORCE_INLINE libplinkio_samples_private_t libplinkio_new_samples_(void) {
     libplinkio_samples_private_t samples = {0};
+    samples.strings = libplinkio_arena_new_();
+    if (samples.strings == NULL) return samples;
     utarray_new( samples.ptr, &LIBPLINKIO_SAMPLE_ICD_ );
     return samples;
 }
@@ -92,6 +72,7 @@ static FORCE_INLINE void libplinkio_add_sample_(libplinkio_samples_private_t sam
 
 static FORCE_INLINE void libplinkio_free_samples_(libplinkio_samples_private_t samples) {
     if (samples.ptr != NULL) utarray_free(samples.ptr);
+    libplinkio_arena_free_(samples.strings);
 }
 
 #ifdef __cplusplus
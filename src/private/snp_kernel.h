@@ -0,0 +1,115 @@
+#ifndef INCLUDED_PLINKIO_PRIVATE_SNP_KERNEL_H_
+#define INCLUDED_PLINKIO_PRIVATE_SNP_KERNEL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "private/cpu.h"
+
+/**
+ * Unpacks num_cols 2-bit genotypes into one byte per genotype,
+ * see unpack_snps in bed.c for the encoding.
+ */
+typedef void (*libplinkio_unpack_kernel_private_t)(const unsigned char *packed_snps, uint8_t *unpacked_snps, size_t num_cols);
+
+/**
+ * Packs num_cols genotypes of one byte each into 2-bit codes, the
+ * reverse of the unpack kernel. Genotypes larger than 3 are detected
+ * without a branch per genotype.
+ *
+ * @return 0 if all genotypes were valid, non-zero otherwise, in
+ *         which case the packed row is undefined.
+ */
+typedef int (*libplinkio_pack_kernel_private_t)(const uint8_t *unpacked_snps, unsigned char *packed_snps, size_t num_cols);
+
+/**
+ * Decodes num_cols 2-bit genotypes into values, where table holds
+ * the value for each packed code: 00 (homozygous major), 01
+ * (missing), 10 (heterozygous) and 11 (homozygous minor).
+ */
+typedef void (*libplinkio_decode_i8_kernel_private_t)(const unsigned char *packed_snps, int8_t *values, size_t num_cols, const int8_t table[4]);
+typedef void (*libplinkio_decode_f32_kernel_private_t)(const unsigned char *packed_snps, float *values, size_t num_cols, const float table[4]);
+typedef void (*libplinkio_decode_f64_kernel_private_t)(const unsigned char *packed_snps, double *values, size_t num_cols, const double table[4]);
+
+/**
+ * Transposes 4 packed rows, src_stride bytes apart, in blocks of
+ * 4x4 genotypes: word j holds byte j of the 4 rows transposed, so
+ * that its byte m is the packed genotypes of column 4j + m in the
+ * 4 rows, the first row in the lowest bits.
+ */
+typedef void (*libplinkio_transpose4_kernel_private_t)(const unsigned char *src, size_t src_stride, size_t num_bytes, uint32_t *words);
+
+/**
+ * A set of kernels that are compiled for the same instruction set.
+ */
+typedef struct {
+    /**
+     * Name of the instruction set, e.g. "avx2".
+     */
+    const char *name;
+
+    /**
+     * Decodes a packed row.
+     */
+    libplinkio_unpack_kernel_private_t unpack;
+
+    /**
+     * Encodes a row.
+     */
+    libplinkio_pack_kernel_private_t pack;
+
+    /**
+     * Decode a packed row into int8, float or double values.
+     */
+    libplinkio_decode_i8_kernel_private_t decode_i8;
+    libplinkio_decode_f32_kernel_private_t decode_f32;
+    libplinkio_decode_f64_kernel_private_t decode_f64;
+
+    /**
+     * Transposes blocks of 4 rows.
+     */
+    libplinkio_transpose4_kernel_private_t transpose4;
+} libplinkio_snp_kernel_private_t;
+
+/**
+ * Returns the fastest kernels supported by the running CPU.
+ * The choice is made on the first call and cached.
+ */
+const libplinkio_snp_kernel_private_t *libplinkio_snp_kernel_(void);
+
+/**
+ * Returns the kernels for the given instruction set if they are
+ * compiled in and supported by the running CPU, NULL otherwise.
+ *
+ * @param name One of "scalar", "sse2", "ssse3", "avx2" or "avx512".
+ */
+const libplinkio_snp_kernel_private_t *libplinkio_snp_kernel_by_name_(const char *name);
+
+void libplinkio_unpack_snps_scalar_(const unsigned char *packed_snps, uint8_t *unpacked_snps, size_t num_cols);
+int libplinkio_pack_snps_scalar_(const uint8_t *unpacked_snps, unsigned char *packed_snps, size_t num_cols);
+void libplinkio_decode_i8_scalar_(const unsigned char *packed_snps, int8_t *values, size_t num_cols, const int8_t table[4]);
+void libplinkio_decode_f32_scalar_(const unsigned char *packed_snps, float *values, size_t num_cols, const float table[4]);
+void libplinkio_decode_f64_scalar_(const unsigned char *packed_snps, double *values, size_t num_cols, const double table[4]);
+void libplinkio_transpose4_scalar_(const unsigned char *src, size_t src_stride, size_t num_bytes, uint32_t *words);
+
+/**
+ * Counts the genotypes of a packed row by their packed code, so
+ * that counts[ 1 ] is the number of missing genotypes and
+ * counts[ 2 ] the number of heterozygotes. The bits after the last
+ * genotype are ignored.
+ *
+ * @param packed_snps The packed SNPs.
+ * @param num_cols The number of SNPs.
+ * @param counts The four counts are stored here.
+ */
+void libplinkio_count_snps_(const unsigned char *packed_snps, size_t num_cols, size_t counts[4]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* End of INCLUDED_PLINKIO_PRIVATE_SNP_KERNEL_H_ */
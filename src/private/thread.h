@@ -0,0 +1,97 @@
+#ifndef INCLUDED_PLINKIO_PRIVATE_THREAD_H_
+#define INCLUDED_PLINKIO_PRIVATE_THREAD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "private/utility.h"
+
+typedef void (*libplinkio_thread_func_private_t)(void *arg);
+
+typedef struct {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t thread;
+#endif
+    libplinkio_thread_func_private_t func;
+    void *arg;
+} libplinkio_thread_private_t;
+
+typedef struct {
+#ifdef _WIN32
+    SRWLOCK lock;
+#else
+    pthread_mutex_t mutex;
+#endif
+} libplinkio_mutex_private_t;
+
+typedef struct {
+#ifdef _WIN32
+    CONDITION_VARIABLE cond;
+#else
+    pthread_cond_t cond;
+#endif
+} libplinkio_cond_private_t;
+
+/**
+ * Starts a thread that runs func( arg ). The thread struct must
+ * stay at the same address until libplinkio_thread_join_.
+ *
+ * @return 0 if the thread could be started, -1 otherwise.
+ */
+int libplinkio_thread_create_(libplinkio_thread_private_t *thread, libplinkio_thread_func_private_t func, void *arg);
+int libplinkio_thread_join_(libplinkio_thread_private_t *thread);
+
+int libplinkio_mutex_init_(libplinkio_mutex_private_t *mutex);
+void libplinkio_mutex_lock_(libplinkio_mutex_private_t *mutex);
+void libplinkio_mutex_unlock_(libplinkio_mutex_private_t *mutex);
+void libplinkio_mutex_destroy_(libplinkio_mutex_private_t *mutex);
+
+int libplinkio_cond_init_(libplinkio_cond_private_t *cond);
+void libplinkio_cond_wait_(libplinkio_cond_private_t *cond, libplinkio_mutex_private_t *mutex);
+void libplinkio_cond_broadcast_(libplinkio_cond_private_t *cond);
+void libplinkio_cond_destroy_(libplinkio_cond_private_t *cond);
+
+/**
+ * Loads a value with acquire semantics, so that everything written
+ * before the matching libplinkio_atomic_store_ is visible.
+ */
+static FORCE_INLINE size_t libplinkio_atomic_load_(volatile size_t *value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#else
+    size_t result = *value;
+    MemoryBarrier();
+    return result;
+#endif
+}
+
+/**
+ * Stores a value with release semantics.
+ */
+static FORCE_INLINE void libplinkio_atomic_store_(volatile size_t *value, size_t new_value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+#else
+    MemoryBarrier();
+    *value = new_value;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* End of INCLUDED_PLINKIO_PRIVATE_THREAD_H_ */
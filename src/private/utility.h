@@ -47,6 +47,17 @@ typedef enum {
     LIBPLINKIO_MMAP_NONE_
 } libplinkio_mmap_mode_private_t;
 
+/**
+ * Access advice for libplinkio_fadvise_ and libplinkio_madvise_.
+ */
+typedef enum {
+    LIBPLINKIO_ADVICE_NORMAL_,
+    LIBPLINKIO_ADVICE_SEQUENTIAL_,
+    LIBPLINKIO_ADVICE_RANDOM_,
+    LIBPLINKIO_ADVICE_WILLNEED_,
+    LIBPLINKIO_ADVICE_DONTNEED_
+} libplinkio_advice_private_t;
+
 typedef struct {
 #ifdef _WIN32
     HANDLE file_mapping_handle;
@@ -65,6 +76,7 @@ static FORCE_INLINE uint32_t libplinkio_popcnt32_(uint32_t x);
 #if (PLINKIO_PTR_BIT_ != 0 && PLINKIO_PTR_BIT_ % 64 == 0)
 static FORCE_INLINE uint64_t libplinkio_popcnt64_(uint64_t x);
 #endif
+static FORCE_INLINE unsigned int libplinkio_ctz64_(uint64_t x);
 
 static FORCE_INLINE size_t libplinkio_bits_msb_size_(size_t x);
 
@@ -73,13 +85,93 @@ int libplinkio_get_random_32_(char* buffer, size_t length);
 
 int libplinkio_tmp_open_(const char* filename_prefix, const size_t filename_prefix_length);
 
+/**
+ * Creates a new file named path followed by a dot and random
+ * characters, e.g. to write it completely before it is renamed to
+ * path. Unlike libplinkio_tmp_open_ the file is kept.
+ *
+ * @param path The path that the name starts with.
+ * @param tmp_path The name of the file is stored here, and must be
+ *                 freed by the caller.
+ *
+ * @return The descriptor of the file opened for reading and
+ *         writing, -1 if it could not be created.
+ */
+int libplinkio_tmp_create_(const char* path, char** tmp_path);
+
+/**
+ * Allocates size bytes at an address that is a multiple of
+ * alignment, which must be a power of two. The block must be
+ * freed with libplinkio_aligned_free_.
+ *
+ * @return The block, or NULL if it could not be allocated.
+ */
+void *libplinkio_aligned_alloc_(size_t size, size_t alignment);
+
+/**
+ * Frees a block allocated with libplinkio_aligned_alloc_, NULL is
+ * ignored.
+ */
+void libplinkio_aligned_free_(void *block);
+
 void* libplinkio_mmap_(int fd, libplinkio_mmap_mode_private_t mode, libplinkio_mmap_state_private_t* state);
 int libplinkio_munmap_(void* mapped_file, libplinkio_mmap_state_private_t* state);
 
 int libplinkio_ftruncate_(int fd, size_t size);
 
+/**
+ * Reads length bytes at the given offset of fd without using or
+ * moving the file position on POSIX systems, so that many threads
+ * can read from the same descriptor. On Windows the position of
+ * the handle is moved, but the offset is still taken from the call.
+ *
+ * @return 0 if all bytes could be read, -1 otherwise.
+ */
+int libplinkio_pread_(int fd, void *buffer, size_t length, uint64_t offset);
+
+/**
+ * Writes length bytes at the given offset of fd, the counterpart
+ * of libplinkio_pread_. Many threads may write disjoint ranges of
+ * the same descriptor at once.
+ *
+ * @return 0 if all bytes could be written, -1 otherwise.
+ */
+int libplinkio_pwrite_(int fd, const void *buffer, size_t length, uint64_t offset);
+
+/**
+ * Grows fd to size bytes and reserves the disk space for it where
+ * the platform and file system support it, so that later writes
+ * into the range do not fail for lack of space or fragment the
+ * file. Elsewhere the file is only extended.
+ *
+ * @return 0 if the file could be extended, -1 otherwise.
+ */
+int libplinkio_fallocate_(int fd, uint64_t size);
+
+/**
+ * Returns the number of online processors, at least 1.
+ */
+size_t libplinkio_num_cpus_(void);
+
 int libplinkio_change_mode_and_open_(int fd, int flags);
 
+/**
+ * Tells the kernel how a range of fd will be accessed, a length of
+ * 0 means to the end of the file. Does nothing where the platform
+ * has no posix_fadvise.
+ *
+ * @return 0 if the advice was given or is not supported, -1 otherwise.
+ */
+int libplinkio_fadvise_(int fd, uint64_t offset, uint64_t length, libplinkio_advice_private_t advice);
+
+/**
+ * Tells the kernel how a range of a mapping will be accessed. The
+ * range is widened to whole pages. Does nothing on Windows.
+ *
+ * @return 0 if the advice was given or is not supported, -1 otherwise.
+ */
+int libplinkio_madvise_(const void *addr, size_t length, libplinkio_advice_private_t advice);
+
 static FORCE_INLINE uint8_t libplinkio_popcnt8_(uint8_t x) {
     x = (x & 0x55) + (x >> 1 & 0x55);
     x = (x & 0x33) + (x >> 2 & 0x33);
@@ -116,6 +208,26 @@ static FORCE_INLINE uint64_t libplinkio_popcnt64_(uint64_t x) {
 }
 #endif
 
+/**
+ * Returns the number of trailing zero bits of x, which must not be 0.
+ */
+static FORCE_INLINE unsigned int libplinkio_ctz64_(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned int)__builtin_ctzll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (unsigned int)index;
+#else
+    unsigned int bits = 0;
+    while ((x & 1) == 0) {
+        x >>= 1;
+        bits++;
+    }
+    return bits;
+#endif
+}
+
 static FORCE_INLINE size_t libplinkio_bits_msb_size_(size_t x)
 {
 #if SIZE_MAX == UINTMAX_C(0xFFFF)
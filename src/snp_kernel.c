@@ -0,0 +1,795 @@
+/**
+ * Copyright (c) 2012-2013, Mattias Frånberg
+ * All rights reserved.
+ *
+ * This file is distributed under the Modified BSD License. See the COPYING file
+ * for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <plinkio/snp_lookup.h>
+
+#include "private/utility.h"
+#include "private/cpu.h"
+#include "private/snp_kernel.h"
+#include "private/thread.h"
+
+#ifdef LIBPLINKIO_X86_
+#include <immintrin.h>
+#endif
+
+/**
+ * Reference implementation of the decoder, it maps each packed
+ * byte to four genotypes through snp_lookup. The SIMD kernels
+ * use it for the bytes that do not fill a whole register.
+ *
+ * @param packed_snps The packed SNPs.
+ * @param unpacked_snps The unpacked SNPs.
+ * @param num_cols The number of SNPs.
+ */
+void
+libplinkio_unpack_snps_scalar_(const unsigned char *packed_snps, uint8_t *unpacked_snps, size_t num_cols)
+{
+    size_t packed_length = num_cols / 4;
+    /* Unpack SNPs in pairs of 4. */
+    uint8_t* p = unpacked_snps;
+    if (((uintptr_t)unpacked_snps & 0b11) == 0) {
+        // 4 bytes aligned
+        for (size_t i = 0; i < packed_length; i++) {
+            *((uint32_t*)p) = *((uint32_t*)(snp_lookup[ packed_snps[ i ] ].snp_array));
+            p += 4;
+        }
+    } else if (((uintptr_t)unpacked_snps & 0b1) == 0) {
+        // 2 byte aligned
+        for (size_t i = 0; i < packed_length; i++) {
+            *((uint16_t*)p) = *((uint16_t*)(snp_lookup[ packed_snps[ i ] ].snp_array));
+            *((uint16_t*)(p + 2)) = *((uint16_t*)(snp_lookup[ packed_snps[ i ] ].snp_array + 2));
+            p += 4;
+        }
+    } else {
+        // Unaligned
+        for (size_t i = 0; i < packed_length; i++) {
+            *(p) = *(snp_lookup[ packed_snps[ i ] ].snp_array);
+            *(p + 1) = *(snp_lookup[ packed_snps[ i ] ].snp_array + 1);
+            *(p + 2) = *(snp_lookup[ packed_snps[ i ] ].snp_array + 2);
+            *(p + 3) = *(snp_lookup[ packed_snps[ i ] ].snp_array + 3);
+            p += 4;
+        }
+    }
+
+    /* Unpack the trailing SNPs */
+    size_t index = packed_length * 4;
+    size_t packed_left = num_cols % 4;
+    for(size_t i = 0; i < packed_left; i++) {
+        unpacked_snps[ index + i ] = snp_lookup[ packed_snps[ packed_length ] ].snp_array[ i ];
+    }
+}
+
+/**
+ * Reference implementation of the encoder, one packed byte at a
+ * time. Invalid genotypes are collected in a mask instead of
+ * being tested one by one.
+ *
+ * @param unpacked_snps The unpacked SNPs.
+ * @param packed_snps The packed SNPs.
+ * @param num_cols The number of SNPs.
+ *
+ * @return 0 if all genotypes were at most 3, non-zero otherwise.
+ */
+int
+libplinkio_pack_snps_scalar_(const uint8_t *unpacked_snps, unsigned char *packed_snps, size_t num_cols)
+{
+    unsigned int seen = 0;
+    for(size_t i = 0; i < num_cols; i += 4)
+    {
+        /* Genotypes are stored backwards. */
+        unsigned int packed = 0;
+        size_t length = num_cols - i < 4 ? num_cols - i : 4;
+        for(size_t j = 0; j < length; j++)
+        {
+            uint8_t genotype = unpacked_snps[ i + j ];
+            seen |= genotype;
+            packed |= (unsigned int) snp_to_bits[ genotype & 0x03 ] << ( 2 * j );
+        }
+        packed_snps[ i / 4 ] = (unsigned char) packed;
+    }
+
+    return ( seen & ~0x03u ) != 0;
+}
+
+
+/**
+ * Reference implementations of the typed decoders, they look up
+ * each 2-bit code in the table. The SIMD kernels use them for the
+ * bytes that do not fill a whole register.
+ *
+ * @param packed_snps The packed SNPs.
+ * @param values The decoded values.
+ * @param num_cols The number of SNPs.
+ * @param table The value of each packed code.
+ */
+void
+libplinkio_decode_i8_scalar_(const unsigned char *packed_snps, int8_t *values, size_t num_cols, const int8_t table[4])
+{
+    for(size_t i = 0; i < num_cols; i++)
+    {
+        values[ i ] = table[ ( packed_snps[ i / 4 ] >> ( 2 * ( i % 4 ) ) ) & 0x03 ];
+    }
+}
+
+void
+libplinkio_decode_f32_scalar_(const unsigned char *packed_snps, float *values, size_t num_cols, const float table[4])
+{
+    for(size_t i = 0; i < num_cols; i++)
+    {
+        values[ i ] = table[ ( packed_snps[ i / 4 ] >> ( 2 * ( i % 4 ) ) ) & 0x03 ];
+    }
+}
+
+void
+libplinkio_decode_f64_scalar_(const unsigned char *packed_snps, double *values, size_t num_cols, const double table[4])
+{
+    for(size_t i = 0; i < num_cols; i++)
+    {
+        values[ i ] = table[ ( packed_snps[ i / 4 ] >> ( 2 * ( i % 4 ) ) ) & 0x03 ];
+    }
+}
+
+/**
+ * Transposes the 4x4 matrix of 2-bit genotypes in x, where byte r
+ * holds row r, with two delta swaps: first the genotypes within each
+ * 2x2 block, then the two off-diagonal 2x2 blocks.
+ */
+static FORCE_INLINE uint32_t
+transpose_4x4(uint32_t x)
+{
+    uint32_t t = ( ( x >> 6 ) ^ x ) & 0x00cc00ccu;
+    x ^= t ^ ( t << 6 );
+    t = ( ( x >> 12 ) ^ x ) & 0x0000f0f0u;
+    return x ^ t ^ ( t << 12 );
+}
+
+void
+libplinkio_transpose4_scalar_(const unsigned char *src, size_t src_stride, size_t num_bytes, uint32_t *words)
+{
+    for(size_t j = 0; j < num_bytes; j++)
+    {
+        uint32_t x = (uint32_t) src[ j ] |
+                     ( (uint32_t) src[ src_stride + j ] << 8 ) |
+                     ( (uint32_t) src[ 2 * src_stride + j ] << 16 ) |
+                     ( (uint32_t) src[ 3 * src_stride + j ] << 24 );
+        words[ j ] = transpose_4x4( x );
+    }
+}
+
+void
+libplinkio_count_snps_(const unsigned char *packed_snps, size_t num_cols, size_t counts[4])
+{
+    const uint32_t m55 = 0x55555555u;
+    size_t packed_length = num_cols / 4;
+    size_t num_missing = 0;
+    size_t num_het = 0;
+    size_t num_hom_minor = 0;
+    size_t i = 0;
+
+    /* A code with bits (hi, lo) is missing if lo & ~hi, het if hi & ~lo and minor if hi & lo. */
+    for(; i < packed_length; i += 4)
+    {
+        uint32_t x = 0;
+        uint32_t lo, hi;
+        memcpy( &x, packed_snps + i, packed_length - i < 4 ? packed_length - i : 4 );
+        lo = x & m55;
+        hi = ( x >> 1 ) & m55;
+        num_missing += libplinkio_popcnt32_( lo & ~hi );
+        num_het += libplinkio_popcnt32_( hi & ~lo );
+        num_hom_minor += libplinkio_popcnt32_( hi & lo );
+    }
+
+    for(i = 0; i < num_cols % 4; i++)
+    {
+        unsigned int code = ( packed_snps[ packed_length ] >> ( 2 * i ) ) & 0x03;
+        num_missing += code == 1;
+        num_het += code == 2;
+        num_hom_minor += code == 3;
+    }
+
+    counts[ 0 ] = num_cols - num_missing - num_het - num_hom_minor;
+    counts[ 1 ] = num_missing;
+    counts[ 2 ] = num_het;
+    counts[ 3 ] = num_hom_minor;
+}
+
+#ifdef LIBPLINKIO_X86_
+
+/*
+ * The SIMD decoders split every packed byte into its four 2-bit
+ * codes c0..c3 (c0 in the lowest bits), translate each code to a
+ * genotype and interleave the four vectors so that byte i of the
+ * input becomes bytes 4i..4i+3 of the output.
+ *
+ * The translation 00 -> 0, 01 -> 3, 10 -> 1, 11 -> 2 is either a
+ * pshufb lookup, or on plain SSE2 the bit identity
+ * genotype = (lo << 1) | (hi ^ lo) for a code with bits (hi, lo).
+ */
+
+LIBPLINKIO_TARGET_("sse2")
+static FORCE_INLINE void
+unpack_store_sse2(__m128i c0, __m128i c1, __m128i c2, __m128i c3, uint8_t *out)
+{
+    __m128i p01_lo = _mm_unpacklo_epi8( c0, c1 );
+    __m128i p01_hi = _mm_unpackhi_epi8( c0, c1 );
+    __m128i p23_lo = _mm_unpacklo_epi8( c2, c3 );
+    __m128i p23_hi = _mm_unpackhi_epi8( c2, c3 );
+
+    _mm_storeu_si128( (__m128i *)( out +  0 ), _mm_unpacklo_epi16( p01_lo, p23_lo ) );
+    _mm_storeu_si128( (__m128i *)( out + 16 ), _mm_unpackhi_epi16( p01_lo, p23_lo ) );
+    _mm_storeu_si128( (__m128i *)( out + 32 ), _mm_unpacklo_epi16( p01_hi, p23_hi ) );
+    _mm_storeu_si128( (__m128i *)( out + 48 ), _mm_unpackhi_epi16( p01_hi, p23_hi ) );
+}
+
+LIBPLINKIO_TARGET_("sse2")
+static void
+unpack_snps_sse2(const unsigned char *packed_snps, uint8_t *unpacked_snps, size_t num_cols)
+{
+    const __m128i m03 = _mm_set1_epi8( 0x03 );
+    const __m128i m55 = _mm_set1_epi8( 0x55 );
+    size_t packed_length = num_cols / 4;
+    size_t i = 0;
+
+    for(; i + 16 <= packed_length; i += 16)
+    {
+        __m128i x = _mm_loadu_si128( (const __m128i *)( packed_snps + i ) );
+        __m128i lo = _mm_and_si128( x, m55 );
+        __m128i hi = _mm_and_si128( _mm_srli_epi16( x, 1 ), m55 );
+        __m128i v = _mm_or_si128( _mm_add_epi8( lo, lo ), _mm_xor_si128( hi, lo ) );
+
+        unpack_store_sse2( _mm_and_si128( v, m03 ),
+                           _mm_and_si128( _mm_srli_epi16( v, 2 ), m03 ),
+                           _mm_and_si128( _mm_srli_epi16( v, 4 ), m03 ),
+                           _mm_and_si128( _mm_srli_epi16( v, 6 ), m03 ),
+                           unpacked_snps + 4 * i );
+    }
+
+    libplinkio_unpack_snps_scalar_( packed_snps + i, unpacked_snps + 4 * i, num_cols - 4 * i );
+}
+
+/**
+ * Translates the codes of whole 16 byte blocks through lut and
+ * interleaves them, see above.
+ *
+ * @return The number of packed bytes that were translated.
+ */
+LIBPLINKIO_TARGET_("ssse3")
+static FORCE_INLINE size_t
+translate_snps_ssse3(const unsigned char *packed_snps, uint8_t *out, size_t num_cols, __m128i lut)
+{
+    const __m128i m03 = _mm_set1_epi8( 0x03 );
+    size_t packed_length = num_cols / 4;
+    size_t i = 0;
+
+    for(; i + 16 <= packed_length; i += 16)
+    {
+        __m128i x = _mm_loadu_si128( (const __m128i *)( packed_snps + i ) );
+
+        unpack_store_sse2( _mm_shuffle_epi8( lut, _mm_and_si128( x, m03 ) ),
+                           _mm_shuffle_epi8( lut, _mm_and_si128( _mm_srli_epi16( x, 2 ), m03 ) ),
+                           _mm_shuffle_epi8( lut, _mm_and_si128( _mm_srli_epi16( x, 4 ), m03 ) ),
+                           _mm_shuffle_epi8( lut, _mm_and_si128( _mm_srli_epi16( x, 6 ), m03 ) ),
+                           out + 4 * i );
+    }
+
+    return i;
+}
+
+LIBPLINKIO_TARGET_("ssse3")
+static void
+unpack_snps_ssse3(const unsigned char *packed_snps, uint8_t *unpacked_snps, size_t num_cols)
+{
+    size_t i = translate_snps_ssse3( packed_snps, unpacked_snps, num_cols, _mm_set1_epi32( 0x02010300 ) );
+
+    libplinkio_unpack_snps_scalar_( packed_snps + i, unpacked_snps + 4 * i, num_cols - 4 * i );
+}
+
+LIBPLINKIO_TARGET_("ssse3")
+static void
+decode_i8_ssse3(const unsigned char *packed_snps, int8_t *values, size_t num_cols, const int8_t table[4])
+{
+    int32_t lut;
+    size_t i;
+
+    memcpy( &lut, table, sizeof( lut ) );
+    i = translate_snps_ssse3( packed_snps, (uint8_t *) values, num_cols, _mm_set1_epi32( lut ) );
+
+    libplinkio_decode_i8_scalar_( packed_snps + i, values + 4 * i, num_cols - 4 * i, table );
+}
+
+/*
+ * The float decoders first translate a block to raw codes and then
+ * look up each code in a register that holds the table.
+ */
+
+LIBPLINKIO_TARGET_("ssse3")
+static void
+decode_f32_ssse3(const unsigned char *packed_snps, float *values, size_t num_cols, const float table[4])
+{
+    const __m128i lut = _mm_castps_si128( _mm_loadu_ps( table ) );
+    const __m128i identity = _mm_set1_epi32( 0x03020100 );
+    /* Code k selects bytes 4k..4k+3 of the table. */
+    const __m128i spread = _mm_setr_epi8( 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3 );
+    const __m128i offsets = _mm_set1_epi32( 0x03020100 );
+    uint8_t codes[ 64 ];
+    size_t packed_length = num_cols / 4;
+    size_t i = 0;
+
+    for(; i + 16 <= packed_length; i += 16)
+    {
+        translate_snps_ssse3( packed_snps + i, codes, 64, identity );
+        for(size_t j = 0; j < 64; j += 4)
+        {
+            int32_t four_codes;
+            __m128i index;
+            memcpy( &four_codes, codes + j, sizeof( four_codes ) );
+            index = _mm_shuffle_epi8( _mm_cvtsi32_si128( four_codes ), spread );
+            index = _mm_add_epi8( _mm_slli_epi16( index, 2 ), offsets );
+            _mm_storeu_ps( values + 4 * i + j, _mm_castsi128_ps( _mm_shuffle_epi8( lut, index ) ) );
+        }
+    }
+
+    libplinkio_decode_f32_scalar_( packed_snps + i, values + 4 * i, num_cols - 4 * i, table );
+}
+
+/**
+ * Translates the codes of whole 32 byte blocks through lut and
+ * interleaves them.
+ *
+ * @return The number of packed bytes that were translated.
+ */
+LIBPLINKIO_TARGET_("avx2")
+static FORCE_INLINE size_t
+translate_snps_avx2(const unsigned char *packed_snps, uint8_t *out_snps, size_t num_cols, __m256i lut)
+{
+    const __m256i m03 = _mm256_set1_epi8( 0x03 );
+    size_t packed_length = num_cols / 4;
+    size_t i = 0;
+
+    for(; i + 32 <= packed_length; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256( (const __m256i *)( packed_snps + i ) );
+        __m256i c0 = _mm256_shuffle_epi8( lut, _mm256_and_si256( x, m03 ) );
+        __m256i c1 = _mm256_shuffle_epi8( lut, _mm256_and_si256( _mm256_srli_epi16( x, 2 ), m03 ) );
+        __m256i c2 = _mm256_shuffle_epi8( lut, _mm256_and_si256( _mm256_srli_epi16( x, 4 ), m03 ) );
+        __m256i c3 = _mm256_shuffle_epi8( lut, _mm256_and_si256( _mm256_srli_epi16( x, 6 ), m03 ) );
+
+        /* The unpacks work within 128-bit lanes, lane 0 holds input bytes 0-15 and lane 1 bytes 16-31. */
+        __m256i p01_lo = _mm256_unpacklo_epi8( c0, c1 );
+        __m256i p01_hi = _mm256_unpackhi_epi8( c0, c1 );
+        __m256i p23_lo = _mm256_unpacklo_epi8( c2, c3 );
+        __m256i p23_hi = _mm256_unpackhi_epi8( c2, c3 );
+        __m256i q0 = _mm256_unpacklo_epi16( p01_lo, p23_lo );
+        __m256i q1 = _mm256_unpackhi_epi16( p01_lo, p23_lo );
+        __m256i q2 = _mm256_unpacklo_epi16( p01_hi, p23_hi );
+        __m256i q3 = _mm256_unpackhi_epi16( p01_hi, p23_hi );
+
+        uint8_t *out = out_snps + 4 * i;
+        _mm256_storeu_si256( (__m256i *)( out +  0 ), _mm256_permute2x128_si256( q0, q1, 0x20 ) );
+        _mm256_storeu_si256( (__m256i *)( out + 32 ), _mm256_permute2x128_si256( q2, q3, 0x20 ) );
+        _mm256_storeu_si256( (__m256i *)( out + 64 ), _mm256_permute2x128_si256( q0, q1, 0x31 ) );
+        _mm256_storeu_si256( (__m256i *)( out + 96 ), _mm256_permute2x128_si256( q2, q3, 0x31 ) );
+    }
+
+    return i;
+}
+
+LIBPLINKIO_TARGET_("avx2")
+static void
+unpack_snps_avx2(const unsigned char *packed_snps, uint8_t *unpacked_snps, size_t num_cols)
+{
+    size_t i = translate_snps_avx2( packed_snps, unpacked_snps, num_cols, _mm256_set1_epi32( 0x02010300 ) );
+
+    unpack_snps_ssse3( packed_snps + i, unpacked_snps + 4 * i, num_cols - 4 * i );
+}
+
+LIBPLINKIO_TARGET_("avx2")
+static void
+decode_i8_avx2(const unsigned char *packed_snps, int8_t *values, size_t num_cols, const int8_t table[4])
+{
+    int32_t lut;
+    size_t i;
+
+    memcpy( &lut, table, sizeof( lut ) );
+    i = translate_snps_avx2( packed_snps, (uint8_t *) values, num_cols, _mm256_set1_epi32( lut ) );
+
+    decode_i8_ssse3( packed_snps + i, values + 4 * i, num_cols - 4 * i, table );
+}
+
+LIBPLINKIO_TARGET_("avx2")
+static void
+decode_f32_avx2(const unsigned char *packed_snps, float *values, size_t num_cols, const float table[4])
+{
+    const __m256 lut = _mm256_broadcast_ps( (const __m128 *) table );
+    const __m256i identity = _mm256_set1_epi32( 0x03020100 );
+    uint8_t codes[ 128 ];
+    size_t packed_length = num_cols / 4;
+    size_t i = 0;
+
+    for(; i + 32 <= packed_length; i += 32)
+    {
+        translate_snps_avx2( packed_snps + i, codes, 128, identity );
+        for(size_t j = 0; j < 128; j += 8)
+        {
+            __m256i index = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i *)( codes + j ) ) );
+            _mm256_storeu_ps( values + 4 * i + j, _mm256_permutevar8x32_ps( lut, index ) );
+        }
+    }
+
+    decode_f32_ssse3( packed_snps + i, values + 4 * i, num_cols - 4 * i, table );
+}
+
+LIBPLINKIO_TARGET_("avx2")
+static void
+decode_f64_avx2(const unsigned char *packed_snps, double *values, size_t num_cols, const double table[4])
+{
+    /* The table as eight 32-bit halves, code k selects halves 2k and 2k + 1. */
+    const __m256 lut = _mm256_castpd_ps( _mm256_loadu_pd( table ) );
+    const __m256i high_half = _mm256_set1_epi64x( (int64_t) 1 << 32 );
+    const __m256i identity = _mm256_set1_epi32( 0x03020100 );
+    uint8_t codes[ 128 ];
+    size_t packed_length = num_cols / 4;
+    size_t i = 0;
+
+    for(; i + 32 <= packed_length; i += 32)
+    {
+        translate_snps_avx2( packed_snps + i, codes, 128, identity );
+        for(size_t j = 0; j < 128; j += 4)
+        {
+            int32_t four_codes;
+            __m256i index;
+            memcpy( &four_codes, codes + j, sizeof( four_codes ) );
+            index = _mm256_slli_epi64( _mm256_cvtepu8_epi64( _mm_cvtsi32_si128( four_codes ) ), 1 );
+            index = _mm256_add_epi64( _mm256_or_si256( index, _mm256_slli_epi64( index, 32 ) ), high_half );
+            _mm256_storeu_pd( values + 4 * i + j, _mm256_castps_pd( _mm256_permutevar8x32_ps( lut, index ) ) );
+        }
+    }
+
+    libplinkio_decode_f64_scalar_( packed_snps + i, values + 4 * i, num_cols - 4 * i, table );
+}
+
+LIBPLINKIO_TARGET_("avx512f,avx512bw")
+static void
+unpack_snps_avx512(const unsigned char *packed_snps, uint8_t *unpacked_snps, size_t num_cols)
+{
+    const __m512i m03 = _mm512_set1_epi8( 0x03 );
+    const __m512i lut = _mm512_set1_epi32( 0x02010300 );
+    size_t packed_length = num_cols / 4;
+    size_t i = 0;
+
+    for(; i + 64 <= packed_length; i += 64)
+    {
+        __m512i x = _mm512_loadu_si512( (const void *)( packed_snps + i ) );
+        __m512i c0 = _mm512_shuffle_epi8( lut, _mm512_and_si512( x, m03 ) );
+        __m512i c1 = _mm512_shuffle_epi8( lut, _mm512_and_si512( _mm512_srli_epi16( x, 2 ), m03 ) );
+        __m512i c2 = _mm512_shuffle_epi8( lut, _mm512_and_si512( _mm512_srli_epi16( x, 4 ), m03 ) );
+        __m512i c3 = _mm512_shuffle_epi8( lut, _mm512_and_si512( _mm512_srli_epi16( x, 6 ), m03 ) );
+
+        __m512i p01_lo = _mm512_unpacklo_epi8( c0, c1 );
+        __m512i p01_hi = _mm512_unpackhi_epi8( c0, c1 );
+        __m512i p23_lo = _mm512_unpacklo_epi8( c2, c3 );
+        __m512i p23_hi = _mm512_unpackhi_epi8( c2, c3 );
+        __m512i q0 = _mm512_unpacklo_epi16( p01_lo, p23_lo );
+        __m512i q1 = _mm512_unpackhi_epi16( p01_lo, p23_lo );
+        __m512i q2 = _mm512_unpacklo_epi16( p01_hi, p23_hi );
+        __m512i q3 = _mm512_unpackhi_epi16( p01_hi, p23_hi );
+
+        /* Lane l of qk holds output block 4l + k, transpose the 4x4 matrix of lanes. */
+        __m512i t0 = _mm512_shuffle_i64x2( q0, q1, 0x44 );
+        __m512i t1 = _mm512_shuffle_i64x2( q2, q3, 0x44 );
+        __m512i t2 = _mm512_shuffle_i64x2( q0, q1, 0xee );
+        __m512i t3 = _mm512_shuffle_i64x2( q2, q3, 0xee );
+
+        uint8_t *out = unpacked_snps + 4 * i;
+        _mm512_storeu_si512( (void *)( out +   0 ), _mm512_shuffle_i64x2( t0, t1, 0x88 ) );
+        _mm512_storeu_si512( (void *)( out +  64 ), _mm512_shuffle_i64x2( t0, t1, 0xdd ) );
+        _mm512_storeu_si512( (void *)( out + 128 ), _mm512_shuffle_i64x2( t2, t3, 0x88 ) );
+        _mm512_storeu_si512( (void *)( out + 192 ), _mm512_shuffle_i64x2( t2, t3, 0xdd ) );
+    }
+
+    unpack_snps_avx2( packed_snps + i, unpacked_snps + 4 * i, num_cols - 4 * i );
+}
+
+/*
+ * The SIMD encoders translate each genotype to its code, combine
+ * the four codes of each 32-bit lane into its low byte and narrow
+ * the lanes to bytes. Every genotype is ORed into an accumulator
+ * that is checked for bits above the lowest two once at the end.
+ */
+
+LIBPLINKIO_TARGET_("sse2")
+static int
+pack_snps_sse2(const uint8_t *unpacked_snps, unsigned char *packed_snps, size_t num_cols)
+{
+    const __m128i m01 = _mm_set1_epi8( 0x01 );
+    const __m128i mff = _mm_set1_epi32( 0xff );
+    __m128i seen = _mm_setzero_si128( );
+    size_t i = 0;
+
+    for(; i + 64 <= num_cols; i += 64)
+    {
+        __m128i lanes[ 4 ];
+        for(size_t k = 0; k < 4; k++)
+        {
+            /* code = ( ( g0 ^ g1 ) << 1 ) | g1 for a genotype with bits ( g1, g0 ). */
+            __m128i x = _mm_loadu_si128( (const __m128i *)( unpacked_snps + i + 16 * k ) );
+            __m128i g0 = _mm_and_si128( x, m01 );
+            __m128i g1 = _mm_and_si128( _mm_srli_epi16( x, 1 ), m01 );
+            __m128i het = _mm_xor_si128( g0, g1 );
+            __m128i c = _mm_or_si128( _mm_add_epi8( het, het ), g1 );
+            seen = _mm_or_si128( seen, x );
+
+            c = _mm_or_si128( c, _mm_srli_epi32( c, 6 ) );
+            c = _mm_or_si128( c, _mm_srli_epi32( c, 12 ) );
+            lanes[ k ] = _mm_and_si128( c, mff );
+        }
+
+        _mm_storeu_si128( (__m128i *)( packed_snps + i / 4 ),
+                          _mm_packus_epi16( _mm_packs_epi32( lanes[ 0 ], lanes[ 1 ] ),
+                                            _mm_packs_epi32( lanes[ 2 ], lanes[ 3 ] ) ) );
+    }
+
+    seen = _mm_cmpeq_epi8( _mm_and_si128( seen, _mm_set1_epi8( (char) 0xfc ) ), _mm_setzero_si128( ) );
+    return ( _mm_movemask_epi8( seen ) != 0xffff ) |
+           libplinkio_pack_snps_scalar_( unpacked_snps + i, packed_snps + i / 4, num_cols - i );
+}
+
+LIBPLINKIO_TARGET_("ssse3")
+static int
+pack_snps_ssse3(const uint8_t *unpacked_snps, unsigned char *packed_snps, size_t num_cols)
+{
+    const __m128i lut = _mm_set1_epi32( 0x01030200 );
+    const __m128i weights2 = _mm_set1_epi16( 0x0401 );
+    const __m128i weights4 = _mm_set1_epi32( 0x00100001 );
+    __m128i seen = _mm_setzero_si128( );
+    size_t i = 0;
+
+    for(; i + 64 <= num_cols; i += 64)
+    {
+        __m128i lanes[ 4 ];
+        for(size_t k = 0; k < 4; k++)
+        {
+            __m128i x = _mm_loadu_si128( (const __m128i *)( unpacked_snps + i + 16 * k ) );
+            seen = _mm_or_si128( seen, x );
+            /* c0 + 4 c1 in each 16-bit lane, then c0 + 4 c1 + 16 c2 + 64 c3 in each 32-bit lane. */
+            lanes[ k ] = _mm_madd_epi16( _mm_maddubs_epi16( _mm_shuffle_epi8( lut, x ), weights2 ), weights4 );
+        }
+
+        _mm_storeu_si128( (__m128i *)( packed_snps + i / 4 ),
+                          _mm_packus_epi16( _mm_packs_epi32( lanes[ 0 ], lanes[ 1 ] ),
+                                            _mm_packs_epi32( lanes[ 2 ], lanes[ 3 ] ) ) );
+    }
+
+    seen = _mm_cmpeq_epi8( _mm_and_si128( seen, _mm_set1_epi8( (char) 0xfc ) ), _mm_setzero_si128( ) );
+    return ( _mm_movemask_epi8( seen ) != 0xffff ) |
+           libplinkio_pack_snps_scalar_( unpacked_snps + i, packed_snps + i / 4, num_cols - i );
+}
+
+LIBPLINKIO_TARGET_("avx2")
+static int
+pack_snps_avx2(const uint8_t *unpacked_snps, unsigned char *packed_snps, size_t num_cols)
+{
+    const __m256i lut = _mm256_set1_epi32( 0x01030200 );
+    const __m256i weights2 = _mm256_set1_epi16( 0x0401 );
+    const __m256i weights4 = _mm256_set1_epi32( 0x00100001 );
+    /* The packs work within 128-bit lanes, which leaves the output dwords in this order. */
+    const __m256i order = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+    __m256i seen = _mm256_setzero_si256( );
+    size_t i = 0;
+
+    for(; i + 128 <= num_cols; i += 128)
+    {
+        __m256i lanes[ 4 ];
+        for(size_t k = 0; k < 4; k++)
+        {
+            __m256i x = _mm256_loadu_si256( (const __m256i *)( unpacked_snps + i + 32 * k ) );
+            seen = _mm256_or_si256( seen, x );
+            lanes[ k ] = _mm256_madd_epi16( _mm256_maddubs_epi16( _mm256_shuffle_epi8( lut, x ), weights2 ), weights4 );
+        }
+
+        __m256i packed = _mm256_packus_epi16( _mm256_packs_epi32( lanes[ 0 ], lanes[ 1 ] ),
+                                              _mm256_packs_epi32( lanes[ 2 ], lanes[ 3 ] ) );
+        _mm256_storeu_si256( (__m256i *)( packed_snps + i / 4 ), _mm256_permutevar8x32_epi32( packed, order ) );
+    }
+
+    return ( _mm256_testz_si256( seen, _mm256_set1_epi8( (char) 0xfc ) ) == 0 ) |
+           pack_snps_ssse3( unpacked_snps + i, packed_snps + i / 4, num_cols - i );
+}
+
+LIBPLINKIO_TARGET_("avx512f,avx512bw")
+static int
+pack_snps_avx512(const uint8_t *unpacked_snps, unsigned char *packed_snps, size_t num_cols)
+{
+    const __m512i lut = _mm512_set1_epi32( 0x01030200 );
+    const __m512i weights2 = _mm512_set1_epi16( 0x0401 );
+    const __m512i weights4 = _mm512_set1_epi32( 0x00100001 );
+    /* Dword 4l + k of the packed vector belongs at position 4k + l. */
+    const __m512i order = _mm512_setr_epi32( 0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15 );
+    __m512i seen = _mm512_setzero_si512( );
+    size_t i = 0;
+
+    for(; i + 256 <= num_cols; i += 256)
+    {
+        __m512i lanes[ 4 ];
+        for(size_t k = 0; k < 4; k++)
+        {
+            __m512i x = _mm512_loadu_si512( (const void *)( unpacked_snps + i + 64 * k ) );
+            seen = _mm512_or_si512( seen, x );
+            lanes[ k ] = _mm512_madd_epi16( _mm512_maddubs_epi16( _mm512_shuffle_epi8( lut, x ), weights2 ), weights4 );
+        }
+
+        __m512i packed = _mm512_packus_epi16( _mm512_packs_epi32( lanes[ 0 ], lanes[ 1 ] ),
+                                              _mm512_packs_epi32( lanes[ 2 ], lanes[ 3 ] ) );
+        _mm512_storeu_si512( (void *)( packed_snps + i / 4 ), _mm512_permutexvar_epi32( order, packed ) );
+    }
+
+    return ( _mm512_test_epi8_mask( seen, _mm512_set1_epi8( (char) 0xfc ) ) != 0 ) |
+           pack_snps_avx2( unpacked_snps + i, packed_snps + i / 4, num_cols - i );
+}
+
+/*
+ * The transpose kernels interleave the bytes of the 4 rows so that
+ * every 32-bit lane holds one byte of each row, and then run the
+ * delta swaps of transpose_4x4 on all lanes at once.
+ */
+
+LIBPLINKIO_TARGET_("sse2")
+static FORCE_INLINE __m128i
+transpose_4x4_sse2(__m128i x)
+{
+    __m128i t = _mm_and_si128( _mm_xor_si128( _mm_srli_epi32( x, 6 ), x ), _mm_set1_epi32( 0x00cc00cc ) );
+    x = _mm_xor_si128( x, _mm_xor_si128( t, _mm_slli_epi32( t, 6 ) ) );
+    t = _mm_and_si128( _mm_xor_si128( _mm_srli_epi32( x, 12 ), x ), _mm_set1_epi32( 0x0000f0f0 ) );
+    return _mm_xor_si128( x, _mm_xor_si128( t, _mm_slli_epi32( t, 12 ) ) );
+}
+
+LIBPLINKIO_TARGET_("sse2")
+static void
+transpose4_sse2(const unsigned char *src, size_t src_stride, size_t num_bytes, uint32_t *words)
+{
+    size_t j = 0;
+
+    for(; j + 16 <= num_bytes; j += 16)
+    {
+        __m128i r0 = _mm_loadu_si128( (const __m128i *)( src + j ) );
+        __m128i r1 = _mm_loadu_si128( (const __m128i *)( src + src_stride + j ) );
+        __m128i r2 = _mm_loadu_si128( (const __m128i *)( src + 2 * src_stride + j ) );
+        __m128i r3 = _mm_loadu_si128( (const __m128i *)( src + 3 * src_stride + j ) );
+        __m128i r01_lo = _mm_unpacklo_epi8( r0, r1 );
+        __m128i r01_hi = _mm_unpackhi_epi8( r0, r1 );
+        __m128i r23_lo = _mm_unpacklo_epi8( r2, r3 );
+        __m128i r23_hi = _mm_unpackhi_epi8( r2, r3 );
+
+        _mm_storeu_si128( (__m128i *)( words + j ), transpose_4x4_sse2( _mm_unpacklo_epi16( r01_lo, r23_lo ) ) );
+        _mm_storeu_si128( (__m128i *)( words + j + 4 ), transpose_4x4_sse2( _mm_unpackhi_epi16( r01_lo, r23_lo ) ) );
+        _mm_storeu_si128( (__m128i *)( words + j + 8 ), transpose_4x4_sse2( _mm_unpacklo_epi16( r01_hi, r23_hi ) ) );
+        _mm_storeu_si128( (__m128i *)( words + j + 12 ), transpose_4x4_sse2( _mm_unpackhi_epi16( r01_hi, r23_hi ) ) );
+    }
+
+    libplinkio_transpose4_scalar_( src + j, src_stride, num_bytes - j, words + j );
+}
+
+LIBPLINKIO_TARGET_("avx2")
+static FORCE_INLINE __m256i
+transpose_4x4_avx2(__m256i x)
+{
+    __m256i t = _mm256_and_si256( _mm256_xor_si256( _mm256_srli_epi32( x, 6 ), x ), _mm256_set1_epi32( 0x00cc00cc ) );
+    x = _mm256_xor_si256( x, _mm256_xor_si256( t, _mm256_slli_epi32( t, 6 ) ) );
+    t = _mm256_and_si256( _mm256_xor_si256( _mm256_srli_epi32( x, 12 ), x ), _mm256_set1_epi32( 0x0000f0f0 ) );
+    return _mm256_xor_si256( x, _mm256_xor_si256( t, _mm256_slli_epi32( t, 12 ) ) );
+}
+
+LIBPLINKIO_TARGET_("avx2")
+static void
+transpose4_avx2(const unsigned char *src, size_t src_stride, size_t num_bytes, uint32_t *words)
+{
+    size_t j = 0;
+
+    for(; j + 32 <= num_bytes; j += 32)
+    {
+        __m256i r0 = _mm256_loadu_si256( (const __m256i *)( src + j ) );
+        __m256i r1 = _mm256_loadu_si256( (const __m256i *)( src + src_stride + j ) );
+        __m256i r2 = _mm256_loadu_si256( (const __m256i *)( src + 2 * src_stride + j ) );
+        __m256i r3 = _mm256_loadu_si256( (const __m256i *)( src + 3 * src_stride + j ) );
+        __m256i r01_lo = _mm256_unpacklo_epi8( r0, r1 );
+        __m256i r01_hi = _mm256_unpackhi_epi8( r0, r1 );
+        __m256i r23_lo = _mm256_unpacklo_epi8( r2, r3 );
+        __m256i r23_hi = _mm256_unpackhi_epi8( r2, r3 );
+
+        /* The unpacks work within 128-bit lanes: w0 holds bytes 0-3 and 16-19, w1 4-7 and 20-23 and so on. */
+        __m256i w0 = transpose_4x4_avx2( _mm256_unpacklo_epi16( r01_lo, r23_lo ) );
+        __m256i w1 = transpose_4x4_avx2( _mm256_unpackhi_epi16( r01_lo, r23_lo ) );
+        __m256i w2 = transpose_4x4_avx2( _mm256_unpacklo_epi16( r01_hi, r23_hi ) );
+        __m256i w3 = transpose_4x4_avx2( _mm256_unpackhi_epi16( r01_hi, r23_hi ) );
+
+        _mm256_storeu_si256( (__m256i *)( words + j ), _mm256_permute2x128_si256( w0, w1, 0x20 ) );
+        _mm256_storeu_si256( (__m256i *)( words + j + 8 ), _mm256_permute2x128_si256( w2, w3, 0x20 ) );
+        _mm256_storeu_si256( (__m256i *)( words + j + 16 ), _mm256_permute2x128_si256( w0, w1, 0x31 ) );
+        _mm256_storeu_si256( (__m256i *)( words + j + 24 ), _mm256_permute2x128_si256( w2, w3, 0x31 ) );
+    }
+
+    transpose4_sse2( src + j, src_stride, num_bytes - j, words + j );
+}
+
+#endif /* LIBPLINKIO_X86_ */
+
+/**
+ * All compiled kernels, slowest first, together with the
+ * CPU features they require.
+ */
+static const struct {
+    unsigned int features;
+    libplinkio_snp_kernel_private_t kernel;
+} g_snp_kernels[] = {
+    { 0, { "scalar", libplinkio_unpack_snps_scalar_, libplinkio_pack_snps_scalar_,
+           libplinkio_decode_i8_scalar_, libplinkio_decode_f32_scalar_, libplinkio_decode_f64_scalar_,
+           libplinkio_transpose4_scalar_ } },
+#ifdef LIBPLINKIO_X86_
+    { LIBPLINKIO_CPU_SSE2_, { "sse2", unpack_snps_sse2, pack_snps_sse2,
+           libplinkio_decode_i8_scalar_, libplinkio_decode_f32_scalar_, libplinkio_decode_f64_scalar_,
+           transpose4_sse2 } },
+    { LIBPLINKIO_CPU_SSE2_ | LIBPLINKIO_CPU_SSSE3_, { "ssse3", unpack_snps_ssse3, pack_snps_ssse3,
+           decode_i8_ssse3, decode_f32_ssse3, libplinkio_decode_f64_scalar_,
+           transpose4_sse2 } },
+    { LIBPLINKIO_CPU_SSE2_ | LIBPLINKIO_CPU_SSSE3_ | LIBPLINKIO_CPU_AVX2_, { "avx2", unpack_snps_avx2, pack_snps_avx2,
+           decode_i8_avx2, decode_f32_avx2, decode_f64_avx2,
+           transpose4_avx2 } },
+    { LIBPLINKIO_CPU_SSE2_ | LIBPLINKIO_CPU_SSSE3_ | LIBPLINKIO_CPU_AVX2_ | LIBPLINKIO_CPU_AVX512BW_, { "avx512", unpack_snps_avx512, pack_snps_avx512,
+           decode_i8_avx2, decode_f32_avx2, decode_f64_avx2,
+           transpose4_avx2 } },
+#endif
+};
+
+#define LIBPLINKIO_NUM_SNP_KERNELS_ ( sizeof( g_snp_kernels ) / sizeof( g_snp_kernels[ 0 ] ) )
+
+/**
+ * One plus the index of the selected kernel in g_snp_kernels, or 0
+ * until it is resolved on first use. It is read and written
+ * atomically, since the first calls may come from several threads,
+ * which then all store the same index.
+ */
+static volatile size_t g_snp_kernel_index = 0;
+
+const libplinkio_snp_kernel_private_t *
+libplinkio_snp_kernel_(void)
+{
+    size_t index = libplinkio_atomic_load_( &g_snp_kernel_index );
+    if( index == 0 )
+    {
+        unsigned int features = libplinkio_cpu_features_( );
+        for(size_t i = 0; i < LIBPLINKIO_NUM_SNP_KERNELS_; i++)
+        {
+            if( ( g_snp_kernels[ i ].features & features ) == g_snp_kernels[ i ].features )
+            {
+                index = i + 1;
+            }
+        }
+        libplinkio_atomic_store_( &g_snp_kernel_index, index );
+    }
+
+    return &g_snp_kernels[ index - 1 ].kernel;
+}
+
+const libplinkio_snp_kernel_private_t *
+libplinkio_snp_kernel_by_name_(const char *name)
+{
+    unsigned int features = libplinkio_cpu_features_( );
+    for(size_t i = 0; i < LIBPLINKIO_NUM_SNP_KERNELS_; i++)
+    {
+        if( strcmp( g_snp_kernels[ i ].kernel.name, name ) == 0 &&
+            ( g_snp_kernels[ i ].features & features ) == g_snp_kernels[ i ].features )
+        {
+            return &g_snp_kernels[ i ].kernel;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,75 @@
+#include "private/thread.h"
+
+#ifdef _WIN32
+
+static DWORD WINAPI
+thread_start(LPVOID arg)
+{
+    libplinkio_thread_private_t *thread = (libplinkio_thread_private_t *)arg;
+    thread->func(thread->arg);
+    return 0;
+}
+
+int
+libplinkio_thread_create_(libplinkio_thread_private_t *thread, libplinkio_thread_func_private_t func, void *arg)
+{
+    thread->func = func;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, thread_start, thread, 0, NULL);
+    return thread->handle != NULL ? 0 : -1;
+}
+
+int
+libplinkio_thread_join_(libplinkio_thread_private_t *thread)
+{
+    if (WaitForSingleObject(thread->handle, INFINITE) != WAIT_OBJECT_0) return -1;
+    CloseHandle(thread->handle);
+    thread->handle = NULL;
+    return 0;
+}
+
+int libplinkio_mutex_init_(libplinkio_mutex_private_t *mutex) { InitializeSRWLock(&mutex->lock); return 0; }
+void libplinkio_mutex_lock_(libplinkio_mutex_private_t *mutex) { AcquireSRWLockExclusive(&mutex->lock); }
+void libplinkio_mutex_unlock_(libplinkio_mutex_private_t *mutex) { ReleaseSRWLockExclusive(&mutex->lock); }
+void libplinkio_mutex_destroy_(libplinkio_mutex_private_t *mutex) { UNUSED_PARAM(mutex); }
+
+int libplinkio_cond_init_(libplinkio_cond_private_t *cond) { InitializeConditionVariable(&cond->cond); return 0; }
+void libplinkio_cond_wait_(libplinkio_cond_private_t *cond, libplinkio_mutex_private_t *mutex) { SleepConditionVariableSRW(&cond->cond, &mutex->lock, INFINITE, 0); }
+void libplinkio_cond_broadcast_(libplinkio_cond_private_t *cond) { WakeAllConditionVariable(&cond->cond); }
+void libplinkio_cond_destroy_(libplinkio_cond_private_t *cond) { UNUSED_PARAM(cond); }
+
+#else
+
+static void *
+thread_start(void *arg)
+{
+    libplinkio_thread_private_t *thread = (libplinkio_thread_private_t *)arg;
+    thread->func(thread->arg);
+    return NULL;
+}
+
+int
+libplinkio_thread_create_(libplinkio_thread_private_t *thread, libplinkio_thread_func_private_t func, void *arg)
+{
+    thread->func = func;
+    thread->arg = arg;
+    return pthread_create(&thread->thread, NULL, thread_start, thread) == 0 ? 0 : -1;
+}
+
+int
+libplinkio_thread_join_(libplinkio_thread_private_t *thread)
+{
+    return pthread_join(thread->thread, NULL) == 0 ? 0 : -1;
+}
+
+int libplinkio_mutex_init_(libplinkio_mutex_private_t *mutex) { return pthread_mutex_init(&mutex->mutex, NULL) == 0 ? 0 : -1; }
+void libplinkio_mutex_lock_(libplinkio_mutex_private_t *mutex) { pthread_mutex_lock(&mutex->mutex); }
+void libplinkio_mutex_unlock_(libplinkio_mutex_private_t *mutex) { pthread_mutex_unlock(&mutex->mutex); }
+void libplinkio_mutex_destroy_(libplinkio_mutex_private_t *mutex) { pthread_mutex_destroy(&mutex->mutex); }
+
+int libplinkio_cond_init_(libplinkio_cond_private_t *cond) { return pthread_cond_init(&cond->cond, NULL) == 0 ? 0 : -1; }
+void libplinkio_cond_wait_(libplinkio_cond_private_t *cond, libplinkio_mutex_private_t *mutex) { pthread_cond_wait(&cond->cond, &mutex->mutex); }
+void libplinkio_cond_broadcast_(libplinkio_cond_private_t *cond) { pthread_cond_broadcast(&cond->cond); }
+void libplinkio_cond_destroy_(libplinkio_cond_private_t *cond) { pthread_cond_destroy(&cond->cond); }
+
+#endif
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 
@@ -82,23 +83,36 @@ error:
 }
 
 
+/**
+ * Number of random characters after the prefix of a temporary file.
+ */
+#define LIBPLINKIO_TMP_RANDOM_LENGTH_ 12
+
+/**
+ * Writes filename_prefix, a dot and random characters to filename,
+ * which must hold LIBPLINKIO_TMP_RANDOM_LENGTH_ + 2 more characters
+ * than the prefix.
+ */
+static int tmp_name(char* filename, const char* filename_prefix, const size_t filename_prefix_length) {
+    memcpy(filename, filename_prefix, filename_prefix_length);
+    filename[filename_prefix_length] = '.';
+    if (libplinkio_get_random_32_(filename + filename_prefix_length + 1, LIBPLINKIO_TMP_RANDOM_LENGTH_) != 0) return -1;
+    filename[filename_prefix_length + LIBPLINKIO_TMP_RANDOM_LENGTH_ + 1] = '\0';
+    return 0;
+}
+
 int libplinkio_tmp_open_(const char* filename_prefix, const size_t filename_prefix_length)
 {
     int fd = -1;
 
-    const size_t random_length = 12;
+    const size_t random_length = LIBPLINKIO_TMP_RANDOM_LENGTH_;
     const size_t filename_length = filename_prefix_length + random_length + 1;
 
     char* filename = (char*)calloc(filename_length + 1, sizeof(char));
     if (filename == NULL) goto error;
 
     for (;;) {
-        strncpy(filename, filename_prefix, filename_prefix_length);
-        filename[filename_prefix_length] = '.';
-        for (size_t i = 0; i < random_length; i++) {
-            if (libplinkio_get_random_32_(filename + filename_prefix_length + i + 1, 1) != 0) goto error;
-        }
-        filename[filename_length] = '\0';
+        if (tmp_name(filename, filename_prefix, filename_prefix_length) != 0) goto error;
 
 #ifdef _WIN32
         errno_t err_open = _sopen_s(
@@ -136,6 +150,31 @@ error:
     return -1;
 }
 
+int libplinkio_tmp_create_(const char* path, char** tmp_path)
+{
+    int fd = -1;
+    const size_t path_length = strlen(path);
+    char* filename = (char*)calloc(path_length + LIBPLINKIO_TMP_RANDOM_LENGTH_ + 2, sizeof(char));
+    if (filename == NULL) return -1;
+
+    for (;;) {
+        if (tmp_name(filename, path, path_length) != 0) break;
+#ifdef _WIN32
+        fd = _open(filename, _O_BINARY | _O_CREAT | _O_EXCL | _O_NOINHERIT | _O_RDWR, _S_IREAD | _S_IWRITE);
+#else
+        fd = open(filename, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+#endif
+        if (fd != -1 || errno != EEXIST) break;
+    }
+
+    if (fd == -1) {
+        free(filename);
+        return -1;
+    }
+    *tmp_path = filename;
+    return fd;
+}
+
 void* libplinkio_mmap_(int fd, libplinkio_mmap_mode_private_t mode, libplinkio_mmap_state_private_t* state) {
     struct stat file_stats;
     void* mapped_file = NULL;
@@ -223,6 +262,132 @@ int libplinkio_ftruncate_(int fd, size_t size) {
     return 0;
 }
 
+int libplinkio_pread_(int fd, void *buffer, size_t length, uint64_t offset) {
+    unsigned char *cur = (unsigned char *)buffer;
+    while (length > 0) {
+#ifdef _WIN32
+        OVERLAPPED overlapped = { 0 };
+        DWORD chunk = length > 0x40000000 ? 0x40000000 : (DWORD)length;
+        DWORD bytes_read = 0;
+        overlapped.Offset = (DWORD)(offset & 0xffffffffu);
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        if (ReadFile((HANDLE)_get_osfhandle(fd), cur, chunk, &bytes_read, &overlapped) == 0) return -1;
+#else
+        ssize_t bytes_read = pread(fd, cur, length, (off_t)offset);
+        if (bytes_read == -1 && errno == EINTR) continue;
+        if (bytes_read == -1) return -1;
+#endif
+        /* A short file ends the read early. */
+        if (bytes_read == 0) return -1;
+        cur += bytes_read;
+        length -= (size_t)bytes_read;
+        offset += (uint64_t)bytes_read;
+    }
+    return 0;
+}
+
+int libplinkio_pwrite_(int fd, const void *buffer, size_t length, uint64_t offset) {
+    const unsigned char *cur = (const unsigned char *)buffer;
+    while (length > 0) {
+#ifdef _WIN32
+        OVERLAPPED overlapped = { 0 };
+        DWORD chunk = length > 0x40000000 ? 0x40000000 : (DWORD)length;
+        DWORD bytes_written = 0;
+        overlapped.Offset = (DWORD)(offset & 0xffffffffu);
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        if (WriteFile((HANDLE)_get_osfhandle(fd), cur, chunk, &bytes_written, &overlapped) == 0) return -1;
+#else
+        ssize_t bytes_written = pwrite(fd, cur, length, (off_t)offset);
+        if (bytes_written == -1 && errno == EINTR) continue;
+        if (bytes_written == -1) return -1;
+#endif
+        if (bytes_written == 0) return -1;
+        cur += bytes_written;
+        length -= (size_t)bytes_written;
+        offset += (uint64_t)bytes_written;
+    }
+    return 0;
+}
+
+int libplinkio_fallocate_(int fd, uint64_t size) {
+#if defined(__linux__) || defined(__FreeBSD__)
+    int result = posix_fallocate(fd, 0, (off_t)size);
+    if (result == 0) return 0;
+    /* Some file systems cannot reserve space, extending the file still works there. */
+    if (result != EINVAL && result != EOPNOTSUPP) return -1;
+#endif
+    return libplinkio_ftruncate_(fd, (size_t)size);
+}
+
+size_t libplinkio_num_cpus_(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (size_t)info.dwNumberOfProcessors : 1;
+#else
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return num_cpus > 0 ? (size_t)num_cpus : 1;
+#endif
+}
+
+void *libplinkio_aligned_alloc_(size_t size, size_t alignment) {
+    /* Over-allocate and keep the address of the whole block just before the aligned one. */
+    unsigned char *block = (unsigned char *)malloc(size + alignment + sizeof(void *));
+    uintptr_t aligned;
+    if (block == NULL) return NULL;
+
+    aligned = ((uintptr_t)(block + sizeof(void *)) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    ((void **)aligned)[-1] = block;
+    return (void *)aligned;
+}
+
+void libplinkio_aligned_free_(void *block) {
+    if (block == NULL) return;
+    free(((void **)block)[-1]);
+}
+
+int libplinkio_fadvise_(int fd, uint64_t offset, uint64_t length, libplinkio_advice_private_t advice) {
+#if defined(POSIX_FADV_NORMAL) && !defined(_WIN32)
+    int posix_advice = POSIX_FADV_NORMAL;
+    switch (advice) {
+    case LIBPLINKIO_ADVICE_NORMAL_: posix_advice = POSIX_FADV_NORMAL; break;
+    case LIBPLINKIO_ADVICE_SEQUENTIAL_: posix_advice = POSIX_FADV_SEQUENTIAL; break;
+    case LIBPLINKIO_ADVICE_RANDOM_: posix_advice = POSIX_FADV_RANDOM; break;
+    case LIBPLINKIO_ADVICE_WILLNEED_: posix_advice = POSIX_FADV_WILLNEED; break;
+    case LIBPLINKIO_ADVICE_DONTNEED_: posix_advice = POSIX_FADV_DONTNEED; break;
+    }
+    if (posix_fadvise(fd, (off_t)offset, (off_t)length, posix_advice) != 0) return -1;
+#else
+    UNUSED_PARAM(fd);
+    UNUSED_PARAM(offset);
+    UNUSED_PARAM(length);
+    UNUSED_PARAM(advice);
+#endif
+    return 0;
+}
+
+int libplinkio_madvise_(const void *addr, size_t length, libplinkio_advice_private_t advice) {
+#ifndef _WIN32
+    int posix_advice = MADV_NORMAL;
+    uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)addr & ~(page_size - 1);
+    switch (advice) {
+    case LIBPLINKIO_ADVICE_NORMAL_: posix_advice = MADV_NORMAL; break;
+    case LIBPLINKIO_ADVICE_SEQUENTIAL_: posix_advice = MADV_SEQUENTIAL; break;
+    case LIBPLINKIO_ADVICE_RANDOM_: posix_advice = MADV_RANDOM; break;
+    case LIBPLINKIO_ADVICE_WILLNEED_: posix_advice = MADV_WILLNEED; break;
+    case LIBPLINKIO_ADVICE_DONTNEED_: posix_advice = MADV_DONTNEED; break;
+    }
+    if (length == 0) return 0;
+    if (madvise((void *)start, length + ((uintptr_t)addr - start), posix_advice) != 0) return -1;
+#else
+    UNUSED_PARAM(addr);
+    UNUSED_PARAM(length);
+    UNUSED_PARAM(advice);
+#endif
+    return 0;
+}
+
 int libplinkio_change_mode_and_open_(int fd, int flags) {
     if (fd < 0) return -1;
 #ifdef _WIN32 
@@ -0,0 +1,1886 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <cmockery.h>
+
+#undef UNIT_TESTING
+
+/* The test_realloc of cmockery cannot grow a block, which the
+ * larger files here need, so use the system allocator. */
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#include <plinkio/plinkio.h>
+
+#include "plinkio.c"
+#include "file.c"
+#include "bed.c"
+#include "bed_header.c"
+#include "bim.c"
+#include "bim_parse.c"
+#include "fam.c"
+#include "fam_parse.c"
+#include "map.c"
+#include "map_parse.c"
+#include "ped.c"
+#include "ped_parse.c"
+#include "plink_txt_parse.c"
+#include "arena.c"
+#include "utility.c"
+#include "packed_snp.c"
+#include "cpu.c"
+#include "snp_kernel.c"
+#include "thread.c"
+#include "prefetch.c"
+#include "async.c"
+
+#define UNIT_TESTING
+
+/**
+ * Prefix of the plink files that the tests write.
+ */
+#define TEST_PREFIX "./data/bed_io_test"
+
+/**
+ * Sample counts that cover rows ending on and off byte
+ * boundaries, rows longer than the widest SIMD register and
+ * rows longer than the chunks of bed_read_row_at.
+ */
+static const size_t g_num_samples[] = { 1, 7, 130, 1029, 16390 };
+
+/**
+ * Returns the genotype that write_fileset stores for the given
+ * locus and sample.
+ */
+static snp_t
+expected_genotype(size_t locus, size_t sample)
+{
+    return (snp_t) ( ( locus * 7 + sample * 3 + ( locus * sample ) % 5 ) % 4 );
+}
+
+/**
+ * Writes a locus major plink file with the given dimensions
+ * directly, without going through the library.
+ */
+static void
+write_fileset(const char *prefix, size_t num_loci, size_t num_samples)
+{
+    unsigned char header[] = { 0x6c, 0x1b, 0x01 };
+    size_t row_size = ( num_samples + 3 ) / 4;
+    snp_t *row = (snp_t *) malloc( num_samples );
+    unsigned char *packed_row = (unsigned char *) malloc( row_size );
+    char *fam_path = concatenate( prefix, ".fam" );
+    char *bim_path = concatenate( prefix, ".bim" );
+    char *bed_path = concatenate( prefix, ".bed" );
+    FILE *fam_fp = fopen( fam_path, "w" );
+    FILE *bim_fp = fopen( bim_path, "w" );
+    FILE *bed_fp = fopen( bed_path, "wb" );
+
+    assert_true( fam_fp != NULL && bim_fp != NULL && bed_fp != NULL );
+    for(size_t i = 0; i < num_samples; i++)
+    {
+        fprintf( fam_fp, "F%d\tI%d\t0\t0\t1\t1\n", (int) i, (int) i );
+    }
+
+    fwrite( header, 1, sizeof( header ), bed_fp );
+    for(size_t i = 0; i < num_loci; i++)
+    {
+        fprintf( bim_fp, "1\trs%d\t0\t%d\tA\tC\n", (int) i, (int) ( i * 100 + 1 ) );
+        for(size_t j = 0; j < num_samples; j++)
+        {
+            row[ j ] = expected_genotype( i, j );
+        }
+        pack_snps( row, packed_row, num_samples );
+        fwrite( packed_row, 1, row_size, bed_fp );
+    }
+
+    fclose( fam_fp );
+    fclose( bim_fp );
+    fclose( bed_fp );
+    free( fam_path );
+    free( bim_path );
+    free( bed_path );
+    free( row );
+    free( packed_row );
+}
+
+/**
+ * Removes the files written by write_fileset.
+ */
+static void
+remove_fileset(const char *prefix)
+{
+    const char *extensions[] = { ".fam", ".bim", ".bed" };
+    for(size_t i = 0; i < sizeof( extensions ) / sizeof( extensions[ 0 ] ); i++)
+    {
+        char *path = concatenate( prefix, extensions[ i ] );
+        remove( path );
+        free( path );
+    }
+}
+
+/**
+ * Asserts that row holds the genotypes of the given locus.
+ */
+static void
+assert_row_equal(const snp_t *row, size_t locus, size_t num_samples)
+{
+    for(size_t j = 0; j < num_samples; j++)
+    {
+        assert_int_equal( row[ j ], expected_genotype( locus, j ) );
+    }
+}
+
+/**
+ * Tests that a memory mapped file decodes to the same rows as
+ * the stdio path, and that the mapped rows are the packed data.
+ */
+void
+test_open_mapped(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 5;
+
+    for(size_t k = 0; k < sizeof( g_num_samples ) / sizeof( g_num_samples[ 0 ] ); k++)
+    {
+        struct pio_file_t plink_file;
+        size_t num_samples = g_num_samples[ k ];
+        size_t row_size = ( num_samples + 3 ) / 4;
+        snp_t *row = (snp_t *) malloc( num_samples );
+        unsigned char *packed_row = (unsigned char *) malloc( row_size );
+        const unsigned char *mapped_row = NULL;
+
+        write_fileset( TEST_PREFIX, num_loci, num_samples );
+        assert_int_equal( pio_open_mapped( &plink_file, TEST_PREFIX ), PIO_OK );
+        assert_int_equal( pio_num_samples( &plink_file ), num_samples );
+
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+            assert_row_equal( row, i, num_samples );
+        }
+        assert_int_equal( pio_next_row( &plink_file, row ), PIO_END );
+
+        pio_reset_row( &plink_file );
+        assert_int_equal( pio_skip_row( &plink_file ), PIO_OK );
+        assert_int_equal( pio_next_row_mapped( &plink_file, &mapped_row ), PIO_OK );
+        for(size_t j = 0; j < num_samples; j++)
+        {
+            row[ j ] = expected_genotype( 1, j );
+        }
+        pack_snps( row, packed_row, num_samples );
+        assert_memory_equal( mapped_row, packed_row, row_size );
+
+        pio_close( &plink_file );
+
+        assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        assert_int_equal( pio_next_row_mapped( &plink_file, &mapped_row ), PIO_ERROR );
+        pio_close( &plink_file );
+
+        remove_fileset( TEST_PREFIX );
+        free( row );
+        free( packed_row );
+    }
+}
+
+/**
+ * Tests that a .bed file that is shorter than the .bim and
+ * .fam files say is not mapped.
+ */
+void
+test_open_mapped_truncated(void **state)
+{
+    UNUSED_PARAM(state);
+    struct pio_file_t plink_file;
+    char *bed_path = concatenate( TEST_PREFIX, ".bed" );
+    FILE *bed_fp = NULL;
+
+    write_fileset( TEST_PREFIX, 3, 9 );
+    bed_fp = fopen( bed_path, "r+b" );
+    assert_true( bed_fp != NULL );
+    assert_int_equal( libplinkio_ftruncate_( fileno( bed_fp ), 3 + 2 * 3 ), 0 );
+    fclose( bed_fp );
+
+    assert_int_equal( pio_open_mapped( &plink_file, TEST_PREFIX ), P_BED_IO_ERROR );
+
+    remove_fileset( TEST_PREFIX );
+    free( bed_path );
+}
+
+/**
+ * Tests that rows can be read by index in any order, from both
+ * stdio and mapped files, without moving the current row.
+ */
+void
+test_read_row_at(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 6;
+
+    for(size_t k = 0; k < sizeof( g_num_samples ) / sizeof( g_num_samples[ 0 ] ); k++)
+    {
+        size_t num_samples = g_num_samples[ k ];
+        size_t row_size = ( num_samples + 3 ) / 4;
+        snp_t *row = (snp_t *) malloc( num_samples );
+        unsigned char *packed_row = (unsigned char *) malloc( row_size );
+        unsigned char *expected_packed_row = (unsigned char *) malloc( row_size );
+
+        write_fileset( TEST_PREFIX, num_loci, num_samples );
+        for(int mapped = 0; mapped < 2; mapped++)
+        {
+            struct pio_file_t plink_file;
+            if( mapped )
+            {
+                assert_int_equal( pio_open_mapped( &plink_file, TEST_PREFIX ), PIO_OK );
+            }
+            else
+            {
+                assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+            }
+
+            for(size_t i = num_loci; i-- > 0; )
+            {
+                assert_int_equal( pio_read_row_at( &plink_file, i, row ), PIO_OK );
+                assert_row_equal( row, i, num_samples );
+
+                pack_snps( row, expected_packed_row, num_samples );
+                assert_int_equal( pio_read_row_packed_at( &plink_file, i, packed_row ), PIO_OK );
+                assert_memory_equal( packed_row, expected_packed_row, row_size );
+            }
+            assert_int_equal( pio_read_row_at( &plink_file, num_loci, row ), PIO_END );
+            assert_int_equal( pio_read_row_packed_at( &plink_file, num_loci, packed_row ), PIO_END );
+
+            assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+            assert_row_equal( row, 0, num_samples );
+
+            pio_close( &plink_file );
+        }
+
+        remove_fileset( TEST_PREFIX );
+        free( row );
+        free( packed_row );
+        free( expected_packed_row );
+    }
+}
+
+/**
+ * Tests that pio_next_rows returns the same rows as pio_next_row
+ * for chunks smaller than, equal to and larger than a row.
+ */
+void
+test_next_rows(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 11;
+    size_t max_rows = 4;
+    size_t chunk_sizes[] = { 1, 3, 64, 0 };
+
+    for(size_t k = 0; k < sizeof( g_num_samples ) / sizeof( g_num_samples[ 0 ] ); k++)
+    {
+        size_t num_samples = g_num_samples[ k ];
+        snp_t *matrix = (snp_t *) malloc( num_loci * num_samples );
+
+        write_fileset( TEST_PREFIX, num_loci, num_samples );
+        for(size_t c = 0; c < 2 * sizeof( chunk_sizes ) / sizeof( chunk_sizes[ 0 ] ); c++)
+        {
+            struct pio_file_t plink_file;
+            size_t locus = 0;
+            size_t rows_read = 0;
+            if( c % 2 == 1 )
+            {
+                assert_int_equal( pio_open_mapped( &plink_file, TEST_PREFIX ), PIO_OK );
+            }
+            else
+            {
+                assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+            }
+            pio_set_chunk_size( &plink_file, chunk_sizes[ c / 2 ] );
+
+            /* Mix in a single row read to check that the cursor is shared. */
+            assert_int_equal( pio_next_row( &plink_file, matrix ), PIO_OK );
+            assert_row_equal( matrix, locus++, num_samples );
+
+            while( pio_next_rows( &plink_file, max_rows, matrix, &rows_read ) == PIO_OK )
+            {
+                assert_true( rows_read > 0 && rows_read <= max_rows );
+                for(size_t i = 0; i < rows_read; i++)
+                {
+                    assert_row_equal( matrix + i * num_samples, locus++, num_samples );
+                }
+            }
+            assert_int_equal( rows_read, 0 );
+            assert_int_equal( locus, num_loci );
+
+            pio_reset_row( &plink_file );
+            assert_int_equal( pio_next_rows( &plink_file, num_loci + 1, matrix, &rows_read ), PIO_OK );
+            assert_int_equal( rows_read, num_loci );
+            for(size_t i = 0; i < rows_read; i++)
+            {
+                assert_row_equal( matrix + i * num_samples, i, num_samples );
+            }
+            pio_close( &plink_file );
+        }
+
+        remove_fileset( TEST_PREFIX );
+        free( matrix );
+    }
+}
+
+/**
+ * Tests that packed rows are returned as stored, except for the
+ * bits after the last SNP which are cleared.
+ */
+void
+test_next_row_packed(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 3;
+    size_t num_samples = 7;
+    size_t row_size = ( num_samples + 3 ) / 4;
+    snp_t row[ 7 ];
+    unsigned char packed_row[ 2 ];
+    unsigned char expected_packed_row[ 2 ];
+    char *bed_path = concatenate( TEST_PREFIX, ".bed" );
+    FILE *bed_fp = NULL;
+
+    /* Fill the unused bits of every row with ones. */
+    write_fileset( TEST_PREFIX, num_loci, num_samples );
+    bed_fp = fopen( bed_path, "r+b" );
+    assert_true( bed_fp != NULL );
+    for(size_t i = 0; i < num_loci; i++)
+    {
+        unsigned char last_byte;
+        long offset = (long) ( 3 + i * row_size + row_size - 1 );
+        fseek( bed_fp, offset, SEEK_SET );
+        assert_int_equal( fread( &last_byte, 1, 1, bed_fp ), 1 );
+        last_byte |= 0xc0;
+        fseek( bed_fp, offset, SEEK_SET );
+        assert_int_equal( fwrite( &last_byte, 1, 1, bed_fp ), 1 );
+    }
+    fclose( bed_fp );
+
+    for(int mapped = 0; mapped < 2; mapped++)
+    {
+        struct pio_file_t plink_file;
+        if( mapped )
+        {
+            assert_int_equal( pio_open_mapped( &plink_file, TEST_PREFIX ), PIO_OK );
+        }
+        else
+        {
+            assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        }
+
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            for(size_t j = 0; j < num_samples; j++)
+            {
+                row[ j ] = expected_genotype( i, j );
+            }
+            pack_snps( row, expected_packed_row, num_samples );
+            assert_int_equal( expected_packed_row[ row_size - 1 ] & 0xc0, 0 );
+
+            assert_int_equal( pio_next_row_packed( &plink_file, packed_row ), PIO_OK );
+            assert_memory_equal( packed_row, expected_packed_row, row_size );
+
+            assert_int_equal( pio_read_row_packed_at( &plink_file, i, packed_row ), PIO_OK );
+            assert_memory_equal( packed_row, expected_packed_row, row_size );
+        }
+        assert_int_equal( pio_next_row_packed( &plink_file, packed_row ), PIO_END );
+
+        pio_close( &plink_file );
+    }
+
+    remove_fileset( TEST_PREFIX );
+    free( bed_path );
+}
+
+/**
+ * Asserts that all read functions return the given samples of
+ * each locus.
+ */
+static void
+assert_subset_rows(struct pio_file_t *plink_file, const size_t *samples, size_t num_selected, size_t num_loci)
+{
+    snp_t *matrix = (snp_t *) malloc( num_loci * num_selected + 1 );
+    size_t rows_read = 0;
+
+    assert_int_equal( pio_row_size( plink_file ), num_selected );
+    for(size_t i = 0; i < num_loci; i++)
+    {
+        assert_int_equal( pio_next_row( plink_file, matrix ), PIO_OK );
+        for(size_t j = 0; j < num_selected; j++)
+        {
+            assert_int_equal( matrix[ j ], expected_genotype( i, samples[ j ] ) );
+        }
+        assert_int_equal( pio_read_row_at( plink_file, num_loci - i - 1, matrix ), PIO_OK );
+        for(size_t j = 0; j < num_selected; j++)
+        {
+            assert_int_equal( matrix[ j ], expected_genotype( num_loci - i - 1, samples[ j ] ) );
+        }
+    }
+
+    pio_reset_row( plink_file );
+    assert_int_equal( pio_next_rows( plink_file, num_loci, matrix, &rows_read ), PIO_OK );
+    assert_int_equal( rows_read, num_loci );
+    for(size_t i = 0; i < num_loci; i++)
+    {
+        for(size_t j = 0; j < num_selected; j++)
+        {
+            assert_int_equal( matrix[ i * num_selected + j ], expected_genotype( i, samples[ j ] ) );
+        }
+    }
+    pio_reset_row( plink_file );
+
+    free( matrix );
+}
+
+/**
+ * Tests that sample subsets given as ids or as a bitmask return
+ * the selected samples in order, for both short and long runs.
+ */
+void
+test_sample_subset(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 4;
+    size_t num_samples = 1029;
+    size_t samples[ 1029 ];
+    size_t num_selected = 0;
+    unsigned char mask[ ( 1029 + 7 ) / 8 ] = { 0 };
+
+    /* Scattered samples in reverse, a repeat, and a long unaligned run. */
+    for(size_t j = num_samples; j > 900; j -= 13)
+    {
+        samples[ num_selected++ ] = j - 1;
+    }
+    samples[ num_selected++ ] = 5;
+    samples[ num_selected++ ] = 5;
+    for(size_t j = 3; j < 203; j++)
+    {
+        samples[ num_selected++ ] = j;
+    }
+    samples[ num_selected++ ] = 1028;
+
+    write_fileset( TEST_PREFIX, num_loci, num_samples );
+    for(int mapped = 0; mapped < 2; mapped++)
+    {
+        struct pio_file_t plink_file;
+        size_t out_of_range = num_samples;
+        if( mapped )
+        {
+            assert_int_equal( pio_open_mapped( &plink_file, TEST_PREFIX ), PIO_OK );
+        }
+        else
+        {
+            assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        }
+
+        assert_int_equal( pio_set_sample_subset( &plink_file, samples, num_selected ), PIO_OK );
+        assert_subset_rows( &plink_file, samples, num_selected, num_loci );
+
+        /* A bad subset keeps the previous one. */
+        assert_int_equal( pio_set_sample_subset( &plink_file, &out_of_range, 1 ), PIO_ERROR );
+        assert_int_equal( pio_row_size( &plink_file ), num_selected );
+
+        assert_int_equal( pio_set_sample_subset( &plink_file, NULL, 0 ), PIO_OK );
+        assert_int_equal( pio_row_size( &plink_file ), num_samples );
+
+        pio_close( &plink_file );
+    }
+
+    num_selected = 0;
+    for(size_t j = 0; j < num_samples; j++)
+    {
+        if( j % 3 == 0 || ( j >= 500 && j < 600 ) )
+        {
+            mask[ j / 8 ] |= (unsigned char) ( 1 << ( j % 8 ) );
+            samples[ num_selected++ ] = j;
+        }
+    }
+    {
+        struct pio_file_t plink_file;
+        assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        assert_int_equal( pio_set_sample_mask( &plink_file, mask ), PIO_OK );
+        assert_subset_rows( &plink_file, samples, num_selected, num_loci );
+        pio_close( &plink_file );
+    }
+
+    remove_fileset( TEST_PREFIX );
+}
+
+/**
+ * Tests that a row subset returns the requested rows in both
+ * orders, with small chunks so that rows span several windows.
+ */
+void
+test_row_subset(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 200;
+    size_t num_samples = 130;
+    size_t row_size = ( num_samples + 3 ) / 4;
+    size_t rows[] = { 150, 3, 4, 5, 199, 0, 4, 120, 121, 60, 2, 198 };
+    size_t sorted_rows[] = { 0, 2, 3, 4, 4, 5, 60, 120, 121, 150, 198, 199 };
+    size_t num_rows = sizeof( rows ) / sizeof( rows[ 0 ] );
+    size_t chunk_sizes[] = { 1, 3 * 33, 0 };
+    snp_t row[ 130 ];
+    unsigned char packed_row[ 33 ];
+    unsigned char expected_packed_row[ 33 ];
+
+    write_fileset( TEST_PREFIX, num_loci, num_samples );
+    for(size_t c = 0; c < 2 * sizeof( chunk_sizes ) / sizeof( chunk_sizes[ 0 ] ); c++)
+    {
+        struct pio_file_t plink_file;
+        struct bed_row_subset_t subset;
+        size_t row_index = 0;
+        if( c % 2 == 1 )
+        {
+            assert_int_equal( pio_open_mapped( &plink_file, TEST_PREFIX ), PIO_OK );
+        }
+        else
+        {
+            assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        }
+        pio_set_chunk_size( &plink_file, chunk_sizes[ c / 2 ] );
+
+        assert_int_equal( pio_row_subset_init( &subset, &plink_file, rows, num_rows, BED_REQUESTED_ORDER ), PIO_OK );
+        for(size_t i = 0; i < num_rows; i++)
+        {
+            assert_int_equal( pio_row_subset_next( &subset, row, &row_index ), PIO_OK );
+            assert_int_equal( row_index, rows[ i ] );
+            assert_row_equal( row, rows[ i ], num_samples );
+        }
+        assert_int_equal( pio_row_subset_next( &subset, row, &row_index ), PIO_END );
+        pio_row_subset_close( &subset );
+
+        assert_int_equal( pio_row_subset_init( &subset, &plink_file, rows, num_rows, BED_FILE_ORDER ), PIO_OK );
+        for(size_t i = 0; i < num_rows; i++)
+        {
+            assert_int_equal( pio_row_subset_next_packed( &subset, packed_row, &row_index ), PIO_OK );
+            assert_int_equal( row_index, sorted_rows[ i ] );
+            assert_int_equal( pio_read_row_packed_at( &plink_file, sorted_rows[ i ], expected_packed_row ), PIO_OK );
+            assert_memory_equal( packed_row, expected_packed_row, row_size );
+        }
+        assert_int_equal( pio_row_subset_next_packed( &subset, packed_row, NULL ), PIO_END );
+        pio_row_subset_close( &subset );
+
+        /* The sequential position is untouched. */
+        assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+        assert_row_equal( row, 0, num_samples );
+
+        assert_int_equal( pio_row_subset_init( &subset, &plink_file, &num_loci, 1, BED_FILE_ORDER ), PIO_ERROR );
+        pio_close( &plink_file );
+    }
+
+    remove_fileset( TEST_PREFIX );
+}
+
+/**
+ * Tests that the sequential read functions return the same rows
+ * when the rows are prefetched, with and without decoding.
+ */
+void
+test_prefetch(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 37;
+    size_t num_samples = 130;
+    size_t row_size = ( num_samples + 3 ) / 4;
+    size_t block_sizes[] = { 1, 5 * 33, 0 };
+    size_t subset[] = { 129, 0, 64 };
+    snp_t *matrix = (snp_t *) malloc( num_loci * num_samples );
+    unsigned char packed_row[ 33 ];
+    unsigned char expected_packed_row[ 33 ];
+
+    write_fileset( TEST_PREFIX, num_loci, num_samples );
+    for(size_t c = 0; c < 4 * sizeof( block_sizes ) / sizeof( block_sizes[ 0 ] ); c++)
+    {
+        struct pio_file_t plink_file;
+        size_t rows_read = 0;
+        int decoded = c % 2;
+        if( ( c / 2 ) % 2 == 1 )
+        {
+            assert_int_equal( pio_open_mapped( &plink_file, TEST_PREFIX ), PIO_OK );
+        }
+        else
+        {
+            assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        }
+
+        assert_int_equal( pio_next_row( &plink_file, matrix ), PIO_OK );
+        assert_int_equal( pio_set_prefetch( &plink_file, 1 + c % 3, block_sizes[ c / 4 ], decoded ), PIO_OK );
+
+        /* Prefetching starts at the current row. */
+        for(size_t i = 1; i < num_loci; i++)
+        {
+            if( i % 5 == 0 )
+            {
+                assert_int_equal( pio_skip_row( &plink_file ), PIO_OK );
+            }
+            else if( i % 7 == 0 )
+            {
+                assert_int_equal( pio_next_row_packed( &plink_file, packed_row ), PIO_OK );
+                assert_int_equal( pio_read_row_packed_at( &plink_file, i, expected_packed_row ), PIO_OK );
+                assert_memory_equal( packed_row, expected_packed_row, row_size );
+            }
+            else
+            {
+                assert_int_equal( pio_next_row( &plink_file, matrix ), PIO_OK );
+                assert_row_equal( matrix, i, num_samples );
+            }
+        }
+        assert_int_equal( pio_next_row( &plink_file, matrix ), PIO_END );
+
+        pio_reset_row( &plink_file );
+        assert_int_equal( pio_next_rows( &plink_file, num_loci, matrix, &rows_read ), PIO_OK );
+        assert_int_equal( rows_read, num_loci );
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            assert_row_equal( matrix + i * num_samples, i, num_samples );
+        }
+
+        pio_reset_row( &plink_file );
+        assert_int_equal( pio_set_sample_subset( &plink_file, subset, 3 ), PIO_OK );
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            assert_int_equal( pio_next_row( &plink_file, matrix ), PIO_OK );
+            for(size_t j = 0; j < 3; j++)
+            {
+                assert_int_equal( matrix[ j ], expected_genotype( i, subset[ j ] ) );
+            }
+        }
+
+        /* Rows read after prefetching stops follow the prefetched ones. */
+        pio_reset_row( &plink_file );
+        assert_int_equal( pio_set_sample_subset( &plink_file, NULL, 0 ), PIO_OK );
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            if( i % 4 == 3 )
+            {
+                size_t depth = ( i / 4 ) % 2 == 0 ? 0 : 1 + c % 3;
+                assert_int_equal( pio_set_prefetch( &plink_file, depth, block_sizes[ c / 4 ], decoded ), PIO_OK );
+            }
+            if( i % 6 == 5 )
+            {
+                assert_int_equal( pio_skip_row( &plink_file ), PIO_OK );
+                continue;
+            }
+            assert_int_equal( pio_next_row( &plink_file, matrix ), PIO_OK );
+            assert_row_equal( matrix, i, num_samples );
+        }
+        assert_int_equal( pio_next_row( &plink_file, matrix ), PIO_END );
+
+        /* Closing with blocks still in flight stops the thread. */
+        assert_int_equal( pio_set_prefetch( &plink_file, 1 + c % 3, block_sizes[ c / 4 ], decoded ), PIO_OK );
+        pio_reset_row( &plink_file );
+        pio_close( &plink_file );
+    }
+
+    remove_fileset( TEST_PREFIX );
+    free( matrix );
+}
+
+/**
+ * Tests that padded buffers are aligned and that their padding is
+ * missing after reading into them.
+ */
+void
+test_padded_rows(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 11;
+    size_t subset[] = { 6, 0, 3 };
+
+    for(size_t s = 0; s < sizeof( g_num_samples ) / sizeof( g_num_samples[ 0 ] ); s++)
+    {
+        struct pio_file_t plink_file;
+        size_t num_samples = g_num_samples[ s ];
+        size_t rows_read = 0;
+        size_t stride;
+        snp_t *row;
+        snp_t *matrix;
+
+        write_fileset( TEST_PREFIX, num_loci, num_samples );
+        assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        if( num_samples == 7 )
+        {
+            assert_int_equal( pio_set_sample_subset( &plink_file, subset, 3 ), PIO_OK );
+        }
+
+        stride = pio_row_stride( &plink_file );
+        assert_int_equal( stride % BED_ROW_ALIGNMENT, 0 );
+        assert_true( stride >= pio_row_size( &plink_file ) && stride < pio_row_size( &plink_file ) + BED_ROW_ALIGNMENT );
+
+        row = pio_row_alloc( &plink_file );
+        matrix = pio_matrix_alloc( &plink_file, num_loci );
+        assert_true( row != NULL && matrix != NULL );
+        assert_true( pio_matrix_alloc( &plink_file, SIZE_MAX / stride + 1 ) == NULL );
+        assert_int_equal( (uintptr_t) row % BED_ROW_ALIGNMENT, 0 );
+        assert_int_equal( (uintptr_t) matrix % BED_ROW_ALIGNMENT, 0 );
+
+        assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+        for(size_t j = pio_row_size( &plink_file ); j < stride; j++)
+        {
+            assert_int_equal( row[ j ], 3 );
+        }
+
+        /* Dirty the padding, the padded reader has to restore it. */
+        memset( matrix, 0, num_loci * stride );
+        assert_int_equal( pio_next_rows_padded( &plink_file, num_loci, matrix, &rows_read ), PIO_OK );
+        assert_int_equal( rows_read, num_loci - 1 );
+        for(size_t i = 0; i < rows_read; i++)
+        {
+            const snp_t *matrix_row = matrix + i * stride;
+            for(size_t j = 0; j < pio_row_size( &plink_file ); j++)
+            {
+                size_t sample = num_samples == 7 ? subset[ j ] : j;
+                assert_int_equal( matrix_row[ j ], expected_genotype( i + 1, sample ) );
+            }
+            for(size_t j = pio_row_size( &plink_file ); j < stride; j++)
+            {
+                assert_int_equal( matrix_row[ j ], 3 );
+            }
+        }
+
+        pio_buffer_free( row );
+        pio_buffer_free( matrix );
+        pio_close( &plink_file );
+    }
+
+    pio_buffer_free( NULL );
+    remove_fileset( TEST_PREFIX );
+}
+
+/**
+ * Tests the typed decoders against the mean and standard deviation
+ * of the genotypes, for whole rows and a sample subset.
+ */
+void
+test_typed_rows(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 9;
+    size_t num_samples = 1029;
+    size_t subset[] = { 1028, 3, 4, 5, 6, 7, 500 };
+    float *float_row = (float *) malloc( sizeof( float ) * num_samples );
+    double *double_row = (double *) malloc( sizeof( double ) * num_samples );
+    int8_t *int8_row = (int8_t *) malloc( num_samples );
+    snp_t *row = (snp_t *) malloc( num_samples );
+
+    write_fileset( TEST_PREFIX, num_loci, num_samples );
+    for(int c = 0; c < 4; c++)
+    {
+        struct pio_file_t plink_file;
+        size_t num_cols = num_samples;
+        if( c % 2 == 1 )
+        {
+            assert_int_equal( pio_open_mapped( &plink_file, TEST_PREFIX ), PIO_OK );
+        }
+        else
+        {
+            assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        }
+        if( c >= 2 )
+        {
+            num_cols = sizeof( subset ) / sizeof( subset[ 0 ] );
+            assert_int_equal( pio_set_sample_subset( &plink_file, subset, num_cols ), PIO_OK );
+        }
+
+        for(int k = 0; k < 8; k++)
+        {
+            enum DosageScaling scaling = (enum DosageScaling) ( k / 2 );
+            int is_float = k % 2;
+            pio_reset_row( &plink_file );
+            for(size_t i = 0; i < num_loci; i++)
+            {
+                double sum = 0.0;
+                double sum_squares = 0.0;
+                double mean, sd;
+                size_t num_observed = 0;
+
+                assert_int_equal( pio_read_row_at( &plink_file, i, row ), PIO_OK );
+                for(size_t j = 0; j < num_cols; j++)
+                {
+                    if( row[ j ] != 3 )
+                    {
+                        sum += row[ j ];
+                        sum_squares += row[ j ] * row[ j ];
+                        num_observed++;
+                    }
+                }
+                mean = num_observed > 0 ? sum / num_observed : 0.0;
+                sd = num_observed > 0 ? sqrt( sum_squares / num_observed - mean * mean ) : 0.0;
+
+                if( is_float )
+                {
+                    assert_int_equal( pio_next_row_float( &plink_file, float_row, scaling, -9.0 ), PIO_OK );
+                }
+                else
+                {
+                    assert_int_equal( pio_next_row_double( &plink_file, double_row, scaling, -9.0 ), PIO_OK );
+                }
+
+                for(size_t j = 0; j < num_cols; j++)
+                {
+                    double expected = row[ j ] == 3 ? -9.0 : row[ j ];
+                    if( scaling == BED_DOSAGE_MEAN_IMPUTED )
+                    {
+                        expected = row[ j ] == 3 ? mean : row[ j ];
+                    }
+                    else if( scaling == BED_DOSAGE_CENTERED )
+                    {
+                        expected = row[ j ] == 3 ? 0.0 : row[ j ] - mean;
+                    }
+                    else if( scaling == BED_DOSAGE_STANDARDIZED )
+                    {
+                        expected = row[ j ] == 3 || sd == 0.0 ? 0.0 : ( row[ j ] - mean ) / sd;
+                    }
+
+                    if( is_float )
+                    {
+                        assert_true( fabs( float_row[ j ] - expected ) < 1e-5 );
+                    }
+                    else
+                    {
+                        assert_true( fabs( double_row[ j ] - expected ) < 1e-9 );
+                    }
+                }
+            }
+        }
+
+        pio_reset_row( &plink_file );
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            assert_int_equal( pio_next_row_int8( &plink_file, int8_row, -1 ), PIO_OK );
+            for(size_t j = 0; j < num_cols; j++)
+            {
+                snp_t genotype = expected_genotype( i, c >= 2 ? subset[ j ] : j );
+                assert_int_equal( int8_row[ j ], genotype == 3 ? -1 : (int8_t) genotype );
+            }
+        }
+        assert_int_equal( pio_next_row_int8( &plink_file, int8_row, -1 ), PIO_END );
+
+        pio_close( &plink_file );
+    }
+
+    remove_fileset( TEST_PREFIX );
+    free( float_row );
+    free( double_row );
+    free( int8_row );
+    free( row );
+}
+
+/**
+ * Tests that the access pattern hints leave the rows unchanged and
+ * that consumed pages are dropped behind the current row.
+ */
+void
+test_access_pattern(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_samples = 16390;
+    size_t row_size = ( num_samples + 3 ) / 4;
+    size_t num_loci = 2 * BED_DROP_CONSUMED_SIZE / row_size + 3;
+    snp_t *row = (snp_t *) malloc( num_samples );
+
+    write_fileset( TEST_PREFIX, num_loci, num_samples );
+    for(int mapped = 0; mapped < 2; mapped++)
+    {
+        struct pio_file_t plink_file;
+        if( mapped )
+        {
+            assert_int_equal( pio_open_mapped( &plink_file, TEST_PREFIX ), PIO_OK );
+        }
+        else
+        {
+            assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        }
+
+        assert_int_equal( pio_set_access_pattern( &plink_file, BED_ACCESS_SEQUENTIAL | BED_ACCESS_RANDOM ), PIO_ERROR );
+        assert_int_equal( pio_set_access_pattern( &plink_file, 8 ), PIO_ERROR );
+        assert_int_equal( pio_will_need_rows( &plink_file, num_loci, 1 ), PIO_ERROR );
+        assert_int_equal( pio_will_need_rows( &plink_file, 1, num_loci - 1 ), PIO_OK );
+        assert_int_equal( pio_set_access_pattern( &plink_file, BED_ACCESS_RANDOM ), PIO_OK );
+        assert_int_equal( pio_read_row_at( &plink_file, num_loci - 1, row ), PIO_OK );
+        assert_row_equal( row, num_loci - 1, num_samples );
+
+        assert_int_equal( pio_set_access_pattern( &plink_file, BED_ACCESS_SEQUENTIAL | BED_ACCESS_DONTNEED_CONSUMED ), PIO_OK );
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+            assert_row_equal( row, i, num_samples );
+            assert_true( plink_file.bed_file.dropped_offset <= 3 + i * row_size );
+        }
+        assert_int_equal( plink_file.bed_file.dropped_offset, 2 * BED_DROP_CONSUMED_SIZE );
+
+        /* A new pass drops from the beginning again. */
+        pio_reset_row( &plink_file );
+        assert_int_equal( plink_file.bed_file.dropped_offset, 0 );
+        assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+        assert_row_equal( row, 0, num_samples );
+
+        pio_close( &plink_file );
+    }
+
+    remove_fileset( TEST_PREFIX );
+    free( row );
+}
+
+/**
+ * Fills in samples for pio_create.
+ */
+static void
+init_samples(struct pio_sample_t *samples, size_t num_samples)
+{
+    for(size_t j = 0; j < num_samples; j++)
+    {
+        samples[ j ].pio_id = j;
+        samples[ j ].fid = "F";
+        samples[ j ].iid = "I";
+        samples[ j ].father_iid = "0";
+        samples[ j ].mother_iid = "0";
+        samples[ j ].sex = PIO_MALE;
+        samples[ j ].affection = PIO_CONTROL;
+        samples[ j ].phenotype = 0.0f;
+    }
+}
+
+/**
+ * Fills in loci named rs0, rs1, ... with names as their storage.
+ */
+static void
+init_loci(struct pio_locus_t *loci, char (*names)[ 16 ], size_t num_loci)
+{
+    for(size_t i = 0; i < num_loci; i++)
+    {
+        snprintf( names[ i ], 16, "rs%d", (int) i );
+        loci[ i ].pio_id = i;
+        loci[ i ].chromosome = (unsigned char) ( 1 + i % 22 );
+        loci[ i ].name = names[ i ];
+        loci[ i ].position = (float) i / 128.0f - 3.0f;
+        loci[ i ].bp_position = (long long) ( i * 100 + 1 );
+        loci[ i ].allele1 = "A";
+        loci[ i ].allele2 = "CT";
+    }
+}
+
+/**
+ * Returns the contents of the given file, its length in length.
+ */
+static unsigned char *
+read_file(const char *path, size_t *length)
+{
+    FILE *fp = fopen( path, "rb" );
+    unsigned char *contents;
+    assert_true( fp != NULL );
+    fseek( fp, 0, SEEK_END );
+    *length = (size_t) ftell( fp );
+    fseek( fp, 0, SEEK_SET );
+    contents = (unsigned char *) malloc( *length + 1 );
+    assert_int_equal( fread( contents, 1, *length, fp ), *length );
+    fclose( fp );
+    return contents;
+}
+
+/**
+ * Tests that pio_write_rows writes the same files as pio_write_row,
+ * across several chunks and with or without keeping the loci.
+ */
+void
+test_write_rows(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_samples = 130;
+    size_t num_loci = 1000;
+    size_t row_size = ( num_samples + 3 ) / 4;
+    struct pio_sample_t *samples = (struct pio_sample_t *) malloc( num_samples * sizeof( struct pio_sample_t ) );
+    struct pio_locus_t *loci = (struct pio_locus_t *) malloc( num_loci * sizeof( struct pio_locus_t ) );
+    char (*names)[ 16 ] = (char (*)[ 16 ]) malloc( num_loci * 16 );
+    snp_t *matrix = (snp_t *) malloc( num_loci * num_samples );
+    snp_t *row = (snp_t *) malloc( num_samples );
+    char *bim_path = concatenate( TEST_PREFIX, ".bim" );
+    char *bed_path = concatenate( TEST_PREFIX, ".bed" );
+    unsigned char *bed;
+    size_t bed_length;
+    char expected[ 256 ];
+    char line[ 256 ];
+
+    init_samples( samples, num_samples );
+    init_loci( loci, names, num_loci );
+    for(size_t i = 0; i < num_loci; i++)
+    {
+        for(size_t j = 0; j < num_samples; j++)
+        {
+            matrix[ i * num_samples + j ] = expected_genotype( i, j );
+        }
+    }
+
+    for(int keep = 0; keep < 2; keep++)
+    {
+        struct pio_file_t plink_file;
+        FILE *bim_fp;
+
+        assert_int_equal( pio_create( &plink_file, TEST_PREFIX, samples, num_samples ), PIO_OK );
+        pio_set_keep_loci( &plink_file, keep );
+        bed_set_chunk_size( &plink_file.bed_file, 7 * row_size );
+        assert_int_equal( pio_write_rows( &plink_file, loci, matrix, 1 ), PIO_OK );
+        assert_int_equal( pio_write_row( &plink_file, &loci[ 1 ], matrix + num_samples ), PIO_OK );
+        assert_int_equal( pio_write_rows( &plink_file, loci + 2, matrix + 2 * num_samples, num_loci - 2 ), PIO_OK );
+        assert_int_equal( pio_write_rows( &plink_file, loci, matrix, 0 ), PIO_OK );
+        assert_int_equal( pio_num_loci( &plink_file ), num_loci );
+        if( keep )
+        {
+            assert_string_equal( pio_get_locus( &plink_file, num_loci - 1 )->name, names[ num_loci - 1 ] );
+        }
+        else
+        {
+            assert_true( pio_get_locus( &plink_file, 0 ) == NULL );
+        }
+
+        /* Invalid genotypes are rejected before anything is written. */
+        matrix[ 5 ] = 4;
+        assert_int_equal( pio_write_rows( &plink_file, loci, matrix, 1 ), P_BED_IO_ERROR );
+        matrix[ 5 ] = expected_genotype( 0, 5 );
+        matrix[ 10 * num_samples + 5 ] = 4;
+        assert_int_equal( pio_write_rows( &plink_file, loci, matrix, 12 ), P_BED_IO_ERROR );
+        matrix[ 10 * num_samples + 5 ] = expected_genotype( 10, 5 );
+        assert_int_equal( pio_num_loci( &plink_file ), num_loci );
+        pio_close( &plink_file );
+
+        assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        assert_int_equal( pio_num_loci( &plink_file ), num_loci );
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+            assert_row_equal( row, i, num_samples );
+        }
+        assert_int_equal( pio_next_row( &plink_file, row ), PIO_END );
+        pio_close( &plink_file );
+
+        bed = read_file( bed_path, &bed_length );
+        assert_int_equal( bed_length, 3 + num_loci * row_size );
+        free( bed );
+
+        bim_fp = fopen( bim_path, "r" );
+        assert_true( bim_fp != NULL );
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            snprintf( expected, sizeof( expected ), "%d\t%s\t%f\t%lld\t%s\t%s\n",
+                      loci[ i ].chromosome, loci[ i ].name, loci[ i ].position,
+                      loci[ i ].bp_position, loci[ i ].allele1, loci[ i ].allele2 );
+            assert_true( fgets( line, sizeof( line ), bim_fp ) != NULL );
+            assert_string_equal( line, expected );
+        }
+        assert_true( fgets( line, sizeof( line ), bim_fp ) == NULL );
+        fclose( bim_fp );
+
+        remove_fileset( TEST_PREFIX );
+    }
+
+    free( samples );
+    free( loci );
+    free( names );
+    free( matrix );
+    free( row );
+    free( bim_path );
+    free( bed_path );
+}
+
+/**
+ * Records the calls of the transpose progress callback.
+ */
+struct transpose_progress_t
+{
+    size_t num_calls;
+    uint64_t bytes_done;
+    uint64_t bytes_total;
+};
+
+static void
+record_transpose_progress(void *user_data, uint64_t bytes_done, uint64_t bytes_total)
+{
+    struct transpose_progress_t *progress = (struct transpose_progress_t *) user_data;
+    assert_true( bytes_done > progress->bytes_done );
+    progress->num_calls++;
+    progress->bytes_done = bytes_done;
+    progress->bytes_total = bytes_total;
+}
+
+/**
+ * Tests that the transpose with a memory budget writes the same
+ * file as the in-memory transpose, both when all rows fit in one
+ * band and when they are merged from runs.
+ */
+void
+test_transpose_budget(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 37;
+    size_t budgets[] = { 1, 200, 4096, 64 << 20 };
+    char *expected_path = concatenate( TEST_PREFIX "_expected", ".bed" );
+    char *transposed_path = concatenate( TEST_PREFIX "_transposed", ".bed" );
+
+    for(size_t k = 0; k < sizeof( g_num_samples ) / sizeof( g_num_samples[ 0 ] ) - 1; k++)
+    {
+        size_t num_samples = g_num_samples[ k ];
+        size_t expected_length;
+        unsigned char *expected;
+        snp_t *col = (snp_t *) malloc( num_loci );
+        FILE *fp;
+
+        write_fileset( TEST_PREFIX, num_loci, num_samples );
+        fp = fopen( expected_path, "wb" );
+        fclose( fp );
+        assert_int_equal( pio_transpose( TEST_PREFIX, TEST_PREFIX "_expected" ), PIO_OK );
+        expected = read_file( expected_path, &expected_length );
+
+        for(size_t b = 0; b < sizeof( budgets ) / sizeof( budgets[ 0 ] ); b++)
+        {
+            struct transpose_progress_t progress = { 0, 0, 0 };
+            struct pio_file_t plink_file;
+            size_t transposed_length;
+            unsigned char *transposed;
+
+            assert_int_equal( pio_transpose_budget( TEST_PREFIX, TEST_PREFIX "_transposed", budgets[ b ], record_transpose_progress, &progress ), PIO_OK );
+            assert_true( progress.num_calls > 0 );
+            assert_true( progress.bytes_done == progress.bytes_total );
+
+            transposed = read_file( transposed_path, &transposed_length );
+            assert_int_equal( transposed_length, expected_length );
+            assert_memory_equal( transposed, expected, expected_length );
+            free( transposed );
+
+            assert_int_equal( pio_open( &plink_file, TEST_PREFIX "_transposed" ), PIO_OK );
+            assert_false( pio_one_locus_per_row( &plink_file ) );
+            for(size_t j = 0; j < num_samples; j++)
+            {
+                assert_int_equal( pio_next_row( &plink_file, col ), PIO_OK );
+                for(size_t i = 0; i < num_loci; i++)
+                {
+                    assert_int_equal( col[ i ], expected_genotype( i, j ) );
+                }
+            }
+            pio_close( &plink_file );
+        }
+
+        remove_fileset( TEST_PREFIX );
+        remove_fileset( TEST_PREFIX "_expected" );
+        remove_fileset( TEST_PREFIX "_transposed" );
+        free( expected );
+        free( col );
+    }
+
+    free( expected_path );
+    free( transposed_path );
+}
+
+/**
+ * Tests that transposes split over many threads write the same
+ * file as a single thread, also when there are more threads than
+ * stripes.
+ */
+void
+test_transpose_threads(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 37;
+    size_t num_threads[] = { 2, 4, 0 };
+    char *expected_path = concatenate( TEST_PREFIX "_expected", ".bed" );
+    char *transposed_path = concatenate( TEST_PREFIX "_transposed", ".bed" );
+
+    for(size_t k = 0; k < sizeof( g_num_samples ) / sizeof( g_num_samples[ 0 ] ); k++)
+    {
+        size_t expected_length;
+        unsigned char *expected;
+        FILE *fp;
+
+        write_fileset( TEST_PREFIX, num_loci, g_num_samples[ k ] );
+        fp = fopen( expected_path, "wb" );
+        fclose( fp );
+        assert_int_equal( pio_transpose( TEST_PREFIX, TEST_PREFIX "_expected" ), PIO_OK );
+        expected = read_file( expected_path, &expected_length );
+
+        for(size_t t = 0; t < sizeof( num_threads ) / sizeof( num_threads[ 0 ] ); t++)
+        {
+            size_t transposed_length;
+            unsigned char *transposed;
+
+            fp = fopen( transposed_path, "wb" );
+            fclose( fp );
+            assert_int_equal( pio_transpose_threads( TEST_PREFIX, TEST_PREFIX "_transposed", num_threads[ t ] ), PIO_OK );
+
+            transposed = read_file( transposed_path, &transposed_length );
+            assert_int_equal( transposed_length, expected_length );
+            assert_memory_equal( transposed, expected, expected_length );
+            free( transposed );
+        }
+
+        remove_fileset( TEST_PREFIX );
+        remove_fileset( TEST_PREFIX "_expected" );
+        remove_fileset( TEST_PREFIX "_transposed" );
+        free( expected );
+    }
+
+    free( expected_path );
+    free( transposed_path );
+}
+
+/**
+ * Tests that transposed rows larger than a stripe are still
+ * written in stripes of 4 rows.
+ */
+void
+test_transpose_narrow_stripes(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 37;
+    size_t num_threads[] = { 1, 4 };
+    char *expected_path = concatenate( TEST_PREFIX "_expected", ".bed" );
+    char *transposed_path = concatenate( TEST_PREFIX "_transposed", ".bed" );
+    size_t expected_length;
+    unsigned char *expected;
+    FILE *fp;
+
+    write_fileset( TEST_PREFIX, num_loci, 130 );
+    fp = fopen( expected_path, "wb" );
+    fclose( fp );
+    assert_int_equal( pio_transpose( TEST_PREFIX, TEST_PREFIX "_expected" ), PIO_OK );
+    expected = read_file( expected_path, &expected_length );
+
+    /* Each transposed row of the 37 loci takes 10 bytes. */
+    g_transpose_stripe_size = 1;
+    for(size_t t = 0; t < sizeof( num_threads ) / sizeof( num_threads[ 0 ] ); t++)
+    {
+        size_t transposed_length;
+        unsigned char *transposed;
+
+        fp = fopen( transposed_path, "wb" );
+        fclose( fp );
+        assert_int_equal( pio_transpose_threads( TEST_PREFIX, TEST_PREFIX "_transposed", num_threads[ t ] ), PIO_OK );
+
+        transposed = read_file( transposed_path, &transposed_length );
+        assert_int_equal( transposed_length, expected_length );
+        assert_memory_equal( transposed, expected, expected_length );
+        free( transposed );
+    }
+    g_transpose_stripe_size = BED_TRANSPOSE_STRIPE_SIZE;
+
+    remove_fileset( TEST_PREFIX );
+    remove_fileset( TEST_PREFIX "_expected" );
+    remove_fileset( TEST_PREFIX "_transposed" );
+    free( expected );
+    free( expected_path );
+    free( transposed_path );
+}
+
+/**
+ * Tests that a sample major file is read a locus per row through
+ * windows of different sizes, with and without a mapping, and that
+ * a locus major file can be read a sample per row.
+ */
+void
+test_snp_order(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 37;
+    size_t window_sizes[] = { 0, 1, 20 };
+    char *transposed_path = concatenate( TEST_PREFIX "_transposed", ".bed" );
+
+    for(size_t k = 0; k < sizeof( g_num_samples ) / sizeof( g_num_samples[ 0 ] ) - 1; k++)
+    {
+        size_t num_samples = g_num_samples[ k ];
+        snp_t *row = (snp_t *) malloc( num_samples );
+        snp_t *col = (snp_t *) malloc( num_loci );
+        unsigned char *packed_row = (unsigned char *) malloc( ( num_samples + 3 ) / 4 );
+        struct pio_file_t plink_file;
+        FILE *fp;
+
+        write_fileset( TEST_PREFIX, num_loci, num_samples );
+        fp = fopen( transposed_path, "wb" );
+        fclose( fp );
+        assert_int_equal( pio_transpose( TEST_PREFIX, TEST_PREFIX "_transposed" ), PIO_OK );
+
+        for(size_t w = 0; w < 2 * sizeof( window_sizes ) / sizeof( window_sizes[ 0 ] ); w++)
+        {
+            if( w % 2 == 0 )
+            {
+                assert_int_equal( pio_open( &plink_file, TEST_PREFIX "_transposed" ), PIO_OK );
+            }
+            else
+            {
+                assert_int_equal( pio_open_mapped( &plink_file, TEST_PREFIX "_transposed" ), PIO_OK );
+            }
+            assert_int_equal( pio_set_snp_order( &plink_file, BED_ONE_LOCUS_PER_ROW, window_sizes[ w / 2 ] ), PIO_OK );
+            assert_true( pio_one_locus_per_row( &plink_file ) );
+            assert_int_equal( pio_set_prefetch( &plink_file, 2, 0, 0 ), PIO_ERROR );
+
+            for(size_t i = 0; i < num_loci; i++)
+            {
+                if( i % 3 == 0 )
+                {
+                    assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+                }
+                else if( i % 3 == 1 )
+                {
+                    assert_int_equal( pio_next_row_packed( &plink_file, packed_row ), PIO_OK );
+                    unpack_snps( packed_row, row, num_samples );
+                }
+                else
+                {
+                    assert_int_equal( pio_skip_row( &plink_file ), PIO_OK );
+                    assert_int_equal( pio_read_row_at( &plink_file, i, row ), PIO_OK );
+                }
+                assert_row_equal( row, i, num_samples );
+            }
+            assert_int_equal( pio_next_row( &plink_file, row ), PIO_END );
+
+            pio_reset_row( &plink_file );
+            assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+            assert_row_equal( row, 0, num_samples );
+
+            /* Reading as stored again starts at the first row. */
+            assert_int_equal( pio_set_snp_order( &plink_file, BED_ONE_SAMPLE_PER_ROW, 0 ), PIO_OK );
+            assert_int_equal( pio_next_row( &plink_file, col ), PIO_OK );
+            assert_int_equal( pio_set_snp_order( &plink_file, BED_ONE_SAMPLE_PER_ROW, 0 ), PIO_OK );
+            assert_int_equal( pio_next_row( &plink_file, col ), PIO_OK );
+            for(size_t i = 0; i < num_loci; i++)
+            {
+                assert_int_equal( col[ i ], expected_genotype( i, 0 ) );
+            }
+            pio_close( &plink_file );
+        }
+
+        assert_int_equal( pio_open_order( &plink_file, TEST_PREFIX, BED_ONE_SAMPLE_PER_ROW ), PIO_OK );
+        assert_false( pio_one_locus_per_row( &plink_file ) );
+        for(size_t j = 0; j < num_samples; j++)
+        {
+            assert_int_equal( pio_next_row( &plink_file, col ), PIO_OK );
+            for(size_t i = 0; i < num_loci; i++)
+            {
+                assert_int_equal( col[ i ], expected_genotype( i, j ) );
+            }
+        }
+        assert_int_equal( pio_next_row( &plink_file, col ), PIO_END );
+        pio_close( &plink_file );
+
+        assert_int_equal( pio_open_order( &plink_file, TEST_PREFIX, BED_ONE_LOCUS_PER_ROW ), PIO_OK );
+        assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+        assert_row_equal( row, 0, num_samples );
+        assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+        assert_int_equal( pio_set_snp_order( &plink_file, BED_ONE_LOCUS_PER_ROW, 0 ), PIO_OK );
+        assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+        assert_row_equal( row, 0, num_samples );
+        pio_close( &plink_file );
+
+        remove_fileset( TEST_PREFIX );
+        remove_fileset( TEST_PREFIX "_transposed" );
+        free( row );
+        free( col );
+        free( packed_row );
+    }
+
+    free( transposed_path );
+}
+
+/**
+ * Tests that file_copy replaces the destination with an exact copy,
+ * also of an empty file, leaves it alone when the source is
+ * missing, and that pio_transpose copies the .bim and .fam files.
+ */
+void
+test_file_copy(void **state)
+{
+    UNUSED_PARAM(state);
+    const char *extensions[] = { ".bim", ".fam" };
+    size_t num_samples = 130;
+    size_t num_loci = 37;
+
+    write_fileset( TEST_PREFIX, num_loci, num_samples );
+    assert_int_equal( pio_transpose( TEST_PREFIX, TEST_PREFIX "_transposed" ), PIO_OK );
+    for(size_t i = 0; i < sizeof( extensions ) / sizeof( extensions[ 0 ] ); i++)
+    {
+        char *path = concatenate( TEST_PREFIX, extensions[ i ] );
+        char *copy_path = concatenate( TEST_PREFIX "_transposed", extensions[ i ] );
+        size_t length, copy_length;
+        unsigned char *contents = read_file( path, &length );
+        unsigned char *copy = read_file( copy_path, &copy_length );
+
+        assert_true( length > 0 );
+        assert_int_equal( copy_length, length );
+        assert_memory_equal( copy, contents, length );
+        free( copy );
+
+        /* A missing source leaves the destination as it was. */
+        assert_int_equal( file_copy( TEST_PREFIX "_missing.bim", copy_path ), FILE_ERROR );
+        copy = read_file( copy_path, &copy_length );
+        assert_int_equal( copy_length, length );
+        free( copy );
+
+        free( contents );
+        free( path );
+        free( copy_path );
+    }
+
+    {
+        char *empty_path = concatenate( TEST_PREFIX "_empty", ".bim" );
+        char *copy_path = concatenate( TEST_PREFIX "_transposed", ".bim" );
+        size_t copy_length;
+        unsigned char *copy;
+        FILE *fp = fopen( empty_path, "wb" );
+        fclose( fp );
+
+        assert_int_equal( file_copy( empty_path, copy_path ), FILE_OK );
+        copy = read_file( copy_path, &copy_length );
+        assert_int_equal( copy_length, 0 );
+        free( copy );
+
+        assert_int_equal( file_remove( empty_path ), FILE_OK );
+        assert_int_equal( file_remove( empty_path ), FILE_ERROR );
+        free( empty_path );
+        free( copy_path );
+    }
+
+    remove_fileset( TEST_PREFIX );
+    remove_fileset( TEST_PREFIX "_transposed" );
+}
+
+/**
+ * Tests that samples written one at a time end up in a locus major
+ * file, with tiles that hold whole rows, parts of rows and a final
+ * partial tile.
+ */
+void
+test_write_sample(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 37;
+    size_t tile_sizes[] = { 0, 1, 10 * 9 };
+
+    for(size_t k = 0; k < sizeof( g_num_samples ) / sizeof( g_num_samples[ 0 ] ) - 1; k++)
+    {
+        size_t num_samples = g_num_samples[ k ];
+        struct pio_sample_t *samples = (struct pio_sample_t *) malloc( num_samples * sizeof( struct pio_sample_t ) );
+        struct pio_locus_t *loci = (struct pio_locus_t *) malloc( num_loci * sizeof( struct pio_locus_t ) );
+        char (*names)[ 16 ] = (char (*)[ 16 ]) malloc( num_loci * 16 );
+        snp_t *col = (snp_t *) malloc( num_loci );
+        snp_t *row = (snp_t *) malloc( num_samples );
+
+        init_samples( samples, num_samples );
+        init_loci( loci, names, num_loci );
+        for(size_t t = 0; t < sizeof( tile_sizes ) / sizeof( tile_sizes[ 0 ] ); t++)
+        {
+            struct pio_file_t plink_file;
+            assert_int_equal( pio_create_sized( &plink_file, TEST_PREFIX, samples, num_samples, loci, num_loci ), PIO_OK );
+            pio_set_sample_tile_size( &plink_file, tile_sizes[ t ] );
+            for(size_t j = 0; j < num_samples; j++)
+            {
+                for(size_t i = 0; i < num_loci; i++)
+                {
+                    col[ i ] = expected_genotype( i, j );
+                }
+                assert_int_equal( pio_write_sample( &plink_file, col ), PIO_OK );
+
+                /* Flushing in the middle of a byte keeps the samples after it. */
+                if( j % 5 == 2 )
+                {
+                    assert_int_equal( pio_flush_samples( &plink_file ), PIO_OK );
+                }
+            }
+            assert_int_equal( pio_write_sample( &plink_file, col ), P_BED_IO_ERROR );
+            assert_int_equal( pio_flush_samples( &plink_file ), PIO_OK );
+            assert_int_equal( pio_close( &plink_file ), PIO_OK );
+
+            assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+            assert_true( pio_one_locus_per_row( &plink_file ) );
+            for(size_t i = 0; i < num_loci; i++)
+            {
+                assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+                assert_row_equal( row, i, num_samples );
+            }
+            pio_close( &plink_file );
+        }
+
+        /* Buffered samples are written on close. */
+        {
+            struct pio_file_t plink_file;
+            assert_int_equal( pio_create_sized( &plink_file, TEST_PREFIX, samples, num_samples, loci, num_loci ), PIO_OK );
+            for(size_t i = 0; i < num_loci; i++)
+            {
+                col[ i ] = expected_genotype( i, 0 );
+            }
+            assert_int_equal( pio_write_sample( &plink_file, col ), PIO_OK );
+            assert_int_equal( pio_close( &plink_file ), PIO_OK );
+
+            assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+            for(size_t i = 0; i < num_loci; i++)
+            {
+                assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+                assert_int_equal( row[ 0 ], expected_genotype( i, 0 ) );
+            }
+            pio_close( &plink_file );
+        }
+
+        /* A failed write of the buffered samples is reported by close. */
+        if( num_samples > 1 )
+        {
+            struct pio_file_t plink_file;
+            char *bed_path = concatenate( TEST_PREFIX, ".bed" );
+            FILE *fp;
+
+            assert_int_equal( pio_create_sized( &plink_file, TEST_PREFIX, samples, num_samples, loci, num_loci ), PIO_OK );
+            assert_int_equal( pio_write_sample( &plink_file, col ), PIO_OK );
+
+            /* The buffered samples cannot be written through a read only stream. */
+            fp = plink_file.bed_file.fp;
+            plink_file.bed_file.fp = fopen( bed_path, "rb" );
+            assert_true( plink_file.bed_file.fp != NULL );
+            assert_int_equal( pio_close( &plink_file ), P_BED_IO_ERROR );
+
+            fclose( fp );
+            free( bed_path );
+        }
+
+        remove_fileset( TEST_PREFIX );
+        free( samples );
+        free( loci );
+        free( names );
+        free( col );
+        free( row );
+    }
+}
+
+/**
+ * Tests that packed rows are copied to a new file unchanged, except
+ * for the padding bits which are cleared.
+ */
+void
+test_write_row_packed(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 9;
+    char *copy_bed_path = concatenate( TEST_PREFIX "_copy", ".bed" );
+
+    for(size_t k = 0; k < sizeof( g_num_samples ) / sizeof( g_num_samples[ 0 ] ); k++)
+    {
+        size_t num_samples = g_num_samples[ k ];
+        size_t row_size = ( num_samples + 3 ) / 4;
+        struct pio_file_t plink_file;
+        struct pio_file_t copy_file;
+        unsigned char *packed_row = (unsigned char *) malloc( row_size );
+        unsigned char *copied_row = (unsigned char *) malloc( row_size );
+        snp_t *expected_row = (snp_t *) malloc( num_samples );
+        struct pio_sample_t *samples = (struct pio_sample_t *) malloc( num_samples * sizeof( struct pio_sample_t ) );
+        FILE *bed_fp;
+
+        write_fileset( TEST_PREFIX, num_loci, num_samples );
+        init_samples( samples, num_samples );
+        assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        assert_int_equal( pio_create( &copy_file, TEST_PREFIX "_copy", samples, num_samples ), PIO_OK );
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            assert_int_equal( pio_next_row_packed( &plink_file, packed_row ), PIO_OK );
+            packed_row[ row_size - 1 ] |= (unsigned char) ( 0xff << ( 2 * ( ( num_samples - 1 ) % 4 + 1 ) ) );
+            assert_int_equal( pio_write_row_packed( &copy_file, pio_get_locus( &plink_file, i ), packed_row ), PIO_OK );
+        }
+        pio_close( &plink_file );
+        pio_close( &copy_file );
+
+        assert_int_equal( pio_open( &copy_file, TEST_PREFIX "_copy" ), PIO_OK );
+        assert_int_equal( pio_num_loci( &copy_file ), num_loci );
+        assert_string_equal( pio_get_locus( &copy_file, num_loci - 1 )->name, "rs8" );
+        pio_close( &copy_file );
+
+        /* The padding bits are cleared in the file itself. */
+        bed_fp = fopen( copy_bed_path, "rb" );
+        assert_true( bed_fp != NULL );
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            assert_int_equal( fseek( bed_fp, (long) ( 3 + i * row_size ), SEEK_SET ), 0 );
+            assert_int_equal( fread( copied_row, 1, row_size, bed_fp ), row_size );
+            for(size_t j = 0; j < num_samples; j++)
+            {
+                expected_row[ j ] = expected_genotype( i, j );
+            }
+            pack_snps( expected_row, packed_row, num_samples );
+            assert_memory_equal( copied_row, packed_row, row_size );
+        }
+        fclose( bed_fp );
+
+        remove_fileset( TEST_PREFIX );
+        remove_fileset( TEST_PREFIX "_copy" );
+        free( packed_row );
+        free( copied_row );
+        free( expected_row );
+        free( samples );
+    }
+
+    free( copy_bed_path );
+}
+
+/**
+ * Number of threads that test_create_sized writes with.
+ */
+#define SIZED_NUM_THREADS 4
+
+/**
+ * Work of one writer thread of test_create_sized.
+ */
+struct sized_writer_t
+{
+    struct pio_file_t *plink_file;
+    size_t thread_index;
+    size_t num_loci;
+    size_t num_samples;
+    size_t num_failed;
+};
+
+/**
+ * Writes every SIZED_NUM_THREADS-th row, last row first.
+ */
+static void
+sized_write_rows(void *arg)
+{
+    struct sized_writer_t *writer = (struct sized_writer_t *) arg;
+    snp_t *row = (snp_t *) malloc( writer->num_samples );
+
+    for(size_t i = writer->num_loci; i-- > 0; )
+    {
+        if( i % SIZED_NUM_THREADS != writer->thread_index )
+        {
+            continue;
+        }
+        for(size_t j = 0; j < writer->num_samples; j++)
+        {
+            row[ j ] = expected_genotype( i, j );
+        }
+        if( pio_write_row_at( writer->plink_file, i, row ) != PIO_OK )
+        {
+            writer->num_failed++;
+        }
+    }
+
+    free( row );
+}
+
+/**
+ * Tests that rows of a file from pio_create_sized can be written
+ * out of order from several threads.
+ */
+void
+test_create_sized(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 301;
+
+    for(size_t k = 0; k < sizeof( g_num_samples ) / sizeof( g_num_samples[ 0 ] ); k++)
+    {
+        size_t num_samples = g_num_samples[ k ];
+        struct pio_sample_t *samples = (struct pio_sample_t *) malloc( num_samples * sizeof( struct pio_sample_t ) );
+        struct pio_locus_t *loci = (struct pio_locus_t *) malloc( num_loci * sizeof( struct pio_locus_t ) );
+        char (*names)[ 16 ] = (char (*)[ 16 ]) malloc( num_loci * 16 );
+        snp_t *row = (snp_t *) malloc( num_samples );
+        libplinkio_thread_private_t threads[ SIZED_NUM_THREADS ];
+        struct sized_writer_t writers[ SIZED_NUM_THREADS ];
+        struct pio_file_t plink_file;
+
+        init_samples( samples, num_samples );
+        init_loci( loci, names, num_loci );
+        assert_int_equal( pio_create_sized( &plink_file, TEST_PREFIX, samples, num_samples, loci, num_loci ), PIO_OK );
+        for(size_t t = 0; t < SIZED_NUM_THREADS; t++)
+        {
+            writers[ t ].plink_file = &plink_file;
+            writers[ t ].thread_index = t;
+            writers[ t ].num_loci = num_loci;
+            writers[ t ].num_samples = num_samples;
+            writers[ t ].num_failed = 0;
+            assert_int_equal( libplinkio_thread_create_( &threads[ t ], sized_write_rows, &writers[ t ] ), 0 );
+        }
+        for(size_t t = 0; t < SIZED_NUM_THREADS; t++)
+        {
+            assert_int_equal( libplinkio_thread_join_( &threads[ t ] ), 0 );
+            assert_int_equal( writers[ t ].num_failed, 0 );
+        }
+
+        for(size_t j = 0; j < num_samples; j++)
+        {
+            row[ j ] = expected_genotype( 0, j );
+        }
+        assert_int_equal( pio_write_row_at( &plink_file, num_loci, row ), P_BED_IO_ERROR );
+
+        /* Nothing of an invalid row is written, not even its first chunks. */
+        row[ num_samples - 1 ] = 4;
+        assert_int_equal( pio_write_row_at( &plink_file, 1, row ), P_BED_IO_ERROR );
+        row[ num_samples - 1 ] = expected_genotype( 0, num_samples - 1 );
+        assert_int_equal( pio_write_row_at( &plink_file, 0, row ), PIO_OK );
+
+        /* Sequential writes start over from the first row. */
+        assert_int_equal( bed_write_row( &plink_file.bed_file, row ), PIO_OK );
+        assert_int_equal( bed_header_num_rows( &plink_file.bed_file.header ), num_loci );
+        pio_close( &plink_file );
+
+        assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        assert_int_equal( pio_num_loci( &plink_file ), num_loci );
+        assert_int_equal( pio_num_samples( &plink_file ), num_samples );
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            assert_int_equal( pio_next_row( &plink_file, row ), PIO_OK );
+            assert_row_equal( row, i, num_samples );
+        }
+        assert_int_equal( pio_next_row( &plink_file, row ), PIO_END );
+        pio_close( &plink_file );
+
+        remove_fileset( TEST_PREFIX );
+        free( samples );
+        free( loci );
+        free( names );
+        free( row );
+    }
+}
+
+/**
+ * State shared with async_check_row.
+ */
+struct async_check_t
+{
+    size_t num_samples;
+    size_t num_ok;
+    size_t seen[ 64 ];
+};
+
+/**
+ * Checks a row read by an async reader and counts it.
+ */
+static void
+async_check_row(void *user_data, size_t row_index, pio_status_t status, const snp_t *row)
+{
+    struct async_check_t *check = (struct async_check_t *) user_data;
+
+    assert_int_equal( status, PIO_OK );
+    assert_row_equal( row, row_index, check->num_samples );
+    check->seen[ row_index ]++;
+    check->num_ok++;
+}
+
+/**
+ * Sets an environment variable, or removes it if value is NULL.
+ */
+static void
+set_env(const char *name, const char *value)
+{
+#ifdef _WIN32
+    _putenv_s( name, value != NULL ? value : "" );
+#else
+    if( value != NULL )
+    {
+        setenv( name, value, 1 );
+    }
+    else
+    {
+        unsetenv( name );
+    }
+#endif
+}
+
+/**
+ * Tests that the async reader returns each submitted row once,
+ * with both engines and more rows than fit in the queue.
+ */
+void
+test_async(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t num_loci = 64;
+    size_t num_samples = 1029;
+    size_t rows[ 100 ];
+    const char *engines[] = { NULL, "threads" };
+
+    for(size_t i = 0; i < 100; i++)
+    {
+        rows[ i ] = ( i * 37 ) % num_loci;
+    }
+
+    write_fileset( TEST_PREFIX, num_loci, num_samples );
+    for(size_t e = 0; e < 2; e++)
+    {
+        struct pio_file_t plink_file;
+        struct bed_async_t async;
+        struct async_check_t check;
+        size_t out_of_range = num_loci;
+
+        memset( &check, 0, sizeof( check ) );
+        check.num_samples = num_samples;
+        set_env( "LIBPLINKIO_ASYNC", engines[ e ] );
+        assert_int_equal( pio_open( &plink_file, TEST_PREFIX ), PIO_OK );
+        assert_int_equal( pio_async_init( &async, &plink_file, 3 ), PIO_OK );
+        if( engines[ e ] != NULL )
+        {
+            assert_string_equal( pio_async_engine( &async ), "threads" );
+        }
+
+        assert_int_equal( pio_async_submit( &async, &out_of_range, 1, async_check_row, &check ), PIO_ERROR );
+        assert_int_equal( pio_async_submit( &async, rows, 60, async_check_row, &check ), PIO_OK );
+        assert_true( pio_async_poll( &async, 5 ) >= 5 );
+        assert_int_equal( pio_async_submit( &async, rows + 60, 40, async_check_row, &check ), PIO_OK );
+        pio_async_wait( &async );
+        assert_int_equal( check.num_ok, 100 );
+        for(size_t i = 0; i < num_loci; i++)
+        {
+            size_t expected = 0;
+            for(size_t j = 0; j < 100; j++)
+            {
+                expected += rows[ j ] == i;
+            }
+            assert_int_equal( check.seen[ i ], expected );
+        }
+
+        /* Closing with reads in flight must not run the callbacks. */
+        assert_int_equal( pio_async_submit( &async, rows, 10, async_check_row, &check ), PIO_OK );
+        pio_async_close( &async );
+        assert_int_equal( check.num_ok, 100 );
+
+        pio_close( &plink_file );
+    }
+    set_env( "LIBPLINKIO_ASYNC", NULL );
+
+    remove_fileset( TEST_PREFIX );
+}
+
+int main(int argc, char* argv[])
+{
+    UNUSED_PARAM(argc);
+    UNUSED_PARAM(argv);
+    const UnitTest tests[] = {
+        unit_test( test_open_mapped ),
+        unit_test( test_open_mapped_truncated ),
+        unit_test( test_read_row_at ),
+        unit_test( test_next_rows ),
+        unit_test( test_next_row_packed ),
+        unit_test( test_sample_subset ),
+        unit_test( test_row_subset ),
+        unit_test( test_prefetch ),
+        unit_test( test_padded_rows ),
+        unit_test( test_typed_rows ),
+        unit_test( test_access_pattern ),
+        unit_test( test_write_rows ),
+        unit_test( test_create_sized ),
+        unit_test( test_write_row_packed ),
+        unit_test( test_write_sample ),
+        unit_test( test_transpose_budget ),
+        unit_test( test_transpose_threads ),
+        unit_test( test_transpose_narrow_stripes ),
+        unit_test( test_snp_order ),
+        unit_test( test_file_copy ),
+        unit_test( test_async ),
+    };
+
+    return run_tests( tests );
+}
@@ -16,6 +16,10 @@
 #include <bed.c>
 #include <file.c>
 #include <utility.c>
+#include <cpu.c>
+#include <snp_kernel.c>
+#include <thread.c>
+#include <prefetch.c>
 
 /**
  * Mock functions.
@@ -264,6 +268,268 @@ test_unpack_snps(void **state)
     } 
 }
 
+/**
+ * Tests that every SIMD decoder supported by this machine agrees
+ * with the scalar reference, for all lengths around the register
+ * widths and for unaligned output.
+ */
+void
+test_unpack_snps_kernels(void **state)
+{
+    UNUSED_PARAM(state);
+    const char *names[] = { "scalar", "sse2", "ssse3", "avx2", "avx512" };
+    size_t max_cols = 4 * 64 * 3 + 7;
+    unsigned char *packed_snps = (unsigned char *) malloc( max_cols / 4 + 1 );
+    snp_t *expected = (snp_t *) malloc( max_cols + 1 );
+    snp_t *unpacked_snps = (snp_t *) malloc( max_cols + 1 );
+
+    for(size_t i = 0; i < max_cols / 4 + 1; i++)
+    {
+        packed_snps[ i ] = (unsigned char) ( i * 167 + 13 );
+    }
+
+    for(size_t k = 0; k < sizeof( names ) / sizeof( names[ 0 ] ); k++)
+    {
+        const libplinkio_snp_kernel_private_t *kernel = libplinkio_snp_kernel_by_name_( names[ k ] );
+        if( kernel == NULL )
+        {
+            continue;
+        }
+
+        for(size_t num_cols = 0; num_cols <= max_cols; num_cols += 3)
+        {
+            libplinkio_unpack_snps_scalar_( packed_snps, expected, num_cols );
+            kernel->unpack( packed_snps, unpacked_snps + 1, num_cols );
+            assert_memory_equal( expected, unpacked_snps + 1, num_cols );
+        }
+    }
+
+    assert_true( libplinkio_snp_kernel_by_name_( bed_unpack_kernel( ) ) != NULL );
+
+    free( packed_snps );
+    free( expected );
+    free( unpacked_snps );
+}
+
+/**
+ * Tests that every SIMD encoder agrees with the scalar reference
+ * and detects invalid genotypes at any position.
+ */
+void
+test_pack_snps_kernels(void **state)
+{
+    UNUSED_PARAM(state);
+    const char *names[] = { "scalar", "sse2", "ssse3", "avx2", "avx512" };
+    size_t max_cols = 256 * 3 + 7;
+    snp_t *unpacked_snps = (snp_t *) malloc( max_cols + 1 );
+    unsigned char *expected = (unsigned char *) malloc( max_cols / 4 + 1 );
+    unsigned char *packed_snps = (unsigned char *) malloc( max_cols / 4 + 2 );
+
+    for(size_t i = 0; i < max_cols + 1; i++)
+    {
+        unpacked_snps[ i ] = (snp_t) ( ( i * 7 + i / 5 ) % 4 );
+    }
+
+    for(size_t k = 0; k < sizeof( names ) / sizeof( names[ 0 ] ); k++)
+    {
+        const libplinkio_snp_kernel_private_t *kernel = libplinkio_snp_kernel_by_name_( names[ k ] );
+        if( kernel == NULL )
+        {
+            continue;
+        }
+
+        for(size_t num_cols = 0; num_cols <= max_cols; num_cols += 3)
+        {
+            assert_int_equal( libplinkio_pack_snps_scalar_( unpacked_snps + 1, expected, num_cols ), 0 );
+            assert_int_equal( kernel->pack( unpacked_snps + 1, packed_snps + 1, num_cols ), 0 );
+            assert_memory_equal( expected, packed_snps + 1, ( num_cols + 3 ) / 4 );
+        }
+
+        for(size_t i = 0; i < max_cols; i += 37)
+        {
+            snp_t genotype = unpacked_snps[ i + 1 ];
+            unpacked_snps[ i + 1 ] = (snp_t) ( 4 + i % 200 );
+            assert_true( kernel->pack( unpacked_snps + 1, packed_snps, max_cols ) != 0 );
+            unpacked_snps[ i + 1 ] = genotype;
+        }
+    }
+
+    unpacked_snps[ 2 ] = 255;
+    assert_int_equal( pack_snps( unpacked_snps, packed_snps, 3 ), PIO_ERROR );
+
+    free( unpacked_snps );
+    free( expected );
+    free( packed_snps );
+}
+
+/**
+ * Returns genotype j of a packed row.
+ */
+static unsigned int
+packed_genotype(const unsigned char *packed_row, size_t j)
+{
+    return ( packed_row[ j / 4 ] >> ( 2 * ( j % 4 ) ) ) & 3u;
+}
+
+/**
+ * Tests that the transpose kernels of every instruction set move
+ * genotype (r, 4j + m) to bits 2r of byte m of word j.
+ */
+void
+test_transpose4_kernels(void **state)
+{
+    UNUSED_PARAM(state);
+    const char *names[] = { "scalar", "sse2", "ssse3", "avx2", "avx512" };
+    size_t max_bytes = 32 * 3 + 7;
+    size_t stride = max_bytes + 5;
+    unsigned char *src = (unsigned char *) malloc( 4 * stride );
+    uint32_t *words = (uint32_t *) malloc( max_bytes * sizeof( uint32_t ) );
+
+    for(size_t i = 0; i < 4 * stride; i++)
+    {
+        src[ i ] = (unsigned char) ( i * 167 + i / 3 );
+    }
+
+    for(size_t k = 0; k < sizeof( names ) / sizeof( names[ 0 ] ); k++)
+    {
+        const libplinkio_snp_kernel_private_t *kernel = libplinkio_snp_kernel_by_name_( names[ k ] );
+        if( kernel == NULL )
+        {
+            continue;
+        }
+
+        for(size_t num_bytes = 0; num_bytes <= max_bytes; num_bytes++)
+        {
+            kernel->transpose4( src, stride, num_bytes, words );
+            for(size_t j = 0; j < num_bytes; j++)
+            {
+                for(size_t m = 0; m < 4; m++)
+                {
+                    unsigned int byte = ( words[ j ] >> ( 8 * m ) ) & 0xff;
+                    for(size_t r = 0; r < 4; r++)
+                    {
+                        assert_int_equal( ( byte >> ( 2 * r ) ) & 3u, packed_genotype( src + r * stride, 4 * j + m ) );
+                    }
+                }
+            }
+        }
+    }
+
+    free( src );
+    free( words );
+}
+
+/**
+ * Tests the blocked transpose on matrices that end inside a tile,
+ * a quad of rows and a byte, and that the padding is cleared.
+ */
+void
+test_transpose_packed(void **state)
+{
+    UNUSED_PARAM(state);
+    size_t sizes[] = { 1, 3, 4, 5, 63, 64, 65, 130, 257, 1029 };
+    size_t num_sizes = sizeof( sizes ) / sizeof( sizes[ 0 ] );
+
+    for(size_t a = 0; a < num_sizes; a++)
+    {
+        for(size_t b = 0; b < num_sizes; b++)
+        {
+            size_t num_rows = sizes[ a ];
+            size_t num_cols = sizes[ b ];
+            size_t src_stride = ( num_cols + 3 ) / 4;
+            size_t dst_stride = ( num_rows + 3 ) / 4;
+            unsigned char *src = (unsigned char *) malloc( num_rows * src_stride );
+            unsigned char *dst = (unsigned char *) malloc( num_cols * dst_stride );
+
+            for(size_t i = 0; i < num_rows * src_stride; i++)
+            {
+                src[ i ] = (unsigned char) ( i * 131 + a * 7 + b );
+            }
+            memset( dst, 0xff, num_cols * dst_stride );
+
+            transpose_packed( src, src_stride, num_rows, num_cols, dst, dst_stride );
+            for(size_t j = 0; j < num_cols; j++)
+            {
+                for(size_t i = 0; i < num_rows; i++)
+                {
+                    assert_int_equal( packed_genotype( dst + j * dst_stride, i ), packed_genotype( src + i * src_stride, j ) );
+                }
+                if( num_rows % 4 != 0 )
+                {
+                    assert_int_equal( dst[ j * dst_stride + dst_stride - 1 ] >> ( 2 * ( num_rows % 4 ) ), 0 );
+                }
+            }
+
+            free( src );
+            free( dst );
+        }
+    }
+}
+
+/**
+ * Tests that the typed decoders of every kernel agree with the
+ * scalar reference, and that the genotype counts match the table.
+ */
+void
+test_decode_snps_kernels(void **state)
+{
+    UNUSED_PARAM(state);
+    const char *names[] = { "scalar", "sse2", "ssse3", "avx2", "avx512" };
+    const int8_t i8_table[ 4 ] = { 0, -9, 1, 2 };
+    const float f32_table[ 4 ] = { -0.5f, 0.25f, 0.5f, 1.5f };
+    const double f64_table[ 4 ] = { -0.125, 3.0, 0.875, 1.875 };
+    size_t max_cols = 4 * 64 * 3 + 7;
+    unsigned char *packed_snps = (unsigned char *) malloc( max_cols / 4 + 1 );
+    int8_t *i8_values = (int8_t *) malloc( max_cols + 1 );
+    float *f32_values = (float *) malloc( sizeof( float ) * ( max_cols + 1 ) );
+    double *f64_values = (double *) malloc( sizeof( double ) * ( max_cols + 1 ) );
+
+    for(size_t i = 0; i < max_cols / 4 + 1; i++)
+    {
+        packed_snps[ i ] = (unsigned char) ( i * 167 + 13 );
+    }
+
+    for(size_t k = 0; k < sizeof( names ) / sizeof( names[ 0 ] ); k++)
+    {
+        const libplinkio_snp_kernel_private_t *kernel = libplinkio_snp_kernel_by_name_( names[ k ] );
+        if( kernel == NULL )
+        {
+            continue;
+        }
+
+        for(size_t num_cols = 0; num_cols <= max_cols; num_cols += 3)
+        {
+            kernel->decode_i8( packed_snps, i8_values + 1, num_cols, i8_table );
+            kernel->decode_f32( packed_snps, f32_values + 1, num_cols, f32_table );
+            kernel->decode_f64( packed_snps, f64_values + 1, num_cols, f64_table );
+            for(size_t i = 0; i < num_cols; i++)
+            {
+                unsigned int code = ( packed_snps[ i / 4 ] >> ( 2 * ( i % 4 ) ) ) & 3;
+                assert_int_equal( i8_values[ i + 1 ], i8_table[ code ] );
+                assert_true( f32_values[ i + 1 ] == f32_table[ code ] );
+                assert_true( f64_values[ i + 1 ] == f64_table[ code ] );
+            }
+        }
+    }
+
+    for(size_t num_cols = 0; num_cols <= max_cols; num_cols += 5)
+    {
+        size_t counts[ 4 ];
+        size_t expected[ 4 ] = { 0, 0, 0, 0 };
+        for(size_t i = 0; i < num_cols; i++)
+        {
+            expected[ ( packed_snps[ i / 4 ] >> ( 2 * ( i % 4 ) ) ) & 3 ]++;
+        }
+        libplinkio_count_snps_( packed_snps, num_cols, counts );
+        assert_memory_equal( counts, expected, sizeof( counts ) );
+    }
+
+    free( packed_snps );
+    free( i8_values );
+    free( f32_values );
+    free( f64_values );
+}
+
 void
 test_bed_row_size(void **state)
 {
@@ -357,6 +623,11 @@ int main(int argc, char* argv[])
         unit_test( test_bed_open ),
         unit_test( test_bed_open2 ),
         unit_test( test_unpack_snps ),
+        unit_test( test_unpack_snps_kernels ),
+        unit_test( test_pack_snps_kernels ),
+        unit_test( test_transpose4_kernels ),
+        unit_test( test_transpose_packed ),
+        unit_test( test_decode_snps_kernels ),
         unit_test( test_bed_read_row ),
         unit_test( test_bed_skip_row ),
     };
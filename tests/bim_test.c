@@ -12,6 +12,8 @@
 #include <bim.c>
 #include <bim_parse.c>
 #include "plink_txt_parse.c"
+#include "arena.c"
+#include "cpu.c"
 #include "mock.h"
 
 /**
@@ -80,6 +82,58 @@ test_parse_multiple_loci(void **state)
     bim_close( &bim_file );
 }
 
+/**
+ * Tests that format_locus gives the same line as fprintf with
+ * "%d\t%s\t%f\t%lld\t%s\t%s\n", including ties that round to even,
+ * negative zero and positions too large or not finite to format
+ * directly.
+ */
+void
+test_format_locus(void **state)
+{
+    UNUSED_PARAM(state);
+    float positions[] = { 0.0f, -0.0f, 0.23f, -1.5f, 0.0000005f, 0.0000015f, 0.0000025f,
+                          0.0078125f, 1.0f / 3.0f, 123456.789f, 999999.9999f, 16777216.0f,
+                          1e9f, -3e38f, INFINITY, -INFINITY, NAN };
+    long long bp_positions[] = { 0, 1, -1, 1234567, 9223372036854775807LL, -9223372036854775807LL - 1 };
+    struct pio_locus_t locus;
+    char expected[ 256 ];
+    char line[ 256 ];
+
+    locus.chromosome = 26;
+    locus.name = "rs123";
+    locus.allele1 = "A";
+    locus.allele2 = "ACCG";
+    for(size_t i = 0; i < sizeof( positions ) / sizeof( positions[ 0 ] ); i++)
+    {
+        for(size_t j = 0; j < sizeof( bp_positions ) / sizeof( bp_positions[ 0 ] ); j++)
+        {
+            size_t length;
+            locus.position = positions[ i ];
+            locus.bp_position = bp_positions[ j ];
+            snprintf( expected, sizeof( expected ), "%d\t%s\t%f\t%lld\t%s\t%s\n",
+                      locus.chromosome, locus.name, locus.position, locus.bp_position,
+                      locus.allele1, locus.allele2 );
+
+            assert_true( locus_line_size( &locus ) <= sizeof( line ) );
+            length = format_locus( line, &locus );
+            assert_int_equal( length, strlen( expected ) );
+            assert_memory_equal( line, expected, length );
+        }
+    }
+
+    /* Every position with up to 7 decimals. */
+    for(int i = -2000000; i <= 2000000; i += 7)
+    {
+        locus.position = (float) i / 10000000.0f;
+        snprintf( expected, sizeof( expected ), "%d\t%s\t%f\t%lld\t%s\t%s\n",
+                  locus.chromosome, locus.name, locus.position, locus.bp_position,
+                  locus.allele1, locus.allele2 );
+        assert_int_equal( format_locus( line, &locus ), strlen( expected ) );
+        assert_memory_equal( line, expected, strlen( expected ) );
+    }
+}
+
 int main(int argc, char* argv[])
 {
     UNUSED_PARAM(argc);
@@ -88,6 +142,7 @@ int main(int argc, char* argv[])
         unit_test( test_parse_position ),
         unit_test( test_parse_chr ),
         unit_test( test_parse_multiple_loci ),
+        unit_test( test_format_locus ),
     };
 
     return run_tests( tests );
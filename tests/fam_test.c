@@ -12,6 +12,8 @@
 #include <fam.c>
 #include <fam_parse.c>
 #include "plink_txt_parse.c"
+#include "arena.c"
+#include "cpu.c"
 
 #include "mock.h"
 
@@ -13,6 +13,8 @@
 #include "map.c"
 #include "map_parse.c"
 #include "plink_txt_parse.c"
+#include "arena.c"
+#include "cpu.c"
 #include "mock.h"
 
 /**
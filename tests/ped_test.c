@@ -33,8 +33,14 @@
 #include "ped.c"
 #include "ped_parse.c"
 #include "plink_txt_parse.c"
+#include "arena.c"
 #include "utility.c"
 #include "packed_snp.c"
+#include "cpu.c"
+#include "snp_kernel.c"
+#include "thread.c"
+#include "prefetch.c"
+#include "async.c"
 
 #define UNIT_TESTING
 
@@ -4,12 +4,20 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include <cmockery.h>
 
 #undef UNIT_TESTING
 
+/* Long fields that span parser chunks grow the field buffer, which
+ * test_realloc does not support. */
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
 #define LIBPLINKIO_EXPERIMENTAL
 #include <plinkio/plinkio.h>
 
@@ -26,8 +34,14 @@
 #include "ped.c"
 #include "ped_parse.c"
 #include "plink_txt_parse.c"
+#include "arena.c"
 #include "utility.c"
 #include "packed_snp.c"
+#include "cpu.c"
+#include "snp_kernel.c"
+#include "thread.c"
+#include "prefetch.c"
+#include "async.c"
 
 #define UNIT_TESTING
 
@@ -75,12 +89,187 @@ test_parse_plink_txt(void **state)
     pio_close(&plink_file);
 }
 
+/**
+ * Size of the buffer that record_field and record_row write to.
+ */
+#define TOKENS_SIZE 8192
+
+/**
+ * Appends each field in brackets to a string.
+ */
+static void
+record_field(char *field, size_t length, size_t field_num, void *data)
+{
+    char *tokens = (char *) data;
+    size_t used = strlen( tokens );
+    assert_true( used + length + 24 < TOKENS_SIZE );
+    used += sprintf( tokens + used, "%zu[", field_num );
+    memcpy( tokens + used, field, length );
+    strcpy( tokens + used + length, "]" );
+}
+
+/**
+ * Appends the end of each row to a string.
+ */
+static void
+record_row(size_t row_num, void *data)
+{
+    char *tokens = (char *) data;
+    size_t used = strlen( tokens );
+    assert_true( used + 24 < TOKENS_SIZE );
+    sprintf( tokens + used, "/%zu\n", row_num );
+}
+
+/**
+ * Parses text in chunks of chunk_size bytes.
+ */
+static void
+tokenize(char *text, size_t length, size_t chunk_size, char *tokens)
+{
+    libplinkio_txt_parser_private_t parser = { 0 };
+    tokens[ 0 ] = '\0';
+    assert_int_equal( libplinkio_txt_parser_init_( &parser ), PIO_OK );
+    for(size_t i = 0; i < length; i += chunk_size)
+    {
+        size_t n = length - i < chunk_size ? length - i : chunk_size;
+        assert_int_equal( libplinkio_txt_parse_( &parser, text + i, n, &record_field, &record_row, tokens ), PIO_OK );
+    }
+    assert_int_equal( libplinkio_txt_parse_fini_( &parser, &record_field, &record_row, tokens ), PIO_OK );
+    libplinkio_txt_parser_free_( &parser );
+}
+
+/**
+ * Tests that every classifier and every chunking splits text
+ * into the same fields and rows.
+ */
+void
+test_tokenize(void **state)
+{
+    UNUSED_PARAM(state);
+    char text[ 1000 ];
+    char expected[ TOKENS_SIZE ];
+    char tokens[ TOKENS_SIZE ];
+    size_t chunk_sizes[ ] = { 1, 7, 63, 64, 65, 1000 };
+    unsigned int features = libplinkio_cpu_features_( );
+    const char *alphabet = "ab \t\nGATTACA";
+
+    tokenize( "1 rs1\t0 A  T\n2 rs2 0 C G", 25, 25, tokens );
+    assert_string_equal( tokens, "0[1]1[rs1]2[0]3[A]4[T]/0\n0[2]1[rs2]2[0]3[C]4[G]/1\n" );
+
+    tokenize( "a b\0c d\n", 9, 9, tokens );
+    assert_string_equal( tokens, "0[a]1[b]/0\n" );
+
+    srand( 7 );
+    for(size_t i = 0; i < sizeof( text ); i++)
+    {
+        text[ i ] = alphabet[ rand( ) % strlen( alphabet ) ];
+    }
+
+    g_txt_classify_index = 1;
+    tokenize( text, sizeof( text ), sizeof( text ), expected );
+    for(size_t k = 0; k < LIBPLINKIO_NUM_TXT_KERNELS_; k++)
+    {
+        if( ( g_txt_kernels[ k ].features & features ) != g_txt_kernels[ k ].features )
+        {
+            continue;
+        }
+
+        g_txt_classify_index = k + 1;
+        for(size_t c = 0; c < sizeof( chunk_sizes ) / sizeof( chunk_sizes[ 0 ] ); c++)
+        {
+            tokenize( text, sizeof( text ), chunk_sizes[ c ], tokens );
+            assert_string_equal( tokens, expected );
+        }
+    }
+    g_txt_classify_index = 0;
+}
+
+/**
+ * Tests that arena strings stay intact as blocks are added,
+ * including strings longer than a block.
+ */
+void
+test_arena(void **state)
+{
+    UNUSED_PARAM(state);
+    libplinkio_arena_private_t *arena = libplinkio_arena_new_( );
+    char *strings[ 1000 ];
+    char *long_string = NULL;
+    char expected[ 16 ];
+    char *big = (char *) malloc( 3 * LIBPLINKIO_ARENA_MAX_BLOCK_SIZE_ );
+
+    assert_true( arena != NULL );
+    assert_true( big != NULL );
+    memset( big, 'x', 3 * LIBPLINKIO_ARENA_MAX_BLOCK_SIZE_ );
+    for(size_t i = 0; i < 1000; i++)
+    {
+        snprintf( expected, sizeof( expected ), "rs%zu", i );
+        strings[ i ] = libplinkio_arena_strndup_( arena, expected, strlen( expected ) );
+        assert_true( strings[ i ] != NULL );
+        if( i == 500 )
+        {
+            long_string = libplinkio_arena_strndup_( arena, big, 3 * LIBPLINKIO_ARENA_MAX_BLOCK_SIZE_ );
+            assert_true( long_string != NULL );
+        }
+    }
+
+    for(size_t i = 0; i < 1000; i++)
+    {
+        snprintf( expected, sizeof( expected ), "rs%zu", i );
+        assert_string_equal( strings[ i ], expected );
+    }
+    assert_int_equal( strlen( long_string ), 3 * LIBPLINKIO_ARENA_MAX_BLOCK_SIZE_ );
+    assert_string_equal( libplinkio_arena_strdup_( arena, "A" ), "A" );
+
+    free( big );
+    libplinkio_arena_free_( arena );
+}
+
+/**
+ * Tests that equal alleles are interned to the same string, also
+ * after the intern table has grown.
+ */
+void
+test_intern(void **state)
+{
+    UNUSED_PARAM(state);
+    libplinkio_arena_private_t *arena = libplinkio_arena_new_( );
+    char *alleles[ 200 ];
+    char allele[ 16 ];
+
+    assert_true( arena != NULL );
+    assert_true( libplinkio_arena_intern_( arena, "AC", 1 ) == libplinkio_arena_intern_( arena, "A", 1 ) );
+    assert_string_equal( libplinkio_arena_intern_( arena, "GT", 1 ), "G" );
+    assert_true( libplinkio_arena_intern_( arena, "A", 1 ) != libplinkio_arena_intern_( arena, "C", 1 ) );
+
+    for(size_t i = 0; i < 200; i++)
+    {
+        snprintf( allele, sizeof( allele ), "AT%zu", i );
+        alleles[ i ] = libplinkio_arena_intern_( arena, allele, strlen( allele ) );
+        assert_true( alleles[ i ] != NULL );
+        assert_string_equal( alleles[ i ], allele );
+    }
+
+    for(size_t i = 0; i < 200; i++)
+    {
+        snprintf( allele, sizeof( allele ), "AT%zu", i );
+        assert_true( libplinkio_arena_intern_( arena, allele, strlen( allele ) ) == alleles[ i ] );
+    }
+    assert_true( libplinkio_arena_intern_( arena, "AT1", 2 ) != alleles[ 1 ] );
+    assert_string_equal( libplinkio_arena_intern_( arena, "AT1", 2 ), "AT" );
+
+    libplinkio_arena_free_( arena );
+}
+
 int main(int argc, char* argv[])
 {
     UNUSED_PARAM(argc);
     UNUSED_PARAM(argv);
     const UnitTest tests[] = {
         unit_test( test_parse_plink_txt ),
+        unit_test( test_tokenize ),
+        unit_test( test_arena ),
+        unit_test( test_intern ),
     };
 
     return run_tests( tests );